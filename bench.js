@@ -0,0 +1,386 @@
+// bench.js
+// FFI 基准测试。用法: ./qjs_ffi [--allocator=system|pool] bench.js [label]
+import {open, symbol, call, close, malloc, free, writeArray, readArray, alloc, mem, pipeline,
+  createCallback, setCallCacheSize, callCacheStats, parallelFor, packStrings, memoize,
+  allocLarge, memStats} from 'ffi';
+import * as os from 'os';
+
+const label = scriptArgs[1] || 'default';
+const now = (typeof os.now === 'function') ? os.now : Date.now;
+
+// 运行 fn(iterations) 若干轮，输出最好的一轮
+function bench(name, iterations, fn, rounds = 3) {
+  let best = Infinity;
+  for (let r = 0; r < rounds; r++) {
+    const start = now();
+    fn(iterations);
+    const elapsed = now() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  const opsPerSec = best > 0 ? Math.round(iterations / (best / 1000)) : Infinity;
+  console.log(`[bench:${label}] ${name.padEnd(32)} ${best.toFixed(2).padStart(10)} ms  ${String(opsPerSec).padStart(12)} ops/s`);
+  return best;
+}
+
+const libSuffix = (os.platform === 'win32' ? '.dll' : (os.platform === 'darwin' ? '.dylib' : '.so'));
+const libHandle = open('./libadd' + libSuffix);
+
+// --- JS 堆分配器：大量小对象 ---
+console.log(`--- JS heap allocator (${label}) ---`);
+
+bench('small object churn', 200000, (n) => {
+  let keep = null;
+  for (let i = 0; i < n; i++) {
+    const o = {x: i, y: i * 2, next: null};
+    if ((i & 1023) === 0) keep = o;
+  }
+  return keep;
+});
+
+bench('string concat', 100000, (n) => {
+  const parts = [];
+  for (let i = 0; i < n; i++) {
+    parts.push('item-' + i);
+  }
+  return parts.join(',').length;
+});
+
+bench('nested arrays', 50000, (n) => {
+  const rows = [];
+  for (let i = 0; i < n; i++) {
+    rows.push([i, i + 1, [i * 2]]);
+  }
+  return rows.length;
+});
+
+bench('closures', 100000, (n) => {
+  const fns = [];
+  for (let i = 0; i < n; i++) {
+    fns.push(() => i);
+  }
+  return fns.length;
+});
+
+const arrayCount = 256;
+const arrayPtr = malloc(arrayCount * 4);
+writeArray(arrayPtr, Array.from({length: arrayCount}, (_, i) => i), 'int', arrayCount);
+
+bench('readArray(256 ints)', 5000, (n) => {
+  let sum = 0;
+  for (let i = 0; i < n; i++) {
+    sum += readArray(arrayPtr, 'int', arrayCount)[i & 255];
+  }
+  return sum;
+});
+
+free(arrayPtr);
+
+// --- 原生缓冲区类型转换 ---
+console.log(`--- Buffer conversion (${label}) ---`);
+
+const pixelCount = 1 << 16;
+const pixels = alloc(pixelCount);
+const floats = alloc(pixelCount * 4, {align: 64});
+mem.fill(pixels, 'uint8', 128, pixelCount);
+
+bench('readArray+writeArray u8->f32', 20, (n) => {
+  for (let i = 0; i < n; i++) {
+    const values = readArray(pixels, 'uint8', pixelCount).map(v => v / 255);
+    writeArray(floats, values, 'float', pixelCount);
+  }
+});
+
+for (const level of ['scalar', 'auto']) {
+  const used = mem.setSimdLevel(level);
+  bench(`mem.convert u8->f32 (${used})`, 2000, (n) => {
+    for (let i = 0; i < n; i++) {
+      mem.convert(floats, 'float', pixels, 'uint8', pixelCount, {scale: 1 / 255});
+    }
+  });
+  bench(`mem.convert f32->u8 (${used})`, 2000, (n) => {
+    for (let i = 0; i < n; i++) {
+      mem.convert(pixels, 'uint8', floats, 'float', pixelCount, {scale: 255, round: true});
+    }
+  });
+  bench(`mem.fill f32 (${used})`, 2000, (n) => {
+    for (let i = 0; i < n; i++) {
+      mem.fill(floats, 'float', 0.5, pixelCount);
+    }
+  });
+}
+mem.setSimdLevel('auto');
+pixels.dispose();
+floats.dispose();
+
+// --- FFI 调用开销 ---
+console.log(`--- FFI call overhead (${label}) ---`);
+
+const benchAdd = symbol(libHandle, 'bench_add');
+bench('call(int, int)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r = call(benchAdd, 'int', ['int', 'int'], i, 1);
+  }
+  return r;
+});
+console.log(`[bench:${label}] call cache: ${JSON.stringify(callCacheStats())}`);
+
+setCallCacheSize(0);
+bench('call(int, int) (no sig cache)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r = call(benchAdd, 'int', ['int', 'int'], i, 1);
+  }
+  return r;
+});
+setCallCacheSize(256);
+
+
+// 三次调用：逐个 call() 与一次 pipeline.run()
+const addChain = pipeline([
+  {fn: benchAdd, ret: 'int', types: ['int', 'int'], args: [{input: 0}, 1]},
+  {fn: benchAdd, ret: 'int', types: ['int', 'int'], args: [{step: 0}, 2]},
+  {fn: benchAdd, ret: 'int', types: ['int', 'int'], args: [{step: 1}, 3]},
+]);
+bench('3x call(int, int)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r = call(benchAdd, 'int', ['int', 'int'], i, 1);
+    r = call(benchAdd, 'int', ['int', 'int'], r, 2);
+    r = call(benchAdd, 'int', ['int', 'int'], r, 3);
+  }
+  return r;
+});
+bench('pipeline.run (3 steps)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r = addChain.run(i);
+  }
+  return r;
+});
+
+// 输出参数：malloc + readArray + free 与 {out: 'int'}
+const findMax = symbol(libHandle, 'bench_find_max');
+const maxSrc = alloc(4 * 4);
+bench('out-param via malloc/readArray', 20000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    const idx = malloc(4);
+    call(findMax, 'int', ['pointer', 'int', 'pointer'], maxSrc, 4, idx);
+    r += readArray(idx, 'int', 1)[0];
+    free(idx);
+  }
+  return r;
+});
+bench('out-param via {out: int}', 20000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(findMax, 'int', ['pointer', 'int', {out: 'int'}], maxSrc, 4).outs[0];
+  }
+  return r;
+});
+maxSrc.dispose();
+
+// 原生循环中的回调：每次进入 JS 与按批次进入 JS
+const benchForeach = symbol(libHandle, 'bench_foreach');
+const foreachCount = 10000;
+const foreachSrc = alloc(foreachCount * 4);
+let callbackSum = 0;
+const plainCb = createCallback((value, index) => { callbackSum += value; }, 'void', ['int', 'int']);
+const batchCb = createCallback((values, indices) => {
+  for (let i = 0; i < values.length; i++) callbackSum += values[i];
+}, 'void', ['int', 'int'], {buffered: 1024});
+bench('callback x10000 (plain)', 20, (n) => {
+  for (let i = 0; i < n; i++) {
+    call(benchForeach, 'void', ['pointer', 'int', 'pointer'], foreachSrc, foreachCount, plainCb);
+  }
+});
+bench('callback x10000 (buffered 1024)', 20, (n) => {
+  for (let i = 0; i < n; i++) {
+    call(benchForeach, 'void', ['pointer', 'int', 'pointer'], foreachSrc, foreachCount, batchCb);
+  }
+});
+foreachSrc.dispose();
+
+// 逐元素变换：一次原生调用与 parallelFor
+const scaleFloats = symbol(libHandle, 'scale_floats');
+const scaleCount = 1 << 22;
+const scaleIn = alloc(scaleCount * 4, {zero: true});
+const scaleOut = alloc(scaleCount * 4);
+bench('scale_floats 4M (1 call)', 20, (n) => {
+  for (let i = 0; i < n; i++) {
+    call(scaleFloats, 'void', ['pointer', 'pointer', 'int', 'float'], scaleIn, scaleOut, scaleCount, 2);
+  }
+});
+let lastParallel = null;
+bench('scale_floats 4M (parallelFor)', 20, (n) => {
+  for (let i = 0; i < n; i++) {
+    lastParallel = parallelFor(scaleFloats, scaleIn, scaleOut, scaleCount, 4, {extra: [['float', 2]]});
+  }
+});
+console.log(`[bench:${label}] parallelFor: ${lastParallel.threads} threads, ${lastParallel.chunks} chunks, ` +
+            `utilisation [${lastParallel.workers.map(w => w.utilisation.toFixed(2)).join(', ')}]`);
+scaleIn.dispose();
+scaleOut.dispose();
+
+// 字符串数组：逐个 malloc/writeArray、stringArray 参数与预先打包
+const totalStringLength = symbol(libHandle, 'total_string_length');
+const names = Array.from({length: 64}, (_, i) => `column_${i}`);
+bench('char** via malloc per string', 2000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    const table = malloc(names.length * 8);
+    const ptrs = names.map((name) => {
+      const p = malloc(name.length + 1);
+      writeArray(p, [...Array.from(name, (c) => c.charCodeAt(0)), 0], 'uint8', name.length + 1);
+      return p;
+    });
+    // writeArray 没有指针类型：按小端 uint32 对写入 64 位地址
+    writeArray(table, ptrs.flatMap((p) => [p % 0x100000000, Math.floor(p / 0x100000000)]), 'uint32', names.length * 2);
+    r += call(totalStringLength, 'int', ['pointer', 'int'], table, names.length);
+    ptrs.forEach(free);
+    free(table);
+  }
+  return r;
+});
+bench('char** via stringArray', 2000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(totalStringLength, 'int', ['stringArray', 'int'], names, names.length);
+  }
+  return r;
+});
+const packedNames = packStrings(names);
+bench('char** via packStrings (reused)', 2000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(totalStringLength, 'int', ['pointer', 'int'], packedNames, names.length);
+  }
+  return r;
+});
+packedNames.dispose();
+
+// 纯函数记忆化：重复参数的 call() 与 memoize 缓存命中
+const collatzSteps = symbol(libHandle, 'collatz_steps');
+const memoSteps = memoize(collatzSteps, {ret: 'int', types: ['int64']}, 256);
+bench('collatz_steps via call (64 distinct args)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(collatzSteps, 'int', ['int64'], 1000001 + (i & 63));
+  }
+  return r;
+});
+bench('collatz_steps via memoize (64 distinct args)', 100000, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += memoSteps.call(1000001 + (i & 63));
+  }
+  return r;
+});
+const memoStats = memoSteps.stats();
+console.log(`[bench:${label}] memoize: hit rate ${(memoStats.hitRate * 100).toFixed(2)}%, ` +
+            `${memoStats.size}/${memoStats.capacity} entries, ${memoStats.evictions} evictions`);
+
+// 大块内存：alloc + memset 与 allocLarge 的惰性清零页、预先缺页和透明大页
+const largeBytes = 256 * 1024 * 1024;
+function largeBufferRun(name, allocate) {
+  const before = memStats();
+  const start = now();
+  const buf = allocate();
+  mem.fill(buf, 'uint8', 1, largeBytes);   // 写遍所有页
+  const elapsed = now() - start;
+  const after = memStats();
+  buf.dispose();
+  console.log(`[bench:${label}] ${name.padEnd(32)} ${elapsed.toFixed(2).padStart(10)} ms  ` +
+              `rss +${((after.rssBytes - before.rssBytes) / 1048576).toFixed(1)} MiB, ` +
+              `${after.minorFaults - before.minorFaults} minor / ${after.majorFaults - before.majorFaults} major faults`);
+}
+largeBufferRun('256 MiB alloc({zero}) + fill', () => alloc(largeBytes, {zero: true}));
+largeBufferRun('256 MiB allocLarge 4K + fill', () => allocLarge(largeBytes, {hugepages: false}));
+largeBufferRun('256 MiB allocLarge THP + fill', () => allocLarge(largeBytes));
+largeBufferRun('256 MiB allocLarge THP populate', () => allocLarge(largeBytes, {populate: true}));
+
+// 可变参数：缓存的 cif 与每次调用都重新 ffi_prep_cif_var（缓存容量为 0）
+const formatMessage = symbol(libHandle, 'format_message');
+const formatBuf = alloc(128);
+const formatTypes = {types: ['pointer', 'int', 'string', 'string', 'int', 'double'], variadic: 3};
+const formatLoop = (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(formatMessage, 'int', formatTypes, formatBuf, 128, '[%s] step %d took %.3f ms', 'io', i, i * 0.25);
+  }
+  return r;
+};
+bench('variadic format (cached cif)', 20000, formatLoop);
+setCallCacheSize(0);
+bench('variadic format (uncached cif)', 20000, formatLoop);
+setCallCacheSize(256);
+formatBuf.dispose();
+
+// 归约与查找：libadd 中等价的 C 循环与 mem.sum/minMax/dot/count/histogram（标量与 SIMD）
+const reduceCount = 1 << 20;
+const reduceInts = alloc(reduceCount * 4, {align: 64});
+const reduceA = alloc(reduceCount * 4, {align: 64});
+const reduceB = alloc(reduceCount * 4, {align: 64});
+writeArray(reduceInts, Array.from({length: reduceCount}, (_, i) => (i * 7919) % 1000003 - 500000), 'int', reduceCount);
+mem.convert(reduceA, 'float', reduceInts, 'int', reduceCount, {scale: 1e-3});
+mem.fill(reduceB, 'float', 0.5, reduceCount);
+const benchArraySum = symbol(libHandle, 'bench_array_sum');
+const benchDotFloats = symbol(libHandle, 'bench_dot_floats');
+const benchCountByte = symbol(libHandle, 'bench_count_byte');
+bench('bench_array_sum via call (1M int)', 200, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) r += call(benchArraySum, 'int64', ['pointer', 'int'], reduceInts, reduceCount);
+  return r;
+});
+bench('bench_find_max via call (1M int)', 200, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) {
+    r += call(findMax, 'int', ['pointer', 'int', {out: 'int'}], reduceInts, reduceCount).outs[0];
+  }
+  return r;
+});
+bench('bench_dot_floats via call (1M float)', 200, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) r += call(benchDotFloats, 'double', ['pointer', 'pointer', 'int'], reduceA, reduceB, reduceCount);
+  return r;
+});
+bench('bench_count_byte via call (4 MiB)', 200, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) r += call(benchCountByte, 'int64', ['pointer', 'int64', 'int'], reduceInts, reduceCount * 4, 0);
+  return r;
+});
+for (const level of ['scalar', 'auto']) {
+  const used = mem.setSimdLevel(level);
+  bench(`mem.sum int (${used})`, 200, (n) => {
+    let r = 0;
+    for (let i = 0; i < n; i++) r += mem.sum(reduceInts, 'int', reduceCount);
+    return r;
+  });
+  bench(`mem.minMax int (${used})`, 200, (n) => {
+    let r = 0;
+    for (let i = 0; i < n; i++) r += mem.minMax(reduceInts, 'int', reduceCount).maxIndex;
+    return r;
+  });
+  bench(`mem.dot float (${used})`, 200, (n) => {
+    let r = 0;
+    for (let i = 0; i < n; i++) r += mem.dot(reduceA, reduceB, 'float', reduceCount);
+    return r;
+  });
+  bench(`mem.count byte (${used})`, 200, (n) => {
+    let r = 0;
+    for (let i = 0; i < n; i++) r += mem.count(reduceInts, 0, reduceCount * 4);
+    return r;
+  });
+}
+mem.setSimdLevel('auto');
+bench('mem.histogram uint8 (4 MiB)', 200, (n) => {
+  let r = 0;
+  for (let i = 0; i < n; i++) r += mem.histogram(reduceInts, 'uint8', reduceCount * 4)[0];
+  return r;
+});
+reduceInts.dispose();
+reduceA.dispose();
+reduceB.dispose();
+
+close(libHandle);
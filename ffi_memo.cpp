@@ -0,0 +1,104 @@
+// ffi_memo.cpp
+#include <algorithm>
+#include <cstring>
+
+#include "ffi_memo.h"
+
+FFIMemoTable::FFIMemoTable(size_t key_size, size_t value_size, size_t capacity)
+  : key_size_(key_size), value_size_(value_size), stride_(key_size + value_size), capacity_(capacity)
+{
+  data_.resize(capacity_ * stride_);
+  hashes_.resize(capacity_);
+  referenced_.resize(capacity_);
+
+  // 装载因子不超过 1/2，探测序列保持很短
+  size_t slots = 8;
+  while (slots < capacity_ * 2) slots <<= 1;
+  index_.assign(slots, 0);
+  mask_ = slots - 1;
+}
+
+// FNV-1a，再用 murmur3 的终结步骤打散低位（索引只取低位）
+uint64_t FFIMemoTable::hash(const void* key, size_t size)
+{
+  const uint8_t* p = (const uint8_t*)key;
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+bool FFIMemoTable::lookup(const void* key, uint64_t hash, void* value)
+{
+  for (size_t slot = hash & mask_;; slot = (slot + 1) & mask_) {
+    uint32_t e = index_[slot];
+    if (!e) break;
+    e--;
+    if (hashes_[e] == hash && memcmp(entry_key(e), key, key_size_) == 0) {
+      referenced_[e] = 1;
+      memcpy(value, entry_value(e), value_size_);
+      stats_.hits++;
+      return true;
+    }
+  }
+  stats_.misses++;
+  return false;
+}
+
+// 从索引中删除条目 e：后续条目中探测起点不在 (hole, j] 内的回移到空位
+void FFIMemoTable::unlink(uint32_t e)
+{
+  size_t hole = hashes_[e] & mask_;
+  while (index_[hole] != e + 1) hole = (hole + 1) & mask_;
+
+  for (size_t j = (hole + 1) & mask_; index_[j]; j = (j + 1) & mask_) {
+    size_t home = hashes_[index_[j] - 1] & mask_;
+    bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+    if (movable) {
+      index_[hole] = index_[j];
+      hole = j;
+    }
+  }
+  index_[hole] = 0;
+}
+
+uint32_t FFIMemoTable::evict()
+{
+  while (referenced_[hand_]) {
+    referenced_[hand_] = 0;
+    hand_ = (hand_ + 1) % capacity_;
+  }
+  uint32_t e = (uint32_t)hand_;
+  hand_ = (hand_ + 1) % capacity_;
+  unlink(e);
+  stats_.evictions++;
+  return e;
+}
+
+void FFIMemoTable::insert(const void* key, uint64_t hash, const void* value)
+{
+  uint32_t e = used_ < capacity_ ? (uint32_t)used_++ : evict();
+  memcpy(entry_key(e), key, key_size_);
+  memcpy(entry_value(e), value, value_size_);
+  hashes_[e] = hash;
+  referenced_[e] = 0;
+
+  size_t slot = hash & mask_;
+  while (index_[slot]) slot = (slot + 1) & mask_;
+  index_[slot] = e + 1;
+}
+
+void FFIMemoTable::clear()
+{
+  std::fill(index_.begin(), index_.end(), 0);
+  std::fill(referenced_.begin(), referenced_.end(), 0);
+  used_ = 0;
+  hand_ = 0;
+}
@@ -0,0 +1,60 @@
+// ffi_memo.h
+// ffi.memoize 使用的定长键值缓存。
+//
+// 键是一次调用中参数槽位的原始字节（按 cif 的布局排好，填充字节清零），值是
+// 返回值存储区的原始字节，两者长度在创建时固定。条目预先分配 capacity 个，
+// 索引是线性探测的开放寻址表（容量的 2 倍以上，删除时回移后续条目，不留墓碑）。
+// 条目用满后按 CLOCK 淘汰：指针扫过的条目如果自上次扫过以来被命中过，清除
+// 访问位后跳过，否则被替换；新插入的条目没有访问位，从未命中的条目最先被淘汰。
+#ifndef FFI_MEMO_H
+#define FFI_MEMO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct FFIMemoStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+class FFIMemoTable {
+public:
+  // capacity 至少为 1
+  FFIMemoTable(size_t key_size, size_t value_size, size_t capacity);
+
+  static uint64_t hash(const void* key, size_t size);
+
+  // 命中时把值复制到 value 并返回 true；hash 必须是 hash(key, key_size)
+  bool lookup(const void* key, uint64_t hash, void* value);
+  // 插入一个不在表中的键，表满时先淘汰一个条目
+  void insert(const void* key, uint64_t hash, const void* value);
+  // 清空所有条目，统计保留
+  void clear();
+
+  size_t size() const { return used_; }
+  size_t capacity() const { return capacity_; }
+  const FFIMemoStats& stats() const { return stats_; }
+
+private:
+  uint8_t* entry_key(uint32_t e) { return data_.data() + e * stride_; }
+  uint8_t* entry_value(uint32_t e) { return entry_key(e) + key_size_; }
+  uint32_t evict();
+  void unlink(uint32_t e);
+
+  size_t key_size_;
+  size_t value_size_;
+  size_t stride_;
+  size_t capacity_;
+  std::vector<uint8_t> data_;         // capacity 个条目，每个是键 + 值
+  std::vector<uint64_t> hashes_;      // 条目键的哈希
+  std::vector<uint8_t> referenced_;   // CLOCK 访问位
+  std::vector<uint32_t> index_;       // 开放寻址表：条目编号 + 1，0 表示空
+  size_t mask_;
+  size_t used_ = 0;                   // 条目按编号顺序分配，用满后靠淘汰复用
+  size_t hand_ = 0;                   // CLOCK 指针
+  FFIMemoStats stats_;
+};
+
+#endif /* FFI_MEMO_H */
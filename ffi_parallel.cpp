@@ -0,0 +1,225 @@
+// ffi_parallel.cpp
+// 工作窃取线程池实现。
+//
+// 每个任务有 participants 个槽位，池线程从待执行队列中领取槽位；某个槽位
+// 一直没有被领取时（例如池线程都在执行更早的任务），它的块会被其他参与者
+// 窃取，因此只要有一个参与者在运行任务就能完成。每个槽位的块队列由一把
+// 小锁保护：块的粒度远大于加锁开销，没有必要使用无锁双端队列。
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <cerrno>
+#include <unistd.h>
+
+#include "ffi_parallel.h"
+
+namespace {
+
+uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ChunkQueue {
+  std::mutex mutex;
+  std::deque<std::pair<size_t, size_t>> chunks;   // 所有者取头部，窃取者取尾部
+};
+
+}  // namespace
+
+struct FFIParallelJob {
+  FFIParallelBody body;
+  unsigned participants = 0;
+  uint64_t total_chunks = 0;
+  std::unique_ptr<ChunkQueue[]> queues;
+  std::vector<FFIParallelWorkerStats> stats;      // 每个槽位一份，只由领取该槽位的线程写入
+  std::atomic<uint64_t> remaining{0};             // 尚未执行完的块
+  unsigned next_slot = 0;                         // 在线程池锁下分配
+
+  uint64_t start_ns = 0;
+  uint64_t end_ns = 0;
+  int notify_fd = -1;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool finished = false;
+};
+
+namespace {
+
+void finish_job(FFIParallelJob* job)
+{
+  std::lock_guard<std::mutex> lock(job->mutex);
+  job->end_ns = now_ns();
+  job->finished = true;
+  // 在锁内写入：等待者看到 finished 后可以安全地关闭 notify_fd
+  if (job->notify_fd >= 0) {
+    char byte = 1;
+    while (write(job->notify_fd, &byte, 1) < 0 && errno == EINTR) {}
+  }
+  job->cv.notify_all();
+}
+
+// 执行一个槽位：先取自己队列中的块，再依次尝试窃取其他槽位的块
+void run_slot(FFIParallelJob* job, unsigned slot)
+{
+  FFIParallelWorkerStats& stats = job->stats[slot];
+  for (;;) {
+    std::pair<size_t, size_t> range;
+    bool found = false;
+    bool stolen = false;
+    {
+      ChunkQueue& own = job->queues[slot];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.chunks.empty()) {
+        range = own.chunks.front();
+        own.chunks.pop_front();
+        found = true;
+      }
+    }
+    for (unsigned k = 1; !found && k < job->participants; k++) {
+      ChunkQueue& victim = job->queues[(slot + k) % job->participants];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.chunks.empty()) {
+        range = victim.chunks.back();
+        victim.chunks.pop_back();
+        found = stolen = true;
+      }
+    }
+    if (!found) return;
+
+    uint64_t t0 = now_ns();
+    job->body(range.first, range.second);
+    stats.busy_ns += now_ns() - t0;
+    stats.chunks++;
+    if (stolen) stats.steals++;
+
+    if (job->remaining.fetch_sub(1) == 1) {
+      finish_job(job);
+    }
+  }
+}
+
+class ThreadPool {
+public:
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : workers_) t.join();
+  }
+
+  void submit(const std::shared_ptr<FFIParallelJob>& job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (workers_.size() < job->participants) {
+        workers_.emplace_back(&ThreadPool::worker_main, this);
+      }
+      pending_.push_back(job);
+    }
+    cv_.notify_all();
+  }
+
+private:
+  void worker_main()
+  {
+    for (;;) {
+      std::shared_ptr<FFIParallelJob> job;
+      unsigned slot;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (stopping_) return;
+        job = pending_.front();
+        slot = job->next_slot++;
+        if (job->next_slot == job->participants) pending_.pop_front();
+      }
+      run_slot(job.get(), slot);
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<FFIParallelJob>> pending_;   // 仍有未领取槽位的任务
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+ThreadPool& thread_pool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+}  // namespace
+
+std::shared_ptr<FFIParallelJob> ffi_parallel_submit(size_t count, size_t grain, unsigned threads,
+                                                    FFIParallelBody body, int notify_fd)
+{
+  auto job = std::make_shared<FFIParallelJob>();
+  job->body = std::move(body);
+  job->notify_fd = notify_fd;
+  job->start_ns = now_ns();
+  if (grain == 0) grain = 1;
+
+  size_t chunks = count / grain + (count % grain != 0);
+  if (chunks == 0) {
+    finish_job(job.get());
+    return job;
+  }
+  unsigned participants = (unsigned)std::min<size_t>(std::max(threads, 1u), chunks);
+  job->participants = participants;
+  job->total_chunks = chunks;
+  job->remaining = chunks;
+  job->stats.resize(participants);
+  job->queues.reset(new ChunkQueue[participants]);
+
+  // 连续的块分给同一个槽位，保持访存局部性
+  for (unsigned p = 0; p < participants; p++) {
+    size_t first = chunks * p / participants;
+    size_t last = chunks * (p + 1) / participants;
+    for (size_t c = first; c < last; c++) {
+      size_t begin = c * grain;
+      job->queues[p].chunks.emplace_back(begin, std::min(begin + grain, count));
+    }
+  }
+
+  thread_pool().submit(job);
+  return job;
+}
+
+void ffi_parallel_wait(FFIParallelJob* job)
+{
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->cv.wait(lock, [job] { return job->finished; });
+}
+
+uint64_t ffi_parallel_chunks(const FFIParallelJob* job)
+{
+  return job->total_chunks;
+}
+
+uint64_t ffi_parallel_elapsed_ns(const FFIParallelJob* job)
+{
+  return job->end_ns - job->start_ns;
+}
+
+const std::vector<FFIParallelWorkerStats>& ffi_parallel_worker_stats(const FFIParallelJob* job)
+{
+  return job->stats;
+}
+
+unsigned ffi_parallel_default_threads()
+{
+  unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
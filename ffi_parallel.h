@@ -0,0 +1,41 @@
+// ffi_parallel.h
+// ffi.parallelFor 使用的工作窃取线程池。
+//
+// 任务把 [0, count) 切成 grain 大小的块，预先按连续区间平均分给各参与线程；
+// 线程从自己队列的头部取块，队列空了就从其他线程队列的尾部窃取，负载不均时
+// 空闲线程自动分担。池线程按需创建并一直保留，多个任务按提交顺序排队。
+#ifndef FFI_PARALLEL_H
+#define FFI_PARALLEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct FFIParallelWorkerStats {
+  uint64_t chunks = 0;     // 执行的块数
+  uint64_t steals = 0;     // 其中从其他线程窃取的块数
+  uint64_t busy_ns = 0;    // 执行 body 的累计时间
+};
+
+struct FFIParallelJob;
+
+// body(begin, end) 处理 [begin, end)，会在多个线程上并发调用
+typedef std::function<void(size_t begin, size_t end)> FFIParallelBody;
+
+// 提交任务后立即返回；threads 为参与的线程数（不超过块数），grain 至少为 1。
+// notify_fd >= 0 时，任务完成后向它写入一个字节，供事件循环等待完成
+std::shared_ptr<FFIParallelJob> ffi_parallel_submit(size_t count, size_t grain, unsigned threads,
+                                                    FFIParallelBody body, int notify_fd = -1);
+void ffi_parallel_wait(FFIParallelJob* job);
+
+// 以下结果在任务完成后读取
+uint64_t ffi_parallel_chunks(const FFIParallelJob* job);
+uint64_t ffi_parallel_elapsed_ns(const FFIParallelJob* job);
+const std::vector<FFIParallelWorkerStats>& ffi_parallel_worker_stats(const FFIParallelJob* job);
+
+// 默认线程数：硬件线程数（至少为 1）
+unsigned ffi_parallel_default_threads();
+
+#endif /* FFI_PARALLEL_H */
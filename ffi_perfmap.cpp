@@ -0,0 +1,91 @@
+// ffi_perfmap.cpp
+// perf 符号表实现。条目数量等于存活的闭包数，删除时整体重写文件
+// （先写临时文件再 rename，perf 不会读到写了一半的文件）。
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <unistd.h>
+
+#include "ffi_perfmap.h"
+
+namespace {
+
+std::mutex g_mutex;
+std::map<uintptr_t, std::pair<size_t, std::string>> g_entries;
+bool g_enabled = false;
+
+std::string map_path()
+{
+  return "/tmp/perf-" + std::to_string((long)getpid()) + ".map";
+}
+
+void write_entry(FILE* f, uintptr_t addr, size_t size, const std::string& name)
+{
+  fprintf(f, "%lx %zx %s\n", (unsigned long)addr, size, name.c_str());
+}
+
+bool rewrite_locked()
+{
+  std::string path = map_path();
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) return false;
+  for (const auto& entry : g_entries) {
+    write_entry(f, entry.first, entry.second.first, entry.second.second);
+  }
+  bool ok = fclose(f) == 0;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ffi_perfmap_enable(bool enable)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!enable) {
+    if (g_enabled) unlink(map_path().c_str());
+    g_enabled = false;
+    return true;
+  }
+  g_enabled = rewrite_locked();
+  return g_enabled;
+}
+
+bool ffi_perfmap_enabled()
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return g_enabled;
+}
+
+std::string ffi_perfmap_path()
+{
+  return map_path();
+}
+
+void ffi_perfmap_add(const void* addr, size_t size, const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_entries[(uintptr_t)addr] = std::make_pair(size, name);
+  if (!g_enabled) return;
+
+  // 新条目直接追加，不必重写
+  FILE* f = fopen(map_path().c_str(), "a");
+  if (f) {
+    write_entry(f, (uintptr_t)addr, size, name);
+    fclose(f);
+  }
+}
+
+void ffi_perfmap_remove(const void* addr)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (g_entries.erase((uintptr_t)addr) && g_enabled) {
+    rewrite_locked();
+  }
+}
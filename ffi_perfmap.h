@@ -0,0 +1,21 @@
+// ffi_perfmap.h
+// perf 的 JIT 符号表（/tmp/perf-<pid>.map）：为 libffi 闭包蹦床提供可读的名称。
+//
+// perf report / bpftrace 在解析符号时读取该文件，每行 "起始地址 长度 名称"（十六进制）。
+// 闭包始终登记在表中，只有开启后才写文件；闭包释放时从文件中删除对应的行，
+// 避免地址被新闭包复用后显示成旧名称。
+#ifndef FFI_PERFMAP_H
+#define FFI_PERFMAP_H
+
+#include <cstddef>
+#include <string>
+
+// 开启时写入所有已登记的条目，失败返回 false；关闭时删除文件
+bool ffi_perfmap_enable(bool enable);
+bool ffi_perfmap_enabled();
+std::string ffi_perfmap_path();
+
+void ffi_perfmap_add(const void* addr, size_t size, const std::string& name);
+void ffi_perfmap_remove(const void* addr);
+
+#endif /* FFI_PERFMAP_H */
@@ -0,0 +1,421 @@
+// ffi_record.cpp
+// FFI 调用日志的写入与读取。写入在一把全局锁下进行，只有开启录制时才有开销；
+// 日志先追加到内存缓冲区，超过 1 MiB 时写入文件。
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <dlfcn.h>
+
+#include "ffi_record.h"
+
+namespace {
+
+const char kMagic[8] = {'Q', 'J', 'S', 'F', 'F', 'I', 'R', '\0'};
+const uint32_t kVersion = 2;   // 2: 'S' 记录加入固定参数个数
+const size_t kFlushThreshold = 1 << 20;
+
+struct Recorder {
+  std::mutex mutex;
+  FILE* file = nullptr;
+  std::string pending;
+  bool write_error = false;
+  std::unordered_map<void*, uint32_t> functions;
+  std::unordered_map<std::string, uint32_t> signatures;
+  FFIRecordStats stats;
+};
+
+Recorder& recorder()
+{
+  static Recorder r;
+  return r;
+}
+
+std::atomic<bool> g_enabled{false};
+std::atomic<size_t> g_buffer_cap{0};
+
+template <typename T>
+void put(std::string& out, T value)
+{
+  out.append((const char*)&value, sizeof(value));
+}
+
+void put_bytes(std::string& out, const void* data, size_t size)
+{
+  out.append((const char*)data, size);
+}
+
+// 长度前缀为 u16 的字符串
+void put_short_string(std::string& out, const std::string& str)
+{
+  uint16_t len = (uint16_t)std::min<size_t>(str.size(), UINT16_MAX);
+  put(out, len);
+  put_bytes(out, str.data(), len);
+}
+
+void flush_locked(Recorder& r)
+{
+  if (r.pending.empty()) return;
+  if (fwrite(r.pending.data(), 1, r.pending.size(), r.file) != r.pending.size()) {
+    r.write_error = true;
+  }
+  r.pending.clear();
+}
+
+// 函数首次出现时通过 dladdr 取得所在库的绝对路径和符号名
+uint32_t intern_function_locked(Recorder& r, void* fn)
+{
+  auto it = r.functions.find(fn);
+  if (it != r.functions.end()) return it->second;
+
+  uint32_t id = (uint32_t)r.functions.size();
+  r.functions.emplace(fn, id);
+
+  std::string library, symbol;
+  Dl_info info;
+  if (dladdr(fn, &info)) {
+    if (info.dli_fname) {
+      char resolved[PATH_MAX];
+      library = realpath(info.dli_fname, resolved) ? resolved : info.dli_fname;
+    }
+    // 只接受精确命中：dladdr 对未导出的函数返回的是前面最近的符号
+    if (info.dli_sname && info.dli_saddr == fn) symbol = info.dli_sname;
+  }
+  r.pending += 'F';
+  put(r.pending, id);
+  put_short_string(r.pending, library);
+  put_short_string(r.pending, symbol);
+  return id;
+}
+
+uint32_t intern_signature_locked(Recorder& r, const std::string& key)
+{
+  auto it = r.signatures.find(key);
+  if (it != r.signatures.end()) return it->second;
+
+  uint32_t id = (uint32_t)r.signatures.size();
+  r.signatures.emplace(key, id);
+  r.pending += 'S';
+  put(r.pending, id);
+  // 键的布局与 'S' 记录相同：u8 返回类型, i32 固定参数个数, 参数类型[]
+  const size_t header = 1 + sizeof(int32_t);
+  put_bytes(r.pending, key.data(), header);
+  put(r.pending, (uint16_t)(key.size() - header));
+  put_bytes(r.pending, key.data() + header, key.size() - header);
+  return id;
+}
+
+// 读取时的游标，越界后 ok 变为 false，之后的读取都返回 0
+struct Reader {
+  const uint8_t* pos;
+  const uint8_t* end;
+  bool ok = true;
+
+  bool need(size_t n)
+  {
+    if ((size_t)(end - pos) < n) ok = false;
+    return ok;
+  }
+
+  template <typename T>
+  T get()
+  {
+    T value = T();
+    if (need(sizeof(T))) {
+      memcpy(&value, pos, sizeof(T));
+      pos += sizeof(T);
+    }
+    return value;
+  }
+
+  void get_bytes(std::vector<uint8_t>& out, size_t n)
+  {
+    if (!need(n)) return;
+    out.assign(pos, pos + n);
+    pos += n;
+  }
+
+  std::string get_short_string()
+  {
+    uint16_t len = get<uint16_t>();
+    if (!need(len)) return std::string();
+    std::string str((const char*)pos, len);
+    pos += len;
+    return str;
+  }
+};
+
+bool read_arg(Reader& in, FFIRecordArg& arg)
+{
+  arg.kind = in.get<uint8_t>();
+  switch (arg.kind) {
+    case FFI_REC_ARG_VALUE:
+      in.get_bytes(arg.data, in.get<uint8_t>());
+      break;
+    case FFI_REC_ARG_NULL:
+      break;
+    case FFI_REC_ARG_OPAQUE:
+    case FFI_REC_ARG_CALLBACK:
+      arg.address = in.get<uint64_t>();
+      break;
+    case FFI_REC_ARG_BUFFER:
+      arg.address = in.get<uint64_t>();
+      arg.length = in.get<uint64_t>();
+      in.get_bytes(arg.data, in.get<uint32_t>());
+      break;
+    case FFI_REC_ARG_STRING:
+      in.get_bytes(arg.data, in.get<uint32_t>());
+      break;
+    case FFI_REC_ARG_STRING_ARRAY:
+      arg.length = in.get<uint32_t>();
+      in.get_bytes(arg.data, in.get<uint32_t>());
+      break;
+    default:
+      return false;
+  }
+  return in.ok;
+}
+
+}  // namespace
+
+FFIRecordType ffi_record_type(const ffi_type* type)
+{
+  if (type == &ffi_type_void) return FFI_REC_VOID;
+  if (type == &ffi_type_sint8) return FFI_REC_INT8;
+  if (type == &ffi_type_uint8) return FFI_REC_UINT8;
+  if (type == &ffi_type_sint16) return FFI_REC_INT16;
+  if (type == &ffi_type_uint16) return FFI_REC_UINT16;
+  if (type == &ffi_type_sint32) return FFI_REC_INT32;
+  if (type == &ffi_type_uint32) return FFI_REC_UINT32;
+  if (type == &ffi_type_sint64) return FFI_REC_INT64;
+  if (type == &ffi_type_uint64) return FFI_REC_UINT64;
+  if (type == &ffi_type_float) return FFI_REC_FLOAT;
+  if (type == &ffi_type_double) return FFI_REC_DOUBLE;
+  if (type == &ffi_type_longdouble) return FFI_REC_LONGDOUBLE;
+  if (type == &ffi_type_pointer) return FFI_REC_POINTER;
+  return FFI_REC_INVALID;
+}
+
+ffi_type* ffi_record_ffi_type(uint8_t type)
+{
+  switch (type) {
+    case FFI_REC_VOID: return &ffi_type_void;
+    case FFI_REC_INT8: return &ffi_type_sint8;
+    case FFI_REC_UINT8: return &ffi_type_uint8;
+    case FFI_REC_INT16: return &ffi_type_sint16;
+    case FFI_REC_UINT16: return &ffi_type_uint16;
+    case FFI_REC_INT32: return &ffi_type_sint32;
+    case FFI_REC_UINT32: return &ffi_type_uint32;
+    case FFI_REC_INT64: return &ffi_type_sint64;
+    case FFI_REC_UINT64: return &ffi_type_uint64;
+    case FFI_REC_FLOAT: return &ffi_type_float;
+    case FFI_REC_DOUBLE: return &ffi_type_double;
+    case FFI_REC_LONGDOUBLE: return &ffi_type_longdouble;
+    case FFI_REC_POINTER: return &ffi_type_pointer;
+    default: return nullptr;
+  }
+}
+
+bool ffi_record_start(const char* path, size_t buffer_cap)
+{
+  ffi_record_stop();
+
+  Recorder& r = recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.file = fopen(path, "wb");
+  if (!r.file) return false;
+
+  r.write_error = false;
+  r.functions.clear();
+  r.signatures.clear();
+  r.stats = FFIRecordStats();
+  put_bytes(r.pending, kMagic, sizeof(kMagic));
+  put(r.pending, kVersion);
+  put(r.pending, (uint32_t)std::min<size_t>(buffer_cap, UINT32_MAX));
+  r.stats.bytes = r.pending.size();
+
+  g_buffer_cap = std::min<size_t>(buffer_cap, UINT32_MAX);
+  g_enabled = true;
+  return true;
+}
+
+bool ffi_record_stop()
+{
+  Recorder& r = recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  if (!r.file) return true;
+  g_enabled = false;
+  flush_locked(r);
+  bool ok = !r.write_error;
+  if (fclose(r.file) != 0) ok = false;
+  r.file = nullptr;
+  return ok;
+}
+
+bool ffi_record_enabled()
+{
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+FFIRecordStats ffi_record_stats()
+{
+  Recorder& r = recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return r.stats;
+}
+
+FFIRecordCall::FFIRecordCall(void* fn, FFIRecordType ret, const uint8_t* arg_types, uint32_t num_args,
+                             int32_t fixed_args)
+  : fn_(fn)
+{
+  signature_ += (char)ret;
+  put(signature_, fixed_args);
+  signature_.append((const char*)arg_types, num_args);
+}
+
+void FFIRecordCall::value(const void* data, size_t size)
+{
+  args_ += (char)FFI_REC_ARG_VALUE;
+  put(args_, (uint8_t)size);
+  put_bytes(args_, data, size);
+}
+
+void FFIRecordCall::pointer(const void* ptr, size_t length)
+{
+  if (!ptr) {
+    args_ += (char)FFI_REC_ARG_NULL;
+    return;
+  }
+  if (length == SIZE_MAX) {
+    args_ += (char)FFI_REC_ARG_OPAQUE;
+    put(args_, (uint64_t)(uintptr_t)ptr);
+    return;
+  }
+  uint32_t saved = (uint32_t)std::min<size_t>(length, g_buffer_cap.load(std::memory_order_relaxed));
+  args_ += (char)FFI_REC_ARG_BUFFER;
+  put(args_, (uint64_t)(uintptr_t)ptr);
+  put(args_, (uint64_t)length);
+  put(args_, saved);
+  put_bytes(args_, ptr, saved);
+}
+
+void FFIRecordCall::string(const char* str)
+{
+  uint32_t len = (uint32_t)strlen(str);
+  args_ += (char)FFI_REC_ARG_STRING;
+  put(args_, len);
+  put_bytes(args_, str, len);
+}
+
+void FFIRecordCall::callback(const void* ptr)
+{
+  args_ += (char)FFI_REC_ARG_CALLBACK;
+  put(args_, (uint64_t)(uintptr_t)ptr);
+}
+
+void FFIRecordCall::string_array(const char* const* items)
+{
+  if (!items) {
+    args_ += (char)FFI_REC_ARG_NULL;
+    return;
+  }
+  std::string payload;
+  uint32_t count = 0;
+  for (; items[count]; count++) {
+    payload.append(items[count], strlen(items[count]) + 1);
+  }
+  args_ += (char)FFI_REC_ARG_STRING_ARRAY;
+  put(args_, count);
+  put(args_, (uint32_t)payload.size());
+  args_ += payload;
+}
+
+void FFIRecordCall::finish(uint64_t duration_ns)
+{
+  Recorder& r = recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  if (!r.file) return;   // 调用期间录制已经结束
+
+  size_t before = r.pending.size();
+  uint32_t fn_id = intern_function_locked(r, fn_);
+  uint32_t sig_id = intern_signature_locked(r, signature_);
+  r.pending += 'C';
+  put(r.pending, fn_id);
+  put(r.pending, sig_id);
+  put(r.pending, duration_ns);
+  r.pending += args_;
+
+  r.stats.calls++;
+  r.stats.bytes += r.pending.size() - before;
+  if (r.pending.size() >= kFlushThreshold) flush_locked(r);
+}
+
+bool ffi_record_load(const char* path, FFIRecordLog* log, std::string* error)
+{
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    *error = std::string("cannot open ") + path;
+    return false;
+  }
+  std::vector<uint8_t> bytes;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) bytes.insert(bytes.end(), chunk, chunk + n);
+  fclose(f);
+
+  Reader in{bytes.data(), bytes.data() + bytes.size()};
+  if (!in.need(sizeof(kMagic)) || memcmp(in.pos, kMagic, sizeof(kMagic)) != 0) {
+    *error = "not an FFI call log";
+    return false;
+  }
+  in.pos += sizeof(kMagic);
+  if (in.get<uint32_t>() != kVersion) {
+    *error = "unsupported log version";
+    return false;
+  }
+  log->buffer_cap = in.get<uint32_t>();
+
+  while (in.ok && in.pos < in.end) {
+    char tag = (char)in.get<uint8_t>();
+    if (tag == 'F') {
+      uint32_t id = in.get<uint32_t>();
+      FFIRecordFunction fn;
+      fn.library = in.get_short_string();
+      fn.symbol = in.get_short_string();
+      if (id != log->functions.size()) break;
+      log->functions.push_back(fn);
+    } else if (tag == 'S') {
+      uint32_t id = in.get<uint32_t>();
+      FFIRecordSignature sig;
+      sig.ret = in.get<uint8_t>();
+      sig.fixed_args = in.get<int32_t>();
+      in.get_bytes(sig.args, in.get<uint16_t>());
+      if (id != log->signatures.size()) break;
+      log->signatures.push_back(sig);
+    } else if (tag == 'C') {
+      FFIRecordEntry call;
+      call.function = in.get<uint32_t>();
+      call.signature = in.get<uint32_t>();
+      call.duration_ns = in.get<uint64_t>();
+      if (call.function >= log->functions.size() || call.signature >= log->signatures.size()) break;
+      call.args.resize(log->signatures[call.signature].args.size());
+      bool ok = true;
+      for (FFIRecordArg& arg : call.args) {
+        if (!(ok = read_arg(in, arg))) break;
+      }
+      if (!ok) break;
+      log->calls.push_back(std::move(call));
+    } else {
+      break;
+    }
+  }
+  if (in.pos != in.end) {
+    *error = "corrupt record at offset " + std::to_string(in.pos - bytes.data());
+    return false;
+  }
+  return true;
+}
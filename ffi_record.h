@@ -0,0 +1,130 @@
+// ffi_record.h
+// FFI 调用录制与回放共用的二进制日志格式。
+//
+// 录制时 ffi.call 把每次调用的函数、签名、参数值以及指针参数指向的缓冲区内容
+// （每个缓冲区最多 buffer_cap 字节）追加到日志；ffi_replay 读取日志，dlopen 同样的
+// 库并在原生循环中重新发起这些调用，从而把原生代码的开销与解释器开销分开测量。
+//
+// 文件布局（小端，只在同一平台上回放）：
+//   头部    "QJSFFIR\0" u32 版本 u32 buffer_cap
+//   'F' 记录 u32 id, u16 长度+库路径, u16 长度+符号名        函数首次出现时写入
+//   'S' 记录 u32 id, u8 返回类型, i32 固定参数个数, u16 参数个数, u8 参数类型[]
+//           签名首次出现时写入；固定参数个数为 -1 表示普通函数，否则是可变参数函数，
+//           参数类型为提升后的类型，回放时用 ffi_prep_cif_var 准备
+//   'C' 记录 u32 函数 id, u32 签名 id, u64 原生耗时(ns), 每个参数一项：
+//           u8 种类 + 内容（见 FFIRecordArgKind）
+#ifndef FFI_RECORD_H
+#define FFI_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ffi.h>
+
+// 日志中的值类型，与 libffi 的基本类型一一对应
+enum FFIRecordType : uint8_t {
+  FFI_REC_VOID,
+  FFI_REC_INT8,
+  FFI_REC_UINT8,
+  FFI_REC_INT16,
+  FFI_REC_UINT16,
+  FFI_REC_INT32,
+  FFI_REC_UINT32,
+  FFI_REC_INT64,
+  FFI_REC_UINT64,
+  FFI_REC_FLOAT,
+  FFI_REC_DOUBLE,
+  FFI_REC_LONGDOUBLE,
+  FFI_REC_POINTER,
+  FFI_REC_INVALID = 0xff,
+};
+
+// 参数的记录方式
+enum FFIRecordArgKind : uint8_t {
+  FFI_REC_ARG_VALUE,     // u8 字节数 + 值本身
+  FFI_REC_ARG_NULL,      // 空指针
+  FFI_REC_ARG_OPAQUE,    // u64 地址：长度未知的指针，回放时换成清零的 buffer_cap 字节
+  FFI_REC_ARG_BUFFER,    // u64 地址, u64 长度, u32 保存的字节数 + 内容；也用于 out/inout 槽位
+  FFI_REC_ARG_STRING,    // u32 长度 + 内容（不含结尾的 0）
+  FFI_REC_ARG_CALLBACK,  // u64 闭包地址：无法回放，回放时跳过整个调用
+  FFI_REC_ARG_STRING_ARRAY, // u32 个数, u32 总长度 + 以 0 分隔的内容：回放时重建 char** 表
+};
+
+FFIRecordType ffi_record_type(const ffi_type* type);
+ffi_type* ffi_record_ffi_type(uint8_t type);
+
+// ---- 录制 ----
+
+// 开始录制，已在录制时先结束上一个日志；失败返回 false
+bool ffi_record_start(const char* path, size_t buffer_cap);
+// 结束录制并关闭文件，写入出错时返回 false
+bool ffi_record_stop();
+bool ffi_record_enabled();
+
+struct FFIRecordStats {
+  uint64_t calls = 0;
+  uint64_t bytes = 0;       // 已写入的字节数（含缓冲中的部分）
+};
+FFIRecordStats ffi_record_stats();
+
+// 一次调用的记录：按参数顺序追加，调用返回后 finish 写入日志。
+// 回调中的嵌套调用先于外层调用完成，因此在日志中排在外层调用之前。
+class FFIRecordCall {
+public:
+  // fixed_args 为可变参数函数的固定参数个数，普通函数为 -1
+  FFIRecordCall(void* fn, FFIRecordType ret, const uint8_t* arg_types, uint32_t num_args,
+                int32_t fixed_args = -1);
+
+  void value(const void* data, size_t size);
+  void pointer(const void* ptr, size_t length);    // length 为 SIZE_MAX 表示长度未知
+  void string(const char* str);
+  void callback(const void* ptr);
+  void string_array(const char* const* items);     // 以 NULL 结尾
+  void finish(uint64_t duration_ns);
+
+private:
+  void* fn_;
+  std::string signature_;   // 返回类型 + 固定参数个数 + 参数类型，作为签名的去重键
+  std::string args_;
+};
+
+// ---- 回放 ----
+
+struct FFIRecordFunction {
+  std::string library;
+  std::string symbol;
+};
+
+struct FFIRecordSignature {
+  uint8_t ret = FFI_REC_VOID;
+  int32_t fixed_args = -1;      // 可变参数函数的固定参数个数，-1 表示普通函数
+  std::vector<uint8_t> args;
+};
+
+struct FFIRecordArg {
+  uint8_t kind = FFI_REC_ARG_NULL;
+  uint64_t address = 0;         // 录制时的地址，回放时同一地址共用一块内存
+  uint64_t length = 0;          // BUFFER 的原始长度；STRING_ARRAY 的字符串个数
+  std::vector<uint8_t> data;    // VALUE 的值、BUFFER 保存的内容或 STRING(_ARRAY) 的内容
+};
+
+struct FFIRecordEntry {
+  uint32_t function = 0;
+  uint32_t signature = 0;
+  uint64_t duration_ns = 0;
+  std::vector<FFIRecordArg> args;
+};
+
+struct FFIRecordLog {
+  uint32_t buffer_cap = 0;
+  std::vector<FFIRecordFunction> functions;     // 按 id 索引
+  std::vector<FFIRecordSignature> signatures;   // 按 id 索引
+  std::vector<FFIRecordEntry> calls;
+};
+
+// 读取整个日志；格式错误（如录制进程异常退出留下的截断记录）时返回 false 并在
+// error 中说明，之前读到的记录仍保留在 log 中
+bool ffi_record_load(const char* path, FFIRecordLog* log, std::string* error);
+
+#endif /* FFI_RECORD_H */
@@ -0,0 +1,339 @@
+// ffi_replay.cpp
+// Replays an FFI call log written by `qjs_ffi --record=<file>` or ffi.recordStart().
+//
+// The libraries named in the log are dlopen'ed again and every call is re-issued
+// through libffi in a tight native loop, so the per-function timings exclude the
+// interpreter. Pointer arguments are backed by fresh buffers: one per recorded
+// address, refilled with that call's captured contents before each call (outside
+// the timed region) unless --no-restore is given.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dlfcn.h>
+#include <ffi.h>
+
+#include "ffi_record.h"
+
+struct ReplayOptions
+{
+  uint32_t iterations = 100;   // --iterations=<n>: passes over the whole log
+  bool restore = true;         // --no-restore: keep buffer contents between calls
+};
+
+// Backing memory for one recorded pointer address
+struct ReplayBuffer
+{
+  void* data = nullptr;
+  size_t length = 0;
+};
+
+// One call ready for ffi_call
+struct ReplayCall
+{
+  uint32_t function = 0;
+  ffi_cif* cif = nullptr;
+  void (*fn)(void) = nullptr;
+  std::vector<long double> slots;                  // argument values
+  std::vector<void*> avalues;
+  std::vector<std::pair<ReplayBuffer*, const std::vector<uint8_t>*>> restores;
+};
+
+struct ReplayStats
+{
+  uint64_t calls = 0;
+  uint64_t total_ns = 0;
+  uint64_t min_ns = UINT64_MAX;
+  uint64_t max_ns = 0;
+  uint64_t recorded_calls = 0;
+  uint64_t recorded_ns = 0;
+};
+
+static void print_usage(const char* prog)
+{
+  std::cerr << "Usage: " << prog << " [options] <log>" << std::endl
+            << "Options:" << std::endl
+            << "  --iterations=<n>   passes over the log (default 100)" << std::endl
+            << "  --no-restore       do not refill buffers with the recorded contents before each call" << std::endl;
+}
+
+static int parse_options(int argc, char** argv, ReplayOptions& opts)
+{
+  int i = 1;
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++)
+  {
+    if (strncmp(argv[i], "--iterations=", 13) == 0)
+    {
+      opts.iterations = (uint32_t)strtoul(argv[i] + 13, nullptr, 10);
+      if (opts.iterations == 0)
+      {
+        std::cerr << "Error: --iterations must be at least 1" << std::endl;
+        return -1;
+      }
+    }
+    else if (strcmp(argv[i], "--no-restore") == 0)
+    {
+      opts.restore = false;
+    }
+    else
+    {
+      std::cerr << "Error: Unknown option: " << argv[i] << std::endl;
+      return -1;
+    }
+  }
+  return i + 1 == argc ? i : -1;
+}
+
+static uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string function_name(const FFIRecordFunction& fn)
+{
+  std::string lib = fn.library.substr(fn.library.find_last_of('/') + 1);
+  return (fn.symbol.empty() ? std::string("?") : fn.symbol) + " (" + lib + ")";
+}
+
+int main(int argc, char** argv)
+{
+  ReplayOptions opts;
+  int log_index = parse_options(argc, argv, opts);
+  if (log_index < 0)
+  {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  FFIRecordLog log;
+  std::string error;
+  if (!ffi_record_load(argv[log_index], &log, &error))
+  {
+    if (log.calls.empty())
+    {
+      std::cerr << "Error: " << argv[log_index] << ": " << error << std::endl;
+      return 1;
+    }
+    std::cerr << "Warning: " << error << "; replaying the " << log.calls.size()
+              << " calls read before it" << std::endl;
+  }
+
+  // Resolve every function; libraries stay loaded until exit
+  std::map<std::string, void*> libraries;
+  std::vector<void (*)(void)> functions(log.functions.size(), nullptr);
+  for (size_t i = 0; i < log.functions.size(); i++)
+  {
+    const FFIRecordFunction& fn = log.functions[i];
+    if (fn.library.empty() || fn.symbol.empty())
+    {
+      std::cerr << "Warning: skipping unnamed function #" << i << std::endl;
+      continue;
+    }
+    void*& handle = libraries[fn.library];
+    if (!handle)
+    {
+      handle = dlopen(fn.library.c_str(), RTLD_NOW);
+      if (!handle)
+      {
+        std::cerr << "Warning: " << dlerror() << std::endl;
+        continue;
+      }
+    }
+    functions[i] = (void (*)(void))dlsym(handle, fn.symbol.c_str());
+    if (!functions[i])
+    {
+      std::cerr << "Warning: " << fn.symbol << " not found in " << fn.library << std::endl;
+    }
+  }
+
+  // One cif per signature
+  std::vector<ffi_cif> cifs(log.signatures.size());
+  std::vector<std::vector<ffi_type*>> atypes(log.signatures.size());
+  std::vector<bool> cif_ok(log.signatures.size(), false);
+  for (size_t i = 0; i < log.signatures.size(); i++)
+  {
+    const FFIRecordSignature& sig = log.signatures[i];
+    ffi_type* rtype = ffi_record_ffi_type(sig.ret);
+    bool valid = rtype != nullptr;
+    for (uint8_t t : sig.args)
+    {
+      atypes[i].push_back(ffi_record_ffi_type(t));
+      valid = valid && atypes[i].back();
+    }
+    // Variadic signatures were recorded with promoted types and need the variadic cif
+    if (!valid || sig.fixed_args > (int32_t)sig.args.size()) continue;
+    cif_ok[i] = (sig.fixed_args < 0
+                   ? ffi_prep_cif(&cifs[i], FFI_DEFAULT_ABI, (unsigned)sig.args.size(), rtype, atypes[i].data())
+                   : ffi_prep_cif_var(&cifs[i], FFI_DEFAULT_ABI, (unsigned)sig.fixed_args,
+                                      (unsigned)sig.args.size(), rtype, atypes[i].data())) == FFI_OK;
+  }
+
+  // Materialise the calls. Pointers of unknown extent get a zeroed buffer_cap block.
+  std::map<std::pair<uint64_t, uint64_t>, ReplayBuffer> buffers;
+  std::deque<std::string> strings;   // stable c_str() pointers
+  std::deque<std::vector<const char*>> tables;
+  std::vector<ReplayCall> calls;
+  std::vector<ReplayStats> stats(log.functions.size());
+  uint64_t skipped = 0;
+  for (const FFIRecordEntry& entry : log.calls)
+  {
+    stats[entry.function].recorded_calls++;
+    stats[entry.function].recorded_ns += entry.duration_ns;
+    if (!functions[entry.function] || !cif_ok[entry.signature])
+    {
+      skipped++;
+      continue;
+    }
+
+    ReplayCall call;
+    call.function = entry.function;
+    call.cif = &cifs[entry.signature];
+    call.fn = functions[entry.function];
+    call.slots.resize(entry.args.size());
+    bool replayable = true;
+    for (size_t a = 0; a < entry.args.size() && replayable; a++)
+    {
+      const FFIRecordArg& arg = entry.args[a];
+      void* slot = &call.slots[a];
+      switch (arg.kind)
+      {
+        case FFI_REC_ARG_VALUE:
+          memcpy(slot, arg.data.data(), std::min(arg.data.size(), sizeof(long double)));
+          break;
+        case FFI_REC_ARG_NULL:
+          *(void**)slot = nullptr;
+          break;
+        case FFI_REC_ARG_STRING:
+          strings.emplace_back(arg.data.begin(), arg.data.end());
+          *(const char**)slot = strings.back().c_str();
+          break;
+        case FFI_REC_ARG_STRING_ARRAY:
+        {
+          // Rebuild the NULL-terminated table over the recorded payload
+          const char* payload = (const char*)arg.data.data();
+          tables.emplace_back();
+          for (uint64_t k = 0; k < arg.length; k++)
+          {
+            tables.back().push_back(payload);
+            payload += strlen(payload) + 1;
+          }
+          tables.back().push_back(nullptr);
+          *(const char* const**)slot = tables.back().data();
+          break;
+        }
+        case FFI_REC_ARG_OPAQUE:
+        case FFI_REC_ARG_BUFFER:
+        {
+          uint64_t length = arg.kind == FFI_REC_ARG_BUFFER ? arg.length : std::max<uint64_t>(log.buffer_cap, 64);
+          ReplayBuffer& buf = buffers[std::make_pair(arg.address, length)];
+          if (!buf.data)
+          {
+            buf.length = (size_t)length;
+            if (posix_memalign(&buf.data, 64, std::max<size_t>(buf.length, 1)) != 0)
+            {
+              buf.data = nullptr;
+              replayable = false;
+              break;
+            }
+            memset(buf.data, 0, buf.length);
+          }
+          *(void**)slot = buf.data;
+          if (arg.kind == FFI_REC_ARG_BUFFER)
+          {
+            call.restores.emplace_back(&buf, &arg.data);
+          }
+          break;
+        }
+        default:   // callbacks cannot be replayed
+          replayable = false;
+          break;
+      }
+    }
+    if (!replayable)
+    {
+      skipped++;
+      continue;
+    }
+    for (long double& slot : call.slots)
+    {
+      call.avalues.push_back(&slot);
+    }
+    calls.push_back(std::move(call));
+  }
+
+  std::cout << "log: " << log.calls.size() << " calls, " << log.functions.size() << " functions, "
+            << calls.size() << " replayable, " << skipped << " skipped" << std::endl;
+  if (calls.empty())
+  {
+    return 1;
+  }
+
+  // Tight loop; the first pass warms caches and lazy binding and is not counted
+  long double rvalue;
+  uint64_t loop_start = 0;
+  for (uint32_t iter = 0; iter <= opts.iterations; iter++)
+  {
+    if (iter == 1)
+    {
+      loop_start = now_ns();
+    }
+    for (ReplayCall& call : calls)
+    {
+      if (opts.restore || iter == 0)
+      {
+        for (const auto& r : call.restores)
+        {
+          memcpy(r.first->data, r.second->data(), std::min(r.first->length, r.second->size()));
+        }
+      }
+      uint64_t t0 = now_ns();
+      ffi_call(call.cif, call.fn, &rvalue, call.avalues.data());
+      uint64_t elapsed = now_ns() - t0;
+      if (iter == 0) continue;
+      ReplayStats& st = stats[call.function];
+      st.calls++;
+      st.total_ns += elapsed;
+      st.min_ns = std::min(st.min_ns, elapsed);
+      st.max_ns = std::max(st.max_ns, elapsed);
+    }
+  }
+  double loop_ms = (now_ns() - loop_start) / 1e6;
+
+  // Per-function report, most expensive first
+  std::vector<size_t> order;
+  for (size_t i = 0; i < stats.size(); i++)
+  {
+    if (stats[i].calls) order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return stats[a].total_ns > stats[b].total_ns; });
+
+  printf("%-40s %10s %14s %14s %12s %12s\n", "function", "calls", "recorded ns", "replay ns", "min ns", "max ns");
+  uint64_t recorded_total = 0, replay_total = 0;
+  for (size_t i : order)
+  {
+    const ReplayStats& st = stats[i];
+    double recorded_mean = st.recorded_calls ? (double)st.recorded_ns / st.recorded_calls : 0;
+    printf("%-40s %10llu %14.1f %14.1f %12llu %12llu\n", function_name(log.functions[i]).c_str(),
+           (unsigned long long)(st.calls / opts.iterations), recorded_mean, (double)st.total_ns / st.calls,
+           (unsigned long long)st.min_ns, (unsigned long long)st.max_ns);
+    recorded_total += st.recorded_ns;
+    replay_total += st.total_ns / opts.iterations;
+  }
+  printf("native time per pass: recorded %.3f ms, replay %.3f ms; %u passes in %.1f ms\n",
+         recorded_total / 1e6, replay_total / 1e6, opts.iterations, loop_ms);
+
+  for (auto& entry : buffers)
+  {
+    free(entry.second.data);
+  }
+  return 0;
+}
@@ -0,0 +1,1754 @@
+// ffi_simd.cpp
+// ffi.mem 的转换/填充与归约/查找内核。
+//
+// 每个向量内核处理 count 中向量宽度整数倍的部分并返回处理的元素数，
+// 剩余部分由同一类型组合的标量实现完成；内核返回 0 表示不支持这组参数。
+// 标量实现在两端都是 8/16 位整数或 float32 时用 float 计算，否则用 double，
+// 向量内核使用相同的计算精度，保证不同 CPU 上结果一致。
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "ffi_simd.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FFI_SIMD_X86 1
+#include <immintrin.h>
+#define FFI_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define FFI_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+typedef void (*ScalarFn)(void* dst, const void* src, size_t n, const FFIConvertOptions& o);
+typedef size_t (*VectorFn)(void* dst, const void* src, size_t n, const FFIConvertOptions& o);
+
+inline bool is_identity(const FFIConvertOptions& o)
+{
+  return o.scale == 1.0 && o.offset == 0.0;
+}
+
+// ---------------------------------------------------------------------------
+// 标量实现
+// ---------------------------------------------------------------------------
+
+template <typename T>
+struct IsSmall {
+  static const bool value = std::is_same<T, float>::value || (std::is_integral<T>::value && sizeof(T) <= 2);
+};
+
+template <typename S, typename D>
+struct ComputeType {
+  typedef typename std::conditional<IsSmall<S>::value && IsSmall<D>::value, float, double>::type type;
+};
+
+// 转为浮点时 NaN 和 ±Inf 原样保留，超出范围的有限值截到 ±max（double -> float 越界转换是未定义行为）
+template <typename D, typename C>
+inline D to_elem(C v, bool round)
+{
+  if (std::is_floating_point<D>::value) {
+    if (v != v || std::isinf(v)) return (D)v;
+    const C hi = (C)std::numeric_limits<D>::max();
+    if (v > hi) return std::numeric_limits<D>::max();
+    if (v < -hi) return -std::numeric_limits<D>::max();
+    return (D)v;
+  }
+  if (v != v) return 0;
+  if (round) v = std::nearbyint(v);
+  const C lo = (C)std::numeric_limits<D>::lowest();
+  const C hi = (C)std::numeric_limits<D>::max();
+  if (v <= lo) return std::numeric_limits<D>::lowest();
+  if (v >= hi) return std::numeric_limits<D>::max();
+  return (D)v;
+}
+
+template <typename S, typename D>
+void convert_scalar(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const S* src = (const S*)src_v;
+  D* dst = (D*)dst_v;
+  const bool identity = is_identity(o);
+
+  if (std::is_integral<S>::value && std::is_integral<D>::value && identity) {
+    if (!o.saturate) {
+      for (size_t i = 0; i < n; i++) dst[i] = (D)src[i];
+      return;
+    }
+    const int64_t lo = (int64_t)std::numeric_limits<D>::lowest();
+    const int64_t hi = (int64_t)std::numeric_limits<D>::max();
+    for (size_t i = 0; i < n; i++) {
+      int64_t v = (int64_t)src[i];
+      dst[i] = (D)(v < lo ? lo : (v > hi ? hi : v));
+    }
+    return;
+  }
+
+  typedef typename ComputeType<S, D>::type C;
+  if (identity) {
+    for (size_t i = 0; i < n; i++) dst[i] = to_elem<D, C>((C)src[i], o.round);
+    return;
+  }
+  const C scale = (C)o.scale;
+  const C offset = (C)o.offset;
+  for (size_t i = 0; i < n; i++) dst[i] = to_elem<D, C>((C)src[i] * scale + offset, o.round);
+}
+
+#define FFI_SCALAR_ROW(S) {                                                      \
+  convert_scalar<S, int8_t>, convert_scalar<S, uint8_t>,                         \
+  convert_scalar<S, int16_t>, convert_scalar<S, uint16_t>,                       \
+  convert_scalar<S, int32_t>, convert_scalar<S, uint32_t>,                       \
+  convert_scalar<S, float>, convert_scalar<S, double> }
+
+// [src][dst]
+const ScalarFn kScalarConvert[FFI_ELEM_COUNT][FFI_ELEM_COUNT] = {
+  FFI_SCALAR_ROW(int8_t),
+  FFI_SCALAR_ROW(uint8_t),
+  FFI_SCALAR_ROW(int16_t),
+  FFI_SCALAR_ROW(uint16_t),
+  FFI_SCALAR_ROW(int32_t),
+  FFI_SCALAR_ROW(uint32_t),
+  FFI_SCALAR_ROW(float),
+  FFI_SCALAR_ROW(double),
+};
+
+#undef FFI_SCALAR_ROW
+
+void fill_pattern_scalar(uint8_t* dst, size_t bytes, const uint8_t* pattern)
+{
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) memcpy(dst + i, pattern, 16);
+  memcpy(dst + i, pattern, bytes - i);
+}
+
+// ---- 归约 ----
+//
+// 浮点求和与点积按 8 路交错累加：第 i 个元素加到 lanes[i % 8]。向量内核处理的
+// 元素数总是 8 的倍数，尾部由标量实现接着累加到同样的路上，最后按固定顺序合并。
+
+const size_t kSumLanes = 8;
+
+typedef size_t (*SumIntFn)(const void* src, size_t n, int64_t* total);
+typedef size_t (*SumFloatFn)(const void* src, size_t n, double* lanes);
+typedef size_t (*DotFn)(const void* a, const void* b, size_t n, double* lanes);
+typedef size_t (*MinMaxFn)(const void* src, size_t n, FFIMinMax* r);
+typedef size_t (*CountFn)(const uint8_t* src, uint8_t byte, size_t n, uint64_t* total);
+
+inline double combine_lanes(const double* lanes)
+{
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// 有符号整数在 int64 中累加，无符号整数在 uint64 中累加
+template <typename T>
+struct AccumType {
+  typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type type;
+};
+
+template <typename T>
+double sum_int(const void* src_v, size_t n, SumIntFn vec)
+{
+  const T* src = (const T*)src_v;
+  int64_t head = 0;
+  size_t i = vec ? vec(src, n, &head) : 0;
+  typename AccumType<T>::type acc = (typename AccumType<T>::type)head;
+  for (; i < n; i++) acc += src[i];
+  return (double)acc;
+}
+
+template <typename T>
+double sum_float(const void* src_v, size_t n, SumFloatFn vec)
+{
+  const T* src = (const T*)src_v;
+  double lanes[kSumLanes] = {};
+  size_t i = vec ? vec(src, n, lanes) : 0;
+  for (; i < n; i++) lanes[i % kSumLanes] += (double)src[i];
+  return combine_lanes(lanes);
+}
+
+template <typename T>
+double dot_int(const void* a_v, const void* b_v, size_t n)
+{
+  const T* a = (const T*)a_v;
+  const T* b = (const T*)b_v;
+  typedef typename AccumType<T>::type A;
+  // 在 uint64 中按模 2^64 累加，溢出时回绕而不是未定义行为，有符号类型最后按补码解释
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; i++) acc += (uint64_t)((A)a[i] * (A)b[i]);
+  return std::is_signed<T>::value ? (double)(int64_t)acc : (double)acc;
+}
+
+template <typename T>
+double dot_float(const void* a_v, const void* b_v, size_t n, DotFn vec)
+{
+  const T* a = (const T*)a_v;
+  const T* b = (const T*)b_v;
+  double lanes[kSumLanes] = {};
+  size_t i = vec ? vec(a, b, n, lanes) : 0;
+  for (; i < n; i++) lanes[i % kSumLanes] += (double)a[i] * (double)b[i];
+  return combine_lanes(lanes);
+}
+
+// 在 r 的基础上继续扫描 [begin, n)，严格比较保证值相同时保留靠前的位置
+template <typename T>
+void minmax_scalar(const T* src, size_t begin, size_t n, FFIMinMax* r)
+{
+  for (size_t i = begin; i < n; i++) {
+    double v = (double)src[i];
+    if (v != v) continue;
+    if (r->min_index == SIZE_MAX || v < r->min) {
+      r->min = v;
+      r->min_index = i;
+    }
+    if (r->max_index == SIZE_MAX || v > r->max) {
+      r->max = v;
+      r->max_index = i;
+    }
+  }
+}
+
+template <typename T>
+FFIMinMax minmax(const void* src_v, size_t n, MinMaxFn vec)
+{
+  const T* src = (const T*)src_v;
+  FFIMinMax r;
+  size_t done = vec ? vec(src, n, &r) : 0;
+  // 浮点内核以 ±inf 为初值，全是 +inf（或 -inf）的部分找不到位置，重新用标量扫描
+  if (done && (r.min_index == SIZE_MAX || r.max_index == SIZE_MAX)) {
+    r = FFIMinMax();
+    done = 0;
+  }
+  minmax_scalar(src, done, n, &r);
+  return r;
+}
+
+// 向量内核最后合并各路的结果：取最小/最大值，值相同时取位置靠前的；位置为 -1 的路没有结果
+template <typename T>
+void merge_minmax_lanes(const T* minv, const int32_t* mini, const T* maxv, const int32_t* maxi,
+                        int lanes, FFIMinMax* r)
+{
+  for (int k = 0; k < lanes; k++) {
+    if (mini[k] >= 0 && (r->min_index == SIZE_MAX || minv[k] < r->min ||
+                         (minv[k] == r->min && (size_t)mini[k] < r->min_index))) {
+      r->min = minv[k];
+      r->min_index = (size_t)mini[k];
+    }
+    if (maxi[k] >= 0 && (r->max_index == SIZE_MAX || maxv[k] > r->max ||
+                         (maxv[k] == r->max && (size_t)maxi[k] < r->max_index))) {
+      r->max = maxv[k];
+      r->max_index = (size_t)maxi[k];
+    }
+  }
+}
+
+template <typename T>
+void histogram_scalar(const void* src_v, size_t n, double lo, double hi, uint64_t* counts, size_t bins)
+{
+  const T* src = (const T*)src_v;
+  const double scale = (double)bins / (hi - lo);
+  for (size_t i = 0; i < n; i++) {
+    double v = (double)src[i];
+    if (!(v >= lo && v <= hi)) continue;
+    size_t k = (size_t)((v - lo) * scale);
+    counts[k < bins ? k : bins - 1]++;
+  }
+}
+
+// 8 位元素每个取值一个区间：轮流计入 4 个子直方图，连续相同的字节不会在同一个
+// 计数器上形成读改写的依赖链。bias 把字节映射到区间号（int8 为 0x80）
+void histogram_bytes(const uint8_t* src, size_t n, uint8_t bias, uint64_t* counts)
+{
+  uint64_t sub[4][256] = {};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sub[0][src[i]]++;
+    sub[1][src[i + 1]]++;
+    sub[2][src[i + 2]]++;
+    sub[3][src[i + 3]]++;
+  }
+  for (; i < n; i++) sub[0][src[i]]++;
+  for (int v = 0; v < 256; v++) {
+    counts[(uint8_t)(v ^ bias)] += sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+  }
+}
+
+// ---------------------------------------------------------------------------
+// SSE2 / AVX2
+// ---------------------------------------------------------------------------
+
+#ifdef FFI_SIMD_X86
+
+inline __m128 sse_affine(__m128 x, bool identity, __m128 scale, __m128 offset)
+{
+  return identity ? x : _mm_add_ps(_mm_mul_ps(x, scale), offset);
+}
+
+// NaN -> 0，截到 [lo, hi] 后转换为 int32
+inline __m128i sse_to_i32(__m128 x, __m128 lo, __m128 hi, bool round)
+{
+  x = _mm_and_ps(x, _mm_cmpord_ps(x, x));
+  x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+  return round ? _mm_cvtps_epi32(x) : _mm_cvttps_epi32(x);
+}
+
+size_t sse2_u8_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128 scale = _mm_set1_ps((float)o.scale);
+  const __m128 offset = _mm_set1_ps((float)o.offset);
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lo16 = _mm_unpacklo_epi8(v, zero);
+    __m128i hi16 = _mm_unpackhi_epi8(v, zero);
+    __m128i w[4] = {
+      _mm_unpacklo_epi16(lo16, zero), _mm_unpackhi_epi16(lo16, zero),
+      _mm_unpacklo_epi16(hi16, zero), _mm_unpackhi_epi16(hi16, zero),
+    };
+    for (int k = 0; k < 4; k++) {
+      _mm_storeu_ps(dst + i + 4 * k, sse_affine(_mm_cvtepi32_ps(w[k]), identity, scale, offset));
+    }
+  }
+  return i;
+}
+
+size_t sse2_i16_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const int16_t* src = (const int16_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128 scale = _mm_set1_ps((float)o.scale);
+  const __m128 offset = _mm_set1_ps((float)o.offset);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, sse_affine(_mm_cvtepi32_ps(lo), identity, scale, offset));
+    _mm_storeu_ps(dst + i + 4, sse_affine(_mm_cvtepi32_ps(hi), identity, scale, offset));
+  }
+  return i;
+}
+
+size_t sse2_f32_to_u8(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  uint8_t* dst = (uint8_t*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128 scale = _mm_set1_ps((float)o.scale);
+  const __m128 offset = _mm_set1_ps((float)o.offset);
+  const __m128 lo = _mm_set1_ps(0.0f);
+  const __m128 hi = _mm_set1_ps(255.0f);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i w[4];
+    for (int k = 0; k < 4; k++) {
+      __m128 x = sse_affine(_mm_loadu_ps(src + i + 4 * k), identity, scale, offset);
+      w[k] = sse_to_i32(x, lo, hi, o.round);
+    }
+    __m128i a = _mm_packs_epi32(w[0], w[1]);
+    __m128i b = _mm_packs_epi32(w[2], w[3]);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+  }
+  return i;
+}
+
+size_t sse2_f32_to_i16(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  int16_t* dst = (int16_t*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128 scale = _mm_set1_ps((float)o.scale);
+  const __m128 offset = _mm_set1_ps((float)o.offset);
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  const __m128 hi = _mm_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = sse_to_i32(sse_affine(_mm_loadu_ps(src + i), identity, scale, offset), lo, hi, o.round);
+    __m128i b = sse_to_i32(sse_affine(_mm_loadu_ps(src + i + 4), identity, scale, offset), lo, hi, o.round);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+  }
+  return i;
+}
+
+size_t sse2_f32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  float* dst = (float*)dst_v;
+  const __m128 scale = _mm_set1_ps((float)o.scale);
+  const __m128 offset = _mm_set1_ps((float)o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, sse_affine(_mm_loadu_ps(src + i), false, scale, offset));
+  }
+  return i;
+}
+
+// int32 -> float32 在 double 中计算（与标量一致），只在不缩放时使用单精度快速路径
+size_t sse2_i32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const int32_t* src = (const int32_t*)src_v;
+  float* dst = (float*)dst_v;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+  }
+  return i;
+}
+
+// float32 -> int32：>= 2^31 的值转换结果为 0x80000000，异或修正为 INT32_MAX
+size_t sse2_f32_to_i32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const float* src = (const float*)src_v;
+  int32_t* dst = (int32_t*)dst_v;
+  const __m128 limit = _mm_set1_ps(2147483648.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(src + i);
+    x = _mm_and_ps(x, _mm_cmpord_ps(x, x));
+    __m128i v = o.round ? _mm_cvtps_epi32(x) : _mm_cvttps_epi32(x);
+    v = _mm_xor_si128(v, _mm_castps_si128(_mm_cmpge_ps(x, limit)));
+    _mm_storeu_si128((__m128i*)(dst + i), v);
+  }
+  return i;
+}
+
+size_t sse2_f32_to_f64(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  double* dst = (double*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128d scale = _mm_set1_pd(o.scale);
+  const __m128d offset = _mm_set1_pd(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(src + i);
+    __m128d lo = _mm_cvtps_pd(x);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+    if (!identity) {
+      lo = _mm_add_pd(_mm_mul_pd(lo, scale), offset);
+      hi = _mm_add_pd(_mm_mul_pd(hi, scale), offset);
+    }
+    _mm_storeu_pd(dst + i, lo);
+    _mm_storeu_pd(dst + i + 2, hi);
+  }
+  return i;
+}
+
+// 与标量一致：有限值截到 ±FLT_MAX，NaN 和 ±Inf 保留。
+// max/min 在有 NaN 时返回第二个操作数，因此 x 放在第二个位置
+inline __m128d sse_clamp_f32_range(__m128d x)
+{
+  const __m128d hi = _mm_set1_pd(std::numeric_limits<float>::max());
+  const __m128d lo = _mm_set1_pd(-std::numeric_limits<float>::max());
+  const __m128d inf = _mm_set1_pd(std::numeric_limits<double>::infinity());
+  __m128d c = _mm_min_pd(hi, _mm_max_pd(lo, x));
+  __m128d is_inf = _mm_cmpeq_pd(_mm_andnot_pd(_mm_set1_pd(-0.0), x), inf);
+  return _mm_or_pd(_mm_and_pd(is_inf, x), _mm_andnot_pd(is_inf, c));
+}
+
+size_t sse2_f64_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const double* src = (const double*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m128d scale = _mm_set1_pd(o.scale);
+  const __m128d offset = _mm_set1_pd(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d lo = _mm_loadu_pd(src + i);
+    __m128d hi = _mm_loadu_pd(src + i + 2);
+    if (!identity) {
+      lo = _mm_add_pd(_mm_mul_pd(lo, scale), offset);
+      hi = _mm_add_pd(_mm_mul_pd(hi, scale), offset);
+    }
+    lo = sse_clamp_f32_range(lo);
+    hi = sse_clamp_f32_range(hi);
+    _mm_storeu_ps(dst + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+  }
+  return i;
+}
+
+void sse2_fill_pattern(uint8_t* dst, size_t bytes, const uint8_t* pattern)
+{
+  const __m128i v = _mm_loadu_si128((const __m128i*)pattern);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) _mm_storeu_si128((__m128i*)(dst + i), v);
+  memcpy(dst + i, pattern, bytes - i);
+}
+
+FFI_TARGET_AVX2 inline __m256 avx_affine(__m256 x, bool identity, __m256 scale, __m256 offset)
+{
+  return identity ? x : _mm256_add_ps(_mm256_mul_ps(x, scale), offset);
+}
+
+FFI_TARGET_AVX2 inline __m256i avx_to_i32(__m256 x, __m256 lo, __m256 hi, bool round)
+{
+  x = _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+  x = _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+  return round ? _mm256_cvtps_epi32(x) : _mm256_cvttps_epi32(x);
+}
+
+FFI_TARGET_AVX2 size_t avx2_u8_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256 scale = _mm256_set1_ps((float)o.scale);
+  const __m256 offset = _mm256_set1_ps((float)o.offset);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    __m256i lo = _mm256_cvtepu8_epi32(v);
+    __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+    _mm256_storeu_ps(dst + i, avx_affine(_mm256_cvtepi32_ps(lo), identity, scale, offset));
+    _mm256_storeu_ps(dst + i + 8, avx_affine(_mm256_cvtepi32_ps(hi), identity, scale, offset));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_i16_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const int16_t* src = (const int16_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256 scale = _mm256_set1_ps((float)o.scale);
+  const __m256 offset = _mm256_set1_ps((float)o.offset);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+    _mm256_storeu_ps(dst + i, avx_affine(_mm256_cvtepi32_ps(lo), identity, scale, offset));
+    _mm256_storeu_ps(dst + i + 8, avx_affine(_mm256_cvtepi32_ps(hi), identity, scale, offset));
+  }
+  return i;
+}
+
+// 256 位 pack 指令按 128 位通道交错，转换后用 permute 恢复元素顺序
+FFI_TARGET_AVX2 size_t avx2_f32_to_u8(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  uint8_t* dst = (uint8_t*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256 scale = _mm256_set1_ps((float)o.scale);
+  const __m256 offset = _mm256_set1_ps((float)o.offset);
+  const __m256 lo = _mm256_set1_ps(0.0f);
+  const __m256 hi = _mm256_set1_ps(255.0f);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i w[4];
+    for (int k = 0; k < 4; k++) {
+      __m256 x = avx_affine(_mm256_loadu_ps(src + i + 8 * k), identity, scale, offset);
+      w[k] = avx_to_i32(x, lo, hi, o.round);
+    }
+    __m256i a = _mm256_packs_epi32(w[0], w[1]);
+    __m256i b = _mm256_packs_epi32(w[2], w[3]);
+    __m256i bytes = _mm256_packus_epi16(a, b);
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(bytes, order));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_f32_to_i16(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  int16_t* dst = (int16_t*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256 scale = _mm256_set1_ps((float)o.scale);
+  const __m256 offset = _mm256_set1_ps((float)o.offset);
+  const __m256 lo = _mm256_set1_ps(-32768.0f);
+  const __m256 hi = _mm256_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = avx_to_i32(avx_affine(_mm256_loadu_ps(src + i), identity, scale, offset), lo, hi, o.round);
+    __m256i b = avx_to_i32(avx_affine(_mm256_loadu_ps(src + i + 8), identity, scale, offset), lo, hi, o.round);
+    __m256i packed = _mm256_packs_epi32(a, b);
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_f32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  float* dst = (float*)dst_v;
+  const __m256 scale = _mm256_set1_ps((float)o.scale);
+  const __m256 offset = _mm256_set1_ps((float)o.offset);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(dst + i, avx_affine(_mm256_loadu_ps(src + i), false, scale, offset));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_i32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const int32_t* src = (const int32_t*)src_v;
+  float* dst = (float*)dst_v;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(src + i))));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_f32_to_i32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const float* src = (const float*)src_v;
+  int32_t* dst = (int32_t*)dst_v;
+  const __m256 limit = _mm256_set1_ps(2147483648.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(src + i);
+    x = _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+    __m256i v = o.round ? _mm256_cvtps_epi32(x) : _mm256_cvttps_epi32(x);
+    v = _mm256_xor_si256(v, _mm256_castps_si256(_mm256_cmp_ps(x, limit, _CMP_GE_OQ)));
+    _mm256_storeu_si256((__m256i*)(dst + i), v);
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_f32_to_f64(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  double* dst = (double*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256d scale = _mm256_set1_pd(o.scale);
+  const __m256d offset = _mm256_set1_pd(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(src + i));
+    if (!identity) x = _mm256_add_pd(_mm256_mul_pd(x, scale), offset);
+    _mm256_storeu_pd(dst + i, x);
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 inline __m256d avx_clamp_f32_range(__m256d x)
+{
+  const __m256d hi = _mm256_set1_pd(std::numeric_limits<float>::max());
+  const __m256d lo = _mm256_set1_pd(-std::numeric_limits<float>::max());
+  const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+  __m256d c = _mm256_min_pd(hi, _mm256_max_pd(lo, x));
+  __m256d is_inf = _mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.0), x), inf, _CMP_EQ_OQ);
+  return _mm256_blendv_pd(c, x, is_inf);
+}
+
+FFI_TARGET_AVX2 size_t avx2_f64_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const double* src = (const double*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const __m256d scale = _mm256_set1_pd(o.scale);
+  const __m256d offset = _mm256_set1_pd(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(src + i);
+    if (!identity) x = _mm256_add_pd(_mm256_mul_pd(x, scale), offset);
+    _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(avx_clamp_f32_range(x)));
+  }
+  return i;
+}
+
+FFI_TARGET_AVX2 void avx2_fill_pattern(uint8_t* dst, size_t bytes, const uint8_t* pattern)
+{
+  const __m256i v = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)pattern));
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) _mm256_storeu_si256((__m256i*)(dst + i), v);
+  fill_pattern_scalar(dst + i, bytes - i, pattern);
+}
+
+// ---- 归约 ----
+
+inline __m128i sse_select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline uint64_t sse_hsum_u64(__m128i v)
+{
+  return (uint64_t)_mm_cvtsi128_si64(v) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+size_t sse2_sum_u8(const void* src_v, size_t n, int64_t* total)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(src + i)), zero));
+  }
+  *total += (int64_t)sse_hsum_u64(acc);
+  return i;
+}
+
+size_t sse2_sum_i32(const void* src_v, size_t n, int64_t* total)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i sign = _mm_cmpgt_epi32(zero, v);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+  }
+  *total += (int64_t)sse_hsum_u64(acc);
+  return i;
+}
+
+size_t sse2_sum_f32(const void* src_v, size_t n, double* lanes)
+{
+  const float* src = (const float*)src_v;
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 a = _mm_loadu_ps(src + i);
+    __m128 b = _mm_loadu_ps(src + i + 4);
+    acc[0] = _mm_add_pd(acc[0], _mm_cvtps_pd(a));
+    acc[1] = _mm_add_pd(acc[1], _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+    acc[2] = _mm_add_pd(acc[2], _mm_cvtps_pd(b));
+    acc[3] = _mm_add_pd(acc[3], _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+  }
+  for (int k = 0; k < 4; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t sse2_sum_f64(const void* src_v, size_t n, double* lanes)
+{
+  const double* src = (const double*)src_v;
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 4; k++) acc[k] = _mm_add_pd(acc[k], _mm_loadu_pd(src + i + 2 * k));
+  }
+  for (int k = 0; k < 4; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t sse2_dot_f32(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const float* a = (const float*)a_v;
+  const float* b = (const float*)b_v;
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int h = 0; h < 2; h++) {
+      __m128 x = _mm_loadu_ps(a + i + 4 * h);
+      __m128 y = _mm_loadu_ps(b + i + 4 * h);
+      acc[2 * h] = _mm_add_pd(acc[2 * h], _mm_mul_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y)));
+      acc[2 * h + 1] = _mm_add_pd(acc[2 * h + 1], _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                                                             _mm_cvtps_pd(_mm_movehl_ps(y, y))));
+    }
+  }
+  for (int k = 0; k < 4; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t sse2_dot_f64(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const double* a = (const double*)a_v;
+  const double* b = (const double*)b_v;
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 4; k++) {
+      acc[k] = _mm_add_pd(acc[k], _mm_mul_pd(_mm_loadu_pd(a + i + 2 * k), _mm_loadu_pd(b + i + 2 * k)));
+    }
+  }
+  for (int k = 0; k < 4; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+// 位置用 int32 记录，超过 INT32_MAX 个元素时交给标量实现
+size_t sse2_minmax_i32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  if (n < 4 || n > (size_t)INT32_MAX) return 0;
+  const __m128i step = _mm_set1_epi32(4);
+  __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i minv = _mm_loadu_si128((const __m128i*)src);
+  __m128i maxv = minv;
+  __m128i mini = idx;
+  __m128i maxi = idx;
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4) {
+    idx = _mm_add_epi32(idx, step);
+    __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lt = _mm_cmplt_epi32(x, minv);
+    __m128i gt = _mm_cmpgt_epi32(x, maxv);
+    minv = sse_select(lt, x, minv);
+    mini = sse_select(lt, idx, mini);
+    maxv = sse_select(gt, x, maxv);
+    maxi = sse_select(gt, idx, maxi);
+  }
+  int32_t v[2][4], k[2][4];
+  _mm_storeu_si128((__m128i*)v[0], minv);
+  _mm_storeu_si128((__m128i*)v[1], maxv);
+  _mm_storeu_si128((__m128i*)k[0], mini);
+  _mm_storeu_si128((__m128i*)k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 4, r);
+  return i;
+}
+
+// NaN 与任何值比较都不成立，因此被跳过
+size_t sse2_minmax_f32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const float* src = (const float*)src_v;
+  if (n > (size_t)INT32_MAX) return 0;
+  const __m128i step = _mm_set1_epi32(4);
+  __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+  __m128 minv = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  __m128 maxv = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+  __m128i mini = _mm_set1_epi32(-1);
+  __m128i maxi = mini;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(src + i);
+    __m128 lt = _mm_cmplt_ps(x, minv);
+    __m128 gt = _mm_cmpgt_ps(x, maxv);
+    minv = _mm_or_ps(_mm_and_ps(lt, x), _mm_andnot_ps(lt, minv));
+    mini = sse_select(_mm_castps_si128(lt), idx, mini);
+    maxv = _mm_or_ps(_mm_and_ps(gt, x), _mm_andnot_ps(gt, maxv));
+    maxi = sse_select(_mm_castps_si128(gt), idx, maxi);
+    idx = _mm_add_epi32(idx, step);
+  }
+  float v[2][4];
+  int32_t k[2][4];
+  _mm_storeu_ps(v[0], minv);
+  _mm_storeu_ps(v[1], maxv);
+  _mm_storeu_si128((__m128i*)k[0], mini);
+  _mm_storeu_si128((__m128i*)k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 4, r);
+  return i;
+}
+
+// 比较结果为 0xff，减去它相当于加 1；每个字节计数器最多累加 255 次后用 sad 汇总
+size_t sse2_count_byte(const uint8_t* src, uint8_t byte, size_t n, uint64_t* total)
+{
+  const __m128i needle = _mm_set1_epi8((char)byte);
+  const __m128i zero = _mm_setzero_si128();
+  const size_t end = n & ~(size_t)15;
+  __m128i sums = zero;
+  size_t i = 0;
+  while (i < end) {
+    const size_t block_end = std::min(end, i + 255 * 16);
+    __m128i acc = zero;
+    for (; i < block_end; i += 16) {
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(src + i)), needle));
+    }
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(acc, zero));
+  }
+  *total += sse_hsum_u64(sums);
+  return i;
+}
+
+FFI_TARGET_AVX2 inline uint64_t avx_hsum_u64(__m256i v)
+{
+  return sse_hsum_u64(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+FFI_TARGET_AVX2 size_t avx2_sum_u8(const void* src_v, size_t n, int64_t* total)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(src + i)), zero));
+  }
+  *total += (int64_t)avx_hsum_u64(acc);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_sum_i32(const void* src_v, size_t n, int64_t* total)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(src + i))));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(src + i + 4))));
+  }
+  *total += (int64_t)avx_hsum_u64(acc);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_sum_f32(const void* src_v, size_t n, double* lanes)
+{
+  const float* src = (const float*)src_v;
+  __m256d lo = _mm256_setzero_pd();
+  __m256d hi = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+    hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm_loadu_ps(src + i + 4)));
+  }
+  _mm256_storeu_pd(lanes, lo);
+  _mm256_storeu_pd(lanes + 4, hi);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_sum_f64(const void* src_v, size_t n, double* lanes)
+{
+  const double* src = (const double*)src_v;
+  __m256d lo = _mm256_setzero_pd();
+  __m256d hi = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    lo = _mm256_add_pd(lo, _mm256_loadu_pd(src + i));
+    hi = _mm256_add_pd(hi, _mm256_loadu_pd(src + i + 4));
+  }
+  _mm256_storeu_pd(lanes, lo);
+  _mm256_storeu_pd(lanes + 4, hi);
+  return i;
+}
+
+// 乘加分开做（不用 FMA），与标量实现的舍入一致
+FFI_TARGET_AVX2 size_t avx2_dot_f32(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const float* a = (const float*)a_v;
+  const float* b = (const float*)b_v;
+  __m256d lo = _mm256_setzero_pd();
+  __m256d hi = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)),
+                                         _mm256_cvtps_pd(_mm_loadu_ps(b + i))));
+    hi = _mm256_add_pd(hi, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)),
+                                         _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4))));
+  }
+  _mm256_storeu_pd(lanes, lo);
+  _mm256_storeu_pd(lanes + 4, hi);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_dot_f64(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const double* a = (const double*)a_v;
+  const double* b = (const double*)b_v;
+  __m256d lo = _mm256_setzero_pd();
+  __m256d hi = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    hi = _mm256_add_pd(hi, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+  }
+  _mm256_storeu_pd(lanes, lo);
+  _mm256_storeu_pd(lanes + 4, hi);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_minmax_i32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  if (n < 8 || n > (size_t)INT32_MAX) return 0;
+  const __m256i step = _mm256_set1_epi32(8);
+  __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i minv = _mm256_loadu_si256((const __m256i*)src);
+  __m256i maxv = minv;
+  __m256i mini = idx;
+  __m256i maxi = idx;
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8) {
+    idx = _mm256_add_epi32(idx, step);
+    __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i lt = _mm256_cmpgt_epi32(minv, x);
+    __m256i gt = _mm256_cmpgt_epi32(x, maxv);
+    minv = _mm256_blendv_epi8(minv, x, lt);
+    mini = _mm256_blendv_epi8(mini, idx, lt);
+    maxv = _mm256_blendv_epi8(maxv, x, gt);
+    maxi = _mm256_blendv_epi8(maxi, idx, gt);
+  }
+  int32_t v[2][8], k[2][8];
+  _mm256_storeu_si256((__m256i*)v[0], minv);
+  _mm256_storeu_si256((__m256i*)v[1], maxv);
+  _mm256_storeu_si256((__m256i*)k[0], mini);
+  _mm256_storeu_si256((__m256i*)k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 8, r);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_minmax_f32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const float* src = (const float*)src_v;
+  if (n > (size_t)INT32_MAX) return 0;
+  const __m256i step = _mm256_set1_epi32(8);
+  __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 minv = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  __m256 maxv = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  __m256i mini = _mm256_set1_epi32(-1);
+  __m256i maxi = mini;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(src + i);
+    __m256 lt = _mm256_cmp_ps(x, minv, _CMP_LT_OQ);
+    __m256 gt = _mm256_cmp_ps(x, maxv, _CMP_GT_OQ);
+    minv = _mm256_blendv_ps(minv, x, lt);
+    mini = _mm256_blendv_epi8(mini, idx, _mm256_castps_si256(lt));
+    maxv = _mm256_blendv_ps(maxv, x, gt);
+    maxi = _mm256_blendv_epi8(maxi, idx, _mm256_castps_si256(gt));
+    idx = _mm256_add_epi32(idx, step);
+  }
+  float v[2][8];
+  int32_t k[2][8];
+  _mm256_storeu_ps(v[0], minv);
+  _mm256_storeu_ps(v[1], maxv);
+  _mm256_storeu_si256((__m256i*)k[0], mini);
+  _mm256_storeu_si256((__m256i*)k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 8, r);
+  return i;
+}
+
+FFI_TARGET_AVX2 size_t avx2_count_byte(const uint8_t* src, uint8_t byte, size_t n, uint64_t* total)
+{
+  const __m256i needle = _mm256_set1_epi8((char)byte);
+  const __m256i zero = _mm256_setzero_si256();
+  const size_t end = n & ~(size_t)31;
+  __m256i sums = zero;
+  size_t i = 0;
+  while (i < end) {
+    const size_t block_end = std::min(end, i + 255 * 32);
+    __m256i acc = zero;
+    for (; i < block_end; i += 32) {
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), needle));
+    }
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(acc, zero));
+  }
+  *total += avx_hsum_u64(sums);
+  return i;
+}
+
+#endif // FFI_SIMD_X86
+
+// ---------------------------------------------------------------------------
+// NEON
+// ---------------------------------------------------------------------------
+
+#ifdef FFI_SIMD_NEON
+
+inline float32x4_t neon_affine(float32x4_t x, bool identity, float32x4_t scale, float32x4_t offset)
+{
+  return identity ? x : vaddq_f32(vmulq_f32(x, scale), offset);
+}
+
+inline int32x4_t neon_to_i32(float32x4_t x, float32x4_t lo, float32x4_t hi, bool round)
+{
+  // NaN -> 0
+  x = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(x), vceqq_f32(x, x)));
+  x = vminq_f32(vmaxq_f32(x, lo), hi);
+  return round ? vcvtnq_s32_f32(x) : vcvtq_s32_f32(x);
+}
+
+size_t neon_u8_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const float32x4_t scale = vdupq_n_f32((float)o.scale);
+  const float32x4_t offset = vdupq_n_f32((float)o.offset);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vld1q_u8(src + i);
+    uint16x8_t lo16 = vmovl_u8(vget_low_u8(v));
+    uint16x8_t hi16 = vmovl_u8(vget_high_u8(v));
+    uint32x4_t w[4] = {
+      vmovl_u16(vget_low_u16(lo16)), vmovl_u16(vget_high_u16(lo16)),
+      vmovl_u16(vget_low_u16(hi16)), vmovl_u16(vget_high_u16(hi16)),
+    };
+    for (int k = 0; k < 4; k++) {
+      vst1q_f32(dst + i + 4 * k, neon_affine(vcvtq_f32_u32(w[k]), identity, scale, offset));
+    }
+  }
+  return i;
+}
+
+size_t neon_i16_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const int16_t* src = (const int16_t*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const float32x4_t scale = vdupq_n_f32((float)o.scale);
+  const float32x4_t offset = vdupq_n_f32((float)o.offset);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    vst1q_f32(dst + i, neon_affine(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), identity, scale, offset));
+    vst1q_f32(dst + i + 4, neon_affine(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), identity, scale, offset));
+  }
+  return i;
+}
+
+size_t neon_f32_to_u8(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  uint8_t* dst = (uint8_t*)dst_v;
+  const bool identity = is_identity(o);
+  const float32x4_t scale = vdupq_n_f32((float)o.scale);
+  const float32x4_t offset = vdupq_n_f32((float)o.offset);
+  const float32x4_t lo = vdupq_n_f32(0.0f);
+  const float32x4_t hi = vdupq_n_f32(255.0f);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    int32x4_t w[4];
+    for (int k = 0; k < 4; k++) {
+      w[k] = neon_to_i32(neon_affine(vld1q_f32(src + i + 4 * k), identity, scale, offset), lo, hi, o.round);
+    }
+    int16x8_t a = vcombine_s16(vqmovn_s32(w[0]), vqmovn_s32(w[1]));
+    int16x8_t b = vcombine_s16(vqmovn_s32(w[2]), vqmovn_s32(w[3]));
+    vst1q_u8(dst + i, vcombine_u8(vqmovun_s16(a), vqmovun_s16(b)));
+  }
+  return i;
+}
+
+size_t neon_f32_to_i16(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  int16_t* dst = (int16_t*)dst_v;
+  const bool identity = is_identity(o);
+  const float32x4_t scale = vdupq_n_f32((float)o.scale);
+  const float32x4_t offset = vdupq_n_f32((float)o.offset);
+  const float32x4_t lo = vdupq_n_f32(-32768.0f);
+  const float32x4_t hi = vdupq_n_f32(32767.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t a = neon_to_i32(neon_affine(vld1q_f32(src + i), identity, scale, offset), lo, hi, o.round);
+    int32x4_t b = neon_to_i32(neon_affine(vld1q_f32(src + i + 4), identity, scale, offset), lo, hi, o.round);
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  return i;
+}
+
+size_t neon_f32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  float* dst = (float*)dst_v;
+  const float32x4_t scale = vdupq_n_f32((float)o.scale);
+  const float32x4_t offset = vdupq_n_f32((float)o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(dst + i, neon_affine(vld1q_f32(src + i), false, scale, offset));
+  }
+  return i;
+}
+
+// NEON 的 float -> int32 转换本身就是饱和的，NaN 转为 0，与标量规则一致
+size_t neon_f32_to_i32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const float* src = (const float*)src_v;
+  int32_t* dst = (int32_t*)dst_v;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32(src + i);
+    vst1q_s32(dst + i, o.round ? vcvtnq_s32_f32(x) : vcvtq_s32_f32(x));
+  }
+  return i;
+}
+
+size_t neon_i32_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  if (!is_identity(o)) return 0;
+  const int32_t* src = (const int32_t*)src_v;
+  float* dst = (float*)dst_v;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(dst + i, vcvtq_f32_s32(vld1q_s32(src + i)));
+  }
+  return i;
+}
+
+size_t neon_f32_to_f64(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const float* src = (const float*)src_v;
+  double* dst = (double*)dst_v;
+  const bool identity = is_identity(o);
+  const float64x2_t scale = vdupq_n_f64(o.scale);
+  const float64x2_t offset = vdupq_n_f64(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32(src + i);
+    float64x2_t lo = vcvt_f64_f32(vget_low_f32(x));
+    float64x2_t hi = vcvt_high_f64_f32(x);
+    if (!identity) {
+      lo = vaddq_f64(vmulq_f64(lo, scale), offset);
+      hi = vaddq_f64(vmulq_f64(hi, scale), offset);
+    }
+    vst1q_f64(dst + i, lo);
+    vst1q_f64(dst + i + 2, hi);
+  }
+  return i;
+}
+
+// vmaxq/vminq 遇到 NaN 返回 NaN，±Inf 单独选回原值
+inline float64x2_t neon_clamp_f32_range(float64x2_t x)
+{
+  const float64x2_t hi = vdupq_n_f64(std::numeric_limits<float>::max());
+  const float64x2_t inf = vdupq_n_f64(std::numeric_limits<double>::infinity());
+  float64x2_t c = vminq_f64(vmaxq_f64(x, vnegq_f64(hi)), hi);
+  return vbslq_f64(vceqq_f64(vabsq_f64(x), inf), x, c);
+}
+
+size_t neon_f64_to_f32(void* dst_v, const void* src_v, size_t n, const FFIConvertOptions& o)
+{
+  const double* src = (const double*)src_v;
+  float* dst = (float*)dst_v;
+  const bool identity = is_identity(o);
+  const float64x2_t scale = vdupq_n_f64(o.scale);
+  const float64x2_t offset = vdupq_n_f64(o.offset);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float64x2_t lo = vld1q_f64(src + i);
+    float64x2_t hi = vld1q_f64(src + i + 2);
+    if (!identity) {
+      lo = vaddq_f64(vmulq_f64(lo, scale), offset);
+      hi = vaddq_f64(vmulq_f64(hi, scale), offset);
+    }
+    lo = neon_clamp_f32_range(lo);
+    hi = neon_clamp_f32_range(hi);
+    vst1q_f32(dst + i, vcvt_high_f32_f64(vcvt_f32_f64(lo), hi));
+  }
+  return i;
+}
+
+void neon_fill_pattern(uint8_t* dst, size_t bytes, const uint8_t* pattern)
+{
+  const uint8x16_t v = vld1q_u8(pattern);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) vst1q_u8(dst + i, v);
+  memcpy(dst + i, pattern, bytes - i);
+}
+
+// ---- 归约 ----
+
+size_t neon_sum_u8(const void* src_v, size_t n, int64_t* total)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  uint64x2_t acc = vdupq_n_u64(0);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vld1q_u8(src + i))));
+  *total += (int64_t)(vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1));
+  return i;
+}
+
+size_t neon_sum_i32(const void* src_v, size_t n, int64_t* total)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  int64x2_t acc = vdupq_n_s64(0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) acc = vpadalq_s32(acc, vld1q_s32(src + i));
+  *total += vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+  return i;
+}
+
+size_t neon_sum_f32(const void* src_v, size_t n, double* lanes)
+{
+  const float* src = (const float*)src_v;
+  float64x2_t acc[4] = {vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0)};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t a = vld1q_f32(src + i);
+    float32x4_t b = vld1q_f32(src + i + 4);
+    acc[0] = vaddq_f64(acc[0], vcvt_f64_f32(vget_low_f32(a)));
+    acc[1] = vaddq_f64(acc[1], vcvt_high_f64_f32(a));
+    acc[2] = vaddq_f64(acc[2], vcvt_f64_f32(vget_low_f32(b)));
+    acc[3] = vaddq_f64(acc[3], vcvt_high_f64_f32(b));
+  }
+  for (int k = 0; k < 4; k++) vst1q_f64(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t neon_sum_f64(const void* src_v, size_t n, double* lanes)
+{
+  const double* src = (const double*)src_v;
+  float64x2_t acc[4] = {vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0)};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 4; k++) acc[k] = vaddq_f64(acc[k], vld1q_f64(src + i + 2 * k));
+  }
+  for (int k = 0; k < 4; k++) vst1q_f64(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+// 乘加分开做（vmulq + vaddq）；标量实现若被编译器合并为 fmadd，最低位可能不同
+size_t neon_dot_f32(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const float* a = (const float*)a_v;
+  const float* b = (const float*)b_v;
+  float64x2_t acc[4] = {vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0)};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int h = 0; h < 2; h++) {
+      float32x4_t x = vld1q_f32(a + i + 4 * h);
+      float32x4_t y = vld1q_f32(b + i + 4 * h);
+      acc[2 * h] = vaddq_f64(acc[2 * h], vmulq_f64(vcvt_f64_f32(vget_low_f32(x)), vcvt_f64_f32(vget_low_f32(y))));
+      acc[2 * h + 1] = vaddq_f64(acc[2 * h + 1], vmulq_f64(vcvt_high_f64_f32(x), vcvt_high_f64_f32(y)));
+    }
+  }
+  for (int k = 0; k < 4; k++) vst1q_f64(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t neon_dot_f64(const void* a_v, const void* b_v, size_t n, double* lanes)
+{
+  const double* a = (const double*)a_v;
+  const double* b = (const double*)b_v;
+  float64x2_t acc[4] = {vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0), vdupq_n_f64(0)};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int k = 0; k < 4; k++) {
+      acc[k] = vaddq_f64(acc[k], vmulq_f64(vld1q_f64(a + i + 2 * k), vld1q_f64(b + i + 2 * k)));
+    }
+  }
+  for (int k = 0; k < 4; k++) vst1q_f64(lanes + 2 * k, acc[k]);
+  return i;
+}
+
+size_t neon_minmax_i32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const int32_t* src = (const int32_t*)src_v;
+  if (n < 4 || n > (size_t)INT32_MAX) return 0;
+  static const int32_t kLaneIndex[4] = {0, 1, 2, 3};
+  const int32x4_t step = vdupq_n_s32(4);
+  int32x4_t idx = vld1q_s32(kLaneIndex);
+  int32x4_t minv = vld1q_s32(src);
+  int32x4_t maxv = minv;
+  int32x4_t mini = idx;
+  int32x4_t maxi = idx;
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4) {
+    idx = vaddq_s32(idx, step);
+    int32x4_t x = vld1q_s32(src + i);
+    uint32x4_t lt = vcltq_s32(x, minv);
+    uint32x4_t gt = vcgtq_s32(x, maxv);
+    minv = vbslq_s32(lt, x, minv);
+    mini = vbslq_s32(lt, idx, mini);
+    maxv = vbslq_s32(gt, x, maxv);
+    maxi = vbslq_s32(gt, idx, maxi);
+  }
+  int32_t v[2][4], k[2][4];
+  vst1q_s32(v[0], minv);
+  vst1q_s32(v[1], maxv);
+  vst1q_s32(k[0], mini);
+  vst1q_s32(k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 4, r);
+  return i;
+}
+
+size_t neon_minmax_f32(const void* src_v, size_t n, FFIMinMax* r)
+{
+  const float* src = (const float*)src_v;
+  if (n > (size_t)INT32_MAX) return 0;
+  static const int32_t kLaneIndex[4] = {0, 1, 2, 3};
+  const int32x4_t step = vdupq_n_s32(4);
+  int32x4_t idx = vld1q_s32(kLaneIndex);
+  float32x4_t minv = vdupq_n_f32(std::numeric_limits<float>::infinity());
+  float32x4_t maxv = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+  int32x4_t mini = vdupq_n_s32(-1);
+  int32x4_t maxi = mini;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32(src + i);
+    uint32x4_t lt = vcltq_f32(x, minv);
+    uint32x4_t gt = vcgtq_f32(x, maxv);
+    minv = vbslq_f32(lt, x, minv);
+    mini = vbslq_s32(lt, idx, mini);
+    maxv = vbslq_f32(gt, x, maxv);
+    maxi = vbslq_s32(gt, idx, maxi);
+    idx = vaddq_s32(idx, step);
+  }
+  float v[2][4];
+  int32_t k[2][4];
+  vst1q_f32(v[0], minv);
+  vst1q_f32(v[1], maxv);
+  vst1q_s32(k[0], mini);
+  vst1q_s32(k[1], maxi);
+  merge_minmax_lanes(v[0], k[0], v[1], k[1], 4, r);
+  return i;
+}
+
+size_t neon_count_byte(const uint8_t* src, uint8_t byte, size_t n, uint64_t* total)
+{
+  const uint8x16_t needle = vdupq_n_u8(byte);
+  const size_t end = n & ~(size_t)15;
+  uint64x2_t sums = vdupq_n_u64(0);
+  size_t i = 0;
+  while (i < end) {
+    const size_t block_end = std::min(end, i + 255 * 16);
+    uint8x16_t acc = vdupq_n_u8(0);
+    for (; i < block_end; i += 16) acc = vsubq_u8(acc, vceqq_u8(vld1q_u8(src + i), needle));
+    sums = vpadalq_u32(sums, vpaddlq_u16(vpaddlq_u8(acc)));
+  }
+  *total += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+  return i;
+}
+
+#endif // FFI_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// 分派
+// ---------------------------------------------------------------------------
+
+typedef void (*FillFn)(uint8_t* dst, size_t bytes, const uint8_t* pattern);
+
+struct KernelEntry {
+  FFIElemType src;
+  FFIElemType dst;
+  VectorFn fn;
+};
+
+// 归约内核，为空的项走标量实现
+struct ReduceKernels {
+  SumIntFn sum_u8;
+  SumIntFn sum_i32;
+  SumFloatFn sum_f32;
+  SumFloatFn sum_f64;
+  DotFn dot_f32;
+  DotFn dot_f64;
+  MinMaxFn minmax_i32;
+  MinMaxFn minmax_f32;
+  CountFn count_byte;
+};
+
+struct KernelSet {
+  VectorFn convert[FFI_ELEM_COUNT][FFI_ELEM_COUNT];
+  FillFn fill;
+  ReduceKernels reduce;
+};
+
+void build_kernel_set(KernelSet* set, const KernelEntry* entries, size_t count, FillFn fill,
+                      const ReduceKernels& reduce)
+{
+  memset(set->convert, 0, sizeof(set->convert));
+  for (size_t i = 0; i < count; i++) {
+    set->convert[entries[i].src][entries[i].dst] = entries[i].fn;
+  }
+  set->fill = fill;
+  set->reduce = reduce;
+}
+
+struct Dispatch {
+  KernelSet sets[4];          // 按 FFISimdLevel 索引
+  FFISimdLevel best;
+  std::atomic<uint8_t> current;
+
+  Dispatch() : best(FFI_SIMD_SCALAR), current(FFI_SIMD_SCALAR)
+  {
+    const ReduceKernels scalar = {};
+    for (auto& set : sets) build_kernel_set(&set, nullptr, 0, fill_pattern_scalar, scalar);
+
+#ifdef FFI_SIMD_X86
+    static const KernelEntry sse2[] = {
+      {FFI_ELEM_UINT8, FFI_ELEM_FLOAT32, sse2_u8_to_f32},
+      {FFI_ELEM_INT16, FFI_ELEM_FLOAT32, sse2_i16_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_UINT8, sse2_f32_to_u8},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT16, sse2_f32_to_i16},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT32, sse2_f32_to_f32},
+      {FFI_ELEM_INT32, FFI_ELEM_FLOAT32, sse2_i32_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT32, sse2_f32_to_i32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT64, sse2_f32_to_f64},
+      {FFI_ELEM_FLOAT64, FFI_ELEM_FLOAT32, sse2_f64_to_f32},
+    };
+    static const KernelEntry avx2[] = {
+      {FFI_ELEM_UINT8, FFI_ELEM_FLOAT32, avx2_u8_to_f32},
+      {FFI_ELEM_INT16, FFI_ELEM_FLOAT32, avx2_i16_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_UINT8, avx2_f32_to_u8},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT16, avx2_f32_to_i16},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT32, avx2_f32_to_f32},
+      {FFI_ELEM_INT32, FFI_ELEM_FLOAT32, avx2_i32_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT32, avx2_f32_to_i32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT64, avx2_f32_to_f64},
+      {FFI_ELEM_FLOAT64, FFI_ELEM_FLOAT32, avx2_f64_to_f32},
+    };
+    static const ReduceKernels sse2_reduce = {
+      sse2_sum_u8, sse2_sum_i32, sse2_sum_f32, sse2_sum_f64, sse2_dot_f32, sse2_dot_f64,
+      sse2_minmax_i32, sse2_minmax_f32, sse2_count_byte,
+    };
+    static const ReduceKernels avx2_reduce = {
+      avx2_sum_u8, avx2_sum_i32, avx2_sum_f32, avx2_sum_f64, avx2_dot_f32, avx2_dot_f64,
+      avx2_minmax_i32, avx2_minmax_f32, avx2_count_byte,
+    };
+    // SSE2 是 x86-64 的基线指令集
+    build_kernel_set(&sets[FFI_SIMD_SSE2], sse2, sizeof(sse2) / sizeof(sse2[0]), sse2_fill_pattern,
+                     sse2_reduce);
+    build_kernel_set(&sets[FFI_SIMD_AVX2], avx2, sizeof(avx2) / sizeof(avx2[0]), avx2_fill_pattern,
+                     avx2_reduce);
+    __builtin_cpu_init();
+    best = __builtin_cpu_supports("avx2") ? FFI_SIMD_AVX2 : FFI_SIMD_SSE2;
+#elif defined(FFI_SIMD_NEON)
+    static const KernelEntry neon[] = {
+      {FFI_ELEM_UINT8, FFI_ELEM_FLOAT32, neon_u8_to_f32},
+      {FFI_ELEM_INT16, FFI_ELEM_FLOAT32, neon_i16_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_UINT8, neon_f32_to_u8},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT16, neon_f32_to_i16},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT32, neon_f32_to_f32},
+      {FFI_ELEM_INT32, FFI_ELEM_FLOAT32, neon_i32_to_f32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_INT32, neon_f32_to_i32},
+      {FFI_ELEM_FLOAT32, FFI_ELEM_FLOAT64, neon_f32_to_f64},
+      {FFI_ELEM_FLOAT64, FFI_ELEM_FLOAT32, neon_f64_to_f32},
+    };
+    static const ReduceKernels neon_reduce = {
+      neon_sum_u8, neon_sum_i32, neon_sum_f32, neon_sum_f64, neon_dot_f32, neon_dot_f64,
+      neon_minmax_i32, neon_minmax_f32, neon_count_byte,
+    };
+    // AArch64 总是带 NEON
+    build_kernel_set(&sets[FFI_SIMD_NEON], neon, sizeof(neon) / sizeof(neon[0]), neon_fill_pattern,
+                     neon_reduce);
+    best = FFI_SIMD_NEON;
+#endif
+    current.store(best);
+  }
+
+  const KernelSet& active() const
+  {
+    return sets[current.load(std::memory_order_relaxed)];
+  }
+};
+
+Dispatch& dispatch()
+{
+  static Dispatch d;
+  return d;
+}
+
+bool level_supported(FFISimdLevel level, FFISimdLevel best)
+{
+  if (level == FFI_SIMD_SCALAR) return true;
+  if (best == FFI_SIMD_NEON) return level == FFI_SIMD_NEON;
+  return level != FFI_SIMD_NEON && level <= best;
+}
+
+template <typename D>
+void store_fill_value(uint8_t* out, double value)
+{
+  D v = to_elem<D, double>(value, false);
+  memcpy(out, &v, sizeof(D));
+}
+
+} // namespace
+
+bool ffi_elem_parse(const char* name, FFIElemType* type)
+{
+  static const struct { const char* name; FFIElemType type; } names[] = {
+    {"int8", FFI_ELEM_INT8}, {"char", FFI_ELEM_INT8},
+    {"uint8", FFI_ELEM_UINT8}, {"uchar", FFI_ELEM_UINT8},
+    {"int16", FFI_ELEM_INT16},
+    {"uint16", FFI_ELEM_UINT16},
+    {"int", FFI_ELEM_INT32}, {"int32", FFI_ELEM_INT32},
+    {"uint", FFI_ELEM_UINT32}, {"uint32", FFI_ELEM_UINT32},
+    {"float", FFI_ELEM_FLOAT32}, {"float32", FFI_ELEM_FLOAT32},
+    {"double", FFI_ELEM_FLOAT64}, {"float64", FFI_ELEM_FLOAT64},
+  };
+  for (const auto& entry : names) {
+    if (strcmp(name, entry.name) == 0) {
+      *type = entry.type;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ffi_elem_size(FFIElemType type)
+{
+  static const size_t sizes[FFI_ELEM_COUNT] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return type < FFI_ELEM_COUNT ? sizes[type] : 0;
+}
+
+void ffi_mem_convert(void* dst, FFIElemType dst_type, const void* src, FFIElemType src_type,
+                     size_t count, const FFIConvertOptions& opts)
+{
+  if (!count) return;
+  if (src_type == dst_type && is_identity(opts)) {
+    if (dst != src) memmove(dst, src, count * ffi_elem_size(src_type));
+    return;
+  }
+
+  size_t done = 0;
+  VectorFn vec = dispatch().active().convert[src_type][dst_type];
+  if (vec) done = vec(dst, src, count, opts);
+  if (done < count) {
+    kScalarConvert[src_type][dst_type]((uint8_t*)dst + done * ffi_elem_size(dst_type),
+                                       (const uint8_t*)src + done * ffi_elem_size(src_type),
+                                       count - done, opts);
+  }
+}
+
+void ffi_mem_fill(void* dst, FFIElemType type, double value, size_t count)
+{
+  if (!count) return;
+
+  // 构造 16 字节的重复模式，1/2/4/8 字节元素都能整除
+  uint8_t pattern[16];
+  size_t elem = ffi_elem_size(type);
+  switch (type) {
+    case FFI_ELEM_INT8: store_fill_value<int8_t>(pattern, value); break;
+    case FFI_ELEM_UINT8: store_fill_value<uint8_t>(pattern, value); break;
+    case FFI_ELEM_INT16: store_fill_value<int16_t>(pattern, value); break;
+    case FFI_ELEM_UINT16: store_fill_value<uint16_t>(pattern, value); break;
+    case FFI_ELEM_INT32: store_fill_value<int32_t>(pattern, value); break;
+    case FFI_ELEM_UINT32: store_fill_value<uint32_t>(pattern, value); break;
+    case FFI_ELEM_FLOAT32: store_fill_value<float>(pattern, value); break;
+    case FFI_ELEM_FLOAT64: store_fill_value<double>(pattern, value); break;
+    default: return;
+  }
+  if (elem == 1) {
+    memset(dst, pattern[0], count);
+    return;
+  }
+  for (size_t i = elem; i < sizeof(pattern); i += elem) memcpy(pattern + i, pattern, elem);
+  dispatch().active().fill((uint8_t*)dst, count * elem, pattern);
+}
+
+void ffi_mem_copy(void* dst, const void* src, size_t bytes)
+{
+  // libc 的 memmove 已经按 CPU 选择了向量实现
+  if (bytes && dst != src) memmove(dst, src, bytes);
+}
+
+double ffi_mem_sum(const void* src, FFIElemType type, size_t count)
+{
+  const ReduceKernels& k = dispatch().active().reduce;
+  switch (type) {
+    case FFI_ELEM_INT8: return sum_int<int8_t>(src, count, nullptr);
+    case FFI_ELEM_UINT8: return sum_int<uint8_t>(src, count, k.sum_u8);
+    case FFI_ELEM_INT16: return sum_int<int16_t>(src, count, nullptr);
+    case FFI_ELEM_UINT16: return sum_int<uint16_t>(src, count, nullptr);
+    case FFI_ELEM_INT32: return sum_int<int32_t>(src, count, k.sum_i32);
+    case FFI_ELEM_UINT32: return sum_int<uint32_t>(src, count, nullptr);
+    case FFI_ELEM_FLOAT32: return sum_float<float>(src, count, k.sum_f32);
+    case FFI_ELEM_FLOAT64: return sum_float<double>(src, count, k.sum_f64);
+    default: return 0;
+  }
+}
+
+FFIMinMax ffi_mem_minmax(const void* src, FFIElemType type, size_t count)
+{
+  const ReduceKernels& k = dispatch().active().reduce;
+  switch (type) {
+    case FFI_ELEM_INT8: return minmax<int8_t>(src, count, nullptr);
+    case FFI_ELEM_UINT8: return minmax<uint8_t>(src, count, nullptr);
+    case FFI_ELEM_INT16: return minmax<int16_t>(src, count, nullptr);
+    case FFI_ELEM_UINT16: return minmax<uint16_t>(src, count, nullptr);
+    case FFI_ELEM_INT32: return minmax<int32_t>(src, count, k.minmax_i32);
+    case FFI_ELEM_UINT32: return minmax<uint32_t>(src, count, nullptr);
+    case FFI_ELEM_FLOAT32: return minmax<float>(src, count, k.minmax_f32);
+    case FFI_ELEM_FLOAT64: return minmax<double>(src, count, nullptr);
+    default: return FFIMinMax();
+  }
+}
+
+double ffi_mem_dot(const void* a, const void* b, FFIElemType type, size_t count)
+{
+  const ReduceKernels& k = dispatch().active().reduce;
+  switch (type) {
+    case FFI_ELEM_INT8: return dot_int<int8_t>(a, b, count);
+    case FFI_ELEM_UINT8: return dot_int<uint8_t>(a, b, count);
+    case FFI_ELEM_INT16: return dot_int<int16_t>(a, b, count);
+    case FFI_ELEM_UINT16: return dot_int<uint16_t>(a, b, count);
+    case FFI_ELEM_INT32: return dot_int<int32_t>(a, b, count);
+    case FFI_ELEM_UINT32: return dot_int<uint32_t>(a, b, count);
+    case FFI_ELEM_FLOAT32: return dot_float<float>(a, b, count, k.dot_f32);
+    case FFI_ELEM_FLOAT64: return dot_float<double>(a, b, count, k.dot_f64);
+    default: return 0;
+  }
+}
+
+void ffi_mem_histogram(const void* src, FFIElemType type, size_t count, double lo, double hi,
+                       uint64_t* counts, size_t bins)
+{
+  if (!count || !bins || !(lo < hi)) return;
+  // 8 位元素覆盖整个取值范围的 256 个区间正好每个取值一个区间，结果与通用实现相同
+  if (bins == 256 && type == FFI_ELEM_UINT8 && lo == 0 && hi == 255) {
+    histogram_bytes((const uint8_t*)src, count, 0, counts);
+    return;
+  }
+  if (bins == 256 && type == FFI_ELEM_INT8 && lo == -128 && hi == 127) {
+    histogram_bytes((const uint8_t*)src, count, 0x80, counts);
+    return;
+  }
+  switch (type) {
+    case FFI_ELEM_INT8: histogram_scalar<int8_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_UINT8: histogram_scalar<uint8_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_INT16: histogram_scalar<int16_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_UINT16: histogram_scalar<uint16_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_INT32: histogram_scalar<int32_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_UINT32: histogram_scalar<uint32_t>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_FLOAT32: histogram_scalar<float>(src, count, lo, hi, counts, bins); break;
+    case FFI_ELEM_FLOAT64: histogram_scalar<double>(src, count, lo, hi, counts, bins); break;
+    default: break;
+  }
+}
+
+uint64_t ffi_mem_count_byte(const void* src_v, uint8_t byte, size_t bytes)
+{
+  const uint8_t* src = (const uint8_t*)src_v;
+  uint64_t total = 0;
+  CountFn vec = dispatch().active().reduce.count_byte;
+  size_t i = vec ? vec(src, byte, bytes, &total) : 0;
+  for (; i < bytes; i++) total += src[i] == byte;
+  return total;
+}
+
+size_t ffi_mem_find(const void* src, size_t bytes, const void* needle, size_t needle_len)
+{
+  // 与 ffi_mem_copy 一样直接用 libc 的向量化实现
+  if (!needle_len) return 0;
+  const void* hit = needle_len == 1 ? memchr(src, *(const uint8_t*)needle, bytes)
+                                    : memmem(src, bytes, needle, needle_len);
+  return hit ? (size_t)((const uint8_t*)hit - (const uint8_t*)src) : SIZE_MAX;
+}
+
+FFISimdLevel ffi_simd_level()
+{
+  return (FFISimdLevel)dispatch().current.load();
+}
+
+FFISimdLevel ffi_simd_set_level(FFISimdLevel level)
+{
+  Dispatch& d = dispatch();
+  if (!level_supported(level, d.best)) level = d.best;
+  d.current.store(level);
+  return level;
+}
+
+bool ffi_simd_parse_level(const char* name, FFISimdLevel* level)
+{
+  static const char* const names[] = {"scalar", "sse2", "avx2", "neon"};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(name, names[i]) == 0) {
+      *level = (FFISimdLevel)i;
+      return true;
+    }
+  }
+  if (strcmp(name, "auto") == 0) {
+    *level = dispatch().best;
+    return true;
+  }
+  return false;
+}
+
+const char* ffi_simd_level_name(FFISimdLevel level)
+{
+  switch (level) {
+    case FFI_SIMD_SCALAR: return "scalar";
+    case FFI_SIMD_SSE2: return "sse2";
+    case FFI_SIMD_AVX2: return "avx2";
+    case FFI_SIMD_NEON: return "neon";
+  }
+  return "unknown";
+}
@@ -0,0 +1,89 @@
+// ffi_simd.h
+// 原生缓冲区之间的元素类型转换、填充与复制，以及归约与查找（ffi.mem）。
+//
+// 常用的类型组合有 SSE2/AVX2（x86-64）和 NEON（AArch64）实现，运行时按 CPU
+// 支持情况选择；其余组合以及向量宽度之外的尾部元素走标量实现，两者结果一致。
+#ifndef FFI_SIMD_H
+#define FFI_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 与 readArray/writeArray 支持的元素类型对应
+enum FFIElemType : uint8_t {
+  FFI_ELEM_INT8,
+  FFI_ELEM_UINT8,
+  FFI_ELEM_INT16,
+  FFI_ELEM_UINT16,
+  FFI_ELEM_INT32,
+  FFI_ELEM_UINT32,
+  FFI_ELEM_FLOAT32,
+  FFI_ELEM_FLOAT64,
+  FFI_ELEM_COUNT
+};
+
+enum FFISimdLevel : uint8_t {
+  FFI_SIMD_SCALAR,
+  FFI_SIMD_SSE2,
+  FFI_SIMD_AVX2,
+  FFI_SIMD_NEON,
+};
+
+// 转换规则：dst = src * scale + offset
+// - 转为整数时默认向零截断，round 为 true 时按偶数舍入；NaN 变为 0
+// - 涉及浮点或缩放的转换，超出目标范围的值总是截到边界；
+//   转为浮点时有限值截到 ±max，NaN 和 ±Inf 原样保留（按 float 计算的缩放溢出时得到 ±Inf）
+// - 纯整数之间的转换默认按 C 的强制转换回绕，saturate 为 true 时截到边界
+struct FFIConvertOptions {
+  double scale = 1.0;
+  double offset = 0.0;
+  bool saturate = false;
+  bool round = false;
+};
+
+// "int8"/"char", "uint8"/"uchar", "int16", "uint16", "int"/"int32",
+// "uint"/"uint32", "float"/"float32", "double"/"float64"
+bool ffi_elem_parse(const char* name, FFIElemType* type);
+size_t ffi_elem_size(FFIElemType type);
+
+// dst 与 src 不能部分重叠；元素大小相同时可以原地转换
+void ffi_mem_convert(void* dst, FFIElemType dst_type, const void* src, FFIElemType src_type,
+                     size_t count, const FFIConvertOptions& opts);
+// value 按 float64 -> type 的规则转换（截到边界）后写入 count 个元素
+void ffi_mem_fill(void* dst, FFIElemType type, double value, size_t count);
+// 允许重叠
+void ffi_mem_copy(void* dst, const void* src, size_t bytes);
+
+// ---- 归约与查找 ----
+//
+// 整数在 64 位整数中精确累加（结果转为 double，超过 2^53 时丢失精度）；浮点在
+// double 中按固定的 8 路交错顺序累加（第 i 个元素加到第 i % 8 路），最后按固定
+// 顺序合并，因此各实现的结果逐位一致，但可能与从头到尾顺序累加的结果略有不同。
+
+struct FFIMinMax {
+  double min = 0;
+  double max = 0;
+  size_t min_index = SIZE_MAX;   // 首次出现的位置；没有有效元素（count 为 0 或全是 NaN）时为 SIZE_MAX
+  size_t max_index = SIZE_MAX;
+};
+
+double ffi_mem_sum(const void* src, FFIElemType type, size_t count);
+// NaN 元素被跳过
+FFIMinMax ffi_mem_minmax(const void* src, FFIElemType type, size_t count);
+double ffi_mem_dot(const void* a, const void* b, FFIElemType type, size_t count);
+// 把 [lo, hi] 等分为 bins 个区间，counts[k] 加上落在第 k 个区间的元素数（等于 hi 的元素
+// 计入最后一个区间）；范围外的元素和 NaN 不计入。要求 bins >= 1 且 lo < hi
+void ffi_mem_histogram(const void* src, FFIElemType type, size_t count, double lo, double hi,
+                       uint64_t* counts, size_t bins);
+// 值等于 byte 的字节数
+uint64_t ffi_mem_count_byte(const void* src, uint8_t byte, size_t bytes);
+// needle 第一次出现的字节偏移，找不到时返回 SIZE_MAX；needle_len 为 0 时返回 0
+size_t ffi_mem_find(const void* src, size_t bytes, const void* needle, size_t needle_len);
+
+// 当前使用的实现；set 会把请求的级别限制在 CPU 支持的范围内并返回实际级别
+FFISimdLevel ffi_simd_level();
+FFISimdLevel ffi_simd_set_level(FFISimdLevel level);
+bool ffi_simd_parse_level(const char* name, FFISimdLevel* level);
+const char* ffi_simd_level_name(FFISimdLevel level);
+
+#endif /* FFI_SIMD_H */
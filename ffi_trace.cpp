@@ -0,0 +1,320 @@
+// ffi_trace.cpp
+// FFI 事件追踪实现。
+//
+// 每个线程第一次记录事件时分配自己的环形缓冲区并登记到全局表中，
+// 之后写入只由所属线程完成（单生产者），无需加锁；导出时在全局锁下
+// 读取每个缓冲区最近的 capacity 个事件。
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "ffi_trace.h"
+
+std::atomic<bool> g_ffi_trace_enabled(false);
+
+namespace {
+
+struct TraceRing {
+  std::unique_ptr<FFITraceEvent[]> events;
+  uint32_t capacity = 0;               // 2 的幂
+  std::atomic<uint64_t> head{0};       // 累计写入的事件数
+  uint64_t tid = 0;
+  // 以下字段只由所属线程访问
+  uint32_t depth = 0;                  // 当前嵌套深度
+  bool region_sampled = false;         // 最外层区间是否被采样
+  uint32_t sample_counter = 0;
+};
+
+std::mutex g_rings_mutex;
+std::vector<std::unique_ptr<TraceRing>> g_rings;
+std::atomic<uint32_t> g_buffer_events(1u << 16);
+std::atomic<uint32_t> g_sample_rate(1);
+
+std::shared_timed_mutex g_symbols_mutex;
+std::vector<std::string> g_symbol_names;                    // id - 1 -> 名称
+std::unordered_map<std::string, uint32_t> g_symbol_by_name;
+std::unordered_map<uintptr_t, uint32_t> g_symbol_by_addr;
+
+thread_local TraceRing* t_ring = nullptr;
+
+uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t current_tid()
+{
+#ifdef __linux__
+  return (uint64_t)syscall(SYS_gettid);
+#else
+  static std::atomic<uint64_t> next_tid(1);
+  thread_local uint64_t tid = next_tid.fetch_add(1);
+  return tid;
+#endif
+}
+
+uint32_t round_up_pow2(uint32_t v)
+{
+  uint32_t p = 16;
+  while (p < v && p < (1u << 30)) p <<= 1;
+  return p;
+}
+
+// 获取当前线程的缓冲区，容量变化时在全局锁下重新分配
+TraceRing* thread_ring()
+{
+  uint32_t wanted = g_buffer_events.load(std::memory_order_relaxed);
+  TraceRing* ring = t_ring;
+  if (ring && ring->capacity == wanted) return ring;
+
+  std::lock_guard<std::mutex> lock(g_rings_mutex);
+  if (!ring) {
+    g_rings.emplace_back(new TraceRing());
+    ring = g_rings.back().get();
+    ring->tid = current_tid();
+    t_ring = ring;
+  }
+  ring->events.reset(new FFITraceEvent[wanted]);
+  ring->capacity = wanted;
+  ring->head.store(0, std::memory_order_relaxed);
+  return ring;
+}
+
+inline void push_event(TraceRing* ring, FFITraceKind kind, FFITracePhase phase,
+                       uint32_t symbol_id, uint64_t value)
+{
+  uint64_t h = ring->head.load(std::memory_order_relaxed);
+  FFITraceEvent& ev = ring->events[h & (ring->capacity - 1)];
+  ev.ts_ns = now_ns();
+  ev.value = value;
+  ev.symbol_id = symbol_id;
+  ev.kind = kind;
+  ev.phase = phase;
+  ring->head.store(h + 1, std::memory_order_release);
+}
+
+bool sample_top_level(TraceRing* ring)
+{
+  uint32_t rate = g_sample_rate.load(std::memory_order_relaxed);
+  if (rate <= 1) return true;
+  return (ring->sample_counter++ % rate) == 0;
+}
+
+const char* kind_category(uint8_t kind)
+{
+  switch (kind) {
+    case FFI_TRACE_CALL: return "ffi.call";
+    case FFI_TRACE_CALLBACK: return "ffi.callback";
+    case FFI_TRACE_MALLOC:
+    case FFI_TRACE_FREE: return "ffi.mem";
+    case FFI_TRACE_DLOPEN:
+    case FFI_TRACE_DLSYM: return "ffi.dl";
+  }
+  return "ffi";
+}
+
+const char* kind_name(uint8_t kind)
+{
+  switch (kind) {
+    case FFI_TRACE_CALL: return "call";
+    case FFI_TRACE_CALLBACK: return "callback";
+    case FFI_TRACE_MALLOC: return "malloc";
+    case FFI_TRACE_FREE: return "free";
+    case FFI_TRACE_DLOPEN: return "dlopen";
+    case FFI_TRACE_DLSYM: return "dlsym";
+  }
+  return "unknown";
+}
+
+void append_json_string(std::string& out, const std::string& s)
+{
+  out += '"';
+  for (char c : s) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+void ffi_trace_start(uint32_t buffer_events, uint32_t sample_rate)
+{
+  if (buffer_events) g_buffer_events.store(round_up_pow2(buffer_events));
+  g_sample_rate.store(sample_rate ? sample_rate : 1);
+  g_ffi_trace_enabled.store(true);
+}
+
+void ffi_trace_stop()
+{
+  g_ffi_trace_enabled.store(false);
+}
+
+void ffi_trace_clear()
+{
+  std::lock_guard<std::mutex> lock(g_rings_mutex);
+  for (auto& ring : g_rings) {
+    ring->head.store(0, std::memory_order_release);
+  }
+}
+
+uint32_t ffi_trace_intern(const char* name)
+{
+  std::string key(name ? name : "");
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(g_symbols_mutex);
+    auto it = g_symbol_by_name.find(key);
+    if (it != g_symbol_by_name.end()) return it->second;
+  }
+  std::unique_lock<std::shared_timed_mutex> lock(g_symbols_mutex);
+  auto it = g_symbol_by_name.find(key);
+  if (it != g_symbol_by_name.end()) return it->second;
+  g_symbol_names.push_back(key);
+  uint32_t id = (uint32_t)g_symbol_names.size();
+  g_symbol_by_name.emplace(key, id);
+  return id;
+}
+
+void ffi_trace_bind_address(uint32_t symbol_id, const void* addr)
+{
+  if (!symbol_id || !addr) return;
+  std::unique_lock<std::shared_timed_mutex> lock(g_symbols_mutex);
+  g_symbol_by_addr[(uintptr_t)addr] = symbol_id;
+}
+
+uint32_t ffi_trace_symbol_id(const void* addr)
+{
+  std::shared_lock<std::shared_timed_mutex> lock(g_symbols_mutex);
+  auto it = g_symbol_by_addr.find((uintptr_t)addr);
+  return it == g_symbol_by_addr.end() ? 0 : it->second;
+}
+
+bool ffi_trace_begin(FFITraceKind kind, uint32_t symbol_id, uint64_t value)
+{
+  TraceRing* ring = thread_ring();
+  if (ring->depth++ == 0) {
+    ring->region_sampled = sample_top_level(ring);
+  }
+  if (ring->region_sampled) {
+    push_event(ring, kind, FFI_TRACE_BEGIN, symbol_id, value);
+  }
+  return ring->region_sampled;
+}
+
+void ffi_trace_end(bool sampled, FFITraceKind kind, uint32_t symbol_id, uint64_t value)
+{
+  TraceRing* ring = thread_ring();
+  if (ring->depth > 0) ring->depth--;
+  if (sampled) {
+    push_event(ring, kind, FFI_TRACE_END, symbol_id, value);
+  }
+}
+
+void ffi_trace_instant(FFITraceKind kind, uint32_t symbol_id, uint64_t value)
+{
+  TraceRing* ring = thread_ring();
+  bool sampled = ring->depth > 0 ? ring->region_sampled : sample_top_level(ring);
+  if (sampled) {
+    push_event(ring, kind, FFI_TRACE_INSTANT, symbol_id, value);
+  }
+}
+
+std::string ffi_trace_export_json()
+{
+  std::vector<std::string> names;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(g_symbols_mutex);
+    names = g_symbol_names;
+  }
+
+  std::string out;
+  out.reserve(4096);
+  out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  char buf[256];
+  long pid = (long)getpid();
+
+  std::lock_guard<std::mutex> lock(g_rings_mutex);
+  for (auto& ring : g_rings) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(head, ring->capacity);
+    // 环形缓冲区回绕后最早的 E 事件可能失去对应的 B，跳过它们
+    int64_t depth = 0;
+    for (uint64_t i = head - count; i < head; i++) {
+      const FFITraceEvent& ev = ring->events[i & (ring->capacity - 1)];
+      if (ev.phase == FFI_TRACE_END) {
+        if (depth == 0) continue;
+        depth--;
+      } else if (ev.phase == FFI_TRACE_BEGIN) {
+        depth++;
+      }
+
+      if (!first) out += ',';
+      first = false;
+
+      out += "{\"name\":";
+      if (ev.symbol_id && ev.symbol_id <= names.size()) {
+        append_json_string(out, names[ev.symbol_id - 1]);
+      } else if (ev.kind == FFI_TRACE_MALLOC || ev.kind == FFI_TRACE_FREE) {
+        append_json_string(out, kind_name(ev.kind));
+      } else {
+        snprintf(buf, sizeof(buf), "%s 0x%llx", kind_name(ev.kind), (unsigned long long)ev.value);
+        append_json_string(out, buf);
+      }
+      snprintf(buf, sizeof(buf),
+               ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%ld,\"tid\":%llu",
+               kind_category(ev.kind), (char)ev.phase,
+               (unsigned long long)(ev.ts_ns / 1000), (unsigned)(ev.ts_ns % 1000),
+               pid, (unsigned long long)ring->tid);
+      out += buf;
+      if (ev.phase == FFI_TRACE_INSTANT) {
+        out += ",\"s\":\"t\"";
+      }
+      if (ev.kind == FFI_TRACE_MALLOC) {
+        snprintf(buf, sizeof(buf), ",\"args\":{\"size\":%llu}", (unsigned long long)ev.value);
+      } else if (ev.kind == FFI_TRACE_DLOPEN && ev.phase == FFI_TRACE_BEGIN) {
+        // 句柄在 dlopen 返回后才确定，只记录在 E 事件上（viewer 会合并 B/E 的 args）
+        buf[0] = '\0';
+      } else {
+        snprintf(buf, sizeof(buf), ",\"args\":{\"%s\":\"0x%llx\"}",
+                 ev.kind == FFI_TRACE_DLOPEN ? "handle" : "ptr", (unsigned long long)ev.value);
+      }
+      out += buf;
+      out += '}';
+    }
+  }
+  out += "]}";
+  return out;
+}
+
+bool ffi_trace_dump_file(const char* path)
+{
+  std::string json = ffi_trace_export_json();
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+  ok = (fclose(f) == 0) && ok;
+  return ok;
+}
@@ -0,0 +1,127 @@
+// ffi_trace.h
+// FFI 事件追踪：每线程无锁环形缓冲区 + Chrome trace-event JSON 导出。
+#ifndef FFI_TRACE_H
+#define FFI_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// USDT 探针：以 -DFFI_ENABLE_USDT 编译（CMake 选项 FFI_USDT）且系统提供 <sys/sdt.h> 时，
+// call 与 callback 类别的 FFITraceScope 在进入和退出时各触发一个探针（provider 为
+// qjs_ffi：call__entry/call__return/callback__entry/callback__return），
+// 参数为 (函数/闭包地址, 符号 id)。未挂载时探针只是一条 nop，不受追踪开关影响。
+#if defined(FFI_ENABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FFI_HAVE_USDT 1
+#endif
+#endif
+
+// 事件类别
+enum FFITraceKind : uint8_t {
+  FFI_TRACE_CALL = 0,      // js_ffi_call 中的 ffi_call
+  FFI_TRACE_CALLBACK,      // C -> JS 回调 (callback_wrapper)
+  FFI_TRACE_MALLOC,        // ffi.malloc
+  FFI_TRACE_FREE,          // ffi.free
+  FFI_TRACE_DLOPEN,        // ffi.open
+  FFI_TRACE_DLSYM,         // ffi.symbol
+};
+
+// 事件阶段，与 Chrome trace-event 的 "ph" 字段对应
+enum FFITracePhase : uint8_t {
+  FFI_TRACE_BEGIN = 'B',
+  FFI_TRACE_END = 'E',
+  FFI_TRACE_INSTANT = 'i',
+};
+
+struct FFITraceEvent {
+  uint64_t ts_ns;      // 单调时钟时间戳（纳秒）
+  uint64_t value;      // 附加数据：指针地址或字节数
+  uint32_t symbol_id;  // ffi_trace_intern 返回的符号 id，0 表示未知
+  uint8_t kind;        // FFITraceKind
+  uint8_t phase;       // FFITracePhase
+};
+
+// 追踪总开关，关闭时热路径只有一次 relaxed 读
+extern std::atomic<bool> g_ffi_trace_enabled;
+
+static inline bool ffi_trace_enabled()
+{
+  return g_ffi_trace_enabled.load(std::memory_order_relaxed);
+}
+
+// 开始追踪。buffer_events 为每个线程环形缓冲区的事件数（向上取 2 的幂），
+// sample_rate 为 N 表示每 N 个顶层区间记录 1 个（1 表示全部记录）。
+void ffi_trace_start(uint32_t buffer_events, uint32_t sample_rate);
+void ffi_trace_stop();
+// 丢弃所有线程已记录的事件
+void ffi_trace_clear();
+
+// 为符号名分配 id，同名重复注册返回同一个 id（不受追踪开关影响）
+uint32_t ffi_trace_intern(const char* name);
+// 把地址（函数指针、闭包、库句柄）关联到符号 id
+void ffi_trace_bind_address(uint32_t symbol_id, const void* addr);
+// 按地址查找符号 id，未注册返回 0
+uint32_t ffi_trace_symbol_id(const void* addr);
+
+// 区间开始：返回是否被采样。嵌套区间继承最外层的采样结果；
+// 只要调用了 begin 就必须调用 end，以维持每线程的嵌套深度。
+bool ffi_trace_begin(FFITraceKind kind, uint32_t symbol_id, uint64_t value);
+void ffi_trace_end(bool sampled, FFITraceKind kind, uint32_t symbol_id, uint64_t value);
+// 瞬时事件（malloc/free），同样受采样率控制
+void ffi_trace_instant(FFITraceKind kind, uint32_t symbol_id, uint64_t value);
+
+// 导出为 Chrome trace-event JSON（可直接在 Perfetto / chrome://tracing 打开）
+std::string ffi_trace_export_json();
+// 写入文件，成功返回 true
+bool ffi_trace_dump_file(const char* path);
+
+// RAII 区间，用于 call / callback 等嵌套场景
+class FFITraceScope
+{
+  FFITraceKind kind_;
+  uint32_t symbol_id_;
+  uint64_t value_;
+  bool entered_;
+  bool sampled_;
+
+public:
+  FFITraceScope(FFITraceKind kind, uint32_t symbol_id, uint64_t value)
+    : kind_(kind), symbol_id_(symbol_id), value_(value), entered_(false), sampled_(false)
+  {
+#ifdef FFI_HAVE_USDT
+    if (kind_ == FFI_TRACE_CALL) {
+      DTRACE_PROBE2(qjs_ffi, call__entry, value_, symbol_id_);
+    } else if (kind_ == FFI_TRACE_CALLBACK) {
+      DTRACE_PROBE2(qjs_ffi, callback__entry, value_, symbol_id_);
+    }
+#endif
+    if (ffi_trace_enabled()) {
+      entered_ = true;
+      sampled_ = ffi_trace_begin(kind_, symbol_id_, value_);
+    }
+  }
+
+  ~FFITraceScope()
+  {
+    if (entered_) {
+      ffi_trace_end(sampled_, kind_, symbol_id_, value_);
+    }
+#ifdef FFI_HAVE_USDT
+    if (kind_ == FFI_TRACE_CALL) {
+      DTRACE_PROBE2(qjs_ffi, call__return, value_, symbol_id_);
+    } else if (kind_ == FFI_TRACE_CALLBACK) {
+      DTRACE_PROBE2(qjs_ffi, callback__return, value_, symbol_id_);
+    }
+#endif
+  }
+
+  // 区间结束时才知道的值（如 dlopen 返回的句柄），写入 E 事件
+  void set_end_value(uint64_t value) { value_ = value; }
+
+  FFITraceScope(const FFITraceScope&) = delete;
+  FFITraceScope& operator=(const FFITraceScope&) = delete;
+};
+
+#endif /* FFI_TRACE_H */
@@ -0,0 +1,323 @@
+// js_allocator.cpp
+// Host-side JSMallocFunctions implementations.
+#include <cstdlib>
+#include <cstring>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#endif
+
+#include "js_allocator.h"
+
+// Per-block bookkeeping overhead reported to QuickJS, as in its default allocator
+static const size_t kMallocOverhead = 8;
+
+// Chunk payload starts after the header, keeping 16-byte alignment
+static const size_t kChunkHeaderSize = 16;
+
+// Size of each class in bytes: 16-byte steps up to 128, 32 up to 256, 64 up to 512
+static const uint32_t kClassSizes[JSAllocator::kNumClasses] = {
+  16, 32, 48, 64, 80, 96, 112, 128,
+  160, 192, 224, 256,
+  320, 384, 448, 512,
+};
+
+// js_malloc_usable_size() receives no JSMallocState, so the pool that owns the
+// current thread's runtime is remembered here.
+static thread_local JSAllocator* t_active_allocator = nullptr;
+
+static int size_to_class(size_t size)
+{
+  if (size <= 128) return size == 0 ? 0 : (int)((size + 15) / 16) - 1;
+  if (size <= 256) return 8 + (int)((size - 129) / 32);
+  return 12 + (int)((size - 257) / 64);
+}
+
+static size_t system_usable_size(const void* ptr)
+{
+#if defined(__APPLE__)
+  return malloc_size(ptr);
+#elif defined(__linux__)
+  return malloc_usable_size(const_cast<void*>(ptr));
+#else
+  (void)ptr;
+  return 0;
+#endif
+}
+
+JSAllocator::JSAllocator(JSAllocatorKind kind) : kind_(kind)
+{
+  t_active_allocator = this;
+}
+
+JSAllocator::~JSAllocator()
+{
+  // Bulk release: every slab goes back at once, whatever is still on the free lists
+  for (auto& entry : chunks_)
+  {
+    free(entry.second);
+  }
+  chunks_.clear();
+  if (t_active_allocator == this)
+  {
+    t_active_allocator = nullptr;
+  }
+}
+
+bool JSAllocator::parse_kind(const char* name, JSAllocatorKind* kind)
+{
+  if (strcmp(name, "system") == 0)
+  {
+    *kind = JSAllocatorKind::System;
+    return true;
+  }
+  if (strcmp(name, "pool") == 0)
+  {
+    *kind = JSAllocatorKind::Pool;
+    return true;
+  }
+  return false;
+}
+
+const char* JSAllocator::kind_name(JSAllocatorKind kind)
+{
+  return kind == JSAllocatorKind::Pool ? "pool" : "system";
+}
+
+const JSMallocFunctions* JSAllocator::functions() const
+{
+  static const JSMallocFunctions mf = {
+    js_malloc_cb,
+    js_free_cb,
+    js_realloc_cb,
+    js_usable_size_cb,
+  };
+  return &mf;
+}
+
+JSAllocator::ChunkHeader* JSAllocator::owning_chunk(const void* ptr) const
+{
+  uintptr_t base = (uintptr_t)ptr & ~(uintptr_t)(kChunkSize - 1);
+  auto it = chunks_.find(base);
+  return it == chunks_.end() ? nullptr : it->second;
+}
+
+bool JSAllocator::refill(int cls)
+{
+  void* mem = nullptr;
+  if (posix_memalign(&mem, kChunkSize, kChunkSize) != 0)
+  {
+    return false;
+  }
+
+  ChunkHeader* chunk = static_cast<ChunkHeader*>(mem);
+  chunk->size_class = (uint32_t)cls;
+  chunks_.emplace((uintptr_t)mem, chunk);
+  stats_.pool_chunks++;
+  stats_.pool_bytes += kChunkSize;
+
+  SizeClass& sc = classes_[cls];
+  sc.bump = static_cast<char*>(mem) + kChunkHeaderSize;
+  sc.bump_end = static_cast<char*>(mem) + kChunkSize;
+  return true;
+}
+
+void* JSAllocator::pool_alloc(size_t size, size_t* usable)
+{
+  if (size > kMaxSmallSize)
+  {
+    void* ptr = malloc(size);
+    if (ptr)
+    {
+      *usable = system_usable_size(ptr);
+      stats_.large_count++;
+    }
+    return ptr;
+  }
+
+  int cls = size_to_class(size);
+  SizeClass& sc = classes_[cls];
+  size_t class_size = kClassSizes[cls];
+  *usable = class_size;
+
+  if (sc.free_list)
+  {
+    FreeNode* node = sc.free_list;
+    sc.free_list = node->next;
+    return node;
+  }
+
+  if (sc.bump + class_size > sc.bump_end && !refill(cls))
+  {
+    return nullptr;
+  }
+  void* ptr = sc.bump;
+  sc.bump += class_size;
+  return ptr;
+}
+
+void JSAllocator::pool_free(void* ptr, size_t* usable)
+{
+  ChunkHeader* chunk = owning_chunk(ptr);
+  if (!chunk)
+  {
+    *usable = system_usable_size(ptr);
+    stats_.large_count--;
+    free(ptr);
+    return;
+  }
+
+  SizeClass& sc = classes_[chunk->size_class];
+  *usable = kClassSizes[chunk->size_class];
+  FreeNode* node = static_cast<FreeNode*>(ptr);
+  node->next = sc.free_list;
+  sc.free_list = node;
+}
+
+size_t JSAllocator::usable_size(const void* ptr) const
+{
+  if (kind_ == JSAllocatorKind::Pool)
+  {
+    ChunkHeader* chunk = owning_chunk(ptr);
+    if (chunk)
+    {
+      return kClassSizes[chunk->size_class];
+    }
+  }
+  return system_usable_size(ptr);
+}
+
+void JSAllocator::on_alloc(size_t usable)
+{
+  stats_.live_bytes += usable;
+  stats_.live_count++;
+  stats_.total_allocs++;
+  if (stats_.live_bytes > stats_.peak_bytes)
+  {
+    stats_.peak_bytes = stats_.live_bytes;
+  }
+}
+
+void JSAllocator::on_free(size_t usable)
+{
+  stats_.live_bytes -= usable;
+  stats_.live_count--;
+}
+
+void* JSAllocator::js_malloc_cb(JSMallocState* s, size_t size)
+{
+  JSAllocator* self = static_cast<JSAllocator*>(s->opaque);
+  if (s->malloc_size + size > s->malloc_limit)
+  {
+    return nullptr;
+  }
+
+  size_t usable = 0;
+  void* ptr;
+  if (self->kind_ == JSAllocatorKind::Pool)
+  {
+    ptr = self->pool_alloc(size, &usable);
+  }
+  else
+  {
+    ptr = malloc(size);
+    if (ptr) usable = system_usable_size(ptr);
+  }
+  if (!ptr)
+  {
+    return nullptr;
+  }
+
+  s->malloc_count++;
+  s->malloc_size += usable + kMallocOverhead;
+  self->on_alloc(usable);
+  return ptr;
+}
+
+void JSAllocator::js_free_cb(JSMallocState* s, void* ptr)
+{
+  if (!ptr)
+  {
+    return;
+  }
+
+  JSAllocator* self = static_cast<JSAllocator*>(s->opaque);
+  size_t usable = 0;
+  if (self->kind_ == JSAllocatorKind::Pool)
+  {
+    self->pool_free(ptr, &usable);
+  }
+  else
+  {
+    usable = system_usable_size(ptr);
+    free(ptr);
+  }
+
+  s->malloc_count--;
+  s->malloc_size -= usable + kMallocOverhead;
+  self->on_free(usable);
+}
+
+void* JSAllocator::js_realloc_cb(JSMallocState* s, void* ptr, size_t size)
+{
+  if (!ptr)
+  {
+    return size == 0 ? nullptr : js_malloc_cb(s, size);
+  }
+  if (size == 0)
+  {
+    js_free_cb(s, ptr);
+    return nullptr;
+  }
+
+  JSAllocator* self = static_cast<JSAllocator*>(s->opaque);
+  size_t old_usable = self->usable_size(ptr);
+
+  if (self->kind_ == JSAllocatorKind::Pool)
+  {
+    ChunkHeader* chunk = self->owning_chunk(ptr);
+    if (chunk && size <= old_usable)
+    {
+      // Still fits the slot; shrinking within a class keeps the block
+      return ptr;
+    }
+    if (chunk || size <= kMaxSmallSize)
+    {
+      // Moving between classes or between pool and malloc
+      void* new_ptr = js_malloc_cb(s, size);
+      if (!new_ptr)
+      {
+        return nullptr;
+      }
+      memcpy(new_ptr, ptr, old_usable < size ? old_usable : size);
+      js_free_cb(s, ptr);
+      return new_ptr;
+    }
+    // Large to large: let realloc grow in place when it can
+  }
+
+  if (s->malloc_size + size - old_usable > s->malloc_limit)
+  {
+    return nullptr;
+  }
+  void* new_ptr = realloc(ptr, size);
+  if (!new_ptr)
+  {
+    return nullptr;
+  }
+  size_t new_usable = system_usable_size(new_ptr);
+  s->malloc_size += new_usable - old_usable;
+  self->stats_.live_bytes += new_usable - old_usable;
+  if (self->stats_.live_bytes > self->stats_.peak_bytes)
+  {
+    self->stats_.peak_bytes = self->stats_.live_bytes;
+  }
+  return new_ptr;
+}
+
+size_t JSAllocator::js_usable_size_cb(const void* ptr)
+{
+  JSAllocator* self = t_active_allocator;
+  return self ? self->usable_size(ptr) : system_usable_size(ptr);
+}
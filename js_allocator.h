@@ -0,0 +1,93 @@
+// js_allocator.h
+// Host-side JSMallocFunctions implementations used to create the JSRuntime.
+//
+// The pooled allocator serves small requests from per-runtime size-class
+// slabs. A JSRuntime is only ever used from one thread, so the pools need no
+// locking; all slabs are released in bulk when the allocator is destroyed
+// (after JS_FreeRuntime).
+#ifndef JS_ALLOCATOR_H
+#define JS_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "quickjs/quickjs.h"
+
+enum class JSAllocatorKind
+{
+  System,  // plain malloc/free, with the same accounting as QuickJS's default
+  Pool,    // size-class slab pools for small blocks, malloc for the rest
+};
+
+struct JSAllocatorStats
+{
+  size_t live_bytes = 0;       // bytes handed out to QuickJS (usable size)
+  size_t peak_bytes = 0;
+  size_t live_count = 0;
+  uint64_t total_allocs = 0;
+  size_t pool_chunks = 0;      // slab chunks currently reserved
+  size_t pool_bytes = 0;       // bytes reserved by slab chunks
+  size_t large_count = 0;      // live blocks served by malloc in pool mode
+};
+
+class JSAllocator
+{
+public:
+  explicit JSAllocator(JSAllocatorKind kind);
+  ~JSAllocator();
+
+  JSAllocator(const JSAllocator&) = delete;
+  JSAllocator& operator=(const JSAllocator&) = delete;
+
+  JSAllocatorKind kind() const { return kind_; }
+  const JSMallocFunctions* functions() const;
+  const JSAllocatorStats& stats() const { return stats_; }
+
+  // Parses "system" / "pool"; returns false for anything else
+  static bool parse_kind(const char* name, JSAllocatorKind* kind);
+  static const char* kind_name(JSAllocatorKind kind);
+
+  // Slab geometry: chunks are aligned to their size so the owning chunk of
+  // any pooled pointer is found by masking the address.
+  static const size_t kChunkSize = 64 * 1024;
+  static const size_t kMaxSmallSize = 512;
+  static const int kNumClasses = 16;
+
+private:
+  struct FreeNode { FreeNode* next; };
+
+  struct ChunkHeader
+  {
+    uint32_t size_class;
+    uint32_t reserved;
+  };
+
+  struct SizeClass
+  {
+    FreeNode* free_list = nullptr;
+    char* bump = nullptr;      // carving position in the newest chunk
+    char* bump_end = nullptr;
+  };
+
+  void* pool_alloc(size_t size, size_t* usable);
+  void pool_free(void* ptr, size_t* usable);
+  size_t usable_size(const void* ptr) const;
+  ChunkHeader* owning_chunk(const void* ptr) const;
+  bool refill(int cls);
+
+  void on_alloc(size_t usable);
+  void on_free(size_t usable);
+
+  static void* js_malloc_cb(JSMallocState* s, size_t size);
+  static void js_free_cb(JSMallocState* s, void* ptr);
+  static void* js_realloc_cb(JSMallocState* s, void* ptr, size_t size);
+  static size_t js_usable_size_cb(const void* ptr);
+
+  JSAllocatorKind kind_;
+  JSAllocatorStats stats_;
+  SizeClass classes_[kNumClasses];
+  std::unordered_map<uintptr_t, ChunkHeader*> chunks_;
+};
+
+#endif /* JS_ALLOCATOR_H */
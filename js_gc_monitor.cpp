@@ -0,0 +1,266 @@
+// js_gc_monitor.cpp
+// Host-side GC scheduling and pause telemetry.
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "js_gc_monitor.h"
+#include "qjs_ffi.h"
+
+// The stats timer callback reaches the monitor through this; like the ffi GC
+// hooks, there is at most one monitor per process
+static JSGCMonitor* timer_monitor = nullptr;
+
+// Near the memory limit the next collection is scheduled halfway to the limit,
+// but never closer than this to the surviving bytes
+static const size_t kMinLimitHeadroom = 64 * 1024;
+
+static double ns_to_ms(uint64_t ns)
+{
+  return ns / 1e6;
+}
+
+static void append_event_json(std::string& out, const JSGCEvent& ev)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"atMs\":%.3f,\"durationMs\":%.3f,\"bytesBefore\":%zu,\"bytesAfter\":%zu,\"reason\":\"%s\"}",
+           ns_to_ms(ev.start_ns), ns_to_ms(ev.duration_ns), ev.bytes_before, ev.bytes_after, ev.reason);
+  out += buf;
+}
+
+JSGCMonitor::JSGCMonitor(JSRuntime* rt, const JSAllocator& allocator, const JSGCOptions& opts)
+  : rt_(rt), allocator_(allocator), opts_(opts), origin_(std::chrono::steady_clock::now())
+{
+  // The monitor decides when to collect; QuickJS's own trigger stays off
+  JS_SetGCThreshold(rt_, (size_t)-1);
+  schedule_next(allocator_.stats().live_bytes);
+
+  JS_SetInterruptHandler(rt_, interrupt_cb, this);
+  JSFFIGCHooks hooks = {gc_json_cb, collect_cb, this};
+  js_ffi_set_gc_hooks(&hooks);
+}
+
+JSGCMonitor::~JSGCMonitor()
+{
+  js_ffi_set_gc_hooks(nullptr);
+  JS_SetInterruptHandler(rt_, nullptr, nullptr);
+  if (timer_monitor == this)
+  {
+    timer_monitor = nullptr;
+  }
+  if (ctx_)
+  {
+    JS_FreeValue(ctx_, set_timeout_);
+  }
+}
+
+void JSGCMonitor::start_stats_timer(JSContext* ctx)
+{
+  if (!opts_.stats_interval_ms || ctx_)
+  {
+    return;
+  }
+  // os.setTimeout has no C entry point; fetch it through a tiny module
+  static const char src[] =
+    "import { setTimeout } from 'os';\n"
+    "globalThis.__gcMonitorSetTimeout = setTimeout;\n";
+  JSValue ret = JS_Eval(ctx, src, sizeof(src) - 1, "<gc-monitor>", JS_EVAL_TYPE_MODULE);
+  if (JS_IsException(ret))
+  {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+  }
+  JS_FreeValue(ctx, ret);
+
+  JSValue global = JS_GetGlobalObject(ctx);
+  JSValue fn = JS_GetPropertyStr(ctx, global, "__gcMonitorSetTimeout");
+  JSAtom atom = JS_NewAtom(ctx, "__gcMonitorSetTimeout");
+  JS_DeleteProperty(ctx, global, atom, 0);
+  JS_FreeAtom(ctx, atom);
+  JS_FreeValue(ctx, global);
+  if (!JS_IsFunction(ctx, fn))
+  {
+    JS_FreeValue(ctx, fn);
+    fprintf(stderr, "Warning: --gc-stats needs the 'os' module; only the final dump is written\n");
+    return;
+  }
+
+  ctx_ = ctx;
+  set_timeout_ = fn;
+  timer_monitor = this;
+  arm_timer();
+}
+
+void JSGCMonitor::arm_timer()
+{
+  JSValue cb = JS_NewCFunction(ctx_, timer_cb, "gcStatsTimer", 0);
+  JSValueConst args[2] = {cb, JS_NewInt64(ctx_, opts_.stats_interval_ms)};
+  JSValue timer = JS_Call(ctx_, set_timeout_, JS_UNDEFINED, 2, args);
+  JS_FreeValue(ctx_, cb);
+  if (JS_IsException(timer))
+  {
+    JS_FreeValue(ctx_, JS_GetException(ctx_));
+    timer_armed_ = false;
+    return;
+  }
+  JS_FreeValue(ctx_, timer);
+  timer_armed_ = true;
+  timer_allocs_ = allocator_.stats().total_allocs;
+}
+
+uint64_t JSGCMonitor::elapsed_ns() const
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - origin_).count();
+}
+
+// Same growth rule as QuickJS, capped halfway to the memory limit
+void JSGCMonitor::schedule_next(size_t live_bytes)
+{
+  if (opts_.threshold == 0)
+  {
+    next_threshold_ = SIZE_MAX;
+    return;
+  }
+  next_threshold_ = std::max(opts_.threshold, live_bytes + (live_bytes >> 1));
+  next_reason_ = "threshold";
+  if (opts_.memory_limit)
+  {
+    size_t headroom = opts_.memory_limit > live_bytes ? (opts_.memory_limit - live_bytes) / 2 : 0;
+    size_t cap = live_bytes + std::max(headroom, kMinLimitHeadroom);
+    if (next_threshold_ > cap)
+    {
+      next_threshold_ = cap;
+      next_reason_ = "memory-limit";
+    }
+  }
+}
+
+void JSGCMonitor::poll()
+{
+  if (allocator_.stats().live_bytes > next_threshold_)
+  {
+    collect(next_reason_);
+  }
+  // JS is running again after the timer went idle; calling os.setTimeout is
+  // not allowed here, so arm it from a job
+  if (ctx_ && !timer_armed_)
+  {
+    timer_armed_ = true;
+    if (JS_EnqueueJob(ctx_, arm_job, 0, nullptr) < 0)
+    {
+      timer_armed_ = false;
+    }
+  }
+}
+
+void JSGCMonitor::collect(const char* reason)
+{
+  JSGCEvent& ev = history_[cycles_ % kHistory];
+  ev.reason = reason;
+  ev.bytes_before = allocator_.stats().live_bytes;
+  ev.start_ns = elapsed_ns();
+  JS_RunGC(rt_);
+  ev.duration_ns = elapsed_ns() - ev.start_ns;
+  ev.bytes_after = allocator_.stats().live_bytes;
+
+  cycles_++;
+  total_ns_ += ev.duration_ns;
+  max_ns_ = std::max(max_ns_, ev.duration_ns);
+  if (strcmp(reason, "threshold") == 0)
+  {
+    threshold_cycles_++;
+  }
+  else if (strcmp(reason, "memory-limit") == 0)
+  {
+    limit_cycles_++;
+  }
+  else
+  {
+    explicit_cycles_++;
+  }
+  schedule_next(ev.bytes_after);
+
+  if (opts_.log_cycles)
+  {
+    std::string line = "{\"gc\":";
+    append_event_json(line, ev);
+    line += "}\n";
+    fputs(line.c_str(), stderr);
+  }
+}
+
+void JSGCMonitor::dump_stats()
+{
+  js_ffi_dump_runtime_stats(stderr, rt_);
+}
+
+std::string JSGCMonitor::gc_json() const
+{
+  char buf[512];
+  int len = snprintf(buf, sizeof(buf),
+                     "{\"uptimeMs\":%.3f,\"cycles\":%" PRIu64 ",\"totalMs\":%.3f,\"maxMs\":%.3f,"
+                     "\"threshold\":%zu,\"memoryLimit\":%zu,"
+                     "\"byReason\":{\"threshold\":%" PRIu64 ",\"memoryLimit\":%" PRIu64 ",\"explicit\":%" PRIu64 "},"
+                     "\"recent\":[",
+                     ns_to_ms(elapsed_ns()), cycles_, ns_to_ms(total_ns_), ns_to_ms(max_ns_),
+                     next_threshold_ == SIZE_MAX ? (size_t)0 : next_threshold_, opts_.memory_limit,
+                     threshold_cycles_, limit_cycles_, explicit_cycles_);
+  std::string out(buf, (size_t)std::max(len, 0));
+
+  // Oldest first
+  uint64_t first = cycles_ > kHistory ? cycles_ - kHistory : 0;
+  for (uint64_t i = first; i < cycles_; i++)
+  {
+    if (i != first) out += ',';
+    append_event_json(out, history_[i % kHistory]);
+  }
+  out += "]}";
+  return out;
+}
+
+int JSGCMonitor::interrupt_cb(JSRuntime* rt, void* opaque)
+{
+  static_cast<JSGCMonitor*>(opaque)->poll();
+  return 0;
+}
+
+JSValue JSGCMonitor::timer_cb(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  JSGCMonitor* self = timer_monitor;
+  if (!self)
+  {
+    return JS_UNDEFINED;
+  }
+  self->timer_armed_ = false;
+  self->dump_stats();
+  // Re-arm only while the script is doing something; otherwise the timer
+  // would be the last thing keeping the event loop from exiting
+  if (self->allocator_.stats().total_allocs != self->timer_allocs_ || JS_IsJobPending(self->rt_))
+  {
+    self->arm_timer();
+  }
+  return JS_UNDEFINED;
+}
+
+JSValue JSGCMonitor::arm_job(JSContext* ctx, int argc, JSValueConst* argv)
+{
+  if (timer_monitor)
+  {
+    timer_monitor->arm_timer();
+  }
+  return JS_UNDEFINED;
+}
+
+const char* JSGCMonitor::gc_json_cb(void* opaque)
+{
+  JSGCMonitor* self = static_cast<JSGCMonitor*>(opaque);
+  self->json_ = self->gc_json();
+  return self->json_.c_str();
+}
+
+void JSGCMonitor::collect_cb(void* opaque)
+{
+  static_cast<JSGCMonitor*>(opaque)->collect("explicit");
+}
@@ -0,0 +1,113 @@
+// js_gc_monitor.h
+// Host-side GC scheduling and pause telemetry.
+//
+// The monitor is opt-in: the host only creates it when a --gc-threshold,
+// --gc-stats or --gc-log option is given, and default runs keep QuickJS's own
+// GC trigger. QuickJS has no hook around its automatic collections, so while
+// the monitor exists it turns that trigger off (JS_SetGCThreshold(rt, -1)) and
+// runs JS_RunGC itself from the interrupt handler, with the same growth rule
+// QuickJS uses: collect once the heap exceeds the threshold, then move the
+// threshold to 1.5x the bytes that survived. Every cycle is timed and kept in a
+// ring of recent events that ffi.runtimeStats() and the periodic stderr dump
+// report. The periodic dump runs from an event loop timer.
+#ifndef JS_GC_MONITOR_H
+#define JS_GC_MONITOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "quickjs/quickjs.h"
+#include "js_allocator.h"
+
+struct JSGCOptions
+{
+  bool enabled = false;           // create the monitor; otherwise QuickJS schedules GC itself
+  size_t threshold = 256 * 1024;  // first automatic GC; 0 disables automatic GC
+  size_t memory_limit = 0;        // JS_SetMemoryLimit; 0 means unlimited
+  size_t max_stack_size = 0;      // JS_SetMaxStackSize; 0 keeps the QuickJS default
+  uint32_t stats_interval_ms = 0; // periodic JSON dump to stderr; 0 disables it
+  bool log_cycles = false;        // print every GC cycle to stderr as one JSON line
+};
+
+struct JSGCEvent
+{
+  uint64_t start_ns = 0;          // relative to monitor creation
+  uint64_t duration_ns = 0;
+  size_t bytes_before = 0;
+  size_t bytes_after = 0;
+  const char* reason = "";        // "threshold", "memory-limit" or "explicit"
+};
+
+class JSGCMonitor
+{
+public:
+  // Takes over GC scheduling on `rt` and installs the interrupt handler and
+  // the ffi module hooks. Both the runtime and the allocator must outlive it.
+  // The heap and stack limits are applied by the host, monitor or not.
+  JSGCMonitor(JSRuntime* rt, const JSAllocator& allocator, const JSGCOptions& opts);
+  ~JSGCMonitor();
+
+  JSGCMonitor(const JSGCMonitor&) = delete;
+  JSGCMonitor& operator=(const JSGCMonitor&) = delete;
+
+  // Arms the periodic stats dump on the event loop with os.setTimeout. Needs
+  // the 'os' module; `ctx` must outlive the monitor. The timer only re-arms
+  // itself while the script is active (JS heap allocations or pending jobs
+  // since the last dump), so it never keeps js_std_loop alive on its own; the
+  // next safe point re-arms it once the script wakes up again.
+  void start_stats_timer(JSContext* ctx);
+
+  // Safe point: collects when the heap is over the threshold and re-arms an
+  // idle stats timer. Called from the interrupt handler.
+  void poll();
+
+  // Runs one timed collection
+  void collect(const char* reason);
+
+  // Writes the ffi.runtimeStats() JSON line to stderr
+  void dump_stats();
+
+  // Summary and recent cycles as a JSON object
+  std::string gc_json() const;
+
+  static const size_t kHistory = 64;
+
+private:
+  uint64_t elapsed_ns() const;
+  void schedule_next(size_t live_bytes);
+
+  void arm_timer();
+
+  static int interrupt_cb(JSRuntime* rt, void* opaque);
+  static JSValue timer_cb(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv);
+  static JSValue arm_job(JSContext* ctx, int argc, JSValueConst* argv);
+  static const char* gc_json_cb(void* opaque);
+  static void collect_cb(void* opaque);
+
+  JSRuntime* rt_;
+  const JSAllocator& allocator_;
+  JSGCOptions opts_;
+  std::chrono::steady_clock::time_point origin_;
+
+  size_t next_threshold_;
+  const char* next_reason_ = "threshold";
+
+  JSContext* ctx_ = nullptr;      // set by start_stats_timer
+  JSValue set_timeout_ = JS_UNDEFINED;
+  bool timer_armed_ = false;      // a dump timer or arm_job is pending
+  uint64_t timer_allocs_ = 0;     // allocator total_allocs when the timer was armed
+
+  JSGCEvent history_[kHistory];
+  uint64_t cycles_ = 0;           // history_[cycles_ % kHistory] is the next slot
+  uint64_t total_ns_ = 0;
+  uint64_t max_ns_ = 0;
+  uint64_t threshold_cycles_ = 0;
+  uint64_t limit_cycles_ = 0;
+  uint64_t explicit_cycles_ = 0;
+
+  std::string json_;              // backing store for gc_json_cb
+};
+
+#endif /* JS_GC_MONITOR_H */
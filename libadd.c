@@ -1,5 +1,6 @@
 // libadd.c
 // 一个简单的动态库，用于被 JS 调用。
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -290,3 +291,155 @@ int test_array_filter(const int* input, int input_size, int* output,
 }
 
 
+
+// 基准测试用函数：不打印任何输出，避免 I/O 干扰计时
+__attribute__((visibility("default")))
+int bench_add(int a, int b) {
+    return a + b;
+}
+
+// 流式读取测试：从 *offset 开始生成字节序列 (offset & 0xff)，直到总共 total 字节，
+// 返回本次填充的字节数，结束时返回 0
+__attribute__((visibility("default")))
+long test_stream_read(long* offset, unsigned char* buf, size_t size, long total) {
+    long remaining = total - *offset;
+    if (remaining <= 0) return 0;
+    long n = remaining < (long)size ? remaining : (long)size;
+    for (long i = 0; i < n; i++) {
+        buf[i] = (unsigned char)((*offset + i) & 0xff);
+    }
+    *offset += n;
+    return n;
+}
+
+// 基准测试用：对每个元素调用一次回调，不打印输出
+__attribute__((visibility("default")))
+void bench_foreach(const int* arr, int size, void (*callback)(int value, int index)) {
+    for (int i = 0; i < size; i++) {
+        callback(arr[i], i);
+    }
+}
+
+// 并行测试用：output[i] = input[i] * factor，不打印输出，可以并发调用
+__attribute__((visibility("default")))
+void scale_floats(const float* input, float* output, int count, float factor) {
+    for (int i = 0; i < count; i++) {
+        output[i] = input[i] * factor;
+    }
+}
+
+// 基准测试用：与 find_max_in_array 相同，但不打印输出
+__attribute__((visibility("default")))
+int bench_find_max(const int* arr, int size, int* max_index) {
+    int max_val = arr[0];
+    *max_index = 0;
+    for (int i = 1; i < size; i++) {
+        if (arr[i] > max_val) {
+            max_val = arr[i];
+            *max_index = i;
+        }
+    }
+    return max_val;
+}
+
+// 基准测试用：不打印输出的求和，在 long long 中累加
+__attribute__((visibility("default")))
+long long bench_array_sum(const int* arr, int size) {
+    long long sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += arr[i];
+    }
+    return sum;
+}
+
+// 基准测试用：float 点积，在 double 中累加
+__attribute__((visibility("default")))
+double bench_dot_floats(const float* a, const float* b, int size) {
+    double sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += (double)a[i] * (double)b[i];
+    }
+    return sum;
+}
+
+// 基准测试用：统计等于 value 的字节数
+__attribute__((visibility("default")))
+long long bench_count_byte(const uint8_t* data, long long size, int value) {
+    long long count = 0;
+    for (long long i = 0; i < size; i++) {
+        count += data[i] == (uint8_t)value;
+    }
+    return count;
+}
+
+// 字符串数组测试：返回所有字符串长度之和，count 为负时读到 NULL 为止
+__attribute__((visibility("default")))
+int total_string_length(const char** items, int count) {
+    int total = 0;
+    for (int i = 0; count < 0 ? items[i] != NULL : i < count; i++) {
+        total += (int)strlen(items[i]);
+    }
+    return total;
+}
+
+// 返回以 NULL 结尾的静态字符串列表，用于测试 char** 解码
+__attribute__((visibility("default")))
+const char** get_color_names(void) {
+    static const char* names[] = {"red", "green", "blue", "\xe7\xba\xa2\xe8\x89\xb2", NULL};
+    return names;
+}
+
+// 记忆化测试：Collatz 序列从 n 到 1 的步数，同时统计实际被调用的次数
+static int collatz_calls = 0;
+
+__attribute__((visibility("default")))
+int collatz_steps(long long n) {
+    int steps = 0;
+    collatz_calls++;
+    while (n > 1) {
+        n = (n & 1) ? 3 * n + 1 : n / 2;
+        steps++;
+    }
+    return steps;
+}
+
+__attribute__((visibility("default")))
+int collatz_call_count(void) {
+    return collatz_calls;
+}
+
+// 可变参数测试：count 个 int（char/short 经默认提升后也按 int 读取）之和
+__attribute__((visibility("default")))
+int sum_variadic_ints(int count, ...) {
+    va_list ap;
+    int total = 0;
+    va_start(ap, count);
+    for (int i = 0; i < count; i++) {
+        total += va_arg(ap, int);
+    }
+    va_end(ap);
+    return total;
+}
+
+// 可变参数测试：count 个 double（float 经默认提升后也按 double 读取）之和
+__attribute__((visibility("default")))
+double sum_variadic_doubles(int count, ...) {
+    va_list ap;
+    double total = 0;
+    va_start(ap, count);
+    for (int i = 0; i < count; i++) {
+        total += va_arg(ap, double);
+    }
+    va_end(ap);
+    return total;
+}
+
+// printf 风格的格式化：写入 buf，返回 vsnprintf 的结果
+__attribute__((visibility("default")))
+int format_message(char* buf, int size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, (size_t)size, fmt, ap);
+    va_end(ap);
+    return n;
+}
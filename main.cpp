@@ -3,11 +3,19 @@
 #include <iostream>
 #include <memory>
 #include <fstream>
+#include <string>
 #include <vector>
+#include <cstdlib>
+#include <cstring>
 
 #include "quickjs/quickjs.h"
 #include "quickjs/quickjs-libc.h"
 #include "qjs_ffi.h"
+#include "ffi_perfmap.h"
+#include "ffi_record.h"
+#include "ffi_trace.h"
+#include "js_allocator.h"
+#include "js_gc_monitor.h"
 
 // Custom deleter for JSRuntime
 struct JSRuntimeDeleter
@@ -97,20 +105,189 @@ static std::string read_file(const char* filename)
                      std::istreambuf_iterator<char>());
 }
 
-int main(int argc, char** argv)
+// Command line options (must precede the script path)
+struct HostOptions
+{
+  std::string trace_path;        // --trace=<file>: dump FFI trace on exit
+  uint32_t trace_buffer = 0;     // --trace-buffer=<events>: per-thread ring size
+  uint32_t trace_sample = 1;     // --trace-sample=<N>: record 1 of N top-level events
+  bool perf_map = false;         // --perf-map: write /tmp/perf-<pid>.map for callback trampolines
+  std::string record_path;       // --record=<file>: log every ffi.call for ffi_replay
+  size_t record_cap = 65536;     // --record-cap=<bytes>: buffer bytes saved per pointer argument
+  bool mem_report = false;       // --mem-report: print native memory statistics on exit
+  size_t mem_limit = 0;          // --mem-limit=<bytes>: soft limit for ffi.malloc
+  bool track_alloc_sites = false; // --track-alloc-sites: record script location per allocation
+  JSAllocatorKind allocator = JSAllocatorKind::System; // --allocator=system|pool
+  JSGCOptions gc;                // --gc-threshold, --heap-limit, --max-stack-size, --gc-stats, --gc-log
+};
+
+static void print_usage(const char* prog)
+{
+  std::cerr << "Usage: " << prog << " [options] <script.js> [args...]" << std::endl
+            << "Options:" << std::endl
+            << "  --trace=<file>          record FFI events and write a Chrome trace on exit" << std::endl
+            << "  --trace-buffer=<n>      per-thread trace ring size in events (default 65536)" << std::endl
+            << "  --trace-sample=<n>      record one of every n top-level FFI events" << std::endl
+            << "  --perf-map              name callback trampolines in /tmp/perf-<pid>.map" << std::endl
+            << "  --record=<file>         log every ffi.call with its arguments for ffi_replay" << std::endl
+            << "  --record-cap=<bytes>    buffer bytes saved per pointer argument (default 65536)" << std::endl
+            << "  --mem-report            print native memory statistics on exit" << std::endl
+            << "  --mem-limit=<bytes>     make ffi.malloc throw beyond this many live bytes" << std::endl
+            << "  --track-alloc-sites     record the script location of every ffi.malloc" << std::endl
+            << "  --allocator=<kind>      JS heap allocator: system (default) or pool" << std::endl
+            << "  --gc-threshold=<bytes>  host-scheduled GC: heap size of the first GC (default 262144, 0 = explicit only)" << std::endl
+            << "  --heap-limit=<bytes>    JS heap memory limit" << std::endl
+            << "  --max-stack-size=<bytes> JS stack size limit" << std::endl
+            << "  --gc-stats=<ms>         print ffi.runtimeStats() to stderr as JSON every <ms>" << std::endl
+            << "  --gc-log                print every GC cycle to stderr as JSON" << std::endl;
+}
+
+// Returns true if `arg` is `--name=value` and stores the value
+static bool match_option(const char* arg, const char* name, const char** value)
 {
-  if (argc < 2)
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  *value = arg + len + 1;
+  return true;
+}
+
+// Parses leading options; returns the index of the script path or -1 on error
+static int parse_options(int argc, char** argv, HostOptions& opts)
+{
+  int i = 1;
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++)
   {
-    std::cerr << "Usage: " << argv[0] << " <script.js>" << std::endl;
-    return 1;
+    const char* value = nullptr;
+    if (match_option(argv[i], "--trace", &value))
+    {
+      opts.trace_path = value;
+    }
+    else if (match_option(argv[i], "--trace-buffer", &value))
+    {
+      opts.trace_buffer = (uint32_t)strtoul(value, nullptr, 10);
+    }
+    else if (match_option(argv[i], "--trace-sample", &value))
+    {
+      opts.trace_sample = (uint32_t)strtoul(value, nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--perf-map") == 0)
+    {
+      opts.perf_map = true;
+    }
+    else if (match_option(argv[i], "--record", &value))
+    {
+      opts.record_path = value;
+    }
+    else if (match_option(argv[i], "--record-cap", &value))
+    {
+      opts.record_cap = (size_t)strtoull(value, nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--mem-report") == 0)
+    {
+      opts.mem_report = true;
+    }
+    else if (match_option(argv[i], "--mem-limit", &value))
+    {
+      opts.mem_limit = (size_t)strtoull(value, nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--track-alloc-sites") == 0)
+    {
+      opts.track_alloc_sites = true;
+    }
+    else if (match_option(argv[i], "--allocator", &value))
+    {
+      if (!JSAllocator::parse_kind(value, &opts.allocator))
+      {
+        std::cerr << "Error: Unknown allocator: " << value << std::endl;
+        return -1;
+      }
+    }
+    else if (match_option(argv[i], "--gc-threshold", &value))
+    {
+      opts.gc.threshold = (size_t)strtoull(value, nullptr, 10);
+      opts.gc.enabled = true;
+    }
+    else if (match_option(argv[i], "--heap-limit", &value))
+    {
+      opts.gc.memory_limit = (size_t)strtoull(value, nullptr, 10);
+    }
+    else if (match_option(argv[i], "--max-stack-size", &value))
+    {
+      opts.gc.max_stack_size = (size_t)strtoull(value, nullptr, 10);
+    }
+    else if (match_option(argv[i], "--gc-stats", &value))
+    {
+      opts.gc.stats_interval_ms = (uint32_t)strtoul(value, nullptr, 10);
+      opts.gc.enabled = true;
+    }
+    else if (strcmp(argv[i], "--gc-log") == 0)
+    {
+      opts.gc.log_cycles = true;
+      opts.gc.enabled = true;
+    }
+    else
+    {
+      std::cerr << "Error: Unknown option: " << argv[i] << std::endl;
+      return -1;
+    }
   }
+  return i < argc ? i : -1;
+}
+
+static std::string g_trace_path;
+static bool g_mem_report = false;
 
+static void dump_trace_at_exit()
+{
+  if (!ffi_trace_dump_file(g_trace_path.c_str()))
+  {
+    std::cerr << "Error: Could not write trace file: " << g_trace_path << std::endl;
+  }
+}
+
+static void stop_recording_at_exit()
+{
+  if (!ffi_record_stop())
+  {
+    std::cerr << "Error: Could not write call log" << std::endl;
+  }
+}
+
+// Reports ffi.malloc blocks that were never freed; verbose with --mem-report
+static void report_allocations_at_exit()
+{
+  js_ffi_report_allocations(stderr, g_mem_report);
+}
+
+static void print_allocator_stats(const JSAllocator& allocator)
+{
+  const JSAllocatorStats& st = allocator.stats();
+  std::cerr << "js heap (" << JSAllocator::kind_name(allocator.kind()) << "): "
+            << "live=" << st.live_count << " (" << st.live_bytes << " bytes)"
+            << " peak=" << st.peak_bytes << " bytes"
+            << " allocs=" << st.total_allocs;
+  if (allocator.kind() == JSAllocatorKind::Pool)
+  {
+    std::cerr << " slab_chunks=" << st.pool_chunks << " (" << st.pool_bytes << " bytes)"
+              << " large_live=" << st.large_count;
+  }
+  std::cerr << std::endl;
+}
+
+// Creates the runtime, evaluates the script and runs the event loop.
+// argv[0] is the script path; the remaining entries become scriptArgs.
+static int run_script(int argc, char** argv, const HostOptions& opts)
+{
   try
   {
-    const char* script_path = argv[1];
+    const char* script_path = argv[0];
+
+    // The allocator must outlive the runtime: its slabs are released in bulk
+    // when it is destroyed, after JS_FreeRuntime has run.
+    JSAllocator allocator(opts.allocator);
 
     // Create runtime with automatic cleanup
-    JSRuntimePtr rt(JS_NewRuntime());
+    JSRuntimePtr rt(JS_NewRuntime2(allocator.functions(), &allocator));
     if (!rt)
     {
       std::cerr << "Error: Could not create QuickJS runtime" << std::endl;
@@ -127,6 +304,23 @@ int main(int argc, char** argv)
 
     js_std_init_handlers(rt.get());
 
+    if (opts.gc.memory_limit)
+    {
+      JS_SetMemoryLimit(rt.get(), opts.gc.memory_limit);
+    }
+    if (opts.gc.max_stack_size)
+    {
+      JS_SetMaxStackSize(rt.get(), opts.gc.max_stack_size);
+    }
+
+    // Opt-in: schedules and times every GC cycle in place of QuickJS's own
+    // trigger. Destroyed before the context and runtime.
+    std::unique_ptr<JSGCMonitor> gc_monitor;
+    if (opts.gc.enabled)
+    {
+      gc_monitor.reset(new JSGCMonitor(rt.get(), allocator, opts.gc));
+    }
+
     // Set up module loader for ES6 import/export support
     JS_SetModuleLoaderFunc2(rt.get(), NULL, js_module_loader, js_module_check_attributes, NULL);
 
@@ -138,6 +332,11 @@ int main(int argc, char** argv)
     // Add standard helpers (console.log, print, etc.)
     js_std_add_helpers(ctx.get(), argc, argv);
 
+    if (gc_monitor)
+    {
+      gc_monitor->start_stats_timer(ctx.get());
+    }
+
     // Read script file
     std::string script_content = read_file(script_path);
     if (script_content.empty())
@@ -162,6 +361,16 @@ int main(int argc, char** argv)
     // Run event loop
     js_std_loop(ctx.get());
 
+    if (gc_monitor && opts.gc.stats_interval_ms)
+    {
+      gc_monitor->dump_stats();
+    }
+
+    if (opts.mem_report)
+    {
+      print_allocator_stats(allocator);
+    }
+
     return 0;
   }
   catch (const std::exception& e)
@@ -175,3 +384,50 @@ int main(int argc, char** argv)
     return 1;
   }
 }
+
+int main(int argc, char** argv)
+{
+  HostOptions opts;
+  int script_index = parse_options(argc, argv, opts);
+  if (script_index < 0)
+  {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (!opts.trace_path.empty())
+  {
+    // Dump from an atexit handler so scripts ending with std.exit() are covered too
+    g_trace_path = opts.trace_path;
+    ffi_trace_start(opts.trace_buffer, opts.trace_sample);
+    atexit(dump_trace_at_exit);
+  }
+
+  if (opts.perf_map && !ffi_perfmap_enable(true))
+  {
+    std::cerr << "Error: Could not write " << ffi_perfmap_path() << std::endl;
+  }
+
+  if (!opts.record_path.empty())
+  {
+    if (!ffi_record_start(opts.record_path.c_str(), opts.record_cap))
+    {
+      std::cerr << "Error: Could not open call log: " << opts.record_path << std::endl;
+      return 1;
+    }
+    atexit(stop_recording_at_exit);
+  }
+
+  g_mem_report = opts.mem_report;
+  js_ffi_set_mem_limit(opts.mem_limit);
+  js_ffi_set_track_alloc_sites(opts.track_alloc_sites);
+  // The leak report needs a per-pointer table, which costs a lock on every
+  // ffi.malloc/free; without it only the atomic counters are kept
+  if (opts.mem_report || opts.track_alloc_sites)
+  {
+    js_ffi_set_leak_report(1);
+    atexit(report_allocations_at_exit);
+  }
+
+  return run_script(argc - script_index, argv + script_index, opts);
+}
@@ -1,18 +1,68 @@
 // qjs_ffi.cpp
 // QuickJS FFI C++ module.
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
 #include <memory>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define malloc_usable_size malloc_size
+#else
+#include <malloc.h>
+#endif
 #include <ffi.h>
 
 #include "quickjs/quickjs.h"
 #include "quickjs/quickjs-libc.h"
 #include "qjs_ffi.h"
+#include "ffi_memo.h"
+#include "ffi_parallel.h"
+#include "ffi_perfmap.h"
+#include "ffi_record.h"
+#include "ffi_simd.h"
+#include "ffi_trace.h"
 
 #define countof(x) (sizeof(x) / sizeof((x)[0]))
 
+// 缓冲回调的按列暂存区：每个参数一列，攒满 capacity 次调用后一次性交给 JS
+struct BufferedColumns {
+  uint32_t capacity = 0;
+  uint32_t count = 0;
+  std::vector<uint8_t*> columns;
+  std::vector<uint8_t> elem_size;
+  std::vector<const char*> view_ctor;   // 每列对应的 TypedArray 构造函数名
+  bool queued = false;                  // 是否已在 buffered_pending 中
+  uint64_t calls = 0;
+  uint64_t batches = 0;
+  uint64_t dropped = 0;                 // 因无法刷新（内存不足）而丢弃的调用
+  JSValue pending_error = JS_UNDEFINED; // 原生代码中途触发的批次抛出的异常
+
+  ~BufferedColumns() {
+    for (uint8_t* column : columns) free(column);
+  }
+};
+
 // 回调函数信息结构体
 struct CallbackInfo {
   JSContext* ctx;
@@ -23,8 +73,13 @@ struct CallbackInfo {
   int argc;
   void* closure_ptr;  // 添加闭包指针以便清理
   void* func_ptr;     // 添加函数指针
+  uint32_t trace_symbol_id;  // 追踪用的符号 id
+  std::unique_ptr<BufferedColumns> buffered;  // 缓冲回调才有
 
   ~CallbackInfo() {
+    if (ctx && buffered) {
+      JS_FreeValue(ctx, buffered->pending_error);
+    }
     if (ctx && !JS_IsUndefined(js_callback)) {
       JS_FreeValue(ctx, js_callback);
     }
@@ -35,6 +90,7 @@ struct CallbackInfo {
       delete cif;
     }
     if (closure_ptr) {
+      ffi_perfmap_remove(func_ptr);
       ffi_closure_free(closure_ptr);
     }
   }
@@ -43,11 +99,17 @@ struct CallbackInfo {
 // 全局回调信息存储（简单实现，实际应用中需要更好的管理）
 static std::vector<std::unique_ptr<CallbackInfo>> callback_infos;
 
+// 有暂存调用（或未抛出的异常）的缓冲回调
+static std::vector<CallbackInfo*> buffered_pending;
+
 // 清理所有回调函数
 static void cleanup_callbacks() {
+  buffered_pending.clear();
   callback_infos.clear();
 }
 
+static int flush_buffered_callback(JSContext* ctx, CallbackInfo* info);
+
 // 回调函数包装器 - 将被C函数调用，然后调用JS函数
 static void callback_wrapper(ffi_cif* cif, void* ret, void** args, void* user_data) {
   CallbackInfo* info = static_cast<CallbackInfo*>(user_data);
@@ -86,7 +148,11 @@ static void callback_wrapper(ffi_cif* cif, void* ret, void** args, void* user_da
   }
 
   // 调用JS回调函数
-  JSValue result = JS_Call(info->ctx, info->js_callback, JS_UNDEFINED, info->argc, js_args.data());
+  JSValue result;
+  {
+    FFITraceScope trace_scope(FFI_TRACE_CALLBACK, info->trace_symbol_id, (uintptr_t)info->func_ptr);
+    result = JS_Call(info->ctx, info->js_callback, JS_UNDEFINED, info->argc, js_args.data());
+  }
 
   // 转换返回值
   if (info->rtype == &ffi_type_sint) {
@@ -110,6 +176,37 @@ static void callback_wrapper(ffi_cif* cif, void* ret, void** args, void* user_da
   JS_FreeValue(info->ctx, result);
 }
 
+// 缓冲回调包装器：只把参数追加到列中，攒满一批时才进入 JS
+static void buffered_callback_wrapper(ffi_cif* cif, void* ret, void** args, void* user_data) {
+  CallbackInfo* info = static_cast<CallbackInfo*>(user_data);
+  BufferedColumns& b = *info->buffered;
+
+  // 刷新失败时批次已被丢弃，正常情况下这里总有空位；防御性检查，避免写出列的末尾
+  if (b.count >= b.capacity) {
+    b.dropped++;
+    return;
+  }
+  for (int i = 0; i < info->argc; i++) {
+    memcpy(b.columns[i] + (size_t)b.count * b.elem_size[i], args[i], b.elem_size[i]);
+  }
+  b.count++;
+  b.calls++;
+  if (!b.queued) {
+    b.queued = true;
+    buffered_pending.push_back(info);
+  }
+
+  if (b.count == b.capacity && flush_buffered_callback(info->ctx, info) < 0) {
+    // 无法在原生代码中途抛出，留到外层 call 返回时再抛出
+    JSValue exception = JS_GetException(info->ctx);
+    if (JS_IsUndefined(b.pending_error)) {
+      b.pending_error = exception;
+    } else {
+      JS_FreeValue(info->ctx, exception);
+    }
+  }
+}
+
 // 将 JS 传入的类型字符串转换为 ffi_type
 static ffi_type* string_to_ffi_type(const char* type_str)
 {
@@ -137,6 +234,7 @@ static ffi_type* string_to_ffi_type(const char* type_str)
   // 指针和字符串类型
   if (strcmp(type_str, "pointer") == 0) return &ffi_type_pointer;
   if (strcmp(type_str, "string") == 0) return &ffi_type_pointer;  // 字符串作为 char* 处理
+  if (strcmp(type_str, "stringArray") == 0) return &ffi_type_pointer; // 字符串数组作为 char** 处理
   if (strcmp(type_str, "callback") == 0) return &ffi_type_pointer; // 回调函数作为指针处理
 
   // 特殊类型
@@ -151,14 +249,249 @@ static ffi_type* string_to_ffi_type(const char* type_str)
   return nullptr;
 }
 
+// GC 管理的原生缓冲区（ffi.alloc 返回的对象）
+struct NativeBuffer {
+  void* ptr;      // dispose 之后为 nullptr
+  size_t size;
+  size_t align;
+  size_t map_length;   // ffi.allocLarge 的匿名映射长度，0 表示堆内存
+  bool hugepages;      // MADV_HUGEPAGE 是否成功
+};
+
+static JSClassID js_ffi_buffer_class_id;
+
+// 内存映射文件（ffi.mapFile 返回的对象）；JS 对象和导出的 ArrayBuffer 各持有一个引用
+struct MappedFile {
+  int refs;
+  uint8_t* base;       // mmap 返回的页对齐地址
+  size_t map_length;
+  uint8_t* data;       // 请求的 offset 对应的地址
+  size_t length;
+  bool writable;       // 'rw'：MAP_SHARED，写入会落到文件
+  bool hugepages;      // MADV_HUGEPAGE 是否成功
+};
+
+struct NativeMapping {
+  MappedFile* file;    // unmap 之后为 nullptr
+  JSValue buffer;      // 懒创建的零拷贝 ArrayBuffer
+};
+
+static JSClassID js_ffi_mapping_class_id;
+
+// 把 JS 值转换为原生指针：支持数字、BigInt、null/undefined 以及 ffi.alloc/ffi.mapFile 返回的对象。
+// size_out 不为空时返回已知的可用字节数，裸地址为 SIZE_MAX。失败时抛出异常并返回 -1。
+static int js_ffi_get_pointer(JSContext* ctx, void** out, JSValueConst val, size_t* size_out = nullptr)
+{
+  if (size_out) *size_out = SIZE_MAX;
+  if (JS_IsNull(val) || JS_IsUndefined(val)) {
+    *out = nullptr;
+    return 0;
+  }
+
+  if (JS_IsObject(val)) {
+    NativeBuffer* buf = (NativeBuffer*)JS_GetOpaque(val, js_ffi_buffer_class_id);
+    if (buf) {
+      if (!buf->ptr) {
+        JS_ThrowTypeError(ctx, "Native buffer has been disposed");
+        return -1;
+      }
+      *out = buf->ptr;
+      if (size_out) *size_out = buf->size;
+      return 0;
+    }
+    NativeMapping* map = (NativeMapping*)JS_GetOpaque(val, js_ffi_mapping_class_id);
+    if (map) {
+      if (!map->file) {
+        JS_ThrowTypeError(ctx, "Mapped file has been unmapped");
+        return -1;
+      }
+      *out = map->file->data;
+      if (size_out) *size_out = map->file->length;
+      return 0;
+    }
+  }
+
+  int64_t ptr_val;
+  if (JS_IsBigInt(ctx, val) ? JS_ToBigInt64(ctx, &ptr_val, val) : JS_ToInt64(ctx, &ptr_val, val)) {
+    return -1;
+  }
+  *out = (void*)(uintptr_t)ptr_val;
+  return 0;
+}
+
+// new Uint8Array(buffer) 等：通过全局构造函数创建视图
+static JSValue js_ffi_new_typed_view(JSContext* ctx, const char* ctor_name, JSValueConst buffer)
+{
+  JSValue global = JS_GetGlobalObject(ctx);
+  JSValue ctor = JS_GetPropertyStr(ctx, global, ctor_name);
+  JS_FreeValue(ctx, global);
+  JSValue view = JS_CallConstructor(ctx, ctor, 1, &buffer);
+  JS_FreeValue(ctx, ctor);
+  return view;
+}
+
+static void js_ffi_free_array_buffer(JSRuntime* rt, void* opaque, void* ptr)
+{
+  free(ptr);
+}
+
+// 把一个缓冲回调暂存的调用以 TypedArray 列的形式交给 JS：fn(column0, column1, ...)。
+// 列内存直接移交给 ArrayBuffer（零拷贝），暂存区换成新分配的内存，
+// 因此 JS 可以保留这些视图，回调中再次触发原生调用也是安全的。
+// 返回 -1 表示出错，异常留在 ctx 中。
+static int flush_buffered_callback(JSContext* ctx, CallbackInfo* info)
+{
+  BufferedColumns& b = *info->buffered;
+  if (b.count == 0) return 0;
+
+  const int ncols = info->argc;
+  std::vector<uint8_t*> fresh(ncols, nullptr);
+  for (int i = 0; i < ncols; i++) {
+    fresh[i] = (uint8_t*)malloc((size_t)b.capacity * b.elem_size[i]);
+    if (!fresh[i]) {
+      // 无法交换列时丢弃这一批，保证下一次调用写入时 count < capacity
+      for (uint8_t* column : fresh) free(column);
+      b.dropped += b.count;
+      b.count = 0;
+      JS_ThrowOutOfMemory(ctx);
+      return -1;
+    }
+  }
+  std::vector<uint8_t*> full(b.columns);
+  b.columns.swap(fresh);
+  uint32_t count = b.count;
+  b.count = 0;
+  b.batches++;
+
+  int ret = 0;
+  std::vector<JSValue> views;
+  views.reserve(ncols);
+  for (int i = 0; i < ncols; i++) {
+    if (ret) {
+      free(full[i]);
+      continue;
+    }
+    JSValue ab = JS_NewArrayBuffer(ctx, full[i], (size_t)count * b.elem_size[i],
+                                   js_ffi_free_array_buffer, nullptr, false);
+    if (JS_IsException(ab)) {
+      free(full[i]);
+      ret = -1;
+      continue;
+    }
+    JSValue view = js_ffi_new_typed_view(ctx, b.view_ctor[i], ab);
+    JS_FreeValue(ctx, ab);
+    if (JS_IsException(view)) {
+      ret = -1;
+      continue;
+    }
+    views.push_back(view);
+  }
+
+  if (!ret) {
+    FFITraceScope trace_scope(FFI_TRACE_CALLBACK, info->trace_symbol_id, (uintptr_t)info->func_ptr);
+    JSValue result = JS_Call(ctx, info->js_callback, JS_UNDEFINED, ncols, views.data());
+    if (JS_IsException(result)) ret = -1;
+    JS_FreeValue(ctx, result);
+  }
+  for (JSValue& view : views) JS_FreeValue(ctx, view);
+  return ret;
+}
+
+// 刷新所有有暂存调用的缓冲回调，并抛出之前批次中记录的异常
+static int flush_buffered_callbacks(JSContext* ctx)
+{
+  std::vector<CallbackInfo*> pending;
+  pending.swap(buffered_pending);
+
+  int ret = 0;
+  JSValue error = JS_UNDEFINED;
+  for (CallbackInfo* info : pending) {
+    BufferedColumns& b = *info->buffered;
+    b.queued = false;
+    if (flush_buffered_callback(ctx, info) < 0) {
+      JSValue exception = JS_GetException(ctx);
+      if (JS_IsUndefined(b.pending_error)) {
+        b.pending_error = exception;
+      } else {
+        JS_FreeValue(ctx, exception);
+      }
+    }
+    if (!JS_IsUndefined(b.pending_error)) {
+      if (JS_IsUndefined(error)) {
+        error = b.pending_error;
+      } else {
+        JS_FreeValue(ctx, b.pending_error);
+      }
+      b.pending_error = JS_UNDEFINED;
+      ret = -1;
+    }
+  }
+  if (ret) JS_Throw(ctx, error);
+  return ret;
+}
+
+// 按 ffi_type 把数值或指针写入参数存储区（不处理 string/callback），失败时返回 -1
+static int js_ffi_store_arg(JSContext* ctx, ffi_type* type, JSValueConst val, void* storage)
+{
+  if (type == &ffi_type_pointer) {
+    return js_ffi_get_pointer(ctx, (void**)storage, val);
+  }
+
+  if (type == &ffi_type_float || type == &ffi_type_double || type == &ffi_type_longdouble) {
+    double d;
+    if (JS_ToFloat64(ctx, &d, val)) return -1;
+    if (type == &ffi_type_float) *(float*)storage = (float)d;
+    else if (type == &ffi_type_double) *(double*)storage = d;
+    else *(long double*)storage = (long double)d;
+    return 0;
+  }
+
+  int64_t v;
+  if (JS_IsBigInt(ctx, val) ? JS_ToBigInt64(ctx, &v, val) : JS_ToInt64(ctx, &v, val)) return -1;
+  switch (type->size) {
+    case 1: *(uint8_t*)storage = (uint8_t)v; break;
+    case 2: *(uint16_t*)storage = (uint16_t)v; break;
+    case 4: *(uint32_t*)storage = (uint32_t)v; break;
+    default: *(uint64_t*)storage = (uint64_t)v; break;
+  }
+  return 0;
+}
+
+// 读取 options 对象中的布尔属性，属性不存在时返回默认值；异常返回 -1
+static int js_ffi_get_bool_option(JSContext* ctx, JSValueConst options, const char* name, bool default_value)
+{
+  if (!JS_IsObject(options)) return default_value;
+  JSValue val = JS_GetPropertyStr(ctx, options, name);
+  int ret = JS_IsUndefined(val) ? (int)default_value : JS_ToBool(ctx, val);
+  JS_FreeValue(ctx, val);
+  return ret;
+}
+
+// 读取 options 对象中的整数属性，属性不存在时保持 *out 不变；异常返回 -1
+static int js_ffi_get_int64_option(JSContext* ctx, JSValueConst options, const char* name, int64_t* out)
+{
+  if (!JS_IsObject(options)) return 0;
+  JSValue val = JS_GetPropertyStr(ctx, options, name);
+  int ret = JS_IsUndefined(val) ? 0 : JS_ToInt64(ctx, out, val);
+  JS_FreeValue(ctx, val);
+  return ret;
+}
+
 // JS: FFI.open(path)
 static JSValue js_ffi_open(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
 {
   const char* path = JS_ToCString(ctx, argv[0]);
   if (!path) return JS_EXCEPTION;
 
+  uint32_t trace_id = ffi_trace_intern(path);
+
   // 直接使用 dlopen，不要在局部作用域中自动关闭
-  void* handle = dlopen(path, RTLD_LAZY);
+  void* handle;
+  {
+    FFITraceScope trace_scope(FFI_TRACE_DLOPEN, trace_id, 0);
+    handle = dlopen(path, RTLD_LAZY);
+    trace_scope.set_end_value((uintptr_t)handle);
+  }
   JS_FreeCString(ctx, path);
 
   if (!handle)
@@ -181,222 +514,73 @@ static JSValue js_ffi_symbol(JSContext* ctx, JSValueConst this_val, int argc, JS
     return JS_EXCEPTION;
   }
   void* handle = (void*)(uintptr_t)handle_val;
-  void* symbol = dlsym(handle, name);
-    JS_FreeCString(ctx, name);
+  uint32_t trace_id = ffi_trace_intern(name);
+  void* symbol;
+  {
+    FFITraceScope trace_scope(FFI_TRACE_DLSYM, trace_id, (uintptr_t)handle);
+    symbol = dlsym(handle, name);
+  }
+  JS_FreeCString(ctx, name);
   if (!symbol) return JS_ThrowTypeError(ctx, "Failed to find symbol: %s", dlerror());
+  ffi_trace_bind_address(trace_id, symbol);
   return JS_NewInt64(ctx, (int64_t)(uintptr_t)symbol);
 }
 
-// JS: FFI.call(func_ptr, ret_type_str, [arg_types_str...], ...args)
-static JSValue js_ffi_call(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+// 把 ffi 返回值存储区（或同样布局的参数槽位）中的值转换为 JS 值
+static JSValue js_ffi_to_js(JSContext* ctx, ffi_type* rtype, const void* storage)
 {
-  if (argc < 3) return JS_ThrowTypeError(ctx, "FFI.call requires at least 3 arguments");
-
-  int64_t func_ptr_val;
-  if (JS_ToInt64(ctx, &func_ptr_val, argv[0])) return JS_EXCEPTION;
-  void (*func_ptr)(void) = (void (*)(void))(uintptr_t)func_ptr_val;
-
-  const char* ret_type_str = JS_ToCString(ctx, argv[1]);
-  ffi_type* rtype = string_to_ffi_type(ret_type_str);
-  JS_FreeCString(ctx, ret_type_str);
-  if (!rtype) return JS_ThrowTypeError(ctx, "Invalid return type");
-
-  JSValueConst arg_types_js = argv[2];
-  if (!JS_IsArray(ctx, arg_types_js)) return JS_ThrowTypeError(ctx, "Argument types must be an array");
-
-  JSValue len_val = JS_GetPropertyStr(ctx, arg_types_js, "length");
-  uint32_t num_args;
-  JS_ToUint32(ctx, &num_args, len_val);
-  JS_FreeValue(ctx, len_val);
-
-  if ((argc - 3) != num_args)
-  {
-    return JS_ThrowTypeError(ctx, "Incorrect number of arguments. Expected %d, got %d", num_args, argc - 3);
-  }
-
-  // 使用智能指针管理内存
-  std::unique_ptr<ffi_type*[]> atypes;
-  std::unique_ptr<void*[]> avalues;
-  std::unique_ptr<char[]> arg_storage;
-
-  if (num_args > 0)
-  {
-    atypes = std::make_unique<ffi_type*[]>(num_args);
-    avalues = std::make_unique<void*[]>(num_args);
-    arg_storage = std::make_unique<char[]>(sizeof(long double) * num_args);
-
-    for (uint32_t i = 0; i < num_args; i++)
-    {
-      JSValue type_val = JS_GetPropertyUint32(ctx, arg_types_js, i);
-      const char* type_str = JS_ToCString(ctx, type_val);
-      atypes[i] = string_to_ffi_type(type_str);
-      if (!atypes[i])
-      {
-        JS_FreeCString(ctx, type_str);
-        JS_FreeValue(ctx, type_val);
-        return JS_ThrowTypeError(ctx, "Invalid argument type");
-      }
-
-      char* current_arg_ptr = arg_storage.get() + i * sizeof(long double);
-
-      // 整数类型
-      if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0)
-      {
-        JS_ToInt32(ctx, (int32_t*)current_arg_ptr, argv[3 + i]);
-      }
-      else if (strcmp(type_str, "uint") == 0 || strcmp(type_str, "uint32") == 0)
-      {
-        JS_ToUint32(ctx, (uint32_t*)current_arg_ptr, argv[3 + i]);
-      }
-      else if (strcmp(type_str, "int8") == 0 || strcmp(type_str, "char") == 0)
-      {
-        int32_t val;
-        JS_ToInt32(ctx, &val, argv[3 + i]);
-        *(int8_t*)current_arg_ptr = (int8_t)val;
-      }
-      else if (strcmp(type_str, "uint8") == 0 || strcmp(type_str, "uchar") == 0)
-      {
-        uint32_t val;
-        JS_ToUint32(ctx, &val, argv[3 + i]);
-        *(uint8_t*)current_arg_ptr = (uint8_t)val;
-      }
-      else if (strcmp(type_str, "int16") == 0)
-      {
-        int32_t val;
-        JS_ToInt32(ctx, &val, argv[3 + i]);
-        *(int16_t*)current_arg_ptr = (int16_t)val;
-      }
-      else if (strcmp(type_str, "uint16") == 0)
-      {
-        uint32_t val;
-        JS_ToUint32(ctx, &val, argv[3 + i]);
-        *(uint16_t*)current_arg_ptr = (uint16_t)val;
-      }
-      else if (strcmp(type_str, "int64") == 0 || strcmp(type_str, "ssize_t") == 0 || strcmp(type_str, "long") == 0)
-      {
-        JS_ToInt64(ctx, (int64_t*)current_arg_ptr, argv[3 + i]);
-      }
-      else if (strcmp(type_str, "uint64") == 0 || strcmp(type_str, "size_t") == 0 || strcmp(type_str, "ulong") == 0)
-      {
-        int64_t val;
-        JS_ToInt64(ctx, &val, argv[3 + i]);
-        *(uint64_t*)current_arg_ptr = (uint64_t)val;
-      }
-      // 浮点数类型
-      else if (strcmp(type_str, "float") == 0)
-      {
-        double val;
-        JS_ToFloat64(ctx, &val, argv[3 + i]);
-        *(float*)current_arg_ptr = (float)val;
-      }
-      else if (strcmp(type_str, "double") == 0)
-      {
-        JS_ToFloat64(ctx, (double*)current_arg_ptr, argv[3 + i]);
-      }
-      else if (strcmp(type_str, "longdouble") == 0)
-      {
-        double val;
-        JS_ToFloat64(ctx, &val, argv[3 + i]);
-        *(long double*)current_arg_ptr = (long double)val;
-      }
-      // 指针和字符串类型
-      else if (strcmp(type_str, "pointer") == 0)
-      {
-        if (JS_IsString(argv[3 + i])) 
-        {
-          // 如果传入的是字符串，转换为字符指针
-          const char* str = JS_ToCString(ctx, argv[3 + i]);
-          *(const char**)current_arg_ptr = str;
-          // 注意：这里的字符串指针会在函数结束后失效，实际应用中需要管理生命周期
-        }
-        else
-        {
-          int64_t ptr_val;
-          JS_ToInt64(ctx, &ptr_val, argv[3 + i]);
-          *(void**)current_arg_ptr = (void*)(uintptr_t)ptr_val;
-        }
-      }
-      else if (strcmp(type_str, "string") == 0)
-      {
-        const char* str = JS_ToCString(ctx, argv[3 + i]);
-        *(const char**)current_arg_ptr = str;
-      }
-      else if (strcmp(type_str, "callback") == 0)
-      {
-        // 回调函数参数直接作为指针处理，需要预先通过createCallback创建
-        int64_t callback_ptr_val;
-        JS_ToInt64(ctx, &callback_ptr_val, argv[3 + i]);
-        *(void**)current_arg_ptr = (void*)(uintptr_t)callback_ptr_val;
-      }
-
-      avalues[i] = current_arg_ptr;
-
-      JS_FreeCString(ctx, type_str);
-      JS_FreeValue(ctx, type_val);
-    }
-  }
-
-  ffi_cif cif;
-  if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, num_args, rtype, atypes.get()) != FFI_OK)
-  {
-    return JS_ThrowInternalError(ctx, "ffi_prep_cif failed");
-  }
-
-  long double rvalue_storage;
-  ffi_call(&cif, func_ptr, &rvalue_storage, avalues.get());
-
   JSValue js_ret;
 
   // 整数类型返回值
   if (rtype == &ffi_type_sint || rtype == &ffi_type_sint32)
   {
-    js_ret = JS_NewInt32(ctx, *(int32_t*)&rvalue_storage);
+    js_ret = JS_NewInt32(ctx, *(const int32_t*)storage);
   }
   else if (rtype == &ffi_type_uint || rtype == &ffi_type_uint32)
   {
-    js_ret = JS_NewUint32(ctx, *(uint32_t*)&rvalue_storage);
+    js_ret = JS_NewUint32(ctx, *(const uint32_t*)storage);
   }
   else if (rtype == &ffi_type_sint8 || rtype == &ffi_type_schar)
   {
-    js_ret = JS_NewInt32(ctx, *(int8_t*)&rvalue_storage);
+    js_ret = JS_NewInt32(ctx, *(const int8_t*)storage);
   }
   else if (rtype == &ffi_type_uint8 || rtype == &ffi_type_uchar)
   {
-    js_ret = JS_NewUint32(ctx, *(uint8_t*)&rvalue_storage);
+    js_ret = JS_NewUint32(ctx, *(const uint8_t*)storage);
   }
   else if (rtype == &ffi_type_sint16)
   {
-    js_ret = JS_NewInt32(ctx, *(int16_t*)&rvalue_storage);
+    js_ret = JS_NewInt32(ctx, *(const int16_t*)storage);
   }
   else if (rtype == &ffi_type_uint16)
   {
-    js_ret = JS_NewUint32(ctx, *(uint16_t*)&rvalue_storage);
+    js_ret = JS_NewUint32(ctx, *(const uint16_t*)storage);
   }
   else if (rtype == &ffi_type_sint64 || rtype == &ffi_type_slong)
   {
-    js_ret = JS_NewInt64(ctx, *(int64_t*)&rvalue_storage);
+    js_ret = JS_NewInt64(ctx, *(const int64_t*)storage);
   }
   else if (rtype == &ffi_type_uint64 || rtype == &ffi_type_ulong)
   {
-    js_ret = JS_NewBigUint64(ctx, *(uint64_t*)&rvalue_storage);
+    js_ret = JS_NewBigUint64(ctx, *(const uint64_t*)storage);
   }
   // 浮点数类型返回值
   else if (rtype == &ffi_type_float)
   {
-    js_ret = JS_NewFloat64(ctx, *(float*)&rvalue_storage);
+    js_ret = JS_NewFloat64(ctx, *(const float*)storage);
   }
   else if (rtype == &ffi_type_double)
   {
-    js_ret = JS_NewFloat64(ctx, *(double*)&rvalue_storage);
+    js_ret = JS_NewFloat64(ctx, *(const double*)storage);
   }
   else if (rtype == &ffi_type_longdouble)
   {
-    js_ret = JS_NewFloat64(ctx, (double)*(long double*)&rvalue_storage);
+    js_ret = JS_NewFloat64(ctx, (double)*(const long double*)storage);
   }
   // 指针类型返回值
   else if (rtype == &ffi_type_pointer)
   {
-    void* ptr = *(void**)&rvalue_storage;
+    void* ptr = *(void* const*)storage;
     if (ptr == nullptr)
     {
       js_ret = JS_NULL;
@@ -420,258 +604,4155 @@ static JSValue js_ffi_call(JSContext* ctx, JSValueConst this_val, int argc, JSVa
   return js_ret;
 }
 
-// JS: FFI.close(handle)
-static JSValue js_ffi_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
-{
-  int64_t handle_val;
-  if (JS_ToInt64(ctx, &handle_val, argv[0])) return JS_EXCEPTION;
+// ---------------------------------------------------------------------------
+// 调用签名缓存
+//
+// call(fn, ret, types, ...args) 原本每次都要逐个解析类型字符串并执行
+// ffi_prep_cif。这里按（函数指针，返回类型，参数类型）缓存准备好的 cif 和
+// 每个参数的转换方式，同一调用点的重复调用只需比较类型 atom。键取的是类型
+// 字符串的 atom 而不是 types 数组对象本身，数组被修改或复用时也不会误命中。
+// 缓存容量有限，按 LRU 淘汰。
+// ---------------------------------------------------------------------------
 
-  // 清理所有回调函数
-  cleanup_callbacks();
+// 参数转换方式，与类型字符串一一对应
+enum FFIArgKind : uint8_t {
+  FFI_ARG_INT32,
+  FFI_ARG_UINT32,
+  FFI_ARG_INT8,
+  FFI_ARG_UINT8,
+  FFI_ARG_INT16,
+  FFI_ARG_UINT16,
+  FFI_ARG_INT64,
+  FFI_ARG_UINT64,
+  FFI_ARG_FLOAT,
+  FFI_ARG_DOUBLE,
+  FFI_ARG_LONGDOUBLE,
+  FFI_ARG_POINTER,
+  FFI_ARG_STRING,
+  FFI_ARG_CALLBACK,
+  FFI_ARG_STRING_ARRAY, // JS 字符串数组打包成一块 char** 内存，调用结束后释放
+  FFI_ARG_OTHER,
+  FFI_ARG_OUT,         // {out: type}：传入内部槽位的地址，调用后返回槽位中的值
+  FFI_ARG_INOUT,       // {inout: type}：同上，槽位先写入调用方给出的初始值
+};
 
-  dlclose((void*)(uintptr_t)handle_val);
-  return JS_UNDEFINED;
-}
+// types 数组中参数的写法：类型字符串、{out: type} 或 {inout: type}
+enum FFIArgMode : uint8_t {
+  FFI_MODE_VALUE,
+  FFI_MODE_OUT,
+  FFI_MODE_INOUT,
+};
 
-// JS: FFI.malloc(size)
-static JSValue js_ffi_malloc(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+static FFIArgKind ffi_arg_kind(const char* type_str)
 {
-  uint32_t size;
-  if (JS_ToUint32(ctx, &size, argv[0])) return JS_EXCEPTION;
+  if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0) return FFI_ARG_INT32;
+  if (strcmp(type_str, "uint") == 0 || strcmp(type_str, "uint32") == 0) return FFI_ARG_UINT32;
+  if (strcmp(type_str, "int8") == 0 || strcmp(type_str, "char") == 0) return FFI_ARG_INT8;
+  if (strcmp(type_str, "uint8") == 0 || strcmp(type_str, "uchar") == 0) return FFI_ARG_UINT8;
+  if (strcmp(type_str, "int16") == 0) return FFI_ARG_INT16;
+  if (strcmp(type_str, "uint16") == 0) return FFI_ARG_UINT16;
+  if (strcmp(type_str, "int64") == 0 || strcmp(type_str, "ssize_t") == 0 || strcmp(type_str, "long") == 0) return FFI_ARG_INT64;
+  if (strcmp(type_str, "uint64") == 0 || strcmp(type_str, "size_t") == 0 || strcmp(type_str, "ulong") == 0) return FFI_ARG_UINT64;
+  if (strcmp(type_str, "float") == 0) return FFI_ARG_FLOAT;
+  if (strcmp(type_str, "double") == 0) return FFI_ARG_DOUBLE;
+  if (strcmp(type_str, "longdouble") == 0) return FFI_ARG_LONGDOUBLE;
+  if (strcmp(type_str, "pointer") == 0) return FFI_ARG_POINTER;
+  if (strcmp(type_str, "string") == 0) return FFI_ARG_STRING;
+  if (strcmp(type_str, "callback") == 0) return FFI_ARG_CALLBACK;
+  if (strcmp(type_str, "stringArray") == 0) return FFI_ARG_STRING_ARRAY;
+  return FFI_ARG_OTHER;
+}
 
-  void* ptr = malloc(size);
-  if (!ptr) {
-    return JS_ThrowOutOfMemory(ctx);
+struct CallSignature {
+  JSRuntime* rt = nullptr;
+  void* fn = nullptr;
+  size_t hash = 0;
+  JSAtom ret_atom = JS_ATOM_NULL;
+  std::vector<JSAtom> arg_atoms;
+  std::vector<uint8_t> arg_modes;      // FFIArgMode
+  int32_t fixed_args = -1;             // 可变参数函数的固定参数个数，-1 表示普通函数
+
+  ffi_cif cif;
+  ffi_type* rtype = nullptr;
+  std::vector<ffi_type*> atypes;
+  std::vector<FFIArgKind> kinds;
+  std::vector<ffi_type*> out_types;    // 输出参数指向的类型，其余为 nullptr
+  uint32_t num_outs = 0;
+  uint32_t min_args = 0;               // 末尾的 out 参数可以省略
+  FFIRecordType record_ret = FFI_REC_VOID;
+  std::vector<uint8_t> record_types;   // 录制日志中的参数类型（FFIRecordType）
+
+  ~CallSignature() {
+    if (!rt) return;
+    if (ret_atom != JS_ATOM_NULL) JS_FreeAtomRT(rt, ret_atom);
+    for (JSAtom atom : arg_atoms) JS_FreeAtomRT(rt, atom);
   }
+};
 
-  // 初始化为0
-  memset(ptr, 0, size);
+struct CallCache {
+  typedef std::list<std::shared_ptr<CallSignature>> LruList;
 
-  return JS_NewInt64(ctx, (int64_t)(uintptr_t)ptr);
+  size_t capacity = 256;
+  LruList lru;                                            // 头部是最近使用的条目
+  std::unordered_multimap<size_t, LruList::iterator> index;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+// 有意不析构：进程退出时 runtime 已经释放，不能再释放条目持有的 atom。
+// 各 runtime 的条目在其上下文销毁时由 call_cache_purge_runtime 清除
+static CallCache& call_cache()
+{
+  static CallCache* cache = new CallCache;
+  return *cache;
 }
 
-// JS: FFI.free(ptr)
-static JSValue js_ffi_free(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+static size_t call_cache_hash(void* fn, JSAtom ret_atom, const JSAtom* atoms, const uint8_t* modes,
+                              uint32_t count, int32_t fixed_args)
 {
-  int64_t ptr_val;
-  if (JS_ToInt64(ctx, &ptr_val, argv[0])) return JS_EXCEPTION;
+  uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)(uintptr_t)fn;
+  h = (h ^ ret_atom ^ ((uint64_t)(uint32_t)fixed_args << 32)) * 0x100000001b3ULL;
+  for (uint32_t i = 0; i < count; i++) {
+    h = (h ^ atoms[i] ^ ((uint64_t)modes[i] << 32)) * 0x100000001b3ULL;
+  }
+  return (size_t)(h ^ (h >> 29));
+}
 
-  void* ptr = (void*)(uintptr_t)ptr_val;
-  if (ptr) {
-    free(ptr);
+static void call_cache_evict_lru(CallCache& cache)
+{
+  CallCache::LruList::iterator victim = std::prev(cache.lru.end());
+  auto range = cache.index.equal_range((*victim)->hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == victim) {
+      cache.index.erase(it);
+      break;
+    }
   }
+  cache.lru.erase(victim);
+  cache.evictions++;
+}
 
-  return JS_UNDEFINED;
+static void call_cache_trim(CallCache& cache, size_t capacity)
+{
+  while (cache.lru.size() > capacity) call_cache_evict_lru(cache);
 }
 
-// JS: FFI.writeArray(ptr, array, type, count)
-static JSValue js_ffi_writeArray(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+// 丢弃 rt 的所有条目，必须在 rt 的 atom 仍然有效时调用
+static void call_cache_purge_runtime(JSRuntime* rt)
 {
-  if (argc < 4) return JS_ThrowTypeError(ctx, "writeArray requires 4 arguments");
+  CallCache& cache = call_cache();
+  for (auto it = cache.index.begin(); it != cache.index.end();) {
+    if ((*it->second)->rt == rt) {
+      cache.lru.erase(it->second);
+      it = cache.index.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
 
-  int64_t ptr_val;
-  if (JS_ToInt64(ctx, &ptr_val, argv[0])) return JS_EXCEPTION;
-  void* ptr = (void*)(uintptr_t)ptr_val;
-  if (!ptr) return JS_ThrowTypeError(ctx, "Invalid pointer");
+// 每个上下文一个哨兵对象，挂在 NativeBuffer 原型上；上下文销毁时（runtime
+// 和它的 atom 仍然存在）由 finalizer 清除该 runtime 的签名条目，之后的淘汰
+// 不会再对已释放的 runtime 调用 JS_FreeAtomRT，同地址的新 runtime 也不会
+// 命中旧的 atom
+static JSClassID js_ffi_cache_owner_class_id;
 
-  if (!JS_IsArray(ctx, argv[1])) return JS_ThrowTypeError(ctx, "Second argument must be an array");
+static void js_ffi_cache_owner_finalizer(JSRuntime* rt, JSValue val)
+{
+  call_cache_purge_runtime(rt);
+}
 
-  const char* type_str = JS_ToCString(ctx, argv[2]);
-  if (!type_str) return JS_EXCEPTION;
+static JSClassDef js_ffi_cache_owner_class = {
+  "CallCacheOwner",
+  js_ffi_cache_owner_finalizer,
+};
 
-  uint32_t count;
-  if (JS_ToUint32(ctx, &count, argv[3])) {
-    JS_FreeCString(ctx, type_str);
-    return JS_EXCEPTION;
+// C 的默认参数提升：可变参数部分的 float 按 double 传递，比 int 窄的整数按 int 传递
+static ffi_type* ffi_promote_variadic(ffi_type* type)
+{
+  if (type == &ffi_type_float) return &ffi_type_double;
+  switch (type->type) {
+    case FFI_TYPE_SINT8:
+    case FFI_TYPE_UINT8:
+    case FFI_TYPE_SINT16:
+    case FFI_TYPE_UINT16:
+      return &ffi_type_sint;
+    default:
+      return type;
   }
+}
 
-  // 根据类型写入数组
-  for (uint32_t i = 0; i < count; i++) {
-    JSValue elem = JS_GetPropertyUint32(ctx, argv[1], i);
+// 缓存未命中时解析类型并准备 cif；失败时抛出异常并返回 nullptr
+static std::shared_ptr<CallSignature> call_signature_create(JSContext* ctx, void* fn, size_t hash,
+                                                            JSAtom ret_atom, const JSAtom* atoms,
+                                                            const uint8_t* modes, uint32_t num_args,
+                                                            int32_t fixed_args)
+{
+  auto sig = std::make_shared<CallSignature>();
+  sig->fn = fn;
+  sig->hash = hash;
+  sig->atypes.resize(num_args);
+  sig->kinds.resize(num_args);
+  sig->out_types.assign(num_args, nullptr);
 
-    if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0) {
-      int32_t val;
-      JS_ToInt32(ctx, &val, elem);
-      ((int32_t*)ptr)[i] = val;
-    }
+  const char* ret_type_str = JS_AtomToCString(ctx, ret_atom);
+  if (!ret_type_str) return nullptr;
+  sig->rtype = string_to_ffi_type(ret_type_str);
+  JS_FreeCString(ctx, ret_type_str);
+  if (!sig->rtype) {
+    JS_ThrowTypeError(ctx, "Invalid return type");
+    return nullptr;
+  }
+
+  for (uint32_t i = 0; i < num_args; i++) {
+    const char* type_str = JS_AtomToCString(ctx, atoms[i]);
+    if (!type_str) return nullptr;
+    ffi_type* type = string_to_ffi_type(type_str);
+    FFIArgKind kind = ffi_arg_kind(type_str);
+    JS_FreeCString(ctx, type_str);
+    if (!type) {
+      JS_ThrowTypeError(ctx, "Invalid argument type");
+      return nullptr;
+    }
+    if (modes[i] == FFI_MODE_VALUE) {
+      // kind 仍按声明的类型转换，写入槽位时按提升后的类型存放
+      sig->atypes[i] = fixed_args >= 0 && i >= (uint32_t)fixed_args ? ffi_promote_variadic(type) : type;
+      sig->kinds[i] = kind;
+      continue;
+    }
+    // 输出参数的槽位按值类型转换，string/callback 没有对应的 JS 值
+    if (type == &ffi_type_void || kind == FFI_ARG_STRING || kind == FFI_ARG_CALLBACK ||
+        kind == FFI_ARG_STRING_ARRAY) {
+      JS_ThrowTypeError(ctx, "Unsupported out-parameter type");
+      return nullptr;
+    }
+    sig->atypes[i] = &ffi_type_pointer;
+    sig->kinds[i] = modes[i] == FFI_MODE_OUT ? FFI_ARG_OUT : FFI_ARG_INOUT;
+    sig->out_types[i] = type;
+    sig->num_outs++;
+  }
+  sig->record_ret = ffi_record_type(sig->rtype);
+  for (ffi_type* type : sig->atypes) sig->record_types.push_back(ffi_record_type(type));
+  sig->min_args = num_args;
+  while (sig->min_args > 0 && modes[sig->min_args - 1] == FFI_MODE_OUT) sig->min_args--;
+
+  ffi_status status = fixed_args < 0
+    ? ffi_prep_cif(&sig->cif, FFI_DEFAULT_ABI, num_args, sig->rtype, sig->atypes.data())
+    : ffi_prep_cif_var(&sig->cif, FFI_DEFAULT_ABI, (unsigned)fixed_args, num_args, sig->rtype, sig->atypes.data());
+  if (status != FFI_OK) {
+    JS_ThrowInternalError(ctx, fixed_args < 0 ? "ffi_prep_cif failed" : "ffi_prep_cif_var failed");
+    return nullptr;
+  }
+
+  // 准备成功后才持有 atom
+  sig->rt = JS_GetRuntime(ctx);
+  sig->ret_atom = JS_DupAtom(ctx, ret_atom);
+  sig->arg_atoms.assign(atoms, atoms + num_args);
+  for (JSAtom atom : sig->arg_atoms) JS_DupAtom(ctx, atom);
+  sig->arg_modes.assign(modes, modes + num_args);
+  sig->fixed_args = fixed_args;
+  return sig;
+}
+
+// 返回的 shared_ptr 在调用期间保持条目存活：回调中的嵌套调用可能把它淘汰。
+// 可变参数调用的键包含固定参数个数和全部参数类型，每种实参类型组合各有一个 cif
+static std::shared_ptr<CallSignature> call_signature_lookup(JSContext* ctx, void* fn, JSAtom ret_atom,
+                                                            const JSAtom* atoms, const uint8_t* modes,
+                                                            uint32_t num_args, int32_t fixed_args)
+{
+  CallCache& cache = call_cache();
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  size_t hash = call_cache_hash(fn, ret_atom, atoms, modes, num_args, fixed_args);
+
+  auto range = cache.index.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const CallSignature& sig = **it->second;
+    if (sig.fn != fn || sig.rt != rt || sig.ret_atom != ret_atom || sig.fixed_args != fixed_args ||
+        sig.arg_atoms.size() != num_args ||
+        !std::equal(sig.arg_atoms.begin(), sig.arg_atoms.end(), atoms) ||
+        !std::equal(sig.arg_modes.begin(), sig.arg_modes.end(), modes)) {
+      continue;
+    }
+    cache.hits++;
+    cache.lru.splice(cache.lru.begin(), cache.lru, it->second);
+    return *it->second;
+  }
+
+  cache.misses++;
+  std::shared_ptr<CallSignature> sig = call_signature_create(ctx, fn, hash, ret_atom, atoms, modes, num_args,
+                                                             fixed_args);
+  if (!sig || cache.capacity == 0) return sig;
+
+  call_cache_trim(cache, cache.capacity - 1);
+  cache.lru.push_front(sig);
+  cache.index.emplace(hash, cache.lru.begin());
+  return sig;
+}
+
+// types 数组中的一项：类型字符串返回其 atom；{out: type} / {inout: type} 返回内部类型的 atom
+static JSAtom js_ffi_arg_type_atom(JSContext* ctx, JSValueConst type_val, uint8_t* mode)
+{
+  *mode = FFI_MODE_VALUE;
+  if (!JS_IsObject(type_val)) return JS_ValueToAtom(ctx, type_val);
+
+  JSValue inner = JS_GetPropertyStr(ctx, type_val, "out");
+  *mode = FFI_MODE_OUT;
+  if (JS_IsUndefined(inner)) {
+    inner = JS_GetPropertyStr(ctx, type_val, "inout");
+    *mode = FFI_MODE_INOUT;
+  }
+  if (!JS_IsString(inner)) {
+    JS_FreeValue(ctx, inner);
+    JS_ThrowTypeError(ctx, "Argument type objects must be {out: type} or {inout: type}");
+    return JS_ATOM_NULL;
+  }
+  JSAtom atom = JS_ValueToAtom(ctx, inner);
+  JS_FreeValue(ctx, inner);
+  return atom;
+}
+
+// 取得输出参数 TypedArray 第一个元素的地址，元素大小必须与输出类型一致
+static uint8_t* js_ffi_out_target(JSContext* ctx, JSValueConst val, size_t elem_size)
+{
+  size_t byte_offset, byte_length, bytes_per_element;
+  JSValue ab = JS_GetTypedArrayBuffer(ctx, val, &byte_offset, &byte_length, &bytes_per_element);
+  if (JS_IsException(ab)) return nullptr;
+  size_t size;
+  uint8_t* data = JS_GetArrayBuffer(ctx, &size, ab);
+  JS_FreeValue(ctx, ab);
+  if (!data) return nullptr;
+  if (bytes_per_element != elem_size || byte_length < elem_size) {
+    JS_ThrowTypeError(ctx, "Out-parameter TypedArray must have %zu-byte elements", elem_size);
+    return nullptr;
+  }
+  return data + byte_offset;
+}
+
+// 指针表不超过 2 GiB
+static const size_t kMaxStringArrayLength = INT32_MAX / sizeof(char*) - 1;
+
+// 把 JS 字符串数组编码为一块连续内存：n + 1 个指针（最后一个为 NULL，与 argv 相同），
+// 随后是各字符串以 0 结尾的 UTF-8 内容，指针指向块内。整块用 free() 释放。
+// 失败时抛出异常并返回 nullptr
+static char** js_ffi_pack_strings(JSContext* ctx, JSValueConst array, size_t* size_out)
+{
+  if (!JS_IsArray(ctx, array)) {
+    JS_ThrowTypeError(ctx, "stringArray argument must be an array of strings");
+    return nullptr;
+  }
+  JSValue len_val = JS_GetPropertyStr(ctx, array, "length");
+  uint32_t count;
+  int ret = JS_ToUint32(ctx, &count, len_val);
+  JS_FreeValue(ctx, len_val);
+  if (ret) return nullptr;
+  // length 可以随意设置（稀疏数组），在读取元素之前不能据此分配
+  if (count > kMaxStringArrayLength) {
+    JS_ThrowRangeError(ctx, "stringArray length %u exceeds the limit of %zu", count, kMaxStringArrayLength);
+    return nullptr;
+  }
+
+  // 先取得全部 C 字符串以确定总大小，再一次性分配；列表随读取的元素增长
+  std::vector<std::pair<const char*, size_t>> items;
+  items.reserve(std::min<size_t>(count, 1024));
+  struct ItemGuard {
+    JSContext* ctx;
+    std::vector<std::pair<const char*, size_t>>& items;
+    ~ItemGuard() { for (const auto& item : items) JS_FreeCString(ctx, item.first); }
+  } item_guard{ctx, items};
+
+  size_t total = ((size_t)count + 1) * sizeof(char*);
+  for (uint32_t i = 0; i < count; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, array, i);
+    if (!JS_IsString(item)) {
+      JS_FreeValue(ctx, item);
+      JS_ThrowTypeError(ctx, "stringArray element %u is not a string", i);
+      return nullptr;
+    }
+    size_t len;
+    const char* str = JS_ToCStringLen(ctx, &len, item);
+    JS_FreeValue(ctx, item);
+    if (!str) return nullptr;
+    items.emplace_back(str, len);
+    total += len + 1;
+  }
+
+  char** block = (char**)malloc(total);
+  if (!block) {
+    JS_ThrowOutOfMemory(ctx);
+    return nullptr;
+  }
+  char* payload = (char*)(block + count + 1);
+  for (uint32_t i = 0; i < count; i++) {
+    block[i] = payload;
+    memcpy(payload, items[i].first, items[i].second + 1);
+    payload += items[i].second + 1;
+  }
+  block[count] = nullptr;
+  if (size_out) *size_out = total;
+  return block;
+}
+
+static size_t mem_block_size(void* ptr);
+
+// 录制一个已转换的参数。指针参数的长度未知时到 ffi.malloc 的记账中查找，
+// out/inout 参数记录为其槽位
+static void record_call_arg(FFIRecordCall& record, const CallSignature& sig, uint32_t i,
+                            const void* slot, size_t ptr_size, bool is_string)
+{
+  switch (sig.kinds[i]) {
+    case FFI_ARG_STRING:
+      record.string(*(const char* const*)slot);
+      return;
+    case FFI_ARG_CALLBACK:
+      record.callback(*(void* const*)slot);
+      return;
+    case FFI_ARG_STRING_ARRAY:
+      record.string_array(*(const char* const* const*)slot);
+      return;
+    case FFI_ARG_OUT:
+    case FFI_ARG_INOUT:
+      record.pointer(*(void* const*)slot, sig.out_types[i]->size);
+      return;
+    default:
+      break;
+  }
+  if (sig.atypes[i] != &ffi_type_pointer) {
+    record.value(slot, sig.atypes[i]->size);
+  } else if (is_string) {
+    record.string(*(const char* const*)slot);
+  } else {
+    void* ptr = *(void* const*)slot;
+    record.pointer(ptr, (ptr_size != SIZE_MAX || !ptr) ? ptr_size : mem_block_size(ptr));
+  }
+}
+
+// JS: FFI.call(func_ptr, ret_type_str, [arg_types_str...], ...args)
+// 参数类型写成 {out: type} 或 {inout: type} 时返回 {ret, outs}，对应的参数可以是
+// undefined（out）、初始值（inout）或元素大小相同的 TypedArray（读写其第一个元素）。
+// 可变参数函数把类型数组换成 {types: [...], variadic: fixedCount}，types 列出本次
+// 调用的全部参数，前 fixedCount 个是固定参数
+static JSValue js_ffi_call(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "FFI.call requires at least 3 arguments");
+
+  int64_t func_ptr_val;
+  if (JS_ToInt64(ctx, &func_ptr_val, argv[0])) return JS_EXCEPTION;
+  void (*func_ptr)(void) = (void (*)(void))(uintptr_t)func_ptr_val;
+
+  // {types, variadic} 形式时 types_val 持有其中的类型数组
+  JSValue types_val = JS_DupValue(ctx, argv[2]);
+  int64_t fixed_args = -1;
+  if (JS_IsObject(types_val) && !JS_IsArray(ctx, types_val)) {
+    int ret = js_ffi_get_int64_option(ctx, argv[2], "variadic", &fixed_args);
+    JS_FreeValue(ctx, types_val);
+    if (ret) return JS_EXCEPTION;
+    types_val = JS_GetPropertyStr(ctx, argv[2], "types");
+  }
+  if (!JS_IsArray(ctx, types_val)) {
+    JS_FreeValue(ctx, types_val);
+    return JS_ThrowTypeError(ctx, "Argument types must be an array");
+  }
+
+  JSValue len_val = JS_GetPropertyStr(ctx, types_val, "length");
+  uint32_t num_args;
+  JS_ToUint32(ctx, &num_args, len_val);
+  JS_FreeValue(ctx, len_val);
+
+  if ((uint32_t)(argc - 3) > num_args)
+  {
+    JS_FreeValue(ctx, types_val);
+    return JS_ThrowTypeError(ctx, "Incorrect number of arguments. Expected %d, got %d", num_args, argc - 3);
+  }
+  if (fixed_args != -1 && (fixed_args < 1 || fixed_args > (int64_t)num_args))
+  {
+    JS_FreeValue(ctx, types_val);
+    return JS_ThrowRangeError(ctx, "variadic must be between 1 and the number of argument types (%u)", num_args);
+  }
+
+  // 取得返回类型和参数类型的 atom 作为缓存键
+  JSAtom ret_atom = JS_ValueToAtom(ctx, argv[1]);
+  if (ret_atom == JS_ATOM_NULL) {
+    JS_FreeValue(ctx, types_val);
+    return JS_EXCEPTION;
+  }
+
+  JSAtom inline_atoms[16];
+  uint8_t inline_modes[16];
+  std::unique_ptr<JSAtom[]> heap_atoms;
+  std::unique_ptr<uint8_t[]> heap_modes;
+  JSAtom* atoms = inline_atoms;
+  uint8_t* modes = inline_modes;
+  if (num_args > 16) {
+    heap_atoms.reset(new JSAtom[num_args]);
+    heap_modes.reset(new uint8_t[num_args]);
+    atoms = heap_atoms.get();
+    modes = heap_modes.get();
+  }
+  uint32_t num_atoms = 0;
+  for (; num_atoms < num_args; num_atoms++) {
+    JSValue type_val = JS_GetPropertyUint32(ctx, types_val, num_atoms);
+    atoms[num_atoms] = js_ffi_arg_type_atom(ctx, type_val, &modes[num_atoms]);
+    JS_FreeValue(ctx, type_val);
+    if (atoms[num_atoms] == JS_ATOM_NULL) break;
+  }
+  JS_FreeValue(ctx, types_val);
+
+  std::shared_ptr<CallSignature> sig;
+  if (num_atoms == num_args) {
+    sig = call_signature_lookup(ctx, (void*)func_ptr, ret_atom, atoms, modes, num_args, (int32_t)fixed_args);
+  }
+  JS_FreeAtom(ctx, ret_atom);
+  for (uint32_t i = 0; i < num_atoms; i++) JS_FreeAtom(ctx, atoms[i]);
+  if (!sig) return JS_EXCEPTION;
+
+  if ((uint32_t)(argc - 3) < sig->min_args)
+  {
+    return JS_ThrowTypeError(ctx, "Incorrect number of arguments. Expected %d, got %d", num_args, argc - 3);
+  }
+
+  // 参数存储区：每个参数一个 long double 大小的槽位，后半部分是输出参数的槽位
+  long double inline_storage[32];
+  void* inline_avalues[16];
+  std::unique_ptr<long double[]> heap_storage;
+  std::unique_ptr<void*[]> heap_avalues;
+  long double* arg_storage = inline_storage;
+  void** avalues = inline_avalues;
+  if (num_args > 16) {
+    heap_storage.reset(new long double[2 * num_args]);
+    heap_avalues.reset(new void*[num_args]);
+    arg_storage = heap_storage.get();
+    avalues = heap_avalues.get();
+  }
+  long double* out_storage = arg_storage + (num_args > 16 ? num_args : 16);
+
+  // string 参数转换出的 C 字符串和 stringArray 参数打包出的内存块，调用结束后释放
+  std::vector<const char*> cstrings;
+  std::vector<char**> packed;
+  struct CStringGuard {
+    JSContext* ctx;
+    std::vector<const char*>& strs;
+    std::vector<char**>& blocks;
+    ~CStringGuard() {
+      for (const char* str : strs) JS_FreeCString(ctx, str);
+      for (char** block : blocks) free(block);
+    }
+  } cstring_guard{ctx, cstrings, packed};
+
+  // 录制模式：参数转换后逐个写入记录，调用返回后连同原生耗时写入日志
+  std::unique_ptr<FFIRecordCall> record;
+  if (ffi_record_enabled()) {
+    record.reset(new FFIRecordCall((void*)func_ptr, sig->record_ret, sig->record_types.data(), num_args,
+                                   sig->fixed_args));
+  }
+
+  for (uint32_t i = 0; i < num_args; i++)
+  {
+    void* current_arg_ptr = &arg_storage[i];
+    JSValueConst arg = (int)(3 + i) < argc ? argv[3 + i] : JS_UNDEFINED;
+    size_t ptr_size = SIZE_MAX;
+    int ret = 0;
+
+    switch (sig->kinds[i])
+    {
+      // 整数类型
+      case FFI_ARG_INT32:
+        ret = JS_ToInt32(ctx, (int32_t*)current_arg_ptr, arg);
+        break;
+      case FFI_ARG_UINT32:
+        ret = JS_ToUint32(ctx, (uint32_t*)current_arg_ptr, arg);
+        break;
+      // 可变参数部分提升为 int 的窄整数先按声明的类型截断，再按 int 写入
+      case FFI_ARG_INT8:
+      case FFI_ARG_INT16:
+      {
+        int32_t val;
+        ret = JS_ToInt32(ctx, &val, arg);
+        if (sig->kinds[i] == FFI_ARG_INT8) val = (int8_t)val;
+        else val = (int16_t)val;
+        if (sig->atypes[i] == &ffi_type_sint) *(int32_t*)current_arg_ptr = val;
+        else if (sig->kinds[i] == FFI_ARG_INT8) *(int8_t*)current_arg_ptr = (int8_t)val;
+        else *(int16_t*)current_arg_ptr = (int16_t)val;
+        break;
+      }
+      case FFI_ARG_UINT8:
+      case FFI_ARG_UINT16:
+      {
+        uint32_t val;
+        ret = JS_ToUint32(ctx, &val, arg);
+        if (sig->kinds[i] == FFI_ARG_UINT8) val = (uint8_t)val;
+        else val = (uint16_t)val;
+        if (sig->atypes[i] == &ffi_type_sint) *(int32_t*)current_arg_ptr = (int32_t)val;
+        else if (sig->kinds[i] == FFI_ARG_UINT8) *(uint8_t*)current_arg_ptr = (uint8_t)val;
+        else *(uint16_t*)current_arg_ptr = (uint16_t)val;
+        break;
+      }
+      case FFI_ARG_INT64:
+      case FFI_ARG_UINT64:
+        ret = JS_IsBigInt(ctx, arg) ? JS_ToBigInt64(ctx, (int64_t*)current_arg_ptr, arg)
+                                    : JS_ToInt64(ctx, (int64_t*)current_arg_ptr, arg);
+        break;
+      // 浮点数类型
+      case FFI_ARG_FLOAT:
+      {
+        double val;
+        ret = JS_ToFloat64(ctx, &val, arg);
+        if (sig->atypes[i] == &ffi_type_double) *(double*)current_arg_ptr = (double)(float)val;
+        else *(float*)current_arg_ptr = (float)val;
+        break;
+      }
+      case FFI_ARG_DOUBLE:
+        ret = JS_ToFloat64(ctx, (double*)current_arg_ptr, arg);
+        break;
+      case FFI_ARG_LONGDOUBLE:
+      {
+        double val;
+        ret = JS_ToFloat64(ctx, &val, arg);
+        *(long double*)current_arg_ptr = (long double)val;
+        break;
+      }
+      // 指针和字符串类型
+      case FFI_ARG_POINTER:
+        if (!JS_IsString(arg))
+        {
+          ret = js_ffi_get_pointer(ctx, (void**)current_arg_ptr, arg, record ? &ptr_size : nullptr);
+          break;
+        }
+        // 如果传入的是字符串，按 char* 传递
+        /* fall through */
+      case FFI_ARG_STRING:
+      {
+        const char* str = JS_ToCString(ctx, arg);
+        if (!str) return JS_EXCEPTION;
+        cstrings.push_back(str);
+        *(const char**)current_arg_ptr = str;
+        break;
+      }
+      case FFI_ARG_CALLBACK:
+      {
+        // 回调函数参数直接作为指针处理，需要预先通过createCallback创建
+        int64_t callback_ptr_val;
+        ret = JS_ToInt64(ctx, &callback_ptr_val, arg);
+        *(void**)current_arg_ptr = (void*)(uintptr_t)callback_ptr_val;
+        break;
+      }
+      case FFI_ARG_STRING_ARRAY:
+      {
+        char** block = nullptr;
+        if (!JS_IsNull(arg) && !JS_IsUndefined(arg)) {
+          block = js_ffi_pack_strings(ctx, arg, nullptr);
+          if (!block) return JS_EXCEPTION;
+          packed.push_back(block);
+        }
+        *(char***)current_arg_ptr = block;
+        break;
+      }
+      case FFI_ARG_OTHER:
+        ret = js_ffi_store_arg(ctx, sig->atypes[i], arg, current_arg_ptr);
+        break;
+      case FFI_ARG_OUT:
+      case FFI_ARG_INOUT:
+      {
+        void* slot = &out_storage[i];
+        memset(slot, 0, sizeof(long double));
+        *(void**)current_arg_ptr = slot;
+        if (JS_IsObject(arg)) {
+          uint8_t* target = js_ffi_out_target(ctx, arg, sig->out_types[i]->size);
+          if (!target) return JS_EXCEPTION;
+          if (sig->kinds[i] == FFI_ARG_INOUT) memcpy(slot, target, sig->out_types[i]->size);
+        } else if (sig->kinds[i] == FFI_ARG_INOUT) {
+          ret = js_ffi_store_arg(ctx, sig->out_types[i], arg, slot);
+        }
+        break;
+      }
+    }
+    if (ret) return JS_EXCEPTION;
+
+    if (record) {
+      record_call_arg(*record, *sig, i, current_arg_ptr, ptr_size, JS_IsString(arg));
+    }
+    avalues[i] = current_arg_ptr;
+  }
+
+  long double rvalue_storage;
+  {
+    uint32_t trace_id = ffi_trace_enabled() ? ffi_trace_symbol_id((void*)func_ptr) : 0;
+    FFITraceScope trace_scope(FFI_TRACE_CALL, trace_id, (uintptr_t)func_ptr);
+    if (record) {
+      auto start = std::chrono::steady_clock::now();
+      ffi_call(&sig->cif, func_ptr, &rvalue_storage, avalues);
+      record->finish(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    } else {
+      ffi_call(&sig->cif, func_ptr, &rvalue_storage, avalues);
+    }
+  }
+
+  // 外层调用返回时把缓冲回调中剩余的调用交给 JS
+  if (!buffered_pending.empty() && flush_buffered_callbacks(ctx) < 0) {
+    return JS_EXCEPTION;
+  }
+
+  JSValue ret = js_ffi_to_js(ctx, sig->rtype, &rvalue_storage);
+  if (sig->num_outs == 0) return ret;
+
+  // 输出参数：按参数顺序收集，并写回调用方给出的 TypedArray
+  JSValue outs = JS_NewArray(ctx);
+  uint32_t out_index = 0;
+  for (uint32_t i = 0; i < num_args; i++)
+  {
+    if (!sig->out_types[i]) continue;
+    JSValueConst arg = (int)(3 + i) < argc ? argv[3 + i] : JS_UNDEFINED;
+    if (JS_IsObject(arg)) {
+      uint8_t* target = js_ffi_out_target(ctx, arg, sig->out_types[i]->size);
+      if (!target) {
+        JS_FreeValue(ctx, ret);
+        JS_FreeValue(ctx, outs);
+        return JS_EXCEPTION;
+      }
+      memcpy(target, &out_storage[i], sig->out_types[i]->size);
+    }
+    JS_SetPropertyUint32(ctx, outs, out_index++, js_ffi_to_js(ctx, sig->out_types[i], &out_storage[i]));
+  }
+  JSValue result = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, result, "ret", ret);
+  JS_SetPropertyStr(ctx, result, "outs", outs);
+  return result;
+}
+
+// JS: FFI.callCacheStats() - 调用签名缓存的 {hits, misses, evictions, size, capacity}
+static JSValue js_ffi_callCacheStats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  CallCache& cache = call_cache();
+  JSValue obj = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, obj, "hits", JS_NewInt64(ctx, (int64_t)cache.hits));
+  JS_SetPropertyStr(ctx, obj, "misses", JS_NewInt64(ctx, (int64_t)cache.misses));
+  JS_SetPropertyStr(ctx, obj, "evictions", JS_NewInt64(ctx, (int64_t)cache.evictions));
+  JS_SetPropertyStr(ctx, obj, "size", JS_NewInt64(ctx, (int64_t)cache.lru.size()));
+  JS_SetPropertyStr(ctx, obj, "capacity", JS_NewInt64(ctx, (int64_t)cache.capacity));
+  return obj;
+}
+
+// JS: FFI.setCallCacheSize(entries) - 0 表示关闭缓存；同时清零命中统计
+static JSValue js_ffi_setCallCacheSize(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  uint32_t capacity;
+  if (JS_ToUint32(ctx, &capacity, argv[0])) return JS_EXCEPTION;
+  CallCache& cache = call_cache();
+  call_cache_trim(cache, capacity);
+  cache.capacity = capacity;
+  cache.hits = cache.misses = cache.evictions = 0;
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.close(handle)
+static JSValue js_ffi_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int64_t handle_val;
+  if (JS_ToInt64(ctx, &handle_val, argv[0])) return JS_EXCEPTION;
+
+  // 清理前先把缓冲回调中剩余的调用交给 JS
+  int ret = buffered_pending.empty() ? 0 : flush_buffered_callbacks(ctx);
+
+  // 清理所有回调函数
+  cleanup_callbacks();
+
+  // 库中的函数地址即将失效，相应的签名条目一并丢弃
+  CallCache& cache = call_cache();
+  cache.index.clear();
+  cache.lru.clear();
+
+  dlclose((void*)(uintptr_t)handle_val);
+  return ret < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+// ---------------------------------------------------------------------------
+// 原生内存记账
+//
+// 计数器（存活数量、字节数、峰值）始终开启，只用原子操作维护；ffi.malloc
+// 的字节数取 malloc_usable_size，释放时不需要查表。逐指针表只在需要时维护：
+// 缓冲区对象持有的分配总是登记（free() 据此拒绝这些地址，创建对象本身的
+// 开销远大于一次查表），ffi.malloc 的分配只在开启位置追踪、退出报告或调用
+// 录制时登记。分配位置（脚本文件和行号）需要构造 Error 对象获取调用栈，
+// 开销较大，默认关闭。
+// ---------------------------------------------------------------------------
+
+struct AllocRecord {
+  size_t size;
+  std::string site;   // "file:line:col"，未开启位置追踪时为空
+  bool gc_owned;      // 由 ffi.alloc 缓冲区对象持有，随对象回收释放
+};
+
+struct MemAccounting {
+  std::atomic<int64_t> live_count{0};
+  std::atomic<int64_t> live_bytes{0};
+  std::atomic<int64_t> peak_bytes{0};
+  std::atomic<uint64_t> total_allocs{0};
+  std::atomic<uint64_t> total_frees{0};
+  std::atomic<size_t> soft_limit{0};      // 0 表示不限制
+  std::atomic<bool> track_sites{false};
+  std::atomic<bool> leak_report{false};   // 退出时报告未释放的 ffi.malloc 分配
+
+  std::mutex mutex;
+  std::unordered_map<void*, AllocRecord> live;
+  std::atomic<size_t> owned_entries{0};   // live 中 gc_owned 的记录数
+  std::atomic<size_t> raw_entries{0};     // live 中 ffi.malloc 的记录数
+};
+
+static MemAccounting& mem_accounting()
+{
+  static MemAccounting accounting;
+  return accounting;
+}
+
+// ffi.malloc 的分配是否需要登记到逐指针表
+static bool mem_track_pointers(const MemAccounting& acc)
+{
+  return acc.track_sites.load(std::memory_order_relaxed) ||
+         acc.leak_report.load(std::memory_order_relaxed) || ffi_record_enabled();
+}
+
+static void mem_count_alloc(MemAccounting& acc, int64_t size)
+{
+  acc.live_count.fetch_add(1, std::memory_order_relaxed);
+  acc.total_allocs.fetch_add(1, std::memory_order_relaxed);
+  int64_t live = acc.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  int64_t peak = acc.peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !acc.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+static void mem_count_free(MemAccounting& acc, int64_t size)
+{
+  acc.live_count.fetch_sub(1, std::memory_order_relaxed);
+  acc.total_frees.fetch_add(1, std::memory_order_relaxed);
+  acc.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+// ptr 是某次已登记分配的起始地址时返回其大小，否则返回 SIZE_MAX
+static size_t mem_block_size(void* ptr)
+{
+  MemAccounting& acc = mem_accounting();
+  std::lock_guard<std::mutex> lock(acc.mutex);
+  auto it = acc.live.find(ptr);
+  return it != acc.live.end() ? it->second.size : SIZE_MAX;
+}
+
+// ptr 是否由缓冲区对象（ffi.alloc/allocLarge/packStrings 等）持有，这类内存随对象释放
+static bool mem_is_gc_owned(void* ptr)
+{
+  MemAccounting& acc = mem_accounting();
+  if (acc.owned_entries.load(std::memory_order_relaxed) == 0) return false;
+  std::lock_guard<std::mutex> lock(acc.mutex);
+  auto it = acc.live.find(ptr);
+  return it != acc.live.end() && it->second.gc_owned;
+}
+
+// 从当前 JS 调用栈中取出第一个脚本帧的位置
+static std::string capture_js_site(JSContext* ctx)
+{
+  std::string site = "<unknown>";
+  JSValue global = JS_GetGlobalObject(ctx);
+  JSValue error_ctor = JS_GetPropertyStr(ctx, global, "Error");
+  JSValue error = JS_CallConstructor(ctx, error_ctor, 0, nullptr);
+  JS_FreeValue(ctx, error_ctor);
+  JS_FreeValue(ctx, global);
+  if (JS_IsException(error)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return site;
+  }
+
+  JSValue stack = JS_GetPropertyStr(ctx, error, "stack");
+  const char* stack_str = JS_ToCString(ctx, stack);
+  if (stack_str) {
+    // 每行形如 "    at func (file:line:col)"，跳过 "(native)" 帧
+    const char* line = stack_str;
+    while (*line) {
+      const char* eol = strchr(line, '\n');
+      if (!eol) eol = line + strlen(line);
+      const char* open = (const char*)memchr(line, '(', eol - line);
+      if (open && strncmp(open, "(native)", 8) != 0) {
+        const char* close = (const char*)memchr(open, ')', eol - open);
+        if (close) {
+          site.assign(open + 1, close - open - 1);
+          break;
+        }
+      }
+      line = *eol ? eol + 1 : eol;
+    }
+    JS_FreeCString(ctx, stack_str);
+  }
+  JS_FreeValue(ctx, stack);
+  JS_FreeValue(ctx, error);
+  return site;
+}
+
+// 分配前检查软限制，超出时抛出 RangeError
+static bool mem_check_limit(JSContext* ctx, size_t size)
+{
+  MemAccounting& acc = mem_accounting();
+  size_t limit = acc.soft_limit.load(std::memory_order_relaxed);
+  int64_t live = acc.live_bytes.load(std::memory_order_relaxed);
+  size_t live_size = live > 0 ? (size_t)live : 0;
+  if (limit && live_size + size > limit) {
+    JS_ThrowRangeError(ctx, "Native memory soft limit exceeded: %zu live + %zu requested > %zu bytes",
+                       live_size, size, limit);
+    return false;
+  }
+  return true;
+}
+
+// gc_owned 的分配按 size 计数；ffi.malloc 的分配按 malloc_usable_size 计数，
+// 这样 ffi.free 不用查表就能扣除同样的字节数
+static void mem_record_alloc(JSContext* ctx, void* ptr, size_t size, bool gc_owned = false)
+{
+  MemAccounting& acc = mem_accounting();
+  mem_count_alloc(acc, (int64_t)(gc_owned ? size : malloc_usable_size(ptr)));
+  if (!gc_owned && !mem_track_pointers(acc)) return;
+
+  std::string site;
+  if (acc.track_sites.load(std::memory_order_relaxed)) {
+    site = capture_js_site(ctx);
+  }
+  std::lock_guard<std::mutex> lock(acc.mutex);
+  auto inserted = acc.live.emplace(ptr, AllocRecord{size, std::move(site), gc_owned});
+  if (inserted.second) {
+    (gc_owned ? acc.owned_entries : acc.raw_entries).fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// 缓冲区对象的内存按登记的大小扣除；其余指针（ffi.free）视为 malloc 分配，
+// 包括 C 函数返回、交给 ffi.free 释放的内存
+static void mem_record_free(void* ptr, bool gc_owned = false)
+{
+  MemAccounting& acc = mem_accounting();
+  if (!gc_owned) {
+    mem_count_free(acc, (int64_t)malloc_usable_size(ptr));
+    if (acc.raw_entries.load(std::memory_order_relaxed) == 0) return;
+  }
+
+  std::lock_guard<std::mutex> lock(acc.mutex);
+  auto it = acc.live.find(ptr);
+  if (it == acc.live.end()) return;
+  if (gc_owned) {
+    mem_count_free(acc, (int64_t)it->second.size);
+  }
+  (it->second.gc_owned ? acc.owned_entries : acc.raw_entries).fetch_sub(1, std::memory_order_relaxed);
+  acc.live.erase(it);
+}
+
+// JS: FFI.malloc(size, {zero = true})
+static JSValue js_ffi_malloc(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  uint32_t size;
+  if (JS_ToUint32(ctx, &size, argv[0])) return JS_EXCEPTION;
+
+  int zero = js_ffi_get_bool_option(ctx, argc > 1 ? argv[1] : JS_UNDEFINED, "zero", true);
+  if (zero < 0) return JS_EXCEPTION;
+
+  if (!mem_check_limit(ctx, size)) return JS_EXCEPTION;
+
+  // 默认初始化为0；calloc 对新映射的页可以省去 memset
+  void* ptr = zero ? calloc(1, size) : malloc(size);
+  if (!ptr) {
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  mem_record_alloc(ctx, ptr, size);
+  if (ffi_trace_enabled()) {
+    ffi_trace_instant(FFI_TRACE_MALLOC, 0, size);
+  }
+
+  return JS_NewInt64(ctx, (int64_t)(uintptr_t)ptr);
+}
+
+static void js_ffi_buffer_release(NativeBuffer* buf);
+
+// JS: FFI.free(ptr)
+static JSValue js_ffi_free(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  // ffi.alloc 返回的缓冲区对象：等同于 dispose()
+  NativeBuffer* buf = (NativeBuffer*)JS_GetOpaque(argv[0], js_ffi_buffer_class_id);
+  if (buf) {
+    js_ffi_buffer_release(buf);
+    return JS_UNDEFINED;
+  }
+
+  int64_t ptr_val;
+  if (JS_ToInt64(ctx, &ptr_val, argv[0])) return JS_EXCEPTION;
+
+  void* ptr = (void*)(uintptr_t)ptr_val;
+  if (ptr) {
+    // 对象仍持有这块内存，这里释放会在 dispose() 或回收时重复释放（allocLarge 的内存也不是 malloc 分配的）
+    if (mem_is_gc_owned(ptr)) {
+      return JS_ThrowTypeError(ctx, "Address is owned by a native buffer object; use dispose() or free(bufferObject)");
+    }
+    if (ffi_trace_enabled()) {
+      ffi_trace_instant(FFI_TRACE_FREE, 0, (uint64_t)(uintptr_t)ptr);
+    }
+    mem_record_free(ptr);
+    free(ptr);
+  }
+
+  return JS_UNDEFINED;
+}
+
+// 进程的常驻内存（/proc/self/statm，其他平台为 0）和缺页次数
+static void process_memory_usage(size_t* rss_bytes, uint64_t* minor_faults, uint64_t* major_faults)
+{
+  *rss_bytes = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    unsigned long total_pages, resident_pages;
+    if (fscanf(f, "%lu %lu", &total_pages, &resident_pages) == 2) {
+      *rss_bytes = (size_t)resident_pages * (size_t)sysconf(_SC_PAGESIZE);
+    }
+    fclose(f);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  *minor_faults = (uint64_t)usage.ru_minflt;
+  *major_faults = (uint64_t)usage.ru_majflt;
+}
+
+// JS: FFI.memStats()
+static JSValue js_ffi_memStats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  size_t rss_bytes;
+  uint64_t minor_faults, major_faults;
+  process_memory_usage(&rss_bytes, &minor_faults, &major_faults);
+
+  MemAccounting& acc = mem_accounting();
+
+  JSValue stats = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, stats, "liveCount", JS_NewInt64(ctx, acc.live_count.load()));
+  JS_SetPropertyStr(ctx, stats, "liveBytes", JS_NewInt64(ctx, acc.live_bytes.load()));
+  JS_SetPropertyStr(ctx, stats, "peakBytes", JS_NewInt64(ctx, acc.peak_bytes.load()));
+  JS_SetPropertyStr(ctx, stats, "totalAllocs", JS_NewInt64(ctx, (int64_t)acc.total_allocs.load()));
+  JS_SetPropertyStr(ctx, stats, "totalFrees", JS_NewInt64(ctx, (int64_t)acc.total_frees.load()));
+  JS_SetPropertyStr(ctx, stats, "softLimit", JS_NewInt64(ctx, (int64_t)acc.soft_limit.load()));
+  JS_SetPropertyStr(ctx, stats, "trackSites", JS_NewBool(ctx, acc.track_sites.load()));
+  JS_SetPropertyStr(ctx, stats, "rssBytes", JS_NewInt64(ctx, (int64_t)rss_bytes));
+  JS_SetPropertyStr(ctx, stats, "minorFaults", JS_NewInt64(ctx, (int64_t)minor_faults));
+  JS_SetPropertyStr(ctx, stats, "majorFaults", JS_NewInt64(ctx, (int64_t)major_faults));
+  return stats;
+}
+
+// JS: FFI.memReport() - 返回所有已登记、未释放的分配 [{ptr, size, site}]
+static JSValue js_ffi_memReport(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MemAccounting& acc = mem_accounting();
+  std::lock_guard<std::mutex> lock(acc.mutex);
+
+  JSValue report = JS_NewArray(ctx);
+  uint32_t i = 0;
+  for (const auto& entry : acc.live) {
+    JSValue item = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, item, "ptr", JS_NewInt64(ctx, (int64_t)(uintptr_t)entry.first));
+    JS_SetPropertyStr(ctx, item, "size", JS_NewInt64(ctx, (int64_t)entry.second.size));
+    JS_SetPropertyStr(ctx, item, "site", entry.second.site.empty()
+                      ? JS_NULL : JS_NewString(ctx, entry.second.site.c_str()));
+    JS_SetPropertyUint32(ctx, report, i++, item);
+  }
+  return report;
+}
+
+// JS: FFI.setMemLimit(bytes) - 0 表示取消限制
+static JSValue js_ffi_setMemLimit(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int64_t limit;
+  if (JS_ToInt64(ctx, &limit, argv[0])) return JS_EXCEPTION;
+  if (limit < 0) return JS_ThrowRangeError(ctx, "Memory limit must be non-negative");
+  js_ffi_set_mem_limit((size_t)limit);
+  return JS_UNDEFINED;
+}
+
+// ---------------------------------------------------------------------------
+// JS 堆统计与 GC
+//
+// 堆统计来自 JS_ComputeMemoryUsage，它会遍历整个堆，适合按秒级频率采样；
+// GC 周期（耗时、前后字节数、触发原因）由宿主的 GC 监控记录，通过
+// js_ffi_set_gc_hooks 接入。
+// ---------------------------------------------------------------------------
+
+static JSFFIGCHooks gc_hooks;   // 全部为空表示宿主未接入
+
+struct RuntimeUsageField {
+  const char* name;
+  size_t offset;
+};
+
+// ffi.runtimeStats() 与 js_ffi_dump_runtime_stats 共用的字段表
+static const RuntimeUsageField runtime_usage_fields[] = {
+  {"mallocSize", offsetof(JSMemoryUsage, malloc_size)},
+  {"mallocLimit", offsetof(JSMemoryUsage, malloc_limit)},
+  {"memoryUsedSize", offsetof(JSMemoryUsage, memory_used_size)},
+  {"mallocCount", offsetof(JSMemoryUsage, malloc_count)},
+  {"memoryUsedCount", offsetof(JSMemoryUsage, memory_used_count)},
+  {"atomCount", offsetof(JSMemoryUsage, atom_count)},
+  {"atomSize", offsetof(JSMemoryUsage, atom_size)},
+  {"strCount", offsetof(JSMemoryUsage, str_count)},
+  {"strSize", offsetof(JSMemoryUsage, str_size)},
+  {"objCount", offsetof(JSMemoryUsage, obj_count)},
+  {"objSize", offsetof(JSMemoryUsage, obj_size)},
+  {"propCount", offsetof(JSMemoryUsage, prop_count)},
+  {"propSize", offsetof(JSMemoryUsage, prop_size)},
+  {"shapeCount", offsetof(JSMemoryUsage, shape_count)},
+  {"shapeSize", offsetof(JSMemoryUsage, shape_size)},
+  {"jsFuncCount", offsetof(JSMemoryUsage, js_func_count)},
+  {"jsFuncSize", offsetof(JSMemoryUsage, js_func_size)},
+  {"jsFuncCodeSize", offsetof(JSMemoryUsage, js_func_code_size)},
+  {"jsFuncPc2lineCount", offsetof(JSMemoryUsage, js_func_pc2line_count)},
+  {"jsFuncPc2lineSize", offsetof(JSMemoryUsage, js_func_pc2line_size)},
+  {"cFuncCount", offsetof(JSMemoryUsage, c_func_count)},
+  {"arrayCount", offsetof(JSMemoryUsage, array_count)},
+  {"fastArrayCount", offsetof(JSMemoryUsage, fast_array_count)},
+  {"fastArrayElements", offsetof(JSMemoryUsage, fast_array_elements)},
+  {"binaryObjectCount", offsetof(JSMemoryUsage, binary_object_count)},
+  {"binaryObjectSize", offsetof(JSMemoryUsage, binary_object_size)},
+};
+
+static int64_t runtime_usage_value(const JSMemoryUsage& usage, const RuntimeUsageField& field)
+{
+  return *(const int64_t*)((const char*)&usage + field.offset);
+}
+
+// JS: FFI.runtimeStats() - JS 堆统计，gc 字段为宿主记录的 GC 周期
+static JSValue js_ffi_runtimeStats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  JSMemoryUsage usage;
+  JS_ComputeMemoryUsage(JS_GetRuntime(ctx), &usage);
+
+  JSValue stats = JS_NewObject(ctx);
+  for (const RuntimeUsageField& field : runtime_usage_fields) {
+    JS_SetPropertyStr(ctx, stats, field.name, JS_NewInt64(ctx, runtime_usage_value(usage, field)));
+  }
+
+  JSValue gc = JS_NULL;
+  if (gc_hooks.gc_json) {
+    const char* json = gc_hooks.gc_json(gc_hooks.opaque);
+    gc = JS_ParseJSON(ctx, json, strlen(json), "<gc stats>");
+    if (JS_IsException(gc)) {
+      JS_FreeValue(ctx, stats);
+      return JS_EXCEPTION;
+    }
+  }
+  JS_SetPropertyStr(ctx, stats, "gc", gc);
+  return stats;
+}
+
+// JS: FFI.gc() - 立即执行一次 GC；接入宿主监控时记为 "explicit" 周期
+static JSValue js_ffi_gc(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (gc_hooks.collect) {
+    gc_hooks.collect(gc_hooks.opaque);
+  } else {
+    JS_RunGC(JS_GetRuntime(ctx));
+  }
+  return JS_UNDEFINED;
+}
+
+// ---------------------------------------------------------------------------
+// GC 管理的原生缓冲区
+//
+// ffi.alloc 返回的对象在被回收时由 finalizer 释放内存，脚本在 malloc 与
+// free 之间抛出异常也不会泄漏；需要确定性释放时调用 dispose()。
+// 对象可以直接作为 "pointer" 参数传给 call/readArray/writeArray。
+// ---------------------------------------------------------------------------
+
+static void js_ffi_buffer_release(NativeBuffer* buf)
+{
+  if (!buf->ptr) return;
+  if (ffi_trace_enabled()) {
+    ffi_trace_instant(FFI_TRACE_FREE, 0, (uint64_t)(uintptr_t)buf->ptr);
+  }
+  mem_record_free(buf->ptr, true);
+  if (buf->map_length) munmap(buf->ptr, buf->map_length);
+  else free(buf->ptr);
+  buf->ptr = nullptr;
+}
+
+static void js_ffi_buffer_finalizer(JSRuntime* rt, JSValue val)
+{
+  NativeBuffer* buf = (NativeBuffer*)JS_GetOpaque(val, js_ffi_buffer_class_id);
+  if (buf) {
+    js_ffi_buffer_release(buf);
+    delete buf;
+  }
+}
+
+static JSClassDef js_ffi_buffer_class = {
+  "NativeBuffer",
+  js_ffi_buffer_finalizer,
+};
+
+static NativeBuffer* js_ffi_buffer_this(JSContext* ctx, JSValueConst this_val)
+{
+  return (NativeBuffer*)JS_GetOpaque2(ctx, this_val, js_ffi_buffer_class_id);
+}
+
+static JSValue js_ffi_buffer_get_address(JSContext* ctx, JSValueConst this_val)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  return JS_NewInt64(ctx, (int64_t)(uintptr_t)buf->ptr);
+}
+
+static JSValue js_ffi_buffer_get_size(JSContext* ctx, JSValueConst this_val)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  return JS_NewInt64(ctx, buf->ptr ? (int64_t)buf->size : 0);
+}
+
+static JSValue js_ffi_buffer_get_alignment(JSContext* ctx, JSValueConst this_val)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  return JS_NewInt64(ctx, (int64_t)buf->align);
+}
+
+static JSValue js_ffi_buffer_get_hugepages(JSContext* ctx, JSValueConst this_val)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  return JS_NewBool(ctx, buf->hugepages);
+}
+
+static JSValue js_ffi_buffer_get_disposed(JSContext* ctx, JSValueConst this_val)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  return JS_NewBool(ctx, buf->ptr == nullptr);
+}
+
+// buffer.dispose() - 立即释放，重复调用无副作用
+static JSValue js_ffi_buffer_dispose(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  NativeBuffer* buf = js_ffi_buffer_this(ctx, this_val);
+  if (!buf) return JS_EXCEPTION;
+  js_ffi_buffer_release(buf);
+  return JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry js_ffi_buffer_proto_funcs[] = {
+  JS_CGETSET_DEF("address", js_ffi_buffer_get_address, NULL),
+  JS_CGETSET_DEF("size", js_ffi_buffer_get_size, NULL),
+  JS_CGETSET_DEF("alignment", js_ffi_buffer_get_alignment, NULL),
+  JS_CGETSET_DEF("hugepages", js_ffi_buffer_get_hugepages, NULL),
+  JS_CGETSET_DEF("disposed", js_ffi_buffer_get_disposed, NULL),
+  JS_CFUNC_DEF("dispose", 0, js_ffi_buffer_dispose),
+};
+
+// JS: FFI.alloc(size, {align = 16, zero = false})
+static JSValue js_ffi_alloc(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int64_t size;
+  if (JS_ToInt64(ctx, &size, argv[0])) return JS_EXCEPTION;
+  if (size < 0) return JS_ThrowRangeError(ctx, "Invalid buffer size");
+
+  JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+  int zero = js_ffi_get_bool_option(ctx, options, "zero", false);
+  if (zero < 0) return JS_EXCEPTION;
+
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t align = 16;
+  if (JS_IsObject(options)) {
+    JSValue val = JS_GetPropertyStr(ctx, options, "align");
+    int64_t align_val = (int64_t)align;
+    int ret = JS_IsUndefined(val) ? 0 : JS_ToInt64(ctx, &align_val, val);
+    JS_FreeValue(ctx, val);
+    if (ret) return JS_EXCEPTION;
+    if (align_val <= 0 || (align_val & (align_val - 1)) || (size_t)align_val > page_size) {
+      return JS_ThrowRangeError(ctx, "Alignment must be a power of two no larger than the page size (%zu)", page_size);
+    }
+    align = (size_t)align_val < sizeof(void*) ? sizeof(void*) : (size_t)align_val;
+  }
+
+  if (!mem_check_limit(ctx, (size_t)size)) return JS_EXCEPTION;
+
+  // posix_memalign 不接受 0 字节的请求在所有平台上都返回可释放指针，统一至少分配 1 字节
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, align, size ? (size_t)size : 1) != 0) {
+    return JS_ThrowOutOfMemory(ctx);
+  }
+  if (zero) {
+    memset(ptr, 0, (size_t)size);
+  }
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_buffer_class_id);
+  if (JS_IsException(obj)) {
+    free(ptr);
+    return obj;
+  }
+  JS_SetOpaque(obj, new NativeBuffer{ptr, (size_t)size, align});
+
+  mem_record_alloc(ctx, ptr, (size_t)size, true);
+  if (ffi_trace_enabled()) {
+    ffi_trace_instant(FFI_TRACE_MALLOC, 0, (uint64_t)size);
+  }
+  return obj;
+}
+
+// ---------------------------------------------------------------------------
+// 大块内存（ffi.allocLarge）
+//
+// 直接使用匿名 mmap：新映射的页由内核在首次访问时清零，分配本身不触碰任何
+// 页，多 GB 的缓冲区也能立即返回。hugepages 时映射按 2 MiB 对齐并设置
+// MADV_HUGEPAGE，让透明大页覆盖整个区域以减少 TLB 未命中；numaNode 通过 mbind
+// 系统调用把页绑定到指定节点（不依赖 libnuma），必须在页被访问之前完成；
+// populate 在返回前预先触发所有页的缺页。释放时 munmap。
+// ---------------------------------------------------------------------------
+
+static const size_t kHugePageSize = 2 << 20;
+static const int kMaxNumaNodes = 1024;
+
+// 把 [addr, addr + length) 绑定到 NUMA 节点 node，失败时返回 -1 并设置 errno
+static int bind_numa_node(void* addr, size_t length, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  const int mpol_bind = 2;   // <numaif.h> 中的 MPOL_BIND
+  const size_t bits = 8 * sizeof(unsigned long);
+  unsigned long mask[kMaxNumaNodes / bits] = {0};
+  mask[node / bits] |= 1UL << (node % bits);
+  return (int)syscall(SYS_mbind, addr, length, mpol_bind, mask, (unsigned long)kMaxNumaNodes + 1, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// 预先触发所有页的缺页，失败（内存不足）时返回 false
+static bool populate_pages(uint8_t* addr, size_t length, size_t page_size)
+{
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(addr, length, MADV_POPULATE_WRITE) == 0) return true;
+  if (errno != EINVAL) return false;   // EINVAL：内核早于 5.14，退回逐页写入
+#endif
+  for (size_t offset = 0; offset < length; offset += page_size) {
+    ((volatile uint8_t*)addr)[offset] = 0;
+  }
+  return true;
+}
+
+// JS: FFI.allocLarge(size, {hugepages = true, numaNode, populate = false})
+static JSValue js_ffi_allocLarge(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int64_t size;
+  if (JS_ToInt64(ctx, &size, argv[0])) return JS_EXCEPTION;
+  if (size <= 0 || (uint64_t)size > SIZE_MAX / 2) return JS_ThrowRangeError(ctx, "Invalid buffer size");
+
+  JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+  int hugepages = js_ffi_get_bool_option(ctx, options, "hugepages", true);
+  if (hugepages < 0) return JS_EXCEPTION;
+  int populate = js_ffi_get_bool_option(ctx, options, "populate", false);
+  if (populate < 0) return JS_EXCEPTION;
+  int64_t numa_node = -1;
+  if (js_ffi_get_int64_option(ctx, options, "numaNode", &numa_node)) return JS_EXCEPTION;
+  if (numa_node < -1 || numa_node >= kMaxNumaNodes) {
+    return JS_ThrowRangeError(ctx, "numaNode must be between 0 and %d", kMaxNumaNodes - 1);
+  }
+
+  if (!mem_check_limit(ctx, (size_t)size)) return JS_EXCEPTION;
+
+  // 大页需要 2 MiB 对齐：多映射一段再裁掉首尾
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t align = hugepages ? kHugePageSize : page_size;
+  size_t map_length = ((size_t)size + align - 1) & ~(align - 1);
+  size_t reserve = map_length + (align - page_size);
+  void* base = mmap(nullptr, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return JS_ThrowOutOfMemory(ctx);
+  }
+  uint8_t* ptr = (uint8_t*)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+  size_t head = ptr - (uint8_t*)base;
+  if (head) munmap(base, head);
+  if (reserve - head > map_length) munmap(ptr + map_length, reserve - head - map_length);
+
+  bool huge = false;
+#ifdef MADV_HUGEPAGE
+  // 透明大页被系统关闭时 madvise 失败，只记录结果
+  if (hugepages) huge = madvise(ptr, map_length, MADV_HUGEPAGE) == 0;
+#endif
+  if (numa_node >= 0 && bind_numa_node(ptr, map_length, (int)numa_node) != 0) {
+    int err = errno;
+    munmap(ptr, map_length);
+    return JS_ThrowInternalError(ctx, "mbind to NUMA node %d failed: %s", (int)numa_node, strerror(err));
+  }
+  if (populate && !populate_pages(ptr, map_length, page_size)) {
+    munmap(ptr, map_length);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_buffer_class_id);
+  if (JS_IsException(obj)) {
+    munmap(ptr, map_length);
+    return obj;
+  }
+  JS_SetOpaque(obj, new NativeBuffer{ptr, (size_t)size, align, map_length, huge});
+
+  mem_record_alloc(ctx, ptr, (size_t)size, true);
+  if (ffi_trace_enabled()) {
+    ffi_trace_instant(FFI_TRACE_MALLOC, 0, (uint64_t)size);
+  }
+  return obj;
+}
+
+// ---------------------------------------------------------------------------
+// 字符串数组（char**）
+//
+// call() 的 "stringArray" 参数每次调用都会重新打包；同一组字符串要传给多次
+// 调用时，用 packStrings 打包一次，得到的缓冲区对象可以反复作为 "pointer"
+// 参数使用。readStringArray 把原生代码返回的 char** 列表解码为 JS 数组。
+// ---------------------------------------------------------------------------
+
+// JS: FFI.packStrings(strings) - 返回 GC 管理的缓冲区，开头是以 NULL 结尾的指针表
+static JSValue js_ffi_packStrings(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  size_t size;
+  char** block = js_ffi_pack_strings(ctx, argv[0], &size);
+  if (!block) return JS_EXCEPTION;
+  if (!mem_check_limit(ctx, size)) {
+    free(block);
+    return JS_EXCEPTION;
+  }
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_buffer_class_id);
+  if (JS_IsException(obj)) {
+    free(block);
+    return obj;
+  }
+  JS_SetOpaque(obj, new NativeBuffer{block, size, alignof(char*)});
+  mem_record_alloc(ctx, block, size, true);
+  return obj;
+}
+
+// JS: FFI.readStringArray(ptr, count) - 读取原生 char* 数组；省略 count 时读到 NULL 为止，
+// 给出 count 时其中的 NULL 项返回 null
+static JSValue js_ffi_readStringArray(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  void* ptr;
+  if (js_ffi_get_pointer(ctx, &ptr, argv[0])) return JS_EXCEPTION;
+
+  bool has_count = argc > 1 && !JS_IsUndefined(argv[1]);
+  uint32_t count = 0;
+  if (has_count && JS_ToUint32(ctx, &count, argv[1])) return JS_EXCEPTION;
+  if (!ptr) {
+    if (has_count && count > 0) return JS_ThrowTypeError(ctx, "Null pointer");
+    return JS_NewArray(ctx);
+  }
+
+  const char* const* items = (const char* const*)ptr;
+  JSValue result = JS_NewArray(ctx);
+  for (uint32_t i = 0; has_count ? i < count : items[i] != nullptr; i++) {
+    JSValue str = items[i] ? JS_NewString(ctx, items[i]) : JS_NULL;
+    if (JS_IsException(str)) {
+      JS_FreeValue(ctx, result);
+      return JS_EXCEPTION;
+    }
+    JS_SetPropertyUint32(ctx, result, i, str);
+  }
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+// 内存映射文件（ffi.mapFile）
+//
+// 文件被 mmap 到进程中，同一段内存既可以作为 "pointer" 参数交给原生代码，
+// 也可以通过 buffer 属性以 ArrayBuffer 的形式交给 JS，中间没有任何复制。
+// 'r' 模式使用私有映射：JS 或原生代码的写入只修改私有副本，不会写回文件，
+// 也不会因为写只读页而崩溃；'rw' 模式使用共享映射，写入直接落到文件。
+// unmap() 时导出的 ArrayBuffer 被分离，之后访问得到的是长度为 0 的缓冲区。
+// ---------------------------------------------------------------------------
+
+static void mapped_file_unref(MappedFile* f)
+{
+  if (--f->refs == 0) {
+    munmap(f->base, f->map_length);
+    delete f;
+  }
+}
+
+static void js_ffi_mapping_release_buffer(JSRuntime* rt, void* opaque, void* ptr)
+{
+  if (!ptr) return;
+  mapped_file_unref((MappedFile*)opaque);
+}
+
+// 分离导出的 ArrayBuffer 并释放 JS 对象持有的引用
+static void js_ffi_mapping_unmap(JSContext* ctx, NativeMapping* map)
+{
+  if (!map->file) return;
+  if (!JS_IsUndefined(map->buffer)) {
+    JS_DetachArrayBuffer(ctx, map->buffer);
+    JS_FreeValue(ctx, map->buffer);
+    map->buffer = JS_UNDEFINED;
+  }
+  mapped_file_unref(map->file);
+  map->file = nullptr;
+}
+
+static void js_ffi_mapping_finalizer(JSRuntime* rt, JSValue val)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque(val, js_ffi_mapping_class_id);
+  if (!map) return;
+  // ArrayBuffer 可能仍被 JS 持有，由它的引用保持映射
+  JS_FreeValueRT(rt, map->buffer);
+  if (map->file) mapped_file_unref(map->file);
+  delete map;
+}
+
+static void js_ffi_mapping_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque(val, js_ffi_mapping_class_id);
+  if (map) JS_MarkValue(rt, map->buffer, mark_func);
+}
+
+static JSClassDef js_ffi_mapping_class = {
+  "MappedFile",
+  js_ffi_mapping_finalizer,
+  js_ffi_mapping_mark,
+};
+
+// 取得仍然有效的映射；已 unmap 时抛出异常
+static MappedFile* js_ffi_mapping_file(JSContext* ctx, JSValueConst this_val)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque2(ctx, this_val, js_ffi_mapping_class_id);
+  if (!map) return nullptr;
+  if (!map->file) {
+    JS_ThrowTypeError(ctx, "Mapped file has been unmapped");
+    return nullptr;
+  }
+  return map->file;
+}
+
+static JSValue js_ffi_mapping_get_address(JSContext* ctx, JSValueConst this_val)
+{
+  MappedFile* f = js_ffi_mapping_file(ctx, this_val);
+  if (!f) return JS_EXCEPTION;
+  return JS_NewInt64(ctx, (int64_t)(uintptr_t)f->data);
+}
+
+static JSValue js_ffi_mapping_get_size(JSContext* ctx, JSValueConst this_val)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque2(ctx, this_val, js_ffi_mapping_class_id);
+  if (!map) return JS_EXCEPTION;
+  return JS_NewInt64(ctx, map->file ? (int64_t)map->file->length : 0);
+}
+
+static JSValue js_ffi_mapping_get_writable(JSContext* ctx, JSValueConst this_val)
+{
+  MappedFile* f = js_ffi_mapping_file(ctx, this_val);
+  if (!f) return JS_EXCEPTION;
+  return JS_NewBool(ctx, f->writable);
+}
+
+static JSValue js_ffi_mapping_get_hugepages(JSContext* ctx, JSValueConst this_val)
+{
+  MappedFile* f = js_ffi_mapping_file(ctx, this_val);
+  if (!f) return JS_EXCEPTION;
+  return JS_NewBool(ctx, f->hugepages);
+}
+
+static JSValue js_ffi_mapping_get_unmapped(JSContext* ctx, JSValueConst this_val)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque2(ctx, this_val, js_ffi_mapping_class_id);
+  if (!map) return JS_EXCEPTION;
+  return JS_NewBool(ctx, map->file == nullptr);
+}
+
+// mapping.buffer - 每次返回同一个 ArrayBuffer
+static JSValue js_ffi_mapping_get_buffer(JSContext* ctx, JSValueConst this_val)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque2(ctx, this_val, js_ffi_mapping_class_id);
+  if (!map) return JS_EXCEPTION;
+  if (!map->file) return JS_ThrowTypeError(ctx, "Mapped file has been unmapped");
+  if (JS_IsUndefined(map->buffer)) {
+    JSValue ab = JS_NewArrayBuffer(ctx, map->file->data, map->file->length,
+                                   js_ffi_mapping_release_buffer, map->file, false);
+    if (JS_IsException(ab)) return ab;
+    map->file->refs++;
+    map->buffer = ab;
+  }
+  return JS_DupValue(ctx, map->buffer);
+}
+
+// mapping.advise(hint) - 'normal' | 'sequential' | 'random' | 'willneed' | 'dontneed'
+static JSValue js_ffi_mapping_advise(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MappedFile* f = js_ffi_mapping_file(ctx, this_val);
+  if (!f) return JS_EXCEPTION;
+
+  const char* hint = JS_ToCString(ctx, argv[0]);
+  if (!hint) return JS_EXCEPTION;
+  int advice;
+  if (strcmp(hint, "normal") == 0) advice = MADV_NORMAL;
+  else if (strcmp(hint, "sequential") == 0) advice = MADV_SEQUENTIAL;
+  else if (strcmp(hint, "random") == 0) advice = MADV_RANDOM;
+  else if (strcmp(hint, "willneed") == 0) advice = MADV_WILLNEED;
+  else if (strcmp(hint, "dontneed") == 0) advice = MADV_DONTNEED;
+  else {
+    JS_FreeCString(ctx, hint);
+    return JS_ThrowTypeError(ctx, "Unknown madvise hint");
+  }
+  JS_FreeCString(ctx, hint);
+
+  if (madvise(f->base, f->map_length, advice) != 0) {
+    return JS_ThrowInternalError(ctx, "madvise failed: %s", strerror(errno));
+  }
+  return JS_UNDEFINED;
+}
+
+// mapping.sync({async = false}) - 把 'rw' 映射的修改写回文件
+static JSValue js_ffi_mapping_sync(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MappedFile* f = js_ffi_mapping_file(ctx, this_val);
+  if (!f) return JS_EXCEPTION;
+  int async = js_ffi_get_bool_option(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, "async", false);
+  if (async < 0) return JS_EXCEPTION;
+  if (!f->writable) return JS_UNDEFINED;
+
+  if (msync(f->base, f->map_length, async ? MS_ASYNC : MS_SYNC) != 0) {
+    return JS_ThrowInternalError(ctx, "msync failed: %s", strerror(errno));
+  }
+  return JS_UNDEFINED;
+}
+
+// mapping.unmap() - 立即解除映射，重复调用无副作用
+static JSValue js_ffi_mapping_unmap_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  NativeMapping* map = (NativeMapping*)JS_GetOpaque2(ctx, this_val, js_ffi_mapping_class_id);
+  if (!map) return JS_EXCEPTION;
+  js_ffi_mapping_unmap(ctx, map);
+  return JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry js_ffi_mapping_proto_funcs[] = {
+  JS_CGETSET_DEF("address", js_ffi_mapping_get_address, NULL),
+  JS_CGETSET_DEF("size", js_ffi_mapping_get_size, NULL),
+  JS_CGETSET_DEF("buffer", js_ffi_mapping_get_buffer, NULL),
+  JS_CGETSET_DEF("writable", js_ffi_mapping_get_writable, NULL),
+  JS_CGETSET_DEF("hugepages", js_ffi_mapping_get_hugepages, NULL),
+  JS_CGETSET_DEF("unmapped", js_ffi_mapping_get_unmapped, NULL),
+  JS_CFUNC_DEF("advise", 1, js_ffi_mapping_advise),
+  JS_CFUNC_DEF("sync", 1, js_ffi_mapping_sync),
+  JS_CFUNC_DEF("unmap", 0, js_ffi_mapping_unmap_method),
+};
+
+// JS: FFI.mapFile(path, {mode = 'r', offset = 0, length, populate = false, hugepages = false})
+// 'rw' 模式下文件不存在时创建，比 offset + length 短时扩展
+static JSValue js_ffi_mapFile(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+
+  bool writable = false;
+  if (JS_IsObject(options)) {
+    JSValue mode_val = JS_GetPropertyStr(ctx, options, "mode");
+    if (!JS_IsUndefined(mode_val)) {
+      const char* mode = JS_ToCString(ctx, mode_val);
+      if (!mode) {
+        JS_FreeValue(ctx, mode_val);
+        return JS_EXCEPTION;
+      }
+      bool valid = strcmp(mode, "r") == 0 || strcmp(mode, "rw") == 0;
+      writable = strcmp(mode, "rw") == 0;
+      JS_FreeCString(ctx, mode);
+      if (!valid) {
+        JS_FreeValue(ctx, mode_val);
+        return JS_ThrowTypeError(ctx, "Mapping mode must be 'r' or 'rw'");
+      }
+    }
+    JS_FreeValue(ctx, mode_val);
+  }
+
+  int64_t offset = 0, length = -1;
+  if (js_ffi_get_int64_option(ctx, options, "offset", &offset) ||
+      js_ffi_get_int64_option(ctx, options, "length", &length)) {
+    return JS_EXCEPTION;
+  }
+  int populate = js_ffi_get_bool_option(ctx, options, "populate", false);
+  if (populate < 0) return JS_EXCEPTION;
+  int hugepages = js_ffi_get_bool_option(ctx, options, "hugepages", false);
+  if (hugepages < 0) return JS_EXCEPTION;
+  if (offset < 0) return JS_ThrowRangeError(ctx, "Invalid mapping offset");
+
+  const char* path = JS_ToCString(ctx, argv[0]);
+  if (!path) return JS_EXCEPTION;
+  int fd = writable ? open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644) : open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    JSValue err = JS_ThrowTypeError(ctx, "Failed to open file %s: %s", path, strerror(errno));
+    JS_FreeCString(ctx, path);
+    return err;
+  }
+  JS_FreeCString(ctx, path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return JS_ThrowInternalError(ctx, "fstat failed: %s", strerror(errno));
+  }
+  int64_t file_size = (int64_t)st.st_size;
+  if (length < 0) length = file_size > offset ? file_size - offset : 0;
+  if (length == 0) {
+    close(fd);
+    return JS_ThrowRangeError(ctx, "Cannot map an empty range");
+  }
+  // offset 与 length 都非负，先检查相加不会溢出
+  if (length > INT64_MAX - offset) {
+    close(fd);
+    return JS_ThrowRangeError(ctx, "Mapping range overflows: offset %lld + length %lld",
+                              (long long)offset, (long long)length);
+  }
+  if (offset + length > file_size) {
+    if (!writable) {
+      close(fd);
+      return JS_ThrowRangeError(ctx, "Mapping range exceeds file size (%lld bytes)", (long long)file_size);
+    }
+    if (ftruncate(fd, (off_t)(offset + length)) != 0) {
+      close(fd);
+      return JS_ThrowInternalError(ctx, "Failed to extend file: %s", strerror(errno));
+    }
+  }
+
+  // mmap 的偏移必须按页对齐，多映射的部分不暴露给调用方
+  int64_t page_size = (int64_t)sysconf(_SC_PAGESIZE);
+  int64_t aligned_offset = offset & ~(page_size - 1);
+  size_t map_length = (size_t)(length + (offset - aligned_offset));
+
+  int flags = writable ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (populate) flags |= MAP_POPULATE;
+#endif
+  void* base = mmap(nullptr, map_length, PROT_READ | PROT_WRITE, flags, fd, (off_t)aligned_offset);
+  int map_errno = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    return JS_ThrowInternalError(ctx, "mmap failed: %s", strerror(map_errno));
+  }
+
+  MappedFile* f = new MappedFile{1, (uint8_t*)base, map_length,
+                                 (uint8_t*)base + (offset - aligned_offset), (size_t)length,
+                                 writable, false};
+#ifdef MADV_HUGEPAGE
+  // 透明大页对文件映射是否生效取决于文件系统，失败时只记录结果
+  if (hugepages) f->hugepages = madvise(base, map_length, MADV_HUGEPAGE) == 0;
+#endif
+#ifndef MAP_POPULATE
+  if (populate) madvise(base, map_length, MADV_WILLNEED);
+#endif
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_mapping_class_id);
+  if (JS_IsException(obj)) {
+    mapped_file_unref(f);
+    return obj;
+  }
+  JS_SetOpaque(obj, new NativeMapping{f, JS_UNDEFINED});
+  return obj;
+}
+
+// ---------------------------------------------------------------------------
+// 原生缓冲区之间的批量转换与归约（ffi.mem）
+//
+// 数据在原生内存之间直接转换，不经过 JS 数值；归约只把标量结果交给 JS。
+// 缓冲区对象和 TypedArray/ArrayBuffer 会检查长度，裸地址由调用方保证有效。
+// 内核实现见 ffi_simd.cpp。
+// ---------------------------------------------------------------------------
+
+static int js_ffi_get_elem_type(JSContext* ctx, FFIElemType* type, JSValueConst val)
+{
+  const char* name = JS_ToCString(ctx, val);
+  if (!name) return -1;
+  bool ok = ffi_elem_parse(name, type);
+  if (!ok) JS_ThrowTypeError(ctx, "Unsupported element type: %s", name);
+  JS_FreeCString(ctx, name);
+  return ok ? 0 : -1;
+}
+
+// TypedArray 或 ArrayBuffer 的存储（直接访问，不复制）；不是这两种对象时返回 0
+static int js_ffi_get_array_data(JSContext* ctx, JSValueConst val, uint8_t** data, size_t* size)
+{
+  if (!JS_IsObject(val)) return 0;
+  size_t byte_offset = 0, byte_length = 0, bytes_per_element;
+  JSValue ab = JS_GetTypedArrayBuffer(ctx, val, &byte_offset, &byte_length, &bytes_per_element);
+  bool typed = !JS_IsException(ab);
+  if (!typed) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    ab = JS_DupValue(ctx, val);
+  }
+  size_t ab_size;
+  uint8_t* p = JS_GetArrayBuffer(ctx, &ab_size, ab);
+  JS_FreeValue(ctx, ab);
+  if (!p) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return 0;
+  }
+  *data = p + byte_offset;
+  *size = typed ? byte_length : ab_size;
+  return 1;
+}
+
+// 取得指针并检查 bytes 是否超出缓冲区对象、TypedArray 或 ArrayBuffer 的长度
+static int js_ffi_get_range(JSContext* ctx, void** out, JSValueConst val, size_t bytes)
+{
+  size_t size;
+  uint8_t* data;
+  if (JS_IsObject(val) && !JS_GetOpaque(val, js_ffi_buffer_class_id) &&
+      !JS_GetOpaque(val, js_ffi_mapping_class_id) && js_ffi_get_array_data(ctx, val, &data, &size)) {
+    *out = data;
+  } else if (js_ffi_get_pointer(ctx, out, val, &size)) {
+    return -1;
+  }
+  if (!*out) {
+    JS_ThrowTypeError(ctx, "Invalid pointer");
+    return -1;
+  }
+  if (bytes > size) {
+    JS_ThrowRangeError(ctx, "Access of %zu bytes exceeds buffer size %zu", bytes, size);
+    return -1;
+  }
+  return 0;
+}
+
+static int js_ffi_get_count(JSContext* ctx, size_t* count, JSValueConst val)
+{
+  int64_t n;
+  if (JS_ToInt64(ctx, &n, val)) return -1;
+  // 元素最大 8 字节，限制 count 保证 count * 元素大小不会溢出
+  if (n < 0 || (uint64_t)n > SIZE_MAX / 8) {
+    JS_ThrowRangeError(ctx, "Invalid count");
+    return -1;
+  }
+  *count = (size_t)n;
+  return 0;
+}
+
+// JS: FFI.mem.convert(dst, dstType, src, srcType, count, {scale, offset, saturate, round})
+static JSValue js_ffi_mem_convert(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 5) return JS_ThrowTypeError(ctx, "convert requires 5 arguments");
+
+  FFIElemType dst_type, src_type;
+  size_t count;
+  if (js_ffi_get_elem_type(ctx, &dst_type, argv[1]) ||
+      js_ffi_get_elem_type(ctx, &src_type, argv[3]) ||
+      js_ffi_get_count(ctx, &count, argv[4])) {
+    return JS_EXCEPTION;
+  }
+
+  void* dst;
+  void* src;
+  if (js_ffi_get_range(ctx, &dst, argv[0], count * ffi_elem_size(dst_type)) ||
+      js_ffi_get_range(ctx, &src, argv[2], count * ffi_elem_size(src_type))) {
+    return JS_EXCEPTION;
+  }
+
+  FFIConvertOptions opts;
+  JSValueConst options = argc > 5 ? argv[5] : JS_UNDEFINED;
+  if (JS_IsObject(options)) {
+    JSValue scale = JS_GetPropertyStr(ctx, options, "scale");
+    JSValue offset = JS_GetPropertyStr(ctx, options, "offset");
+    int ret = (!JS_IsUndefined(scale) && JS_ToFloat64(ctx, &opts.scale, scale)) ||
+              (!JS_IsUndefined(offset) && JS_ToFloat64(ctx, &opts.offset, offset));
+    JS_FreeValue(ctx, scale);
+    JS_FreeValue(ctx, offset);
+    if (ret) return JS_EXCEPTION;
+  }
+  int saturate = js_ffi_get_bool_option(ctx, options, "saturate", false);
+  int round = js_ffi_get_bool_option(ctx, options, "round", false);
+  if (saturate < 0 || round < 0) return JS_EXCEPTION;
+  opts.saturate = saturate;
+  opts.round = round;
+
+  ffi_mem_convert(dst, dst_type, src, src_type, count, opts);
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.mem.copy(dst, src, byteLength)
+static JSValue js_ffi_mem_copy(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "copy requires 3 arguments");
+
+  size_t bytes;
+  if (js_ffi_get_count(ctx, &bytes, argv[2])) return JS_EXCEPTION;
+
+  void* dst;
+  void* src;
+  if (js_ffi_get_range(ctx, &dst, argv[0], bytes) || js_ffi_get_range(ctx, &src, argv[1], bytes)) {
+    return JS_EXCEPTION;
+  }
+
+  ffi_mem_copy(dst, src, bytes);
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.mem.fill(dst, type, value, count)
+static JSValue js_ffi_mem_fill(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 4) return JS_ThrowTypeError(ctx, "fill requires 4 arguments");
+
+  FFIElemType type;
+  double value;
+  size_t count;
+  if (js_ffi_get_elem_type(ctx, &type, argv[1]) ||
+      JS_ToFloat64(ctx, &value, argv[2]) ||
+      js_ffi_get_count(ctx, &count, argv[3])) {
+    return JS_EXCEPTION;
+  }
+
+  void* dst;
+  if (js_ffi_get_range(ctx, &dst, argv[0], count * ffi_elem_size(type))) return JS_EXCEPTION;
+
+  ffi_mem_fill(dst, type, value, count);
+  return JS_UNDEFINED;
+}
+
+// 归约的输入：(buf, type, count)，检查缓冲区长度
+static int js_ffi_get_elems(JSContext* ctx, const void** src, FFIElemType* type, size_t* count,
+                            JSValueConst buf, JSValueConst type_val, JSValueConst count_val)
+{
+  void* ptr;
+  if (js_ffi_get_elem_type(ctx, type, type_val) ||
+      js_ffi_get_count(ctx, count, count_val) ||
+      js_ffi_get_range(ctx, &ptr, buf, *count * ffi_elem_size(*type))) {
+    return -1;
+  }
+  *src = ptr;
+  return 0;
+}
+
+// JS: FFI.mem.sum(src, type, count) - 整数精确累加，浮点在 double 中按固定顺序累加
+static JSValue js_ffi_mem_sum(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "sum requires 3 arguments");
+
+  const void* src;
+  FFIElemType type;
+  size_t count;
+  if (js_ffi_get_elems(ctx, &src, &type, &count, argv[0], argv[1], argv[2])) return JS_EXCEPTION;
+
+  return JS_NewFloat64(ctx, ffi_mem_sum(src, type, count));
+}
+
+// JS: FFI.mem.minMax(src, type, count) -> {min, minIndex, max, maxIndex}
+// 位置是第一次出现的元素下标，NaN 被跳过；没有有效元素时 min/max 为 NaN、位置为 -1
+static JSValue js_ffi_mem_minMax(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "minMax requires 3 arguments");
+
+  const void* src;
+  FFIElemType type;
+  size_t count;
+  if (js_ffi_get_elems(ctx, &src, &type, &count, argv[0], argv[1], argv[2])) return JS_EXCEPTION;
+
+  FFIMinMax r = ffi_mem_minmax(src, type, count);
+  bool found = r.min_index != SIZE_MAX;
+  JSValue obj = JS_NewObject(ctx);
+  if (JS_IsException(obj)) return obj;
+  JS_SetPropertyStr(ctx, obj, "min", JS_NewFloat64(ctx, found ? r.min : NAN));
+  JS_SetPropertyStr(ctx, obj, "minIndex", JS_NewInt64(ctx, found ? (int64_t)r.min_index : -1));
+  JS_SetPropertyStr(ctx, obj, "max", JS_NewFloat64(ctx, found ? r.max : NAN));
+  JS_SetPropertyStr(ctx, obj, "maxIndex", JS_NewInt64(ctx, found ? (int64_t)r.max_index : -1));
+  return obj;
+}
+
+// JS: FFI.mem.dot(a, b, type, count)
+static JSValue js_ffi_mem_dot(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 4) return JS_ThrowTypeError(ctx, "dot requires 4 arguments");
+
+  const void* a;
+  FFIElemType type;
+  size_t count;
+  void* b;
+  if (js_ffi_get_elems(ctx, &a, &type, &count, argv[0], argv[2], argv[3]) ||
+      js_ffi_get_range(ctx, &b, argv[1], count * ffi_elem_size(type))) {
+    return JS_EXCEPTION;
+  }
+
+  return JS_NewFloat64(ctx, ffi_mem_dot(a, b, type, count));
+}
+
+// JS: FFI.mem.histogram(src, type, count, {bins = 256, min, max}) -> Float64Array(bins)
+// [min, max] 等分为 bins 个区间，等于 max 的元素计入最后一个区间，范围外的元素和 NaN 不计入。
+// 8 位类型默认覆盖整个取值范围（256 个区间时每个取值一个区间），其余类型默认取数据的最小/最大值
+static JSValue js_ffi_mem_histogram(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "histogram requires 3 arguments");
+
+  const void* src;
+  FFIElemType type;
+  size_t count;
+  if (js_ffi_get_elems(ctx, &src, &type, &count, argv[0], argv[1], argv[2])) return JS_EXCEPTION;
+
+  JSValueConst options = argc > 3 ? argv[3] : JS_UNDEFINED;
+  int64_t bins = 256;
+  if (js_ffi_get_int64_option(ctx, options, "bins", &bins)) return JS_EXCEPTION;
+  if (bins < 1 || bins > (1 << 24)) return JS_ThrowRangeError(ctx, "histogram bins must be between 1 and 16777216");
+
+  double lo = 0, hi = 0;
+  bool has_lo = false, has_hi = false;
+  if (JS_IsObject(options)) {
+    JSValue min_val = JS_GetPropertyStr(ctx, options, "min");
+    JSValue max_val = JS_GetPropertyStr(ctx, options, "max");
+    has_lo = !JS_IsUndefined(min_val);
+    has_hi = !JS_IsUndefined(max_val);
+    int ret = (has_lo && JS_ToFloat64(ctx, &lo, min_val)) || (has_hi && JS_ToFloat64(ctx, &hi, max_val));
+    JS_FreeValue(ctx, min_val);
+    JS_FreeValue(ctx, max_val);
+    if (ret) return JS_EXCEPTION;
+  }
+  if (!has_lo || !has_hi) {
+    double data_lo, data_hi;
+    if (type == FFI_ELEM_INT8 || type == FFI_ELEM_UINT8) {
+      data_lo = type == FFI_ELEM_INT8 ? -128 : 0;
+      data_hi = data_lo + 255;
+    } else {
+      FFIMinMax r = ffi_mem_minmax(src, type, count);
+      data_lo = r.min_index != SIZE_MAX ? r.min : 0;
+      data_hi = r.max_index != SIZE_MAX ? r.max : 0;
+    }
+    if (!has_lo) lo = data_lo;
+    if (!has_hi) hi = data_hi;
+    // 数据全部相同时所有元素计入第一个区间
+    if (!has_lo && !has_hi && lo == hi) hi = lo + 1;
+  }
+  if (!(lo < hi)) return JS_ThrowRangeError(ctx, "histogram requires min < max");
+
+  std::vector<uint64_t> counts((size_t)bins, 0);
+  ffi_mem_histogram(src, type, count, lo, hi, counts.data(), counts.size());
+  std::vector<double> result(counts.begin(), counts.end());
+
+  JSValue ab = JS_NewArrayBufferCopy(ctx, (const uint8_t*)result.data(), result.size() * sizeof(double));
+  if (JS_IsException(ab)) return ab;
+  JSValue view = js_ffi_new_typed_view(ctx, "Float64Array", ab);
+  JS_FreeValue(ctx, ab);
+  return view;
+}
+
+// JS: FFI.mem.indexOf(src, needle, byteLength, fromIndex = 0) - needle 为字节值、字符串（UTF-8）
+// 或 TypedArray/ArrayBuffer，返回第一次出现的字节偏移，找不到时返回 -1
+static JSValue js_ffi_mem_indexOf(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "indexOf requires 3 arguments");
+
+  size_t bytes;
+  int64_t from = 0;
+  if (js_ffi_get_count(ctx, &bytes, argv[2]) || (argc > 3 && JS_ToInt64(ctx, &from, argv[3]))) {
+    return JS_EXCEPTION;
+  }
+  if (from < 0) return JS_ThrowRangeError(ctx, "indexOf fromIndex must not be negative");
+  void* src;
+  if (js_ffi_get_range(ctx, &src, argv[0], bytes)) return JS_EXCEPTION;
+
+  uint8_t byte;
+  const void* needle = &byte;
+  size_t needle_len = 1;
+  const char* str = nullptr;
+  uint8_t* data;
+  if (JS_IsString(argv[1])) {
+    str = JS_ToCStringLen(ctx, &needle_len, argv[1]);
+    if (!str) return JS_EXCEPTION;
+    needle = str;
+  } else if (js_ffi_get_array_data(ctx, argv[1], &data, &needle_len)) {
+    needle = data;
+  } else if (JS_IsObject(argv[1])) {
+    return JS_ThrowTypeError(ctx, "indexOf needle must be a byte value, string or TypedArray");
+  } else {
+    int32_t v;
+    if (JS_ToInt32(ctx, &v, argv[1])) return JS_EXCEPTION;
+    if (v < 0 || v > 255) return JS_ThrowRangeError(ctx, "indexOf needle must be a byte value, string or TypedArray");
+    byte = (uint8_t)v;
+  }
+
+  int64_t result = -1;
+  if ((uint64_t)from <= bytes) {
+    size_t pos = ffi_mem_find((const uint8_t*)src + from, bytes - (size_t)from, needle, needle_len);
+    if (pos != SIZE_MAX) result = from + (int64_t)pos;
+  }
+  if (str) JS_FreeCString(ctx, str);
+  return JS_NewInt64(ctx, result);
+}
+
+// JS: FFI.mem.count(src, byte, byteLength) - 值等于 byte 的字节数
+static JSValue js_ffi_mem_count(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "count requires 3 arguments");
+
+  int32_t byte;
+  size_t bytes;
+  if (JS_ToInt32(ctx, &byte, argv[1]) || js_ffi_get_count(ctx, &bytes, argv[2])) return JS_EXCEPTION;
+  if (byte < 0 || byte > 255) return JS_ThrowRangeError(ctx, "count byte must be between 0 and 255");
+
+  void* src;
+  if (js_ffi_get_range(ctx, &src, argv[0], bytes)) return JS_EXCEPTION;
+
+  return JS_NewInt64(ctx, (int64_t)ffi_mem_count_byte(src, (uint8_t)byte, bytes));
+}
+
+// JS: FFI.mem.simdLevel()
+static JSValue js_ffi_mem_simdLevel(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  return JS_NewString(ctx, ffi_simd_level_name(ffi_simd_level()));
+}
+
+// JS: FFI.mem.setSimdLevel(name) - "auto" | "scalar" | "sse2" | "avx2" | "neon"，返回实际使用的级别
+static JSValue js_ffi_mem_setSimdLevel(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  const char* name = JS_ToCString(ctx, argv[0]);
+  if (!name) return JS_EXCEPTION;
+
+  FFISimdLevel level;
+  bool ok = ffi_simd_parse_level(name, &level);
+  JS_FreeCString(ctx, name);
+  if (!ok) return JS_ThrowTypeError(ctx, "Unknown SIMD level");
+
+  return JS_NewString(ctx, ffi_simd_level_name(ffi_simd_set_level(level)));
+}
+
+static const JSCFunctionListEntry js_ffi_mem_funcs[] = {
+  JS_CFUNC_DEF("convert", 6, js_ffi_mem_convert),
+  JS_CFUNC_DEF("copy", 3, js_ffi_mem_copy),
+  JS_CFUNC_DEF("fill", 4, js_ffi_mem_fill),
+  JS_CFUNC_DEF("sum", 3, js_ffi_mem_sum),
+  JS_CFUNC_DEF("minMax", 3, js_ffi_mem_minMax),
+  JS_CFUNC_DEF("dot", 4, js_ffi_mem_dot),
+  JS_CFUNC_DEF("histogram", 4, js_ffi_mem_histogram),
+  JS_CFUNC_DEF("indexOf", 4, js_ffi_mem_indexOf),
+  JS_CFUNC_DEF("count", 3, js_ffi_mem_count),
+  JS_CFUNC_DEF("simdLevel", 0, js_ffi_mem_simdLevel),
+  JS_CFUNC_DEF("setSimdLevel", 1, js_ffi_mem_setSimdLevel),
+};
+
+// JS: FFI.trackAllocSites(enable)
+static JSValue js_ffi_trackAllocSites(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int enable = JS_ToBool(ctx, argv[0]);
+  if (enable < 0) return JS_EXCEPTION;
+  js_ffi_set_track_alloc_sites(enable);
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.writeArray(ptr, array, type, count)
+static JSValue js_ffi_writeArray(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 4) return JS_ThrowTypeError(ctx, "writeArray requires 4 arguments");
+
+  void* ptr;
+  if (js_ffi_get_pointer(ctx, &ptr, argv[0])) return JS_EXCEPTION;
+  if (!ptr) return JS_ThrowTypeError(ctx, "Invalid pointer");
+
+  if (!JS_IsArray(ctx, argv[1])) return JS_ThrowTypeError(ctx, "Second argument must be an array");
+
+  const char* type_str = JS_ToCString(ctx, argv[2]);
+  if (!type_str) return JS_EXCEPTION;
+
+  uint32_t count;
+  if (JS_ToUint32(ctx, &count, argv[3])) {
+    JS_FreeCString(ctx, type_str);
+    return JS_EXCEPTION;
+  }
+
+  // 根据类型写入数组
+  for (uint32_t i = 0; i < count; i++) {
+    JSValue elem = JS_GetPropertyUint32(ctx, argv[1], i);
+
+    if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0) {
+      int32_t val;
+      JS_ToInt32(ctx, &val, elem);
+      ((int32_t*)ptr)[i] = val;
+    }
+    else if (strcmp(type_str, "uint32") == 0) {
+      uint32_t val;
+      JS_ToUint32(ctx, &val, elem);
+      ((uint32_t*)ptr)[i] = val;
+    }
+    else if (strcmp(type_str, "float") == 0) {
+      double val;
+      JS_ToFloat64(ctx, &val, elem);
+      ((float*)ptr)[i] = (float)val;
+    }
+    else if (strcmp(type_str, "double") == 0) {
+      double val;
+      JS_ToFloat64(ctx, &val, elem);
+      ((double*)ptr)[i] = val;
+    }
+    else if (strcmp(type_str, "int8") == 0) {
+      int32_t val;
+      JS_ToInt32(ctx, &val, elem);
+      ((int8_t*)ptr)[i] = (int8_t)val;
+    }
+    else if (strcmp(type_str, "uint8") == 0) {
+      uint32_t val;
+      JS_ToUint32(ctx, &val, elem);
+      ((uint8_t*)ptr)[i] = (uint8_t)val;
+    }
+    else if (strcmp(type_str, "int16") == 0) {
+      int32_t val;
+      JS_ToInt32(ctx, &val, elem);
+      ((int16_t*)ptr)[i] = (int16_t)val;
+    }
+    else if (strcmp(type_str, "uint16") == 0) {
+      uint32_t val;
+      JS_ToUint32(ctx, &val, elem);
+      ((uint16_t*)ptr)[i] = (uint16_t)val;
+    }
+
+    JS_FreeValue(ctx, elem);
+  }
+
+  JS_FreeCString(ctx, type_str);
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.readArray(ptr, type, count)
+static JSValue js_ffi_readArray(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "readArray requires 3 arguments");
+
+  void* ptr;
+  if (js_ffi_get_pointer(ctx, &ptr, argv[0])) return JS_EXCEPTION;
+  if (!ptr) return JS_ThrowTypeError(ctx, "Invalid pointer");
+
+  const char* type_str = JS_ToCString(ctx, argv[1]);
+  if (!type_str) return JS_EXCEPTION;
+
+  uint32_t count;
+  if (JS_ToUint32(ctx, &count, argv[2])) {
+    JS_FreeCString(ctx, type_str);
+    return JS_EXCEPTION;
+  }
+
+  JSValue array = JS_NewArray(ctx);
+
+  // 根据类型读取数组
+  for (uint32_t i = 0; i < count; i++) {
+    JSValue elem;
+
+    if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0) {
+      elem = JS_NewInt32(ctx, ((int32_t*)ptr)[i]);
+    }
     else if (strcmp(type_str, "uint32") == 0) {
-      uint32_t val;
-      JS_ToUint32(ctx, &val, elem);
-      ((uint32_t*)ptr)[i] = val;
+      elem = JS_NewUint32(ctx, ((uint32_t*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "float") == 0) {
+      elem = JS_NewFloat64(ctx, ((float*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "double") == 0) {
+      elem = JS_NewFloat64(ctx, ((double*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "int8") == 0) {
+      elem = JS_NewInt32(ctx, ((int8_t*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "uint8") == 0) {
+      elem = JS_NewUint32(ctx, ((uint8_t*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "int16") == 0) {
+      elem = JS_NewInt32(ctx, ((int16_t*)ptr)[i]);
+    }
+    else if (strcmp(type_str, "uint16") == 0) {
+      elem = JS_NewUint32(ctx, ((uint16_t*)ptr)[i]);
+    }
+    else {
+      elem = JS_UNDEFINED;
+    }
+
+    JS_SetPropertyUint32(ctx, array, i, elem);
+  }
+
+  JS_FreeCString(ctx, type_str);
+  return array;
+}
+
+// 缓冲回调每一列的 TypedArray 类型；不支持的参数类型返回 nullptr
+static const char* buffered_column_ctor(ffi_type* type)
+{
+  if (type == &ffi_type_sint8) return "Int8Array";
+  if (type == &ffi_type_uint8) return "Uint8Array";
+  if (type == &ffi_type_sint16) return "Int16Array";
+  if (type == &ffi_type_uint16) return "Uint16Array";
+  if (type == &ffi_type_sint32) return "Int32Array";
+  if (type == &ffi_type_uint32) return "Uint32Array";
+  if (type == &ffi_type_sint64) return "BigInt64Array";
+  if (type == &ffi_type_uint64 || type == &ffi_type_pointer) return "BigUint64Array";
+  if (type == &ffi_type_float) return "Float32Array";
+  if (type == &ffi_type_double) return "Float64Array";
+  return nullptr;
+}
+
+// JS: FFI.createCallback(js_function, return_type, [param_types], {buffered: batchSize})
+static JSValue js_ffi_createCallback(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "createCallback requires 3 arguments");
+
+  // 缓冲回调：void 回调的参数按列暂存，每 batchSize 次调用 JS 一次
+  uint32_t batch_size = 0;
+  if (argc > 3 && JS_IsObject(argv[3])) {
+    JSValue batch_val = JS_GetPropertyStr(ctx, argv[3], "buffered");
+    int ret = JS_IsUndefined(batch_val) ? 0 : JS_ToUint32(ctx, &batch_size, batch_val);
+    JS_FreeValue(ctx, batch_val);
+    if (ret) return JS_EXCEPTION;
+  }
+
+  if (!JS_IsFunction(ctx, argv[0])) {
+    return JS_ThrowTypeError(ctx, "First argument must be a function");
+  }
+
+  const char* ret_type_str = JS_ToCString(ctx, argv[1]);
+  ffi_type* rtype = string_to_ffi_type(ret_type_str);
+  std::string ret_name = rtype ? ret_type_str : "";
+  JS_FreeCString(ctx, ret_type_str);
+  if (!rtype) return JS_ThrowTypeError(ctx, "Invalid return type");
+
+  JSValueConst param_types_js = argv[2];
+  if (!JS_IsArray(ctx, param_types_js)) {
+    return JS_ThrowTypeError(ctx, "Parameter types must be an array");
+  }
+
+  JSValue len_val = JS_GetPropertyStr(ctx, param_types_js, "length");
+  uint32_t num_params;
+  JS_ToUint32(ctx, &num_params, len_val);
+  JS_FreeValue(ctx, len_val);
+
+  // 创建回调信息
+  auto callback_info = std::make_unique<CallbackInfo>();
+  callback_info->ctx = ctx;
+  callback_info->js_callback = JS_DupValue(ctx, argv[0]);
+  callback_info->argc = num_params;
+  callback_info->rtype = rtype;
+
+  std::string param_names;   // "int,int"，用于 perf 符号名
+  if (num_params > 0) {
+    callback_info->atypes = new ffi_type*[num_params];
+
+    for (uint32_t i = 0; i < num_params; i++) {
+      JSValue type_val = JS_GetPropertyUint32(ctx, param_types_js, i);
+      const char* type_str = JS_ToCString(ctx, type_val);
+      callback_info->atypes[i] = string_to_ffi_type(type_str);
+
+      if (!callback_info->atypes[i]) {
+        JS_FreeCString(ctx, type_str);
+        JS_FreeValue(ctx, type_val);
+        delete[] callback_info->atypes;
+        JS_FreeValue(ctx, callback_info->js_callback);
+        return JS_ThrowTypeError(ctx, "Invalid parameter type");
+      }
+      if (i > 0) param_names += ',';
+      param_names += type_str;
+
+      JS_FreeCString(ctx, type_str);
+      JS_FreeValue(ctx, type_val);
+    }
+  } else {
+    callback_info->atypes = nullptr;
+  }
+
+  if (batch_size > 0) {
+    if (rtype != &ffi_type_void) {
+      return JS_ThrowTypeError(ctx, "Buffered callbacks must return void");
+    }
+    auto buffered = std::make_unique<BufferedColumns>();
+    buffered->capacity = batch_size;
+    for (uint32_t i = 0; i < num_params; i++) {
+      const char* ctor = buffered_column_ctor(callback_info->atypes[i]);
+      if (!ctor) {
+        return JS_ThrowTypeError(ctx, "Unsupported parameter type for buffered callback");
+      }
+      uint8_t* column = (uint8_t*)malloc((size_t)batch_size * callback_info->atypes[i]->size);
+      if (!column) return JS_ThrowOutOfMemory(ctx);
+      buffered->columns.push_back(column);
+      buffered->elem_size.push_back((uint8_t)callback_info->atypes[i]->size);
+      buffered->view_ctor.push_back(ctor);
+    }
+    callback_info->buffered = std::move(buffered);
+  }
+
+  callback_info->cif = new ffi_cif;
+  if (ffi_prep_cif(callback_info->cif, FFI_DEFAULT_ABI, 
+                  callback_info->argc, callback_info->rtype, 
+                  callback_info->atypes) != FFI_OK) {
+    delete[] callback_info->atypes;
+    delete callback_info->cif;
+    JS_FreeValue(ctx, callback_info->js_callback);
+    return JS_ThrowInternalError(ctx, "ffi_prep_cif failed for callback");
+  }
+
+  // 创建闭包
+  void* func_ptr;
+  void* closure_ptr = ffi_closure_alloc(sizeof(ffi_closure), &func_ptr);
+  if (!closure_ptr) {
+    delete[] callback_info->atypes;
+    delete callback_info->cif;
+    JS_FreeValue(ctx, callback_info->js_callback);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  if (ffi_prep_closure_loc((ffi_closure*)closure_ptr, callback_info->cif,
+                          callback_info->buffered ? buffered_callback_wrapper : callback_wrapper,
+                          callback_info.get(), func_ptr) != FFI_OK) {
+    ffi_closure_free(closure_ptr);
+    delete[] callback_info->atypes;
+    delete callback_info->cif;
+    JS_FreeValue(ctx, callback_info->js_callback);
+    return JS_ThrowInternalError(ctx, "ffi_prep_closure_loc failed");
+  }
+
+  // 保存闭包信息到结构体中
+  callback_info->closure_ptr = closure_ptr;
+  callback_info->func_ptr = func_ptr;
+
+  // 以 JS 函数名登记追踪符号
+  JSValue name_val = JS_GetPropertyStr(ctx, argv[0], "name");
+  const char* fn_name = JS_ToCString(ctx, name_val);
+  std::string trace_name = std::string("callback:") + (fn_name && *fn_name ? fn_name : "<anonymous>");
+  JS_FreeCString(ctx, fn_name);
+  JS_FreeValue(ctx, name_val);
+  callback_info->trace_symbol_id = ffi_trace_intern(trace_name.c_str());
+  ffi_trace_bind_address(callback_info->trace_symbol_id, func_ptr);
+
+  // perf 符号表中的蹦床名称，如 "callback:onItem(int,int)->void"
+#ifdef FFI_TRAMPOLINE_SIZE
+  const size_t trampoline_size = FFI_TRAMPOLINE_SIZE;
+#else
+  const size_t trampoline_size = 32;
+#endif
+  ffi_perfmap_add(func_ptr, trampoline_size, trace_name + "(" + param_names + ")->" + ret_name);
+
+  // 保存回调信息
+  callback_infos.push_back(std::move(callback_info));
+
+  return JS_NewInt64(ctx, (int64_t)(uintptr_t)func_ptr);
+}
+
+// JS: FFI.flushCallbacks([callback_ptr]) - 立即把缓冲回调中暂存的调用交给 JS
+static JSValue js_ffi_flushCallbacks(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 1 || JS_IsUndefined(argv[0])) {
+    return flush_buffered_callbacks(ctx) < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+  }
+
+  void* func_ptr;
+  if (js_ffi_get_pointer(ctx, &func_ptr, argv[0])) return JS_EXCEPTION;
+  for (auto& info : callback_infos) {
+    if (info->func_ptr == func_ptr) {
+      if (!info->buffered) return JS_ThrowTypeError(ctx, "Callback is not buffered");
+      return flush_buffered_callback(ctx, info.get()) < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+    }
+  }
+  return JS_ThrowTypeError(ctx, "Unknown callback");
+}
+
+// JS: FFI.callbackStats(callback_ptr) - 缓冲回调的 {calls, batches, pending, dropped}
+static JSValue js_ffi_callbackStats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  void* func_ptr;
+  if (js_ffi_get_pointer(ctx, &func_ptr, argv[0])) return JS_EXCEPTION;
+  for (auto& info : callback_infos) {
+    if (info->func_ptr == func_ptr && info->buffered) {
+      JSValue obj = JS_NewObject(ctx);
+      JS_SetPropertyStr(ctx, obj, "calls", JS_NewInt64(ctx, (int64_t)info->buffered->calls));
+      JS_SetPropertyStr(ctx, obj, "batches", JS_NewInt64(ctx, (int64_t)info->buffered->batches));
+      JS_SetPropertyStr(ctx, obj, "pending", JS_NewUint32(ctx, info->buffered->count));
+      JS_SetPropertyStr(ctx, obj, "dropped", JS_NewInt64(ctx, (int64_t)info->buffered->dropped));
+      return obj;
+    }
+  }
+  return JS_ThrowTypeError(ctx, "Not a buffered callback");
+}
+
+// ---------------------------------------------------------------------------
+// 事件循环集成
+//
+// 后台线程完成工作后写一个非阻塞管道，读端通过 quickjs-libc 的
+// os.setReadHandler 注册到 js_std_loop。该函数没有 C 接口，首次使用时由
+// 一个内部模块从 'os' 取得，缓存在流原型的隐藏属性上，随上下文回收。
+// ---------------------------------------------------------------------------
+
+static JSClassID js_ffi_stream_class_id;
+
+static const char kLoopHandlerProp[] = "__ffiSetReadHandler";
+
+static JSValue js_ffi_loop_capture(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  JSValue proto = JS_GetClassProto(ctx, js_ffi_stream_class_id);
+  JS_DefinePropertyValueStr(ctx, proto, kLoopHandlerProp, JS_DupValue(ctx, argc > 0 ? argv[0] : JS_NULL), 0);
+  JS_FreeValue(ctx, proto);
+  return JS_UNDEFINED;
+}
+
+// 返回 os.setReadHandler；宿主没有 'os' 模块时返回 null
+static JSValue loop_get_set_read_handler(JSContext* ctx)
+{
+  JSValue proto = JS_GetClassProto(ctx, js_ffi_stream_class_id);
+  JSValue fn = JS_GetPropertyStr(ctx, proto, kLoopHandlerProp);
+  if (JS_IsUndefined(fn)) {
+    static const char src[] =
+      "import { setReadHandler } from 'os';\n"
+      "globalThis.__ffiLoopCapture(setReadHandler);\n";
+    JSValue global = JS_GetGlobalObject(ctx);
+    JS_SetPropertyStr(ctx, global, "__ffiLoopCapture",
+                      JS_NewCFunction(ctx, js_ffi_loop_capture, "__ffiLoopCapture", 1));
+    JSValue ret = JS_Eval(ctx, src, sizeof(src) - 1, "<ffi-loop>", JS_EVAL_TYPE_MODULE);
+    if (JS_IsException(ret)) {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+    JS_FreeValue(ctx, ret);
+    JSAtom atom = JS_NewAtom(ctx, "__ffiLoopCapture");
+    JS_DeleteProperty(ctx, global, atom, 0);
+    JS_FreeAtom(ctx, atom);
+    JS_FreeValue(ctx, global);
+
+    fn = JS_GetPropertyStr(ctx, proto, kLoopHandlerProp);
+    if (!JS_IsFunction(ctx, fn)) {
+      // 不再重复尝试
+      JS_FreeValue(ctx, fn);
+      fn = JS_NULL;
+      JS_DefinePropertyValueStr(ctx, proto, kLoopHandlerProp, JS_NULL, 0);
+    }
+  }
+  JS_FreeValue(ctx, proto);
+  return fn;
+}
+
+// os.setReadHandler(fd, handler)；handler 为 null 时注销
+static int loop_set_read_handler(JSContext* ctx, int fd, JSValueConst handler)
+{
+  JSValue fn = loop_get_set_read_handler(ctx);
+  if (!JS_IsFunction(ctx, fn)) {
+    JS_FreeValue(ctx, fn);
+    return -1;
+  }
+  JSValueConst args[2] = { JS_NewInt32(ctx, fd), handler };
+  JSValue ret = JS_Call(ctx, fn, JS_UNDEFINED, 2, args);
+  JS_FreeValue(ctx, fn);
+  if (JS_IsException(ret)) return -1;
+  JS_FreeValue(ctx, ret);
+  return 0;
+}
+
+static bool loop_available(JSContext* ctx)
+{
+  JSValue fn = loop_get_set_read_handler(ctx);
+  bool ok = JS_IsFunction(ctx, fn);
+  JS_FreeValue(ctx, fn);
+  return ok;
+}
+
+// 非阻塞通知管道：任意线程 signal，JS 线程在读事件中 drain
+static bool loop_pipe_open(int fds[2])
+{
+  if (pipe(fds) != 0) {
+    fds[0] = fds[1] = -1;
+    return false;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  return true;
+}
+
+static void loop_pipe_close(int fds[2])
+{
+  for (int i = 0; i < 2; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+    fds[i] = -1;
+  }
+}
+
+static void loop_pipe_signal(int fd)
+{
+  char byte = 1;
+  // 管道已满说明读端已经有未处理的通知，EAGAIN 可以忽略
+  while (write(fd, &byte, 1) < 0 && errno == EINTR) {}
+}
+
+static void loop_pipe_drain(int fd)
+{
+  char buf[64];
+  for (;;) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) continue;
+    if (n < 0 && errno == EINTR) continue;
+    break;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// 流式生产者（ffi.stream）
+//
+// 原生的 read(buf, n) 风格函数在后台线程中反复调用，填充一圈固定数量的
+// 原生缓冲区；JS 通过异步迭代器按顺序取得分块，每个分块是直接指向环形
+// 缓冲区的 Uint8Array（零拷贝）。下一次调用 next() 时，之前交付的分块被
+// 分离（detach）并归还给生产者；分块被 GC 回收时同样会归还。
+//
+// 生产者每交付一个分块（或结束）时，如果 JS 正在等待，就向流的通知管道
+// 写一个字节；管道读端通过 os.setReadHandler 注册在 js_std_loop 上，可读时
+// 在 JS 线程中完成等待中的 next()，与 os.Worker 的消息端口相同，事件循环
+// 从不阻塞。宿主没有 'os' 模块时退回到由作业等待生产者。
+// ---------------------------------------------------------------------------
+
+struct StreamCore {
+  std::atomic<int> refs{1};          // JS 对象 + 每个未归还的分块 ArrayBuffer
+
+  // 生产者调用：ssize_t fn(...)，返回填充字节数，0 表示结束，负数表示错误
+  void* fn = nullptr;
+  ffi_cif cif;
+  std::vector<ffi_type*> atypes;
+  std::vector<long double> arg_template;
+  int buffer_arg = -1;
+  int size_arg = -1;
+  uint32_t trace_id = 0;
+
+  // 环形缓冲区：depth 个分块连续存放，步长按缓存行对齐
+  uint8_t* block = nullptr;
+  size_t chunk_size = 0;
+  size_t stride = 0;
+  uint32_t depth = 0;
+  std::vector<size_t> lengths;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<uint32_t> free_slots;   // 等待生产者填充
+  std::deque<uint32_t> filled;       // 等待交付给 JS
+  bool stopping = false;
+  bool finished = false;
+  int64_t status = 0;
+
+  uint64_t chunks = 0;
+  uint64_t bytes = 0;
+  uint64_t producer_stalls = 0;      // 环形缓冲区满，生产者等待 JS
+  uint64_t consumer_stalls = 0;      // 环形缓冲区空，JS 等待生产者
+
+  // 通知管道：JS 有等待中的 next() 时，生产者交付分块或结束后写入一个字节
+  int notify_fds[2] = { -1, -1 };
+  bool consumer_waiting = false;
+  bool signaled = false;
+
+  std::thread thread;
+
+  ~StreamCore() {
+    loop_pipe_close(notify_fds);
+    if (block) {
+      mem_record_free(block, true);
+      free(block);
+    }
+  }
+};
+
+struct StreamRequest {
+  JSValue resolve;
+  JSValue reject;
+};
+
+struct NativeStream {
+  StreamCore* core = nullptr;
+  std::vector<JSValue> delivered;    // 已交付、尚未归还的分块 ArrayBuffer
+  std::vector<JSValue> pinned;       // 参数模板中引用的缓冲区对象，防止提前回收
+  std::deque<StreamRequest> waiting; // 等待生产者的 next()，按调用顺序完成
+  bool watching = false;             // 通知管道的读端是否注册在事件循环上
+};
+
+static void stream_core_unref(StreamCore* s)
+{
+  if (--s->refs == 0) {
+    delete s;
+  }
+}
+
+static void stream_produce(StreamCore* s)
+{
+  std::vector<long double> args(s->arg_template);
+  std::vector<void*> avalues(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    avalues[i] = &args[i];
+  }
+
+  for (;;) {
+    uint32_t slot;
+    {
+      std::unique_lock<std::mutex> lock(s->mutex);
+      if (s->free_slots.empty() && !s->stopping) s->producer_stalls++;
+      s->cv.wait(lock, [s] { return s->stopping || !s->free_slots.empty(); });
+      if (s->stopping) break;
+      slot = s->free_slots.front();
+      s->free_slots.pop_front();
+    }
+
+    *(void**)&args[s->buffer_arg] = s->block + slot * s->stride;
+    if (s->size_arg >= 0) {
+      *(uint64_t*)&args[s->size_arg] = s->chunk_size;
+    }
+
+    int64_t ret;
+    {
+      FFITraceScope trace_scope(FFI_TRACE_CALL, s->trace_id, (uintptr_t)s->fn);
+      ffi_call(&s->cif, FFI_FN(s->fn), &ret, avalues.data());
+    }
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (s->consumer_waiting && !s->signaled) {
+      s->signaled = true;
+      loop_pipe_signal(s->notify_fds[1]);
+    }
+    if (ret <= 0) {
+      s->finished = true;
+      s->status = ret;
+      s->free_slots.push_back(slot);
+      s->cv.notify_all();
+      break;
+    }
+    s->lengths[slot] = (size_t)ret < s->chunk_size ? (size_t)ret : s->chunk_size;
+    s->filled.push_back(slot);
+    s->chunks++;
+    s->bytes += s->lengths[slot];
+    s->cv.notify_all();
+  }
+}
+
+static void stream_stop(StreamCore* s)
+{
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->stopping = true;
+  }
+  s->cv.notify_all();
+  if (s->thread.joinable()) {
+    s->thread.join();
+  }
+}
+
+// 分块 ArrayBuffer 的释放函数：分离时以数据指针调用一次，对象回收时以 NULL 再调用一次
+static void js_ffi_stream_release_chunk(JSRuntime* rt, void* opaque, void* ptr)
+{
+  if (!ptr) return;
+  StreamCore* s = (StreamCore*)opaque;
+  uint32_t slot = (uint32_t)(((uint8_t*)ptr - s->block) / s->stride);
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->free_slots.push_back(slot);
+  }
+  s->cv.notify_all();
+  stream_core_unref(s);
+}
+
+// 分离之前交付的所有分块，缓冲区立即回到生产者手中
+static void js_ffi_stream_recycle(JSContext* ctx, NativeStream* st)
+{
+  for (JSValue& ab : st->delivered) {
+    JS_DetachArrayBuffer(ctx, ab);
+    JS_FreeValue(ctx, ab);
+  }
+  st->delivered.clear();
+}
+
+static void js_ffi_stream_finalizer(JSRuntime* rt, JSValue val)
+{
+  NativeStream* st = (NativeStream*)JS_GetOpaque(val, js_ffi_stream_class_id);
+  if (!st) return;
+  stream_stop(st->core);
+  for (JSValue& v : st->delivered) JS_FreeValueRT(rt, v);
+  for (JSValue& v : st->pinned) JS_FreeValueRT(rt, v);
+  for (StreamRequest& r : st->waiting) {
+    JS_FreeValueRT(rt, r.resolve);
+    JS_FreeValueRT(rt, r.reject);
+  }
+  stream_core_unref(st->core);
+  delete st;
+}
+
+static void js_ffi_stream_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func)
+{
+  NativeStream* st = (NativeStream*)JS_GetOpaque(val, js_ffi_stream_class_id);
+  if (!st) return;
+  for (JSValue& v : st->delivered) JS_MarkValue(rt, v, mark_func);
+  for (JSValue& v : st->pinned) JS_MarkValue(rt, v, mark_func);
+  for (StreamRequest& r : st->waiting) {
+    JS_MarkValue(rt, r.resolve, mark_func);
+    JS_MarkValue(rt, r.reject, mark_func);
+  }
+}
+
+static JSClassDef js_ffi_stream_class = {
+  "NativeStream",
+  js_ffi_stream_finalizer,
+  js_ffi_stream_mark,
+};
+
+static JSValue js_ffi_iter_result(JSContext* ctx, JSValue value, bool done)
+{
+  JSValue result = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, result, "value", value);
+  JS_SetPropertyStr(ctx, result, "done", JS_NewBool(ctx, done));
+  return result;
+}
+
+// 取出下一个结果；返回 false 表示既没有分块也没有结束，需要等待生产者
+static bool stream_take_locked(StreamCore* s, int64_t* slot, int64_t* status)
+{
+  if (!s->filled.empty()) {
+    *slot = s->filled.front();
+    s->filled.pop_front();
+  } else if (s->finished || s->stopping) {
+    *slot = -1;
+  } else {
+    return false;
+  }
+  *status = s->status;
+  return true;
+}
+
+// 用 stream_take_locked 取得的结果完成一个 next()
+static void js_ffi_stream_settle(JSContext* ctx, NativeStream* st, int64_t slot, int64_t status,
+                                 JSValueConst resolve, JSValueConst reject)
+{
+  StreamCore* s = st->core;
+  JSValueConst settle = resolve;
+  JSValue result;
+  if (slot >= 0) {
+    uint8_t* data = s->block + slot * s->stride;
+    s->refs++;
+    JSValue ab = JS_NewArrayBuffer(ctx, data, s->lengths[slot], js_ffi_stream_release_chunk, s, false);
+    if (JS_IsException(ab)) {
+      js_ffi_stream_release_chunk(JS_GetRuntime(ctx), s, data);
+      settle = reject;
+      result = JS_GetException(ctx);
+    } else {
+      st->delivered.push_back(JS_DupValue(ctx, ab));
+      JSValue view = js_ffi_new_typed_view(ctx, "Uint8Array", ab);
+      JS_FreeValue(ctx, ab);
+      if (JS_IsException(view)) {
+        settle = reject;
+        result = JS_GetException(ctx);
+      } else {
+        result = js_ffi_iter_result(ctx, view, false);
+      }
     }
-    else if (strcmp(type_str, "float") == 0) {
-      double val;
-      JS_ToFloat64(ctx, &val, elem);
-      ((float*)ptr)[i] = (float)val;
+  } else if (status < 0) {
+    settle = reject;
+    result = JS_NewError(ctx);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Stream producer failed with code %lld", (long long)status);
+    JS_SetPropertyStr(ctx, result, "message", JS_NewString(ctx, msg));
+  } else {
+    result = js_ffi_iter_result(ctx, JS_UNDEFINED, true);
+  }
+
+  JSValue ret = JS_Call(ctx, settle, JS_UNDEFINED, 1, (JSValueConst*)&result);
+  JS_FreeValue(ctx, result);
+  JS_FreeValue(ctx, ret);
+}
+
+// 作业：argv = [stream, resolve, reject]；仅在宿主没有事件循环集成时使用
+static JSValue js_ffi_stream_job(JSContext* ctx, int argc, JSValueConst* argv)
+{
+  NativeStream* st = (NativeStream*)JS_GetOpaque(argv[0], js_ffi_stream_class_id);
+  StreamCore* s = st->core;
+
+  int64_t slot;
+  int64_t status;
+  {
+    std::unique_lock<std::mutex> lock(s->mutex);
+    if (s->filled.empty() && !s->finished && !s->stopping) s->consumer_stalls++;
+    s->cv.wait(lock, [s] { return !s->filled.empty() || s->finished || s->stopping; });
+    stream_take_locked(s, &slot, &status);
+  }
+  js_ffi_stream_settle(ctx, st, slot, status, argv[1], argv[2]);
+  return JS_UNDEFINED;
+}
+
+// 按顺序完成所有已有结果的 next()；没有等待者后注销读事件
+static void js_ffi_stream_dispatch(JSContext* ctx, NativeStream* st)
+{
+  StreamCore* s = st->core;
+  while (!st->waiting.empty()) {
+    int64_t slot;
+    int64_t status;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->signaled = false;
+      if (!stream_take_locked(s, &slot, &status)) {
+        s->consumer_waiting = true;
+        return;
+      }
     }
-    else if (strcmp(type_str, "double") == 0) {
-      double val;
-      JS_ToFloat64(ctx, &val, elem);
-      ((double*)ptr)[i] = val;
+    StreamRequest r = st->waiting.front();
+    st->waiting.pop_front();
+    js_ffi_stream_settle(ctx, st, slot, status, r.resolve, r.reject);
+    JS_FreeValue(ctx, r.resolve);
+    JS_FreeValue(ctx, r.reject);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->consumer_waiting = false;
+  }
+  if (st->watching) {
+    st->watching = false;
+    loop_set_read_handler(ctx, s->notify_fds[0], JS_NULL);
+  }
+}
+
+// 通知管道的读事件：data = [stream]
+static JSValue js_ffi_stream_on_readable(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv,
+                                         int magic, JSValue* data)
+{
+  NativeStream* st = (NativeStream*)JS_GetOpaque(data[0], js_ffi_stream_class_id);
+  if (!st) return JS_UNDEFINED;
+  loop_pipe_drain(st->core->notify_fds[0]);
+  js_ffi_stream_dispatch(ctx, st);
+  return JS_UNDEFINED;
+}
+
+static NativeStream* js_ffi_stream_this(JSContext* ctx, JSValueConst this_val)
+{
+  return (NativeStream*)JS_GetOpaque2(ctx, this_val, js_ffi_stream_class_id);
+}
+
+// stream.next() - Promise<{value: Uint8Array, done}>
+static JSValue js_ffi_stream_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  NativeStream* st = js_ffi_stream_this(ctx, this_val);
+  if (!st) return JS_EXCEPTION;
+  StreamCore* s = st->core;
+
+  js_ffi_stream_recycle(ctx, st);
+
+  JSValue funcs[2];
+  JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+  if (JS_IsException(promise)) return promise;
+
+  if (s->notify_fds[0] < 0 || !loop_available(ctx)) {
+    JSValueConst job_args[3] = { this_val, funcs[0], funcs[1] };
+    int ret = JS_EnqueueJob(ctx, js_ffi_stream_job, 3, job_args);
+    JS_FreeValue(ctx, funcs[0]);
+    JS_FreeValue(ctx, funcs[1]);
+    if (ret < 0) {
+      JS_FreeValue(ctx, promise);
+      return JS_EXCEPTION;
     }
-    else if (strcmp(type_str, "int8") == 0) {
-      int32_t val;
-      JS_ToInt32(ctx, &val, elem);
-      ((int8_t*)ptr)[i] = (int8_t)val;
+    return promise;
+  }
+
+  bool stalled;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    stalled = st->waiting.empty() && s->filled.empty() && !s->finished && !s->stopping;
+    if (stalled) s->consumer_stalls++;
+  }
+  st->waiting.push_back(StreamRequest{ funcs[0], funcs[1] });
+  js_ffi_stream_dispatch(ctx, st);
+
+  if (!st->waiting.empty() && !st->watching) {
+    JSValue handler = JS_NewCFunctionData(ctx, js_ffi_stream_on_readable, 0, 0, 1, &this_val);
+    if (JS_IsException(handler) || loop_set_read_handler(ctx, s->notify_fds[0], handler)) {
+      // 只有刚加入的请求在等待（否则读事件已注册），撤回它
+      StreamRequest r = st->waiting.back();
+      st->waiting.pop_back();
+      JS_FreeValue(ctx, r.resolve);
+      JS_FreeValue(ctx, r.reject);
+      JS_FreeValue(ctx, handler);
+      JS_FreeValue(ctx, promise);
+      return JS_EXCEPTION;
     }
-    else if (strcmp(type_str, "uint8") == 0) {
-      uint32_t val;
-      JS_ToUint32(ctx, &val, elem);
-      ((uint8_t*)ptr)[i] = (uint8_t)val;
+    JS_FreeValue(ctx, handler);
+    st->watching = true;
+  }
+  return promise;
+}
+
+// stream.return() - 停止生产者并归还所有分块；生产者正阻塞在原生调用中时会等待其返回
+static JSValue js_ffi_stream_return(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  NativeStream* st = js_ffi_stream_this(ctx, this_val);
+  if (!st) return JS_EXCEPTION;
+
+  js_ffi_stream_recycle(ctx, st);
+  stream_stop(st->core);
+  // 等待中的 next() 都以 done 结束
+  js_ffi_stream_dispatch(ctx, st);
+
+  JSValue funcs[2];
+  JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+  if (JS_IsException(promise)) return promise;
+  JSValue result = js_ffi_iter_result(ctx, JS_UNDEFINED, true);
+  JSValue ret = JS_Call(ctx, funcs[0], JS_UNDEFINED, 1, (JSValueConst*)&result);
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, result);
+  JS_FreeValue(ctx, funcs[0]);
+  JS_FreeValue(ctx, funcs[1]);
+  return promise;
+}
+
+static JSValue js_ffi_stream_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  return JS_DupValue(ctx, this_val);
+}
+
+static JSValue js_ffi_stream_get_stats(JSContext* ctx, JSValueConst this_val)
+{
+  NativeStream* st = js_ffi_stream_this(ctx, this_val);
+  if (!st) return JS_EXCEPTION;
+
+  StreamCore* s = st->core;
+  std::lock_guard<std::mutex> lock(s->mutex);
+  JSValue obj = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, obj, "chunks", JS_NewInt64(ctx, (int64_t)s->chunks));
+  JS_SetPropertyStr(ctx, obj, "bytes", JS_NewInt64(ctx, (int64_t)s->bytes));
+  JS_SetPropertyStr(ctx, obj, "producerStalls", JS_NewInt64(ctx, (int64_t)s->producer_stalls));
+  JS_SetPropertyStr(ctx, obj, "consumerStalls", JS_NewInt64(ctx, (int64_t)s->consumer_stalls));
+  JS_SetPropertyStr(ctx, obj, "depth", JS_NewUint32(ctx, s->depth));
+  JS_SetPropertyStr(ctx, obj, "chunkSize", JS_NewInt64(ctx, (int64_t)s->chunk_size));
+  return obj;
+}
+
+static const JSCFunctionListEntry js_ffi_stream_proto_funcs[] = {
+  JS_CFUNC_DEF("next", 0, js_ffi_stream_next),
+  JS_CFUNC_DEF("return", 0, js_ffi_stream_return),
+  JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_ffi_stream_iterator),
+  JS_CGETSET_DEF("stats", js_ffi_stream_get_stats, NULL),
+};
+
+// 解析参数模板：'$buffer' / '$size' 占位符，或 [type, value] 常量
+static int js_ffi_stream_parse_template(JSContext* ctx, StreamCore* s, NativeStream* st, JSValueConst tmpl)
+{
+  if (!JS_IsArray(ctx, tmpl)) {
+    JS_ThrowTypeError(ctx, "Argument template must be an array");
+    return -1;
+  }
+  JSValue len_val = JS_GetPropertyStr(ctx, tmpl, "length");
+  uint32_t num_args;
+  int ret = JS_ToUint32(ctx, &num_args, len_val);
+  JS_FreeValue(ctx, len_val);
+  if (ret) return -1;
+
+  s->atypes.resize(num_args);
+  s->arg_template.assign(num_args, 0.0L);
+  for (uint32_t i = 0; i < num_args; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, tmpl, i);
+    ret = -1;
+    if (JS_IsString(item)) {
+      const char* name = JS_ToCString(ctx, item);
+      if (name && strcmp(name, "$buffer") == 0 && s->buffer_arg < 0) {
+        s->atypes[i] = &ffi_type_pointer;
+        s->buffer_arg = (int)i;
+        ret = 0;
+      } else if (name && strcmp(name, "$size") == 0 && s->size_arg < 0) {
+        s->atypes[i] = &ffi_type_uint64;
+        s->size_arg = (int)i;
+        ret = 0;
+      } else if (name) {
+        JS_ThrowTypeError(ctx, "Unexpected placeholder in argument template: %s", name);
+      }
+      JS_FreeCString(ctx, name);
+    } else if (JS_IsArray(ctx, item)) {
+      JSValue type_val = JS_GetPropertyUint32(ctx, item, 0);
+      JSValue value = JS_GetPropertyUint32(ctx, item, 1);
+      const char* type_str = JS_ToCString(ctx, type_val);
+      ffi_type* type = type_str ? string_to_ffi_type(type_str) : nullptr;
+      bool allowed = type && type != &ffi_type_void &&
+                     strcmp(type_str, "string") != 0 && strcmp(type_str, "callback") != 0;
+      if (type_str && !allowed) {
+        // 生产者运行在后台线程，不能引用 JS 字符串或回调
+        JS_ThrowTypeError(ctx, "Unsupported stream argument type: %s", type_str);
+      } else if (allowed) {
+        s->atypes[i] = type;
+        ret = js_ffi_store_arg(ctx, type, value, &s->arg_template[i]);
+        if (!ret && JS_GetOpaque(value, js_ffi_buffer_class_id)) {
+          st->pinned.push_back(JS_DupValue(ctx, value));
+        }
+      }
+      JS_FreeCString(ctx, type_str);
+      JS_FreeValue(ctx, type_val);
+      JS_FreeValue(ctx, value);
+    } else {
+      JS_ThrowTypeError(ctx, "Argument template entries must be '$buffer', '$size' or [type, value]");
+    }
+    JS_FreeValue(ctx, item);
+    if (ret) return -1;
+  }
+
+  if (s->buffer_arg < 0) {
+    JS_ThrowTypeError(ctx, "Argument template must contain '$buffer'");
+    return -1;
+  }
+  return 0;
+}
+
+// JS: FFI.stream(fn, argTemplate, chunkSize, depth = 4)
+static JSValue js_ffi_stream(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 3) return JS_ThrowTypeError(ctx, "stream requires at least 3 arguments");
+
+  void* fn;
+  if (js_ffi_get_pointer(ctx, &fn, argv[0])) return JS_EXCEPTION;
+  if (!fn) return JS_ThrowTypeError(ctx, "Invalid function pointer");
+
+  int64_t chunk_size;
+  uint32_t depth = 4;
+  if (JS_ToInt64(ctx, &chunk_size, argv[2])) return JS_EXCEPTION;
+  if (argc > 3 && !JS_IsUndefined(argv[3]) && JS_ToUint32(ctx, &depth, argv[3])) return JS_EXCEPTION;
+  if (chunk_size <= 0) return JS_ThrowRangeError(ctx, "Invalid chunk size");
+  if (depth < 1 || depth > 1024) return JS_ThrowRangeError(ctx, "Stream depth must be between 1 and 1024");
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_stream_class_id);
+  if (JS_IsException(obj)) return obj;
+
+  StreamCore* s = new StreamCore();
+  NativeStream* st = new NativeStream();
+  st->core = s;
+  JS_SetOpaque(obj, st);   // 之后出错由 finalizer 统一清理
+
+  s->fn = fn;
+  s->trace_id = ffi_trace_symbol_id(fn);
+  if (js_ffi_stream_parse_template(ctx, s, st, argv[1])) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+  if (ffi_prep_cif(&s->cif, FFI_DEFAULT_ABI, (unsigned)s->atypes.size(), &ffi_type_sint64, s->atypes.data()) != FFI_OK) {
+    JS_FreeValue(ctx, obj);
+    return JS_ThrowInternalError(ctx, "ffi_prep_cif failed");
+  }
+
+  s->chunk_size = (size_t)chunk_size;
+  s->stride = (s->chunk_size + 63) & ~(size_t)63;
+  s->depth = depth;
+  s->lengths.assign(depth, 0);
+  size_t total = s->stride * depth;
+  if (!mem_check_limit(ctx, total)) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+  void* block = nullptr;
+  if (posix_memalign(&block, 64, total) != 0) {
+    JS_FreeValue(ctx, obj);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+  s->block = (uint8_t*)block;
+  mem_record_alloc(ctx, block, total, true);
+  for (uint32_t i = 0; i < depth; i++) {
+    s->free_slots.push_back(i);
+  }
+
+  loop_pipe_open(s->notify_fds);   // 失败时 next() 退回到作业等待
+  s->thread = std::thread(stream_produce, s);
+  return obj;
+}
+
+// ---------------------------------------------------------------------------
+// 原生调用流水线（ffi.pipeline）
+//
+// 把一串原生调用编译成固定的执行计划：每个参数对应一个地址固定的槽位，
+// 常量在编译时写入，输入在 run() 开始时转换一次，之后所有步骤在 C 中
+// 依次执行，前面步骤的返回值和输出参数直接作为后面步骤的参数（类型
+// 不同时先做一次数值转换），只有最终输出会转换回 JS。
+// ---------------------------------------------------------------------------
+
+// 槽位足以容纳任意标量参数或返回值（libffi 要求返回值存储至少为 ffi_arg 大小）
+typedef long double PipelineSlot;
+
+struct PipelineConversion {
+  PipelineSlot* dst;
+  ffi_type* dst_type;
+  const PipelineSlot* src;
+  ffi_type* src_type;
+};
+
+struct PipelineInput {
+  PipelineSlot* dst;
+  ffi_type* type;
+  uint32_t index;
+};
+
+struct PipelineOutput {
+  const PipelineSlot* slot;
+  ffi_type* type;
+};
+
+struct PipelineStep {
+  void (*fn)(void);
+  ffi_cif cif;
+  ffi_type* rtype;
+  std::vector<ffi_type*> atypes;
+  std::vector<void*> avalues;
+  std::vector<PipelineConversion> conversions;
+  PipelineSlot* ret;
+  std::vector<int> out_slot;          // 参数下标 -> out_slots 下标，不是输出参数时为 -1
+  uint32_t trace_id;
+};
+
+struct NativePipeline {
+  std::deque<PipelineSlot> slots;     // deque 追加元素不会移动已有元素
+  std::vector<PipelineStep> steps;
+  std::vector<PipelineInput> inputs;
+  std::vector<std::pair<PipelineSlot*, ffi_type*>> out_slots;
+  std::vector<PipelineOutput> outputs;
+  bool single_output = true;
+  uint32_t input_count = 0;
+  std::deque<std::string> strings;    // 字符串常量
+  std::vector<JSValue> pinned;        // 常量中引用的缓冲区对象
+};
+
+static JSClassID js_ffi_pipeline_class_id;
+
+static bool ffi_type_is_float(ffi_type* t)
+{
+  return t == &ffi_type_float || t == &ffi_type_double || t == &ffi_type_longdouble;
+}
+
+static int64_t pipeline_load_int(ffi_type* t, const void* p)
+{
+  switch (t->type) {
+    case FFI_TYPE_SINT8: return *(const int8_t*)p;
+    case FFI_TYPE_UINT8: return *(const uint8_t*)p;
+    case FFI_TYPE_SINT16: return *(const int16_t*)p;
+    case FFI_TYPE_UINT16: return *(const uint16_t*)p;
+    case FFI_TYPE_SINT32: return *(const int32_t*)p;
+    case FFI_TYPE_UINT32: return *(const uint32_t*)p;
+    case FFI_TYPE_POINTER: return (int64_t)(uintptr_t)*(void* const*)p;
+    default: return *(const int64_t*)p;
+  }
+}
+
+static double pipeline_load_float(ffi_type* t, const void* p)
+{
+  if (t == &ffi_type_float) return *(const float*)p;
+  if (t == &ffi_type_double) return *(const double*)p;
+  return (double)*(const long double*)p;
+}
+
+// 在两个槽位之间按 C 的数值转换规则转换
+static void pipeline_convert(const PipelineConversion& c)
+{
+  if (ffi_type_is_float(c.dst_type)) {
+    double v = ffi_type_is_float(c.src_type) ? pipeline_load_float(c.src_type, c.src)
+                                             : (double)pipeline_load_int(c.src_type, c.src);
+    if (c.dst_type == &ffi_type_float) *(float*)c.dst = (float)v;
+    else if (c.dst_type == &ffi_type_double) *(double*)c.dst = v;
+    else *(long double*)c.dst = (long double)v;
+    return;
+  }
+
+  int64_t v = ffi_type_is_float(c.src_type) ? (int64_t)pipeline_load_float(c.src_type, c.src)
+                                            : pipeline_load_int(c.src_type, c.src);
+  switch (c.dst_type->size) {
+    case 1: *(uint8_t*)c.dst = (uint8_t)v; break;
+    case 2: *(uint16_t*)c.dst = (uint16_t)v; break;
+    case 4: *(uint32_t*)c.dst = (uint32_t)v; break;
+    default: *(uint64_t*)c.dst = (uint64_t)v; break;
+  }
+}
+
+static void js_ffi_pipeline_finalizer(JSRuntime* rt, JSValue val)
+{
+  NativePipeline* p = (NativePipeline*)JS_GetOpaque(val, js_ffi_pipeline_class_id);
+  if (!p) return;
+  for (JSValue& v : p->pinned) JS_FreeValueRT(rt, v);
+  delete p;
+}
+
+static void js_ffi_pipeline_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func)
+{
+  NativePipeline* p = (NativePipeline*)JS_GetOpaque(val, js_ffi_pipeline_class_id);
+  if (!p) return;
+  for (JSValue& v : p->pinned) JS_MarkValue(rt, v, mark_func);
+}
+
+static JSClassDef js_ffi_pipeline_class = {
+  "NativePipeline",
+  js_ffi_pipeline_finalizer,
+  js_ffi_pipeline_mark,
+};
+
+static PipelineSlot* pipeline_new_slot(NativePipeline* p)
+{
+  p->slots.push_back(0.0L);
+  return &p->slots.back();
+}
+
+// 读取 {step: k} 或 {step: k, out: j} 引用的槽位；k 必须是之前的步骤
+static int pipeline_resolve_ref(JSContext* ctx, NativePipeline* p, JSValueConst ref, uint32_t current,
+                                const PipelineSlot** slot, ffi_type** type)
+{
+  JSValue step_val = JS_GetPropertyStr(ctx, ref, "step");
+  JSValue out_val = JS_GetPropertyStr(ctx, ref, "out");
+  uint32_t k = 0, j = 0;
+  int ret = JS_ToUint32(ctx, &k, step_val);
+  if (!ret && !JS_IsUndefined(out_val)) ret = JS_ToUint32(ctx, &j, out_val);
+  bool has_out = !JS_IsUndefined(out_val);
+  JS_FreeValue(ctx, step_val);
+  JS_FreeValue(ctx, out_val);
+  if (ret) return -1;
+
+  if (k >= current) {
+    JS_ThrowRangeError(ctx, "Step %u can only refer to earlier steps (got %u)", current, k);
+    return -1;
+  }
+  const PipelineStep& src = p->steps[k];
+  if (has_out) {
+    if (j >= src.out_slot.size() || src.out_slot[j] < 0) {
+      JS_ThrowRangeError(ctx, "Argument %u of step %u is not an out-param", j, k);
+      return -1;
+    }
+    *slot = p->out_slots[src.out_slot[j]].first;
+    *type = p->out_slots[src.out_slot[j]].second;
+  } else {
+    if (src.rtype == &ffi_type_void) {
+      JS_ThrowTypeError(ctx, "Step %u returns void", k);
+      return -1;
+    }
+    *slot = src.ret;
+    *type = src.rtype;
+  }
+  return 0;
+}
+
+// 编译一个参数：常量 / {input: i} / {step: k[, out: j]} / {out: type}
+static int pipeline_compile_arg(JSContext* ctx, NativePipeline* p, PipelineStep& step, uint32_t step_index,
+                                uint32_t arg_index, const char* type_str, JSValueConst arg)
+{
+  ffi_type* type = step.atypes[arg_index];
+  PipelineSlot* slot = pipeline_new_slot(p);
+  step.avalues[arg_index] = slot;
+
+  bool is_ref = JS_IsObject(arg) && !JS_IsArray(ctx, arg) && !JS_IsFunction(ctx, arg) &&
+                !JS_GetOpaque(arg, js_ffi_buffer_class_id);
+  if (is_ref) {
+    JSValue input_val = JS_GetPropertyStr(ctx, arg, "input");
+    JSValue step_val = JS_GetPropertyStr(ctx, arg, "step");
+    JSValue out_val = JS_GetPropertyStr(ctx, arg, "out");
+    bool has_input = !JS_IsUndefined(input_val);
+    bool has_step = !JS_IsUndefined(step_val);
+    bool is_out_param = !has_input && !has_step && JS_IsString(out_val);
+    uint32_t index = 0;
+    int ret = has_input ? JS_ToUint32(ctx, &index, input_val) : 0;
+    const char* out_type_str = is_out_param ? JS_ToCString(ctx, out_val) : nullptr;
+    JS_FreeValue(ctx, input_val);
+    JS_FreeValue(ctx, step_val);
+    JS_FreeValue(ctx, out_val);
+    if (ret) return -1;
+
+    if (has_input) {
+      if (strcmp(type_str, "string") == 0) {
+        JS_ThrowTypeError(ctx, "Pipeline inputs cannot be strings; pass a buffer instead");
+        return -1;
+      }
+      p->inputs.push_back(PipelineInput{slot, type, index});
+      if (index + 1 > p->input_count) p->input_count = index + 1;
+      return 0;
+    }
+
+    if (has_step) {
+      PipelineConversion conv{slot, type, nullptr, nullptr};
+      if (pipeline_resolve_ref(ctx, p, arg, step_index, &conv.src, &conv.src_type)) return -1;
+      if (conv.src_type == type) {
+        step.avalues[arg_index] = (void*)conv.src;   // 类型相同时直接引用，不需要转换
+      } else {
+        step.conversions.push_back(conv);
+      }
+      return 0;
+    }
+
+    if (is_out_param) {
+      ffi_type* out_type = out_type_str ? string_to_ffi_type(out_type_str) : nullptr;
+      bool valid = out_type && out_type != &ffi_type_void && strcmp(out_type_str, "string") != 0;
+      if (out_type_str && !valid) JS_ThrowTypeError(ctx, "Invalid out-param type: %s", out_type_str);
+      JS_FreeCString(ctx, out_type_str);
+      if (!valid) return -1;
+      if (type != &ffi_type_pointer) {
+        JS_ThrowTypeError(ctx, "Out-param argument %u of step %u must be declared as 'pointer'", arg_index, step_index);
+        return -1;
+      }
+      PipelineSlot* out_slot = pipeline_new_slot(p);
+      *(void**)slot = out_slot;
+      step.out_slot[arg_index] = (int)p->out_slots.size();
+      p->out_slots.emplace_back(out_slot, out_type);
+      return 0;
+    }
+
+    JS_ThrowTypeError(ctx, "Pipeline argument objects must be {input}, {step[, out]} or {out: type}");
+    return -1;
+  }
+
+  // 常量
+  if (strcmp(type_str, "string") == 0) {
+    const char* str = JS_ToCString(ctx, arg);
+    if (!str) return -1;
+    p->strings.emplace_back(str);
+    JS_FreeCString(ctx, str);
+    *(const char**)slot = p->strings.back().c_str();
+    return 0;
+  }
+  if (js_ffi_store_arg(ctx, type, arg, slot)) return -1;
+  if (JS_GetOpaque(arg, js_ffi_buffer_class_id)) {
+    p->pinned.push_back(JS_DupValue(ctx, arg));
+  }
+  return 0;
+}
+
+// 编译一个步骤：{fn, ret, types: [...], args: [...]}
+static int pipeline_compile_step(JSContext* ctx, NativePipeline* p, uint32_t step_index, JSValueConst spec)
+{
+  p->steps.emplace_back();
+  PipelineStep& step = p->steps.back();
+
+  JSValue fn_val = JS_GetPropertyStr(ctx, spec, "fn");
+  void* fn = nullptr;
+  int ret = js_ffi_get_pointer(ctx, &fn, fn_val);
+  JS_FreeValue(ctx, fn_val);
+  if (ret) return -1;
+  if (!fn) {
+    JS_ThrowTypeError(ctx, "Step %u has no function pointer", step_index);
+    return -1;
+  }
+  step.fn = (void (*)(void))fn;
+  step.trace_id = ffi_trace_symbol_id(fn);
+
+  JSValue ret_val = JS_GetPropertyStr(ctx, spec, "ret");
+  const char* ret_str = JS_IsUndefined(ret_val) ? nullptr : JS_ToCString(ctx, ret_val);
+  step.rtype = ret_str ? string_to_ffi_type(ret_str) : &ffi_type_void;
+  JS_FreeCString(ctx, ret_str);
+  JS_FreeValue(ctx, ret_val);
+  if (!step.rtype) {
+    JS_ThrowTypeError(ctx, "Invalid return type in step %u", step_index);
+    return -1;
+  }
+  step.ret = pipeline_new_slot(p);
+
+  JSValue types = JS_GetPropertyStr(ctx, spec, "types");
+  JSValue args = JS_GetPropertyStr(ctx, spec, "args");
+  uint32_t num_args = 0, num_values = 0;
+  if (JS_IsArray(ctx, types)) {
+    JSValue len_val = JS_GetPropertyStr(ctx, types, "length");
+    JS_ToUint32(ctx, &num_args, len_val);
+    JS_FreeValue(ctx, len_val);
+  }
+  if (JS_IsArray(ctx, args)) {
+    JSValue len_val = JS_GetPropertyStr(ctx, args, "length");
+    JS_ToUint32(ctx, &num_values, len_val);
+    JS_FreeValue(ctx, len_val);
+  }
+  if (num_args != num_values) {
+    JS_FreeValue(ctx, types);
+    JS_FreeValue(ctx, args);
+    JS_ThrowTypeError(ctx, "Step %u: expected %u arguments, got %u", step_index, num_args, num_values);
+    return -1;
+  }
+
+  step.atypes.resize(num_args);
+  step.avalues.resize(num_args);
+  step.out_slot.assign(num_args, -1);
+  ret = 0;
+  for (uint32_t i = 0; i < num_args && !ret; i++) {
+    JSValue type_val = JS_GetPropertyUint32(ctx, types, i);
+    JSValue arg = JS_GetPropertyUint32(ctx, args, i);
+    const char* type_str = JS_ToCString(ctx, type_val);
+    step.atypes[i] = type_str ? string_to_ffi_type(type_str) : nullptr;
+    if (!type_str) {
+      ret = -1;
+    } else if (!step.atypes[i] || step.atypes[i] == &ffi_type_void) {
+      JS_ThrowTypeError(ctx, "Invalid argument type in step %u: %s", step_index, type_str);
+      ret = -1;
+    } else {
+      ret = pipeline_compile_arg(ctx, p, step, step_index, i, type_str, arg);
+    }
+    JS_FreeCString(ctx, type_str);
+    JS_FreeValue(ctx, type_val);
+    JS_FreeValue(ctx, arg);
+  }
+  JS_FreeValue(ctx, types);
+  JS_FreeValue(ctx, args);
+  if (ret) return -1;
+
+  if (ffi_prep_cif(&step.cif, FFI_DEFAULT_ABI, num_args, step.rtype, step.atypes.data()) != FFI_OK) {
+    JS_ThrowInternalError(ctx, "ffi_prep_cif failed for step %u", step_index);
+    return -1;
+  }
+  return 0;
+}
+
+// pipeline.run(...inputs) - 一次进入 C 执行所有步骤
+static JSValue js_ffi_pipeline_run(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  NativePipeline* p = (NativePipeline*)JS_GetOpaque2(ctx, this_val, js_ffi_pipeline_class_id);
+  if (!p) return JS_EXCEPTION;
+
+  if ((uint32_t)argc < p->input_count) {
+    return JS_ThrowTypeError(ctx, "Pipeline expects %u inputs, got %d", p->input_count, argc);
+  }
+  for (const PipelineInput& input : p->inputs) {
+    if (js_ffi_store_arg(ctx, input.type, argv[input.index], input.dst)) return JS_EXCEPTION;
+  }
+  for (auto& out : p->out_slots) {
+    *out.first = 0.0L;
+  }
+
+  for (PipelineStep& step : p->steps) {
+    for (const PipelineConversion& conv : step.conversions) {
+      pipeline_convert(conv);
+    }
+    FFITraceScope trace_scope(FFI_TRACE_CALL, step.trace_id, (uintptr_t)step.fn);
+    ffi_call(&step.cif, step.fn, step.ret, step.avalues.data());
+  }
+  if (!buffered_pending.empty() && flush_buffered_callbacks(ctx) < 0) {
+    return JS_EXCEPTION;
+  }
+
+  if (p->single_output) {
+    const PipelineOutput& out = p->outputs[0];
+    return js_ffi_to_js(ctx, out.type, out.slot);
+  }
+  JSValue result = JS_NewArray(ctx);
+  for (uint32_t i = 0; i < p->outputs.size(); i++) {
+    JS_SetPropertyUint32(ctx, result, i, js_ffi_to_js(ctx, p->outputs[i].type, p->outputs[i].slot));
+  }
+  return result;
+}
+
+static const JSCFunctionListEntry js_ffi_pipeline_proto_funcs[] = {
+  JS_CFUNC_DEF("run", 0, js_ffi_pipeline_run),
+};
+
+// JS: FFI.pipeline([{fn, ret, types, args}...], {outputs: [{step[, out]}...]})
+static JSValue js_ffi_pipeline(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (!JS_IsArray(ctx, argv[0])) return JS_ThrowTypeError(ctx, "pipeline requires an array of steps");
+
+  JSValue len_val = JS_GetPropertyStr(ctx, argv[0], "length");
+  uint32_t num_steps;
+  int ret = JS_ToUint32(ctx, &num_steps, len_val);
+  JS_FreeValue(ctx, len_val);
+  if (ret) return JS_EXCEPTION;
+  if (num_steps == 0) return JS_ThrowRangeError(ctx, "pipeline requires at least one step");
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_pipeline_class_id);
+  if (JS_IsException(obj)) return obj;
+  NativePipeline* p = new NativePipeline();
+  JS_SetOpaque(obj, p);   // 之后出错由 finalizer 统一清理
+  p->steps.reserve(num_steps);
+
+  for (uint32_t i = 0; i < num_steps; i++) {
+    JSValue spec = JS_GetPropertyUint32(ctx, argv[0], i);
+    ret = pipeline_compile_step(ctx, p, i, spec);
+    JS_FreeValue(ctx, spec);
+    if (ret) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+  }
+
+  // 输出：默认为最后一步的返回值
+  JSValue outputs = argc > 1 && JS_IsObject(argv[1]) ? JS_GetPropertyStr(ctx, argv[1], "outputs") : JS_UNDEFINED;
+  if (JS_IsArray(ctx, outputs)) {
+    p->single_output = false;
+    JSValue out_len = JS_GetPropertyStr(ctx, outputs, "length");
+    uint32_t num_outputs = 0;
+    JS_ToUint32(ctx, &num_outputs, out_len);
+    JS_FreeValue(ctx, out_len);
+    for (uint32_t i = 0; i < num_outputs && !ret; i++) {
+      JSValue ref = JS_GetPropertyUint32(ctx, outputs, i);
+      PipelineOutput out;
+      ret = pipeline_resolve_ref(ctx, p, ref, num_steps, &out.slot, &out.type);
+      if (!ret) p->outputs.push_back(out);
+      JS_FreeValue(ctx, ref);
+    }
+  } else {
+    p->outputs.push_back(PipelineOutput{p->steps.back().ret, p->steps.back().rtype});
+  }
+  JS_FreeValue(ctx, outputs);
+  if (ret) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+  return obj;
+}
+
+// ---------------------------------------------------------------------------
+// 原生记忆化（ffi.memoize）
+//
+// 纯函数的结果按参数的原始字节缓存在 C 侧（缓存表见 ffi_memo.cpp）：参数直接
+// 转换到按类型对齐排好的键缓冲区，这块缓冲区同时就是 ffi_call 的参数存储区；
+// 命中时复制缓存的返回值，不再调用 ffi_call。只接受数值参数，指针参数的结果
+// 取决于指向的内容，不能按地址缓存。
+// ---------------------------------------------------------------------------
+
+static const uint32_t kMemoMaxArgs = 32;
+
+struct MemoizedFunction {
+  void (*fn)(void);
+  ffi_cif cif;
+  ffi_type* rtype;
+  std::vector<ffi_type*> atypes;
+  std::vector<size_t> offsets;        // 参数在键中的偏移
+  size_t key_size;
+  uint32_t trace_id;
+  std::unique_ptr<FFIMemoTable> table;
+};
+
+static JSClassID js_ffi_memo_class_id;
+
+static void js_ffi_memo_finalizer(JSRuntime* rt, JSValue val)
+{
+  delete (MemoizedFunction*)JS_GetOpaque(val, js_ffi_memo_class_id);
+}
+
+static JSClassDef js_ffi_memo_class = {
+  "MemoizedFunction",
+  js_ffi_memo_finalizer,
+};
+
+// memo.call(...args)
+static JSValue js_ffi_memo_call(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MemoizedFunction* m = (MemoizedFunction*)JS_GetOpaque2(ctx, this_val, js_ffi_memo_class_id);
+  if (!m) return JS_EXCEPTION;
+
+  uint32_t num_args = (uint32_t)m->atypes.size();
+  if ((uint32_t)argc < num_args) {
+    return JS_ThrowTypeError(ctx, "Memoized function expects %u arguments, got %d", num_args, argc);
+  }
+
+  // 键缓冲区放在栈上，原生函数重入 JS 再调用同一个对象也不会互相覆盖
+  long double key[kMemoMaxArgs];
+  void* avalues[kMemoMaxArgs];
+  memset(key, 0, m->key_size);   // 填充字节参与比较，必须清零
+  for (uint32_t i = 0; i < num_args; i++) {
+    avalues[i] = (uint8_t*)key + m->offsets[i];
+    if (js_ffi_store_arg(ctx, m->atypes[i], argv[i], avalues[i])) return JS_EXCEPTION;
+  }
+
+  long double rvalue;   // 足够容纳任何标量返回值（含 ffi_arg 扩展）
+  uint64_t hash = FFIMemoTable::hash(key, m->key_size);
+  if (!m->table->lookup(key, hash, &rvalue)) {
+    {
+      FFITraceScope trace_scope(FFI_TRACE_CALL, m->trace_id, (uintptr_t)m->fn);
+      ffi_call(&m->cif, m->fn, &rvalue, avalues);
     }
+    m->table->insert(key, hash, &rvalue);
+    if (!buffered_pending.empty() && flush_buffered_callbacks(ctx) < 0) {
+      return JS_EXCEPTION;
+    }
+  }
+  return js_ffi_to_js(ctx, m->rtype, &rvalue);
+}
+
+// memo.stats() - {hits, misses, evictions, size, capacity, hitRate}
+static JSValue js_ffi_memo_stats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MemoizedFunction* m = (MemoizedFunction*)JS_GetOpaque2(ctx, this_val, js_ffi_memo_class_id);
+  if (!m) return JS_EXCEPTION;
 
-    JS_FreeValue(ctx, elem);
-  }
+  const FFIMemoStats& st = m->table->stats();
+  uint64_t lookups = st.hits + st.misses;
+  JSValue obj = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, obj, "hits", JS_NewInt64(ctx, (int64_t)st.hits));
+  JS_SetPropertyStr(ctx, obj, "misses", JS_NewInt64(ctx, (int64_t)st.misses));
+  JS_SetPropertyStr(ctx, obj, "evictions", JS_NewInt64(ctx, (int64_t)st.evictions));
+  JS_SetPropertyStr(ctx, obj, "size", JS_NewInt64(ctx, (int64_t)m->table->size()));
+  JS_SetPropertyStr(ctx, obj, "capacity", JS_NewInt64(ctx, (int64_t)m->table->capacity()));
+  JS_SetPropertyStr(ctx, obj, "hitRate", JS_NewFloat64(ctx, lookups ? (double)st.hits / lookups : 0.0));
+  return obj;
+}
 
-  JS_FreeCString(ctx, type_str);
+// memo.clear() - 丢弃所有缓存的结果（统计保留）
+static JSValue js_ffi_memo_clear(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  MemoizedFunction* m = (MemoizedFunction*)JS_GetOpaque2(ctx, this_val, js_ffi_memo_class_id);
+  if (!m) return JS_EXCEPTION;
+  m->table->clear();
   return JS_UNDEFINED;
 }
 
-// JS: FFI.readArray(ptr, type, count)
-static JSValue js_ffi_readArray(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
-{
-  if (argc < 3) return JS_ThrowTypeError(ctx, "readArray requires 3 arguments");
+static const JSCFunctionListEntry js_ffi_memo_proto_funcs[] = {
+  JS_CFUNC_DEF("call", 0, js_ffi_memo_call),
+  JS_CFUNC_DEF("stats", 0, js_ffi_memo_stats),
+  JS_CFUNC_DEF("clear", 0, js_ffi_memo_clear),
+};
 
-  int64_t ptr_val;
-  if (JS_ToInt64(ctx, &ptr_val, argv[0])) return JS_EXCEPTION;
-  void* ptr = (void*)(uintptr_t)ptr_val;
-  if (!ptr) return JS_ThrowTypeError(ctx, "Invalid pointer");
+// 解析 {ret, types}：参数只能是数值类型，返回值不能是 void
+static int memo_compile_signature(JSContext* ctx, MemoizedFunction* m, JSValueConst sig)
+{
+  JSValue ret_val = JS_GetPropertyStr(ctx, sig, "ret");
+  const char* ret_str = JS_ToCString(ctx, ret_val);
+  JS_FreeValue(ctx, ret_val);
+  if (!ret_str) return -1;
+  m->rtype = string_to_ffi_type(ret_str);
+  JS_FreeCString(ctx, ret_str);
+  if (!m->rtype || m->rtype == &ffi_type_void) {
+    JS_ThrowTypeError(ctx, "memoize requires a non-void return type");
+    return -1;
+  }
 
-  const char* type_str = JS_ToCString(ctx, argv[1]);
-  if (!type_str) return JS_EXCEPTION;
+  JSValue types = JS_GetPropertyStr(ctx, sig, "types");
+  uint32_t num_args = 0;
+  if (JS_IsArray(ctx, types)) {
+    JSValue len_val = JS_GetPropertyStr(ctx, types, "length");
+    JS_ToUint32(ctx, &num_args, len_val);
+    JS_FreeValue(ctx, len_val);
+  } else if (!JS_IsUndefined(types)) {
+    JS_FreeValue(ctx, types);
+    JS_ThrowTypeError(ctx, "signature.types must be an array");
+    return -1;
+  }
+  if (num_args > kMemoMaxArgs) {
+    JS_FreeValue(ctx, types);
+    JS_ThrowRangeError(ctx, "memoize supports at most %u arguments", kMemoMaxArgs);
+    return -1;
+  }
 
-  uint32_t count;
-  if (JS_ToUint32(ctx, &count, argv[2])) {
+  // 每个参数按自身对齐放在键中，对齐后的地址可以直接交给 ffi_call
+  size_t offset = 0;
+  int ret = 0;
+  for (uint32_t i = 0; i < num_args && !ret; i++) {
+    JSValue type_val = JS_GetPropertyUint32(ctx, types, i);
+    const char* type_str = JS_ToCString(ctx, type_val);
+    JS_FreeValue(ctx, type_val);
+    if (!type_str) {
+      ret = -1;
+      break;
+    }
+    ffi_type* type = string_to_ffi_type(type_str);
+    if (!type || type == &ffi_type_void || type == &ffi_type_pointer) {
+      JS_ThrowTypeError(ctx, "memoize only accepts numeric argument types, got %s", type_str);
+      ret = -1;
+    } else {
+      offset = (offset + type->alignment - 1) & ~(size_t)(type->alignment - 1);
+      m->atypes.push_back(type);
+      m->offsets.push_back(offset);
+      offset += type->size;
+    }
     JS_FreeCString(ctx, type_str);
+  }
+  JS_FreeValue(ctx, types);
+  if (ret) return -1;
+  m->key_size = offset;
+
+  if (ffi_prep_cif(&m->cif, FFI_DEFAULT_ABI, num_args, m->rtype, m->atypes.data()) != FFI_OK) {
+    JS_ThrowInternalError(ctx, "ffi_prep_cif failed");
+    return -1;
+  }
+  return 0;
+}
+
+// JS: FFI.memoize(fn, {ret, types}, capacity = 1024)
+static JSValue js_ffi_memoize(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  void* fn = nullptr;
+  if (js_ffi_get_pointer(ctx, &fn, argv[0])) return JS_EXCEPTION;
+  if (!fn) return JS_ThrowTypeError(ctx, "memoize requires a function pointer");
+  if (!JS_IsObject(argv[1])) return JS_ThrowTypeError(ctx, "memoize requires a signature {ret, types}");
+
+  int64_t capacity = 1024;
+  if (argc > 2 && !JS_IsUndefined(argv[2]) && JS_ToInt64(ctx, &capacity, argv[2])) return JS_EXCEPTION;
+  if (capacity < 1 || capacity > (1 << 24)) {
+    return JS_ThrowRangeError(ctx, "memoize capacity must be between 1 and %d", 1 << 24);
+  }
+
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_memo_class_id);
+  if (JS_IsException(obj)) return obj;
+  MemoizedFunction* m = new MemoizedFunction();
+  JS_SetOpaque(obj, m);   // 之后出错由 finalizer 统一清理
+  m->fn = (void (*)(void))fn;
+  m->trace_id = ffi_trace_symbol_id(fn);
+  if (memo_compile_signature(ctx, m, argv[1])) {
+    JS_FreeValue(ctx, obj);
     return JS_EXCEPTION;
   }
 
-  JSValue array = JS_NewArray(ctx);
+  // 整数返回值被 libffi 扩展成 ffi_arg，缓存整个扩展后的宽度
+  size_t value_size = std::max(m->rtype->size, sizeof(ffi_arg));
+  m->table.reset(new FFIMemoTable(m->key_size, value_size, (size_t)capacity));
+  return obj;
+}
 
-  // 根据类型读取数组
-  for (uint32_t i = 0; i < count; i++) {
-    JSValue elem;
+// ---------------------------------------------------------------------------
+// 并行执行（ffi.parallelFor）
+//
+// 纯函数形式的原生函数 fn(in_ptr, out_ptr, count, ...extra) 在工作窃取线程池
+// 上分块执行：每块传入偏移后的输入/输出指针和本块元素数。原生函数必须可以
+// 并发调用，且不同块之间不能有数据依赖。线程池实现见 ffi_parallel.cpp。
+// ---------------------------------------------------------------------------
 
-    if (strcmp(type_str, "int") == 0 || strcmp(type_str, "int32") == 0) {
-      elem = JS_NewInt32(ctx, ((int32_t*)ptr)[i]);
-    }
-    else if (strcmp(type_str, "uint32") == 0) {
-      elem = JS_NewUint32(ctx, ((uint32_t*)ptr)[i]);
-    }
-    else if (strcmp(type_str, "float") == 0) {
-      elem = JS_NewFloat64(ctx, ((float*)ptr)[i]);
-    }
-    else if (strcmp(type_str, "double") == 0) {
-      elem = JS_NewFloat64(ctx, ((double*)ptr)[i]);
-    }
-    else if (strcmp(type_str, "int8") == 0) {
-      elem = JS_NewInt32(ctx, ((int8_t*)ptr)[i]);
-    }
-    else if (strcmp(type_str, "uint8") == 0) {
-      elem = JS_NewUint32(ctx, ((uint8_t*)ptr)[i]);
-    }
-    else {
-      elem = JS_UNDEFINED;
-    }
+struct ParallelCall {
+  void* fn = nullptr;
+  ffi_cif cif;
+  std::vector<ffi_type*> atypes;
+  std::vector<long double> arg_template;   // [in, out, count, ...extra]
+  uint8_t* in = nullptr;
+  uint8_t* out = nullptr;
+  size_t in_stride = 0;
+  size_t out_stride = 0;
+  uint32_t trace_id = 0;
+  unsigned threads = 0;
+  size_t grain = 0;
 
-    JS_SetPropertyUint32(ctx, array, i, elem);
+  std::shared_ptr<FFIParallelJob> job;
+  std::vector<JSValue> pinned;             // 异步执行期间保持缓冲区对象存活
+  int notify_fds[2] = { -1, -1 };          // 异步执行时的完成通知管道
+};
+
+static JSClassID js_ffi_parallel_class_id;
+
+static void parallel_run_chunk(ParallelCall* pc, size_t begin, size_t end)
+{
+  std::vector<long double> args(pc->arg_template);
+  std::vector<void*> avalues(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    avalues[i] = &args[i];
+  }
+  *(void**)&args[0] = pc->in ? pc->in + begin * pc->in_stride : nullptr;
+  *(void**)&args[1] = pc->out ? pc->out + begin * pc->out_stride : nullptr;
+  uint64_t count = end - begin;
+  switch (pc->atypes[2]->size) {
+    case 1: *(uint8_t*)&args[2] = (uint8_t)count; break;
+    case 2: *(uint16_t*)&args[2] = (uint16_t)count; break;
+    case 4: *(uint32_t*)&args[2] = (uint32_t)count; break;
+    default: *(uint64_t*)&args[2] = count; break;
   }
 
-  JS_FreeCString(ctx, type_str);
-  return array;
+  FFITraceScope trace_scope(FFI_TRACE_CALL, pc->trace_id, (uintptr_t)pc->fn);
+  ffi_call(&pc->cif, FFI_FN(pc->fn), nullptr, avalues.data());
 }
 
-// JS: FFI.createCallback(js_function, return_type, [param_types])
-static JSValue js_ffi_createCallback(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+static void parallel_submit(ParallelCall* pc, size_t count)
 {
-  if (argc < 3) return JS_ThrowTypeError(ctx, "createCallback requires 3 arguments");
+  pc->job = ffi_parallel_submit(count, pc->grain, pc->threads,
+                                [pc](size_t begin, size_t end) { parallel_run_chunk(pc, begin, end); },
+                                pc->notify_fds[1]);
+}
 
-  if (!JS_IsFunction(ctx, argv[0])) {
-    return JS_ThrowTypeError(ctx, "First argument must be a function");
+// {threads, chunks, grain, elapsedMs, workers: [{chunks, steals, busyMs, utilisation}]}
+static JSValue js_ffi_parallel_stats(JSContext* ctx, ParallelCall* pc)
+{
+  const FFIParallelJob* job = pc->job.get();
+  const std::vector<FFIParallelWorkerStats>& workers = ffi_parallel_worker_stats(job);
+  double elapsed_ms = ffi_parallel_elapsed_ns(job) / 1e6;
+
+  JSValue obj = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, obj, "threads", JS_NewUint32(ctx, (uint32_t)workers.size()));
+  JS_SetPropertyStr(ctx, obj, "chunks", JS_NewInt64(ctx, (int64_t)ffi_parallel_chunks(job)));
+  JS_SetPropertyStr(ctx, obj, "grain", JS_NewInt64(ctx, (int64_t)pc->grain));
+  JS_SetPropertyStr(ctx, obj, "elapsedMs", JS_NewFloat64(ctx, elapsed_ms));
+  JSValue list = JS_NewArray(ctx);
+  for (uint32_t i = 0; i < workers.size(); i++) {
+    double busy_ms = workers[i].busy_ns / 1e6;
+    JSValue w = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, w, "chunks", JS_NewInt64(ctx, (int64_t)workers[i].chunks));
+    JS_SetPropertyStr(ctx, w, "steals", JS_NewInt64(ctx, (int64_t)workers[i].steals));
+    JS_SetPropertyStr(ctx, w, "busyMs", JS_NewFloat64(ctx, busy_ms));
+    JS_SetPropertyStr(ctx, w, "utilisation", JS_NewFloat64(ctx, elapsed_ms > 0 ? busy_ms / elapsed_ms : 0));
+    JS_SetPropertyUint32(ctx, list, i, w);
   }
+  JS_SetPropertyStr(ctx, obj, "workers", list);
+  return obj;
+}
 
-  const char* ret_type_str = JS_ToCString(ctx, argv[1]);
-  ffi_type* rtype = string_to_ffi_type(ret_type_str);
-  JS_FreeCString(ctx, ret_type_str);
-  if (!rtype) return JS_ThrowTypeError(ctx, "Invalid return type");
+static void js_ffi_parallel_finalizer(JSRuntime* rt, JSValue val)
+{
+  ParallelCall* pc = (ParallelCall*)JS_GetOpaque(val, js_ffi_parallel_class_id);
+  if (!pc) return;
+  // 池线程可能仍在使用 pc 和缓冲区
+  if (pc->job) ffi_parallel_wait(pc->job.get());
+  loop_pipe_close(pc->notify_fds);
+  for (JSValue& v : pc->pinned) JS_FreeValueRT(rt, v);
+  delete pc;
+}
 
-  JSValueConst param_types_js = argv[2];
-  if (!JS_IsArray(ctx, param_types_js)) {
-    return JS_ThrowTypeError(ctx, "Parameter types must be an array");
+static void js_ffi_parallel_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func)
+{
+  ParallelCall* pc = (ParallelCall*)JS_GetOpaque(val, js_ffi_parallel_class_id);
+  if (!pc) return;
+  for (JSValue& v : pc->pinned) JS_MarkValue(rt, v, mark_func);
+}
+
+static JSClassDef js_ffi_parallel_class = {
+  "ParallelTask",
+  js_ffi_parallel_finalizer,
+  js_ffi_parallel_mark,
+};
+
+// 完成通知管道的读事件：data = [task, resolve, reject]
+static JSValue js_ffi_parallel_on_done(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv,
+                                       int magic, JSValue* data)
+{
+  ParallelCall* pc = (ParallelCall*)JS_GetOpaque(data[0], js_ffi_parallel_class_id);
+  loop_pipe_drain(pc->notify_fds[0]);
+  ffi_parallel_wait(pc->job.get());   // 已经完成，只用于同步结果
+  loop_set_read_handler(ctx, pc->notify_fds[0], JS_NULL);
+  JSValue stats = js_ffi_parallel_stats(ctx, pc);
+  JSValue ret = JS_Call(ctx, data[1], JS_UNDEFINED, 1, (JSValueConst*)&stats);
+  JS_FreeValue(ctx, stats);
+  JS_FreeValue(ctx, ret);
+  return JS_UNDEFINED;
+}
+
+// 作业参数：[task, resolve, reject]。仅在宿主没有事件循环集成时使用，作业在这里等待任务完成
+static JSValue js_ffi_parallel_job(JSContext* ctx, int argc, JSValueConst* argv)
+{
+  ParallelCall* pc = (ParallelCall*)JS_GetOpaque(argv[0], js_ffi_parallel_class_id);
+  ffi_parallel_wait(pc->job.get());
+  JSValue stats = js_ffi_parallel_stats(ctx, pc);
+  JSValue ret = JS_Call(ctx, argv[1], JS_UNDEFINED, 1, (JSValueConst*)&stats);
+  JS_FreeValue(ctx, stats);
+  JS_FreeValue(ctx, ret);
+  return JS_UNDEFINED;
+}
+
+// 解析缓冲区参数：返回指针，并检查 count * stride 不超过已知长度
+static int js_ffi_parallel_buffer(JSContext* ctx, ParallelCall* pc, JSValueConst val,
+                                  uint64_t count, size_t stride, uint8_t** out)
+{
+  void* ptr;
+  size_t size;
+  if (js_ffi_get_pointer(ctx, &ptr, val, &size)) return -1;
+  if (ptr && size != SIZE_MAX && (stride && count > size / stride)) {
+    JS_ThrowRangeError(ctx, "Buffer of %zu bytes is too small for %llu elements of %zu bytes",
+                       size, (unsigned long long)count, stride);
+    return -1;
   }
+  *out = (uint8_t*)ptr;
+  if (JS_IsObject(val)) pc->pinned.push_back(JS_DupValue(ctx, val));
+  return 0;
+}
 
-  JSValue len_val = JS_GetPropertyStr(ctx, param_types_js, "length");
-  uint32_t num_params;
-  JS_ToUint32(ctx, &num_params, len_val);
+// 解析选项中的 extra: [[type, value], ...]，追加到参数模板末尾
+static int js_ffi_parallel_extra(JSContext* ctx, ParallelCall* pc, JSValueConst extra)
+{
+  if (JS_IsUndefined(extra)) return 0;
+  if (!JS_IsArray(ctx, extra)) {
+    JS_ThrowTypeError(ctx, "extra must be an array of [type, value]");
+    return -1;
+  }
+  JSValue len_val = JS_GetPropertyStr(ctx, extra, "length");
+  uint32_t num_extra;
+  int ret = JS_ToUint32(ctx, &num_extra, len_val);
   JS_FreeValue(ctx, len_val);
+  if (ret) return -1;
 
-  // 创建回调信息
-  auto callback_info = std::make_unique<CallbackInfo>();
-  callback_info->ctx = ctx;
-  callback_info->js_callback = JS_DupValue(ctx, argv[0]);
-  callback_info->argc = num_params;
-  callback_info->rtype = rtype;
+  for (uint32_t i = 0; i < num_extra && !ret; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, extra, i);
+    JSValue type_val = JS_GetPropertyUint32(ctx, item, 0);
+    JSValue value = JS_GetPropertyUint32(ctx, item, 1);
+    const char* type_str = JS_ToCString(ctx, type_val);
+    ffi_type* type = type_str ? string_to_ffi_type(type_str) : nullptr;
+    ret = -1;
+    if (type_str && (!type || type == &ffi_type_void ||
+                     strcmp(type_str, "string") == 0 || strcmp(type_str, "callback") == 0)) {
+      // 原生函数在池线程上运行，不能引用 JS 字符串或回调
+      JS_ThrowTypeError(ctx, "Unsupported parallelFor argument type: %s", type_str);
+    } else if (type) {
+      pc->atypes.push_back(type);
+      pc->arg_template.push_back(0.0L);
+      ret = js_ffi_store_arg(ctx, type, value, &pc->arg_template.back());
+      if (!ret && JS_IsObject(value)) pc->pinned.push_back(JS_DupValue(ctx, value));
+    }
+    JS_FreeCString(ctx, type_str);
+    JS_FreeValue(ctx, type_val);
+    JS_FreeValue(ctx, value);
+    JS_FreeValue(ctx, item);
+  }
+  return ret;
+}
 
-  if (num_params > 0) {
-    callback_info->atypes = new ffi_type*[num_params];
+// JS: FFI.parallelFor(fn, input, output, count, elemSize,
+//                     {outElemSize = elemSize, countType = 'int', extra = [], grain, threads, async = false})
+static JSValue js_ffi_parallelFor(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 5) return JS_ThrowTypeError(ctx, "parallelFor requires at least 5 arguments");
 
-    for (uint32_t i = 0; i < num_params; i++) {
-      JSValue type_val = JS_GetPropertyUint32(ctx, param_types_js, i);
-      const char* type_str = JS_ToCString(ctx, type_val);
-      callback_info->atypes[i] = string_to_ffi_type(type_str);
+  void* fn;
+  if (js_ffi_get_pointer(ctx, &fn, argv[0])) return JS_EXCEPTION;
+  if (!fn) return JS_ThrowTypeError(ctx, "Invalid function pointer");
 
-      if (!callback_info->atypes[i]) {
-        JS_FreeCString(ctx, type_str);
-        JS_FreeValue(ctx, type_val);
-        delete[] callback_info->atypes;
-        JS_FreeValue(ctx, callback_info->js_callback);
-        return JS_ThrowTypeError(ctx, "Invalid parameter type");
-      }
+  int64_t count, elem_size;
+  if (JS_ToInt64(ctx, &count, argv[3]) || JS_ToInt64(ctx, &elem_size, argv[4])) return JS_EXCEPTION;
+  if (count < 0) return JS_ThrowRangeError(ctx, "Invalid element count");
+  if (elem_size < 0) return JS_ThrowRangeError(ctx, "Invalid element size");
+
+  JSValueConst options = argc > 5 ? argv[5] : JS_UNDEFINED;
+  int64_t out_elem_size = elem_size, grain = 0, threads = 0;
+  if (js_ffi_get_int64_option(ctx, options, "outElemSize", &out_elem_size) ||
+      js_ffi_get_int64_option(ctx, options, "grain", &grain) ||
+      js_ffi_get_int64_option(ctx, options, "threads", &threads)) {
+    return JS_EXCEPTION;
+  }
+  if (out_elem_size < 0) return JS_ThrowRangeError(ctx, "Invalid output element size");
+  if (threads < 0 || threads > 256) return JS_ThrowRangeError(ctx, "threads must be between 1 and 256");
+  if (grain < 0) return JS_ThrowRangeError(ctx, "Invalid grain size");
+  int async = js_ffi_get_bool_option(ctx, options, "async", false);
+  if (async < 0) return JS_EXCEPTION;
+
+  // 同步调用期间缓冲区由调用方持有；对象同样用于异步执行时保持缓冲区存活
+  JSValue obj = JS_NewObjectClass(ctx, js_ffi_parallel_class_id);
+  if (JS_IsException(obj)) return obj;
+  ParallelCall* pc = new ParallelCall();
+  JS_SetOpaque(obj, pc);   // 之后出错由 finalizer 统一清理
 
+  pc->fn = fn;
+  pc->trace_id = ffi_trace_symbol_id(fn);
+  pc->in_stride = (size_t)elem_size;
+  pc->out_stride = (size_t)out_elem_size;
+  pc->threads = threads ? (unsigned)threads : ffi_parallel_default_threads();
+  // 默认每个线程约 8 块，留出窃取的余地
+  pc->grain = grain ? (size_t)grain : std::max<size_t>(1, ((size_t)count + pc->threads * 8 - 1) / (pc->threads * 8));
+
+  ffi_type* count_type = &ffi_type_sint32;
+  if (JS_IsObject(options)) {
+    JSValue type_val = JS_GetPropertyStr(ctx, options, "countType");
+    if (!JS_IsUndefined(type_val)) {
+      const char* type_str = JS_ToCString(ctx, type_val);
+      count_type = type_str ? string_to_ffi_type(type_str) : nullptr;
+      bool is_integer = count_type && count_type != &ffi_type_void && count_type != &ffi_type_pointer &&
+                        count_type != &ffi_type_float && count_type != &ffi_type_double &&
+                        count_type != &ffi_type_longdouble;
+      if (type_str && !is_integer) {
+        JS_ThrowTypeError(ctx, "countType must be an integer type");
+      }
       JS_FreeCString(ctx, type_str);
-      JS_FreeValue(ctx, type_val);
+      if (!is_integer) count_type = nullptr;
     }
-  } else {
-    callback_info->atypes = nullptr;
+    JS_FreeValue(ctx, type_val);
+  }
+  if (!count_type) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
   }
 
-  callback_info->cif = new ffi_cif;
-  if (ffi_prep_cif(callback_info->cif, FFI_DEFAULT_ABI, 
-                  callback_info->argc, callback_info->rtype, 
-                  callback_info->atypes) != FFI_OK) {
-    delete[] callback_info->atypes;
-    delete callback_info->cif;
-    JS_FreeValue(ctx, callback_info->js_callback);
-    return JS_ThrowInternalError(ctx, "ffi_prep_cif failed for callback");
+  pc->atypes = {&ffi_type_pointer, &ffi_type_pointer, count_type};
+  pc->arg_template.assign(3, 0.0L);
+  JSValue extra = JS_IsObject(options) ? JS_GetPropertyStr(ctx, options, "extra") : JS_UNDEFINED;
+  int ret = js_ffi_parallel_buffer(ctx, pc, argv[1], (uint64_t)count, pc->in_stride, &pc->in);
+  if (!ret) ret = js_ffi_parallel_buffer(ctx, pc, argv[2], (uint64_t)count, pc->out_stride, &pc->out);
+  if (!ret) ret = js_ffi_parallel_extra(ctx, pc, extra);
+  JS_FreeValue(ctx, extra);
+  if (ret) {
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+  }
+  if (ffi_prep_cif(&pc->cif, FFI_DEFAULT_ABI, (unsigned)pc->atypes.size(), &ffi_type_void, pc->atypes.data()) != FFI_OK) {
+    JS_FreeValue(ctx, obj);
+    return JS_ThrowInternalError(ctx, "ffi_prep_cif failed");
   }
 
-  // 创建闭包
-  void* func_ptr;
-  void* closure_ptr = ffi_closure_alloc(sizeof(ffi_closure), &func_ptr);
-  if (!closure_ptr) {
-    delete[] callback_info->atypes;
-    delete callback_info->cif;
-    JS_FreeValue(ctx, callback_info->js_callback);
-    return JS_ThrowOutOfMemory(ctx);
+  // 异步执行时由池线程写管道唤醒事件循环；没有事件循环集成时退回到作业等待
+  bool watch = async && loop_available(ctx) && loop_pipe_open(pc->notify_fds);
+  parallel_submit(pc, (size_t)count);
+
+  if (!async) {
+    ffi_parallel_wait(pc->job.get());
+    JSValue stats = js_ffi_parallel_stats(ctx, pc);
+    JS_FreeValue(ctx, obj);
+    return stats;
   }
 
-  if (ffi_prep_closure_loc((ffi_closure*)closure_ptr, callback_info->cif,
-                          callback_wrapper, callback_info.get(), func_ptr) != FFI_OK) {
-    ffi_closure_free(closure_ptr);
-    delete[] callback_info->atypes;
-    delete callback_info->cif;
-    JS_FreeValue(ctx, callback_info->js_callback);
-    return JS_ThrowInternalError(ctx, "ffi_prep_closure_loc failed");
+  JSValue funcs[2];
+  JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+  if (!JS_IsException(promise)) {
+    JSValueConst job_args[3] = { obj, funcs[0], funcs[1] };
+    if (watch) {
+      JSValue handler = JS_NewCFunctionData(ctx, js_ffi_parallel_on_done, 0, 0, 3, job_args);
+      ret = JS_IsException(handler) ? -1 : loop_set_read_handler(ctx, pc->notify_fds[0], handler);
+      JS_FreeValue(ctx, handler);
+    } else {
+      ret = JS_EnqueueJob(ctx, js_ffi_parallel_job, 3, job_args);
+    }
+    JS_FreeValue(ctx, funcs[0]);
+    JS_FreeValue(ctx, funcs[1]);
+    if (ret < 0) {
+      JS_FreeValue(ctx, promise);
+      promise = JS_EXCEPTION;
+    }
   }
+  JS_FreeValue(ctx, obj);
+  return promise;
+}
 
-  // 保存闭包信息到结构体中
-  callback_info->closure_ptr = closure_ptr;
-  callback_info->func_ptr = func_ptr;
+// JS: FFI.perfMap(enable = true) - 开启时返回符号表路径
+static JSValue js_ffi_perfMap(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  bool enable = argc < 1 || JS_IsUndefined(argv[0]) || JS_ToBool(ctx, argv[0]);
+  if (!ffi_perfmap_enable(enable)) {
+    return JS_ThrowInternalError(ctx, "Failed to write %s", ffi_perfmap_path().c_str());
+  }
+  return enable ? JS_NewString(ctx, ffi_perfmap_path().c_str()) : JS_UNDEFINED;
+}
 
-  // 保存回调信息
-  callback_infos.push_back(std::move(callback_info));
+// JS: FFI.recordStart(path, {bufferCap = 65536}) - 录制之后的 call() 调用，供 ffi_replay 回放
+static JSValue js_ffi_recordStart(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  int64_t buffer_cap = 65536;
+  if (argc > 1 && js_ffi_get_int64_option(ctx, argv[1], "bufferCap", &buffer_cap)) {
+    return JS_EXCEPTION;
+  }
+  if (buffer_cap < 0) return JS_ThrowRangeError(ctx, "bufferCap must be non-negative");
 
-  return JS_NewInt64(ctx, (int64_t)(uintptr_t)func_ptr);
+  const char* path = JS_ToCString(ctx, argv[0]);
+  if (!path) return JS_EXCEPTION;
+  bool ok = ffi_record_start(path, (size_t)buffer_cap);
+  JSValue ret = ok ? JS_UNDEFINED : JS_ThrowInternalError(ctx, "Failed to open record file: %s", path);
+  JS_FreeCString(ctx, path);
+  return ret;
+}
+
+// JS: FFI.recordStop() - 结束录制，返回 {calls, bytes}
+static JSValue js_ffi_recordStop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  FFIRecordStats stats = ffi_record_stats();
+  if (!ffi_record_stop()) return JS_ThrowInternalError(ctx, "Failed to write record file");
+  JSValue obj = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, obj, "calls", JS_NewInt64(ctx, (int64_t)stats.calls));
+  JS_SetPropertyStr(ctx, obj, "bytes", JS_NewInt64(ctx, (int64_t)stats.bytes));
+  return obj;
+}
+
+// JS: FFI.traceStart({bufferSize, sampleRate})
+static JSValue js_ffi_traceStart(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  uint32_t buffer_size = 0;
+  uint32_t sample_rate = 1;
+
+  if (argc > 0 && JS_IsObject(argv[0])) {
+    JSValue val = JS_GetPropertyStr(ctx, argv[0], "bufferSize");
+    int ret = JS_IsUndefined(val) ? 0 : JS_ToUint32(ctx, &buffer_size, val);
+    JS_FreeValue(ctx, val);
+    if (ret) return JS_EXCEPTION;
+
+    val = JS_GetPropertyStr(ctx, argv[0], "sampleRate");
+    ret = JS_IsUndefined(val) ? 0 : JS_ToUint32(ctx, &sample_rate, val);
+    JS_FreeValue(ctx, val);
+    if (ret) return JS_EXCEPTION;
+  }
+
+  ffi_trace_start(buffer_size, sample_rate);
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.traceStop()
+static JSValue js_ffi_traceStop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  ffi_trace_stop();
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.traceClear()
+static JSValue js_ffi_traceClear(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  ffi_trace_clear();
+  return JS_UNDEFINED;
+}
+
+// JS: FFI.traceDump([path]) - 不传路径时返回 JSON 字符串
+static JSValue js_ffi_traceDump(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+{
+  if (argc < 1 || JS_IsUndefined(argv[0])) {
+    std::string json = ffi_trace_export_json();
+    return JS_NewStringLen(ctx, json.data(), json.size());
+  }
+
+  const char* path = JS_ToCString(ctx, argv[0]);
+  if (!path) return JS_EXCEPTION;
+  bool ok = ffi_trace_dump_file(path);
+  JSValue ret = ok ? JS_TRUE : JS_ThrowInternalError(ctx, "Failed to write trace file: %s", path);
+  JS_FreeCString(ctx, path);
+  return ret;
 }
 
 static const JSCFunctionListEntry js_ffi_funcs[] = {
@@ -679,11 +4760,38 @@ static const JSCFunctionListEntry js_ffi_funcs[] = {
   JS_CFUNC_DEF("symbol", 2, js_ffi_symbol),
   JS_CFUNC_DEF("call", 3, js_ffi_call),
   JS_CFUNC_DEF("close", 1, js_ffi_close),
+  JS_CFUNC_DEF("callCacheStats", 0, js_ffi_callCacheStats),
+  JS_CFUNC_DEF("setCallCacheSize", 1, js_ffi_setCallCacheSize),
   JS_CFUNC_DEF("malloc", 1, js_ffi_malloc),
   JS_CFUNC_DEF("free", 1, js_ffi_free),
+  JS_CFUNC_DEF("alloc", 2, js_ffi_alloc),
+  JS_CFUNC_DEF("allocLarge", 2, js_ffi_allocLarge),
+  JS_CFUNC_DEF("mapFile", 2, js_ffi_mapFile),
+  JS_OBJECT_DEF("mem", js_ffi_mem_funcs, countof(js_ffi_mem_funcs), JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE),
+  JS_CFUNC_DEF("memStats", 0, js_ffi_memStats),
+  JS_CFUNC_DEF("memReport", 0, js_ffi_memReport),
+  JS_CFUNC_DEF("setMemLimit", 1, js_ffi_setMemLimit),
+  JS_CFUNC_DEF("trackAllocSites", 1, js_ffi_trackAllocSites),
+  JS_CFUNC_DEF("runtimeStats", 0, js_ffi_runtimeStats),
+  JS_CFUNC_DEF("gc", 0, js_ffi_gc),
   JS_CFUNC_DEF("writeArray", 4, js_ffi_writeArray),
   JS_CFUNC_DEF("readArray", 3, js_ffi_readArray),
+  JS_CFUNC_DEF("packStrings", 1, js_ffi_packStrings),
+  JS_CFUNC_DEF("readStringArray", 2, js_ffi_readStringArray),
   JS_CFUNC_DEF("createCallback", 3, js_ffi_createCallback),
+  JS_CFUNC_DEF("flushCallbacks", 1, js_ffi_flushCallbacks),
+  JS_CFUNC_DEF("callbackStats", 1, js_ffi_callbackStats),
+  JS_CFUNC_DEF("stream", 4, js_ffi_stream),
+  JS_CFUNC_DEF("pipeline", 2, js_ffi_pipeline),
+  JS_CFUNC_DEF("memoize", 3, js_ffi_memoize),
+  JS_CFUNC_DEF("parallelFor", 6, js_ffi_parallelFor),
+  JS_CFUNC_DEF("traceStart", 1, js_ffi_traceStart),
+  JS_CFUNC_DEF("traceStop", 0, js_ffi_traceStop),
+  JS_CFUNC_DEF("traceClear", 0, js_ffi_traceClear),
+  JS_CFUNC_DEF("traceDump", 1, js_ffi_traceDump),
+  JS_CFUNC_DEF("perfMap", 1, js_ffi_perfMap),
+  JS_CFUNC_DEF("recordStart", 2, js_ffi_recordStart),
+  JS_CFUNC_DEF("recordStop", 0, js_ffi_recordStop),
 };
 
 static int js_ffi_init(JSContext* ctx, JSModuleDef* m)
@@ -699,6 +4807,63 @@ static void js_ffi_module_finalizer(JSRuntime* rt, JSModuleDef* m)
 
 JSModuleDef* js_init_module_ffi(JSContext* ctx, const char* module_name)
 {
+  // NativeBuffer 类：类 id 全局分配一次，类本身每个 runtime 注册一次
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  JS_NewClassID(&js_ffi_buffer_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_buffer_class_id)) {
+    JS_NewClass(rt, js_ffi_buffer_class_id, &js_ffi_buffer_class);
+  }
+  JSValue buffer_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, buffer_proto, js_ffi_buffer_proto_funcs, countof(js_ffi_buffer_proto_funcs));
+  JS_SetClassProto(ctx, js_ffi_buffer_class_id, buffer_proto);
+
+  JS_NewClassID(&js_ffi_cache_owner_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_cache_owner_class_id)) {
+    JS_NewClass(rt, js_ffi_cache_owner_class_id, &js_ffi_cache_owner_class);
+  }
+  JSValue cache_owner = JS_NewObjectClass(ctx, js_ffi_cache_owner_class_id);
+  if (!JS_IsException(cache_owner)) {
+    JS_DefinePropertyValueStr(ctx, buffer_proto, "__ffiCallCacheOwner", cache_owner, 0);
+  }
+
+  JS_NewClassID(&js_ffi_mapping_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_mapping_class_id)) {
+    JS_NewClass(rt, js_ffi_mapping_class_id, &js_ffi_mapping_class);
+  }
+  JSValue mapping_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, mapping_proto, js_ffi_mapping_proto_funcs, countof(js_ffi_mapping_proto_funcs));
+  JS_SetClassProto(ctx, js_ffi_mapping_class_id, mapping_proto);
+
+  JS_NewClassID(&js_ffi_stream_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_stream_class_id)) {
+    JS_NewClass(rt, js_ffi_stream_class_id, &js_ffi_stream_class);
+  }
+  JSValue stream_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, stream_proto, js_ffi_stream_proto_funcs, countof(js_ffi_stream_proto_funcs));
+  JS_SetClassProto(ctx, js_ffi_stream_class_id, stream_proto);
+
+  JS_NewClassID(&js_ffi_pipeline_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_pipeline_class_id)) {
+    JS_NewClass(rt, js_ffi_pipeline_class_id, &js_ffi_pipeline_class);
+  }
+  JSValue pipeline_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, pipeline_proto, js_ffi_pipeline_proto_funcs, countof(js_ffi_pipeline_proto_funcs));
+  JS_SetClassProto(ctx, js_ffi_pipeline_class_id, pipeline_proto);
+
+  JS_NewClassID(&js_ffi_memo_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_memo_class_id)) {
+    JS_NewClass(rt, js_ffi_memo_class_id, &js_ffi_memo_class);
+  }
+  JSValue memo_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, memo_proto, js_ffi_memo_proto_funcs, countof(js_ffi_memo_proto_funcs));
+  JS_SetClassProto(ctx, js_ffi_memo_class_id, memo_proto);
+
+  // ParallelTask 只在内部使用，不需要原型
+  JS_NewClassID(&js_ffi_parallel_class_id);
+  if (!JS_IsRegisteredClass(rt, js_ffi_parallel_class_id)) {
+    JS_NewClass(rt, js_ffi_parallel_class_id, &js_ffi_parallel_class);
+  }
+
   JSModuleDef* m = JS_NewCModule(ctx, module_name, js_ffi_init);
   if (!m) return nullptr;
   JS_AddModuleExportList(ctx, m, js_ffi_funcs, countof(js_ffi_funcs));
@@ -708,3 +4873,78 @@ JSModuleDef* js_init_module_ffi(JSContext* ctx, const char* module_name)
 
   return m;
 }
+
+void js_ffi_set_mem_limit(size_t bytes)
+{
+  mem_accounting().soft_limit = bytes;
+}
+
+void js_ffi_set_gc_hooks(const JSFFIGCHooks* hooks)
+{
+  gc_hooks = hooks ? *hooks : JSFFIGCHooks();
+}
+
+void js_ffi_dump_runtime_stats(FILE* out, JSRuntime* rt)
+{
+  JSMemoryUsage usage;
+  JS_ComputeMemoryUsage(rt, &usage);
+
+  std::string line = "{";
+  char buf[64];
+  for (const RuntimeUsageField& field : runtime_usage_fields) {
+    snprintf(buf, sizeof(buf), "\"%s\":%lld,", field.name, (long long)runtime_usage_value(usage, field));
+    line += buf;
+  }
+  line += "\"gc\":";
+  line += gc_hooks.gc_json ? gc_hooks.gc_json(gc_hooks.opaque) : "null";
+  line += "}\n";
+  fputs(line.c_str(), out);
+}
+
+void js_ffi_set_track_alloc_sites(int enable)
+{
+  mem_accounting().track_sites = enable != 0;
+}
+
+void js_ffi_set_leak_report(int enable)
+{
+  mem_accounting().leak_report = enable != 0;
+}
+
+size_t js_ffi_report_allocations(FILE* out, int verbose)
+{
+  MemAccounting& acc = mem_accounting();
+  std::lock_guard<std::mutex> lock(acc.mutex);
+
+  if (verbose) {
+    fprintf(out, "ffi memory: live=%lld (%lld bytes) peak=%lld bytes allocs=%llu frees=%llu\n",
+            (long long)acc.live_count.load(), (long long)acc.live_bytes.load(), (long long)acc.peak_bytes.load(),
+            (unsigned long long)acc.total_allocs.load(), (unsigned long long)acc.total_frees.load());
+  }
+  // ffi.alloc 缓冲区由 GC 释放，runtime 未销毁就退出（如 std.exit）时不算泄漏
+  size_t leaked = 0, leaked_bytes = 0;
+  for (const auto& entry : acc.live) {
+    if (!entry.second.gc_owned) {
+      leaked++;
+      leaked_bytes += entry.second.size;
+    }
+  }
+  if (!leaked) return 0;
+
+  fprintf(out, "ffi memory: %zu allocation(s) totalling %zu bytes were never freed\n",
+          leaked, leaked_bytes);
+
+  // 按分配位置汇总
+  std::map<std::string, std::pair<size_t, size_t>> by_site;
+  for (const auto& entry : acc.live) {
+    if (entry.second.gc_owned) continue;
+    auto& slot = by_site[entry.second.site.empty() ? "<site tracking disabled>" : entry.second.site];
+    slot.first++;
+    slot.second += entry.second.size;
+  }
+  for (const auto& site : by_site) {
+    fprintf(out, "  %6zu allocation(s) %10zu bytes  at %s\n",
+            site.second.first, site.second.second, site.first.c_str());
+  }
+  return leaked;
+}
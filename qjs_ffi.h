@@ -1,6 +1,7 @@
 #ifndef QJS_FFI_H
 #define QJS_FFI_H
 
+#include <stdio.h>
 #include "quickjs/quickjs.h"
 
 #ifdef __cplusplus
@@ -9,6 +10,27 @@ extern "C" {
 
 JSModuleDef *js_init_module_ffi(JSContext *ctx, const char *module_name);
 
+/* 原生内存记账：软限制（0 表示不限制）与分配位置追踪开关 */
+void js_ffi_set_mem_limit(size_t bytes);
+void js_ffi_set_track_alloc_sites(int enable);
+/* 逐指针登记 ffi.malloc 的分配，供退出报告使用（默认只维护计数器） */
+void js_ffi_set_leak_report(int enable);
+/* 打印仍未释放的 ffi.malloc 分配，返回其数量；verbose 时同时打印统计信息。
+ * 只有开启退出报告、位置追踪或调用录制期间的分配会被列出 */
+size_t js_ffi_report_allocations(FILE *out, int verbose);
+
+/* 宿主 GC 监控接入（见 js_gc_monitor.h）。gc_json 返回 GC 统计的 JSON 对象文本，
+ * 指针在下一次调用前有效；collect 执行一次计时的 GC。未设置（传 NULL）时
+ * ffi.runtimeStats() 的 gc 字段为 null，ffi.gc() 直接调用 JS_RunGC。 */
+typedef struct JSFFIGCHooks {
+    const char *(*gc_json)(void *opaque);
+    void (*collect)(void *opaque);
+    void *opaque;
+} JSFFIGCHooks;
+void js_ffi_set_gc_hooks(const JSFFIGCHooks *hooks);
+/* 把 ffi.runtimeStats() 的内容写成一行 JSON */
+void js_ffi_dump_runtime_stats(FILE *out, JSRuntime *rt);
+
 #ifdef __cplusplus
 }
 #endif
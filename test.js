@@ -1,6 +1,11 @@
 // test.js
 // The JavaScript code that uses the FFI module.
-import {open, symbol, call, close, malloc, free, writeArray, readArray, createCallback} from 'ffi';
+import {open, symbol, call, close, malloc, free, writeArray, readArray, createCallback,
+  traceStart, traceStop, traceClear, traceDump, memStats, memReport, setMemLimit, trackAllocSites,
+  alloc, mem, stream, pipeline, flushCallbacks, callbackStats,
+  callCacheStats, setCallCacheSize, mapFile, parallelFor, perfMap,
+  runtimeStats, gc, recordStart, recordStop, packStrings, readStringArray, memoize,
+  allocLarge} from 'ffi';
 import * as std from 'std';
 import * as os from 'os';
 
@@ -678,6 +683,718 @@ try {
     // 不抛出异常，让其他测试继续
   }
 
+  // --- 测试 FFI 事件追踪 ---
+  logTest("Test 11: FFI Tracing", 'RUNNING');
+
+  traceClear();
+  traceStart({bufferSize: 1024, sampleRate: 1});
+
+  const traceAddFunc = symbol(libHandle, 'add');
+  call(traceAddFunc, 'int', ['int', 'int'], 1, 2);
+
+  const traceCallbackPtr = createCallback(function traceCallback(a, b) {
+    return a - b;
+  }, 'int', ['int', 'int']);
+  call(symbol(libHandle, 'test_simple_callback'), 'int', ['int', 'int', 'pointer'], 5, 3, traceCallbackPtr);
+
+  const tracePtr = malloc(16);
+  free(tracePtr);
+  // 再次 dlopen 只增加引用计数，返回同一个句柄（close 会清理回调，这里不调用）
+  const traceLibHandle = open(libPath);
+  traceStop();
+
+  const trace = JSON.parse(traceDump());
+  const traceNames = trace.traceEvents.map(e => e.name);
+  logInfo(`Recorded ${trace.traceEvents.length} trace events`);
+  for (const expected of ['add', 'test_simple_callback', 'callback:traceCallback', 'malloc', 'free']) {
+    if (!traceNames.includes(expected)) {
+      logTest("FFI Tracing", 'FAIL');
+      throw new Error(`Trace is missing event '${expected}'`);
+    }
+  }
+  const dlopenEnd = trace.traceEvents.find(e => e.cat === 'ffi.dl' && e.name === libPath && e.ph === 'E');
+  logInfo(`dlopen event handle: ${dlopenEnd && dlopenEnd.args.handle}`);
+  if (!dlopenEnd || BigInt(dlopenEnd.args.handle) !== BigInt(traceLibHandle)) {
+    logTest("FFI Tracing", 'FAIL');
+    throw new Error("dlopen trace event does not record the returned handle");
+  }
+  const beginCount = trace.traceEvents.filter(e => e.ph === 'B').length;
+  const endCount = trace.traceEvents.filter(e => e.ph === 'E').length;
+  if (beginCount !== endCount) {
+    logTest("FFI Tracing", 'FAIL');
+    throw new Error(`Unbalanced trace events: ${beginCount} begin vs ${endCount} end`);
+  }
+  logTest("FFI Tracing", 'PASS');
+
+  // --- 测试原生内存记账 ---
+  logTest("Test 12: Native Memory Accounting", 'RUNNING');
+
+  const memBefore = memStats();
+  const accountedPtr = malloc(100);
+  trackAllocSites(true);
+  const sitePtr = malloc(32);
+  trackAllocSites(false);
+
+  const memDuring = memStats();
+  logInfo(`Live: ${memDuring.liveCount} blocks / ${memDuring.liveBytes} bytes, peak ${memDuring.peakBytes} bytes`);
+  // 字节数按 malloc_usable_size 计算，不小于请求的大小
+  if (memDuring.liveBytes - memBefore.liveBytes < 132 || memDuring.liveCount - memBefore.liveCount !== 2) {
+    logTest("Native Memory Accounting", 'FAIL');
+    throw new Error("memStats did not account for new allocations");
+  }
+
+  const siteEntry = memReport().find(e => e.ptr === sitePtr);
+  logInfo(`Allocation site: ${siteEntry && siteEntry.site}`);
+  if (!siteEntry || !siteEntry.site || !siteEntry.site.includes('test.js')) {
+    logTest("Native Memory Accounting", 'FAIL');
+    throw new Error("memReport did not record the allocation site");
+  }
+
+  setMemLimit(memDuring.liveBytes + 64);
+  let limitHit = false;
+  try {
+    free(malloc(1024));
+  } catch (e) {
+    limitHit = e instanceof RangeError;
+  }
+  setMemLimit(0);
+  if (!limitHit) {
+    logTest("Native Memory Accounting", 'FAIL');
+    throw new Error("Soft memory limit was not enforced");
+  }
+
+  free(accountedPtr);
+  free(sitePtr);
+  if (memStats().liveBytes !== memBefore.liveBytes) {
+    logTest("Native Memory Accounting", 'FAIL');
+    throw new Error("free() did not release accounted bytes");
+  }
+  logTest("Native Memory Accounting", 'PASS');
+
+  // Test 13: GC 管理的原生缓冲区
+  logTest("Test 13: GC-owned Native Buffers", 'RUNNING');
+  const bufBefore = memStats();
+  const buf = alloc(64, {align: 64, zero: true});
+  logInfo(`Buffer at 0x${buf.address.toString(16)}, size ${buf.size}, alignment ${buf.alignment}`);
+  if (buf.address % 64 !== 0 || buf.size !== 64) {
+    logTest("GC-owned Native Buffers", 'FAIL');
+    throw new Error("alloc() did not honour size/alignment");
+  }
+  writeArray(buf, [5, 6, 7, 8], 'int', 4);
+  const bufSum = call(symbol(libHandle, 'array_sum'), 'int', ['pointer', 'int'], buf, 4);
+  logInfo(`array_sum(buffer) = ${bufSum}`);
+  buf.dispose();
+  buf.dispose();
+  let disposedThrows = false;
+  try {
+    readArray(buf, 'int', 1);
+  } catch (e) {
+    disposedThrows = e instanceof TypeError;
+  }
+  if (bufSum !== 26 || !buf.disposed || !disposedThrows || memStats().liveBytes !== bufBefore.liveBytes) {
+    logTest("GC-owned Native Buffers", 'FAIL');
+    throw new Error("Buffer was not usable as a pointer or not released by dispose()");
+  }
+
+  // 缓冲区对象持有的地址不能交给 free()，否则 dispose() 或回收时会重复释放
+  const ownedBuf = alloc(64);
+  let ownedFreeRejected = false;
+  try {
+    free(ownedBuf.address);
+  } catch (e) {
+    ownedFreeRejected = e instanceof TypeError;
+  }
+  ownedBuf.dispose();
+  if (!ownedFreeRejected) {
+    logTest("GC-owned Native Buffers", 'FAIL');
+    throw new Error("free() accepted the address of a buffer object");
+  }
+
+  // 未 dispose 的缓冲区在对象被回收时释放
+  (() => { for (let i = 0; i < 100; i++) alloc(1024); })();
+  std.gc();
+  logInfo(`Live bytes after GC: ${memStats().liveBytes}`);
+  if (memStats().liveBytes !== bufBefore.liveBytes) {
+    logTest("GC-owned Native Buffers", 'FAIL');
+    throw new Error("Unreachable buffers were not freed by the GC");
+  }
+  logTest("GC-owned Native Buffers", 'PASS');
+
+  // Test 14: 原生缓冲区之间的类型转换
+  logTest("Test 14: Native Buffer Conversion", 'RUNNING');
+  logInfo(`SIMD level: ${mem.simdLevel()}`);
+  const pixelCount = 37;  // 不是向量宽度的整数倍，覆盖尾部处理
+  const pixels = alloc(pixelCount);
+  const floats = alloc(pixelCount * 4);
+  const back = alloc(pixelCount);
+  writeArray(pixels, Array.from({length: pixelCount}, (_, i) => i * 7), 'uint8', pixelCount);
+
+  const convertResults = {};
+  for (const level of ['scalar', 'auto']) {
+    mem.setSimdLevel(level);
+    mem.convert(floats, 'float', pixels, 'uint8', pixelCount, {scale: 1 / 255});
+    mem.convert(back, 'uint8', floats, 'float', pixelCount, {scale: 255, round: true});
+    convertResults[level] = readArray(back, 'uint8', pixelCount).join(',');
+  }
+  const expectedPixels = readArray(pixels, 'uint8', pixelCount).join(',');
+  logInfo(`Round trip: ${convertResults.auto.slice(0, 40)}...`);
+
+  mem.fill(floats, 'float', 300.5, pixelCount);
+  mem.convert(back, 'uint8', floats, 'float', pixelCount);
+  const saturated = readArray(back, 'uint8', 1)[0];
+  mem.fill(back, 'uint8', 0, pixelCount);
+  mem.copy(back, pixels, 4);
+  const copied = readArray(back, 'uint8', 5);
+
+  let boundsChecked = false;
+  try {
+    mem.convert(back, 'uint8', floats, 'float', pixelCount + 1);
+  } catch (e) {
+    boundsChecked = e instanceof RangeError;
+  }
+  pixels.dispose();
+  floats.dispose();
+  back.dispose();
+
+  // double -> float：有限值截到 ±FLT_MAX，NaN 和 ±Inf 保留，标量与向量实现一致
+  const FLT_MAX = 3.4028234663852886e38;
+  const wide = new Float64Array([1e300, -1e300, Infinity, -Infinity, NaN, 3.5e38, -3.5e38, 1.5]);
+  const expectedNarrow = [FLT_MAX, -FLT_MAX, Infinity, -Infinity, NaN, FLT_MAX, -FLT_MAX, 1.5];
+  let narrowOk = true;
+  for (const level of ['scalar', 'auto']) {
+    mem.setSimdLevel(level);
+    const narrow = new Float32Array(wide.length);
+    mem.convert(narrow, 'float', wide, 'double', wide.length);
+    narrowOk = narrowOk && expectedNarrow.every((v, i) => Object.is(narrow[i], v));
+  }
+
+  if (convertResults.scalar !== expectedPixels || convertResults.auto !== expectedPixels ||
+      saturated !== 255 || copied.join(',') !== '0,7,14,21,0' || !boundsChecked || !narrowOk) {
+    logTest("Native Buffer Conversion", 'FAIL');
+    throw new Error("mem.convert/fill/copy produced unexpected results");
+  }
+  logTest("Native Buffer Conversion", 'PASS');
+
+  // Test 15: 原生生产者 -> 异步迭代器
+  logTest("Test 15: Native Stream", 'RUNNING');
+  const streamTotal = 10000;
+  const streamOffset = alloc(8, {zero: true});
+  const producer = stream(symbol(libHandle, 'test_stream_read'),
+    [['pointer', streamOffset], '$buffer', '$size', ['long', streamTotal]], 1024, 3);
+  let streamBytes = 0;
+  let streamOrdered = true;
+  for await (const chunk of producer) {
+    for (let i = 0; i < chunk.length; i++) {
+      if (chunk[i] !== ((streamBytes + i) & 0xff)) streamOrdered = false;
+    }
+    streamBytes += chunk.length;
+  }
+  const streamStats = producer.stats;
+  logInfo(`Received ${streamBytes} bytes in ${streamStats.chunks} chunks ` +
+          `(producer stalls ${streamStats.producerStalls}, consumer stalls ${streamStats.consumerStalls})`);
+  if (streamBytes !== streamTotal || !streamOrdered || streamStats.chunks !== Math.ceil(streamTotal / 1024)) {
+    logTest("Native Stream", 'FAIL');
+    throw new Error("Stream delivered unexpected data");
+  }
+  logTest("Native Stream", 'PASS');
+
+  // Test 16: 原生调用流水线
+  logTest("Test 16: Native Call Pipeline", 'RUNNING');
+  const pipeSrc = alloc(8 * 4);
+  const pipeTmp = alloc(8 * 4);
+  const scaleAndMax = pipeline([
+    {fn: symbol(libHandle, 'array_copy'), ret: 'void', types: ['pointer', 'pointer', 'int'],
+     args: [{input: 0}, pipeTmp, {input: 1}]},
+    {fn: symbol(libHandle, 'array_multiply'), ret: 'void', types: ['pointer', 'int', 'int'],
+     args: [pipeTmp, {input: 1}, 3]},
+    {fn: symbol(libHandle, 'find_max_in_array'), ret: 'int', types: ['pointer', 'int', 'pointer'],
+     args: [pipeTmp, {input: 1}, {out: 'int'}]},
+    // 上一步的返回值作为 double 参数传入，经过 int -> double 转换
+    {fn: symbol(libHandle, 'add_double'), ret: 'double', types: ['double', 'double'],
+     args: [{step: 2}, 0.5]},
+  ], {outputs: [{step: 2}, {step: 2, out: 2}, {step: 3}]});
+
+  writeArray(pipeSrc, [4, 9, 2, 7, 1], 'int', 5);
+  const firstRun = scaleAndMax.run(pipeSrc, 5);
+  writeArray(pipeSrc, [1, 2, 30], 'int', 3);
+  const secondRun = scaleAndMax.run(pipeSrc, 3);
+  logInfo(`First run: ${JSON.stringify(firstRun)}, second run: ${JSON.stringify(secondRun)}`);
+  if (JSON.stringify(firstRun) !== '[27,1,27.5]' || JSON.stringify(secondRun) !== '[90,2,90.5]') {
+    logTest("Native Call Pipeline", 'FAIL');
+    throw new Error("Pipeline produced unexpected results");
+  }
+  logTest("Native Call Pipeline", 'PASS');
+
+  // Test 17: 缓冲回调
+  logTest("Test 17: Buffered Callbacks", 'RUNNING');
+  const batches = [];
+  const bufferedCb = createCallback((values, indices) => {
+    batches.push({values: Array.from(values), indices: Array.from(indices)});
+  }, 'void', ['int', 'int'], {buffered: 4});
+  const foreachSrc = alloc(10 * 4);
+  writeArray(foreachSrc, [1, 2, 3, 4, 5, 6, 7, 8, 9, 10], 'int', 10);
+  // 10 次回调 -> 两个满批次 + call 返回时自动刷新的 2 个
+  call(symbol(libHandle, 'test_array_foreach'), 'void', ['pointer', 'int', 'pointer'],
+       foreachSrc, 10, bufferedCb);
+  const cbStats = callbackStats(bufferedCb);
+  logInfo(`Batches: ${JSON.stringify(batches.map(b => b.values))}, stats: ${JSON.stringify(cbStats)}`);
+  const allValues = batches.flatMap(b => b.values);
+  const allIndices = batches.flatMap(b => b.indices);
+  if (batches.length !== 3 || batches[2].values.length !== 2 ||
+      allValues.join() !== '1,2,3,4,5,6,7,8,9,10' || allIndices.join() !== '0,1,2,3,4,5,6,7,8,9' ||
+      cbStats.calls !== 10 || cbStats.batches !== 3 || cbStats.pending !== 0 || cbStats.dropped !== 0) {
+    logTest("Buffered Callbacks", 'FAIL');
+    throw new Error("Buffered callback batches are wrong");
+  }
+  flushCallbacks(bufferedCb);   // 没有暂存的调用时不会调用 JS
+  if (batches.length !== 3) {
+    logTest("Buffered Callbacks", 'FAIL');
+    throw new Error("Empty flush invoked the callback");
+  }
+  foreachSrc.dispose();
+  logTest("Buffered Callbacks", 'PASS');
+
+  // Test 18: 调用签名缓存
+  logTest("Test 18: Call Signature Cache", 'RUNNING');
+  setCallCacheSize(4);
+  const cachedAdd = symbol(libHandle, 'bench_add');
+  let cacheSum = 0;
+  for (let i = 0; i < 10; i++) {
+    cacheSum += call(cachedAdd, 'int', ['int', 'int'], i, 1);
+  }
+  const afterRepeat = callCacheStats();
+  // 同一函数换一种签名是另一个条目；修改过的 types 数组不能命中旧条目
+  const mutableTypes = ['int', 'int'];
+  call(cachedAdd, 'int', mutableTypes, 1, 2);
+  mutableTypes[1] = 'int32';
+  const viaInt32 = call(cachedAdd, 'int', mutableTypes, 1, 2);
+  // 超出容量时淘汰最久未使用的条目
+  for (const t of ['int8', 'int16', 'uint8', 'uint16']) {
+    call(cachedAdd, 'int', [t, 'int'], 1, 1);
+  }
+  const afterEvict = callCacheStats();
+  logInfo(`After repeat: ${JSON.stringify(afterRepeat)}, after evict: ${JSON.stringify(afterEvict)}`);
+  if (cacheSum !== 55 || afterRepeat.misses !== 1 || afterRepeat.hits !== 9 ||
+      afterEvict.size !== 4 || afterEvict.evictions !== 2 || afterEvict.misses !== 6 || viaInt32 !== 3) {
+    logTest("Call Signature Cache", 'FAIL');
+    throw new Error("Call cache statistics are wrong");
+  }
+  setCallCacheSize(256);
+  logTest("Call Signature Cache", 'PASS');
+
+  // Test 19: 内存映射文件
+  logTest("Test 19: Memory-mapped Files", 'RUNNING');
+  const mapPath = './ffi_map_test.bin';
+  const mapInput = new Int32Array([5, 10, 20, 40, 80, 160]);
+  const mapFileOut = std.open(mapPath, 'wb');
+  mapFileOut.write(mapInput.buffer, 0, mapInput.byteLength);
+  mapFileOut.close();
+
+  // 只读映射：从第 2 个元素开始映射 4 个 int，原生代码与 JS 看到同一段内存
+  const roMap = mapFile(mapPath, {offset: 8, length: 16});
+  roMap.advise('sequential');
+  const roView = new Int32Array(roMap.buffer);
+  const mappedSum = call(symbol(libHandle, 'array_sum'), 'int', ['pointer', 'int'], roMap, 4);
+  logInfo(`Mapped view: [${Array.from(roView)}], native sum: ${mappedSum}`);
+  if (roView.length !== 4 || roView[0] !== 20 || mappedSum !== 300) {
+    logTest("Memory-mapped Files", 'FAIL');
+    throw new Error("Read-only mapping returned unexpected data");
+  }
+  roMap.unmap();
+  if (!roMap.unmapped || roView.length !== 0) {
+    logTest("Memory-mapped Files", 'FAIL');
+    throw new Error("ArrayBuffer was not detached by unmap()");
+  }
+
+  // offset + length 超出 int64 时抛出 RangeError，不能扩展文件
+  let mapOverflowRejected = false;
+  try {
+    mapFile(mapPath, {mode: 'rw', offset: 2 ** 62, length: 2 ** 62});
+  } catch (e) {
+    mapOverflowRejected = e instanceof RangeError;
+  }
+  if (!mapOverflowRejected) {
+    logTest("Memory-mapped Files", 'FAIL');
+    throw new Error("mapFile() accepted an overflowing range");
+  }
+
+  // 读写映射：原生代码直接写文件
+  const rwMap = mapFile(mapPath, {mode: 'rw'});
+  call(symbol(libHandle, 'array_multiply'), 'void', ['pointer', 'int', 'int'], rwMap, 6, 2);
+  rwMap.sync();
+  rwMap.unmap();
+  const mapCheck = std.open(mapPath, 'rb');
+  const mapResult = new Int32Array(6);
+  mapCheck.read(mapResult.buffer, 0, mapResult.byteLength);
+  mapCheck.close();
+  os.remove(mapPath);
+  logInfo(`File after rw mapping: [${Array.from(mapResult)}]`);
+  if (mapResult.join() !== '10,20,40,80,160,320') {
+    logTest("Memory-mapped Files", 'FAIL');
+    throw new Error("Writable mapping did not reach the file");
+  }
+  logTest("Memory-mapped Files", 'PASS');
+
+  // Test 20: 并行执行
+  logTest("Test 20: Parallel For", 'RUNNING');
+  const scaleFloats = symbol(libHandle, 'scale_floats');
+  const parCount = 100000;
+  const parIn = alloc(parCount * 4);
+  const parOut = alloc(parCount * 4, {zero: true});
+  const parInView = new Float32Array(parCount);
+  for (let i = 0; i < parCount; i++) parInView[i] = i;
+  writeArray(parIn, Array.from(parInView), 'float', parCount);
+
+  const parStats = parallelFor(scaleFloats, parIn, parOut, parCount, 4,
+                               {extra: [['float', 0.5]], grain: 1000, threads: 4});
+  const parResult = readArray(parOut, 'float', parCount);
+  const workerChunks = parStats.workers.reduce((n, w) => n + w.chunks, 0);
+  logInfo(`threads=${parStats.threads} chunks=${parStats.chunks} elapsed=${parStats.elapsedMs.toFixed(2)}ms ` +
+          `utilisation=[${parStats.workers.map(w => w.utilisation.toFixed(2))}]`);
+  if (parStats.chunks !== 100 || workerChunks !== 100 || parStats.threads !== 4 ||
+      parResult[0] !== 0 || parResult[1] !== 0.5 || parResult[parCount - 1] !== (parCount - 1) * 0.5) {
+    logTest("Parallel For", 'FAIL');
+    throw new Error("parallelFor produced unexpected results");
+  }
+
+  // Promise 形式；元素数超出缓冲区长度时抛出 RangeError
+  const asyncStats = await parallelFor(scaleFloats, parIn, parOut, parCount, 4,
+                                       {extra: [['float', 2]], async: true});
+  const asyncResult = readArray(parOut, 'float', 4);
+  let rangeRejected = false;
+  try {
+    parallelFor(scaleFloats, parIn, parOut, parCount + 1, 4, {extra: [['float', 1]]});
+  } catch (e) {
+    rangeRejected = e instanceof RangeError;
+  }
+  logInfo(`Async run: ${asyncStats.chunks} chunks on ${asyncStats.threads} threads, first values [${asyncResult}]`);
+  if (asyncResult.join() !== '0,2,4,6' || !rangeRejected) {
+    logTest("Parallel For", 'FAIL');
+    throw new Error("Async parallelFor or range check failed");
+  }
+  parIn.dispose();
+  parOut.dispose();
+  logTest("Parallel For", 'PASS');
+
+  // Test 21: 输出参数
+  logTest("Test 21: Out-parameters", 'RUNNING');
+  const findMaxFn = symbol(libHandle, 'find_max_in_array');
+  const outArr = alloc(5 * 4);
+  writeArray(outArr, [3, 8, 1, 9, 4], 'int', 5);
+  // 末尾的 out 参数可以省略
+  const maxResult = call(findMaxFn, 'int', ['pointer', 'int', {out: 'int32'}], outArr, 5);
+  // 写入调用方提供的 TypedArray
+  const indexTarget = new Int32Array(1);
+  const maxIntoArray = call(findMaxFn, 'int', ['pointer', 'int', {out: 'int32'}], outArr, 3, indexTarget);
+  // inout：槽位先写入初始值，原生代码在其上加 offset
+  const inoutResult = call(symbol(libHandle, 'test_int_pointer'), 'pointer', [{inout: 'int'}, 'int'], 40, 2);
+  logInfo(`find_max: ${JSON.stringify(maxResult)}, into TypedArray: ${maxIntoArray.ret} @ ${indexTarget[0]}, ` +
+          `inout: ${inoutResult.outs[0]}`);
+  if (maxResult.ret !== 9 || maxResult.outs[0] !== 3 || maxIntoArray.ret !== 8 || indexTarget[0] !== 1 ||
+      inoutResult.outs[0] !== 42) {
+    logTest("Out-parameters", 'FAIL');
+    throw new Error("Out-parameter values are wrong");
+  }
+  outArr.dispose();
+  logTest("Out-parameters", 'PASS');
+
+  // Test 22: perf 符号表
+  logTest("Test 22: Perf Map", 'RUNNING');
+  const perfMapPath = perfMap(true);
+  function perfProbe(a, b) { return a + b; }
+  const perfCb = createCallback(perfProbe, 'int', ['int', 'int']);
+  const perfLines = (std.loadFile(perfMapPath) || '').split('\n');
+  const perfEntry = perfLines.find(line => line.startsWith(perfCb.toString(16) + ' '));
+  logInfo(`${perfMapPath}: ${perfEntry}`);
+  perfMap(false);
+  if (!perfEntry || !perfEntry.endsWith(' callback:perfProbe(int,int)->int') || std.loadFile(perfMapPath) !== null) {
+    logTest("Perf Map", 'FAIL');
+    throw new Error("Perf map entry missing or file not removed");
+  }
+  logTest("Perf Map", 'PASS');
+
+  // Test 23: JS 堆统计与 GC 记录
+  logTest("Test 23: Runtime Stats", 'RUNNING');
+  let gcGarbage = [];
+  for (let i = 0; i < 20000; i++) gcGarbage.push({i, next: null});
+  gcGarbage = null;
+  const gcBefore = runtimeStats();
+  gc();
+  const gcAfter = runtimeStats();
+  // GC 监控只在 --gc-* 选项下开启，默认运行时 gc 字段为 null；
+  // run_demo 的第二次运行传入 'gc-monitor'，此时必须有 GC 记录
+  const gcExpected = scriptArgs.includes('gc-monitor');
+  const gcMonitored = gcAfter.gc !== null;
+  if (gcExpected && !gcMonitored) {
+    logTest("Runtime Stats", 'FAIL');
+    throw new Error("GC monitor is not active although --gc-* options were given");
+  }
+  const lastCycle = gcMonitored ? gcAfter.gc.recent[gcAfter.gc.recent.length - 1] : null;
+  logInfo(`objCount ${gcBefore.objCount} -> ${gcAfter.objCount}, ` +
+          (gcMonitored ? `gc cycles ${gcAfter.gc.cycles}` : 'gc monitor off'));
+  if (gcMonitored) logInfo(`last cycle: ${JSON.stringify(lastCycle)}`);
+  // 1 MiB 的阈值下，到这里为止的分配已经触发过阈值回收
+  if ((gcMonitored && (gcAfter.gc.cycles !== gcBefore.gc.cycles + 1 || gcAfter.gc.byReason.explicit < 1 ||
+                       lastCycle.reason !== 'explicit' || lastCycle.bytesAfter > lastCycle.bytesBefore ||
+                       !(lastCycle.durationMs >= 0) || !(gcAfter.gc.maxMs >= lastCycle.durationMs))) ||
+      (gcExpected && gcAfter.gc.byReason.threshold < 1) ||
+      !(gcAfter.mallocSize > 0) || !(gcAfter.objCount > 0)) {
+    logTest("Runtime Stats", 'FAIL');
+    throw new Error("runtimeStats() did not record the explicit GC");
+  }
+  logTest("Runtime Stats", 'PASS');
+
+  // Test 24: 调用录制
+  logTest("Test 24: Call Recording", 'RUNNING');
+  const recordPath = '/tmp/qjs_ffi_test.ffirec';
+  const recordFindMax = symbol(libHandle, 'bench_find_max');
+  const recordSrc = alloc(4 * 4);
+  writeArray(recordSrc, [3, 9, 4, 1], 'int', 4);
+  recordStart(recordPath, {bufferCap: 1024});
+  for (let i = 0; i < 3; i++) call(addFunc, 'int', ['int', 'int'], i, 1);
+  call(testStringLength, 'int', ['string'], 'recorded');
+  call(recordFindMax, 'int', ['pointer', 'int', {out: 'int'}], recordSrc, 4);
+  const recordStats = recordStop();
+  recordSrc.dispose();
+  const [recordStat] = os.stat(recordPath);
+  const recordHeader = (std.loadFile(recordPath) || '').slice(0, 7);
+  logInfo(`${recordPath}: ${JSON.stringify(recordStats)}, ${recordStat.size} bytes on disk`);
+  os.remove(recordPath);
+  if (recordStats.calls !== 5 || recordStats.bytes !== recordStat.size || recordHeader !== 'QJSFFIR') {
+    logTest("Call Recording", 'FAIL');
+    throw new Error("Call log does not match the recorded calls");
+  }
+  logTest("Call Recording", 'PASS');
+
+  // Test 25: 字符串数组（char**）
+  logTest("Test 25: String Arrays", 'RUNNING');
+  const totalStringLength = symbol(libHandle, 'total_string_length');
+  const colorNames = symbol(libHandle, 'get_color_names');
+  const words = ['alpha', 'beta', '', '中文'];
+  const expectedLength = 5 + 4 + 0 + 6;   // UTF-8 字节数
+  const viaCall = call(totalStringLength, 'int', ['stringArray', 'int'], words, words.length);
+  const viaNull = call(totalStringLength, 'int', ['stringArray', 'int'], words, -1);
+  const packedWords = packStrings(words);
+  const viaPacked = call(totalStringLength, 'int', ['pointer', 'int'], packedWords, words.length);
+  const roundTrip = readStringArray(packedWords);
+  const colors = readStringArray(call(colorNames, 'pointer', []));
+  const firstTwo = readStringArray(call(colorNames, 'pointer', []), 2);
+  packedWords.dispose();
+  logInfo(`lengths ${viaCall}/${viaNull}/${viaPacked}, round trip ${JSON.stringify(roundTrip)}, colors ${JSON.stringify(colors)}`);
+  let rejected = false;
+  try {
+    call(totalStringLength, 'int', ['stringArray', 'int'], ['ok', 42], 2);
+  } catch (e) {
+    rejected = e instanceof TypeError;
+  }
+  // length 巨大的稀疏数组在分配之前被拒绝
+  const hugeSparse = [];
+  hugeSparse.length = 2 ** 32 - 1;
+  let hugeRejected = 0;
+  try {
+    packStrings(hugeSparse);
+  } catch (e) {
+    if (e instanceof RangeError) hugeRejected++;
+  }
+  try {
+    call(totalStringLength, 'int', ['stringArray', 'int'], hugeSparse, 0);
+  } catch (e) {
+    if (e instanceof RangeError) hugeRejected++;
+  }
+  if (viaCall !== expectedLength || viaNull !== expectedLength || viaPacked !== expectedLength ||
+      hugeRejected !== 2 ||
+      JSON.stringify(roundTrip) !== JSON.stringify(words) ||
+      JSON.stringify(colors) !== JSON.stringify(['red', 'green', 'blue', '红色']) ||
+      JSON.stringify(firstTwo) !== JSON.stringify(['red', 'green']) || !rejected) {
+    logTest("String Arrays", 'FAIL');
+    throw new Error("stringArray packing or decoding mismatch");
+  }
+  logTest("String Arrays", 'PASS');
+
+  // Test 26: 原生记忆化（ffi.memoize）
+  logTest("Test 26: Memoize", 'RUNNING');
+  const collatzSteps = symbol(libHandle, 'collatz_steps');
+  const collatzCallCount = symbol(libHandle, 'collatz_call_count');
+  const callsBefore = call(collatzCallCount, 'int', []);
+  const memoSteps = memoize(collatzSteps, {ret: 'int', types: ['int64']}, 4);
+  const first = memoSteps.call(27);
+  const second = memoSteps.call(27);
+  const nativeAfterRepeat = call(collatzCallCount, 'int', []) - callsBefore;
+  for (let n = 1; n <= 6; n++) memoSteps.call(n);
+  const memoStats = memoSteps.stats();
+  memoSteps.clear();
+  const sizeAfterClear = memoSteps.stats().size;
+  memoSteps.call(27);
+  const nativeTotal = call(collatzCallCount, 'int', []) - callsBefore;
+  logInfo(`steps(27) = ${first}/${second}, native calls ${nativeAfterRepeat}/${nativeTotal}, stats ${JSON.stringify(memoStats)}`);
+  let memoRejected = false;
+  try {
+    memoize(totalStringLength, {ret: 'int', types: ['pointer', 'int']});
+  } catch (e) {
+    memoRejected = e instanceof TypeError;
+  }
+  if (first !== 111 || second !== 111 || nativeAfterRepeat !== 1 || nativeTotal !== 8 ||
+      memoStats.hits !== 1 || memoStats.misses !== 7 || memoStats.size !== 4 || memoStats.evictions !== 3 ||
+      sizeAfterClear !== 0 || !memoRejected) {
+    logTest("Memoize", 'FAIL');
+    throw new Error("memoized calls did not skip the native function as expected");
+  }
+  logTest("Memoize", 'PASS');
+
+  // Test 27: 大块内存（ffi.allocLarge）
+  logTest("Test 27: Large Allocations", 'RUNNING');
+  const largeSize = 8 * 1024 * 1024 + 100;
+  const large = allocLarge(largeSize);
+  const largeTail = large.address + largeSize - 4;
+  const lazyZero = readArray(large.address, 'int', 4).every((v) => v === 0);
+  writeArray(largeTail, [0x12345678], 'int', 1);
+  const tailValue = readArray(largeTail, 'int', 1)[0];
+  const largeAligned = large.alignment >= 4096 && large.address % large.alignment === 0;
+  logInfo(`allocLarge: ${large.size} bytes at 0x${large.address.toString(16)}, alignment ${large.alignment}, hugepages ${large.hugepages}`);
+
+  const faultsBefore = memStats();
+  const populated = allocLarge(4 * 1024 * 1024, {hugepages: false, populate: true});
+  const faultsAfter = memStats();
+  logInfo(`populate: rss +${((faultsAfter.rssBytes - faultsBefore.rssBytes) / 1048576).toFixed(1)} MiB, ` +
+          `${faultsAfter.minorFaults - faultsBefore.minorFaults} minor faults`);
+
+  // 容器或没有 NUMA 支持的内核可能拒绝 mbind，此时应抛出 InternalError
+  let numaResult;
+  try {
+    const bound = allocLarge(1 << 20, {numaNode: 0});
+    numaResult = bound.size === 1 << 20 ? 'bound' : 'wrong size';
+    bound.dispose();
+  } catch (e) {
+    numaResult = e instanceof InternalError ? `unavailable (${e.message})` : `unexpected ${e}`;
+  }
+  logInfo(`numaNode 0: ${numaResult}`);
+
+  let largeRejected = false;
+  try {
+    allocLarge(0);
+  } catch (e) {
+    largeRejected = e instanceof RangeError;
+  }
+  // mmap 得到的内存不能交给 libc free()
+  let largeFreeRejected = false;
+  try {
+    free(large.address);
+  } catch (e) {
+    largeFreeRejected = e instanceof TypeError;
+  }
+  const liveWithLarge = memStats().liveBytes;
+  large.dispose();
+  populated.dispose();
+  const largeReleased = liveWithLarge - memStats().liveBytes === largeSize + 4 * 1024 * 1024;
+  if (large.size !== 0 || !large.disposed || !lazyZero || tailValue !== 0x12345678 ||
+      !largeAligned ||
+      faultsAfter.minorFaults <= faultsBefore.minorFaults || numaResult.startsWith('unexpected') ||
+      numaResult === 'wrong size' || !largeRejected || !largeFreeRejected || !largeReleased) {
+    logTest("Large Allocations", 'FAIL');
+    throw new Error("allocLarge mapping, population or release mismatch");
+  }
+  logTest("Large Allocations", 'PASS');
+
+  // Test 28: 可变参数函数
+  logTest("Test 28: Variadic Calls", 'RUNNING');
+  const sumVariadicInts = symbol(libHandle, 'sum_variadic_ints');
+  const sumVariadicDoubles = symbol(libHandle, 'sum_variadic_doubles');
+  const formatMessage = symbol(libHandle, 'format_message');
+  const variadicCacheBefore = callCacheStats();
+  const intSum = call(sumVariadicInts, 'int', {types: ['int', 'int', 'int', 'int'], variadic: 1}, 3, 10, 20, 30);
+  const intSumAgain = call(sumVariadicInts, 'int', {types: ['int', 'int', 'int', 'int'], variadic: 1}, 3, 1, 2, 3);
+  // 窄整数先按声明的类型截断再提升为 int：int8 200 -> -56，uint8 200 -> 200
+  const promotedSum = call(sumVariadicInts, 'int', {types: ['int', 'int8', 'uint8', 'int16'], variadic: 1},
+                           3, 200, 200, 300);
+  const doubleSum = call(sumVariadicDoubles, 'double', {types: ['int', 'float', 'double'], variadic: 1}, 2, 1.5, 2.25);
+  const variadicCacheAfter = callCacheStats();
+  const messageBuf = alloc(64, {zero: true});
+  const messageLength = call(formatMessage, 'int',
+                             {types: ['pointer', 'int', 'string', 'string', 'int', 'double'], variadic: 3},
+                             messageBuf, 64, '%s=%d (%.1f)', 'x', 42, 2.5);
+  const message = String.fromCharCode(...readArray(messageBuf, 'uint8', messageLength));
+  messageBuf.dispose();
+  logInfo(`sums ${intSum}/${intSumAgain}/${promotedSum}/${doubleSum}, message "${message}", ` +
+          `cache +${variadicCacheAfter.misses - variadicCacheBefore.misses} misses / ` +
+          `+${variadicCacheAfter.hits - variadicCacheBefore.hits} hits`);
+  let variadicRejected = false;
+  try {
+    call(sumVariadicInts, 'int', {types: ['int'], variadic: 2}, 0);
+  } catch (e) {
+    variadicRejected = e instanceof RangeError;
+  }
+  if (intSum !== 60 || intSumAgain !== 6 || promotedSum !== 444 || doubleSum !== 3.75 ||
+      message !== 'x=42 (2.5)' || variadicCacheAfter.misses - variadicCacheBefore.misses !== 3 ||
+      variadicCacheAfter.hits - variadicCacheBefore.hits !== 1 || !variadicRejected) {
+    logTest("Variadic Calls", 'FAIL');
+    throw new Error("variadic call results or cif cache behaviour mismatch");
+  }
+  logTest("Variadic Calls", 'PASS');
+
+  // Test 29: 原生缓冲区上的归约与查找
+  logTest("Test 29: SIMD Reductions", 'RUNNING');
+  const reduceCount = 1003;  // 不是向量宽度的整数倍，覆盖尾部处理
+  const reduceInts = Array.from({length: reduceCount}, (_, i) => ((i * 7919) % 2001) - 1000);
+  reduceInts[17] = -5000;
+  reduceInts[900] = -5000;
+  reduceInts[40] = 7000;
+  const reduceFloats = reduceInts.map(v => v / 8);  // float 可以精确表示
+  const intBuf = alloc(reduceCount * 4);
+  const floatBuf = alloc(reduceCount * 4);
+  writeArray(intBuf, reduceInts, 'int', reduceCount);
+  writeArray(floatBuf, reduceFloats, 'float', reduceCount);
+  const expectedSum = reduceInts.reduce((a, b) => a + b, 0);
+  const expectedDot = reduceFloats.reduce((a, v) => a + v * v, 0);
+
+  const reduceResults = {};
+  for (const level of ['scalar', 'auto']) {
+    mem.setSimdLevel(level);
+    const mm = mem.minMax(intBuf, 'int', reduceCount);
+    const fm = mem.minMax(floatBuf, 'float', reduceCount);
+    reduceResults[level] = [mem.sum(intBuf, 'int', reduceCount), mem.sum(floatBuf, 'float', reduceCount),
+      mem.dot(floatBuf, floatBuf, 'float', reduceCount), mm.min, mm.minIndex, mm.max, mm.maxIndex,
+      fm.minIndex, fm.maxIndex, mem.count(intBuf, 0xff, reduceCount * 4)].join(',');
+  }
+  mem.setSimdLevel('auto');
+  logInfo(`Reductions (${mem.simdLevel()}): ${reduceResults.auto}`);
+
+  // TypedArray 直接作为输入，直方图与字节查找
+  const bytes = new Uint8Array(256);
+  for (let i = 0; i < bytes.length; i++) bytes[i] = i & 15;
+  const byteHist = mem.histogram(bytes, 'uint8', bytes.length);
+  const rangeHist = mem.histogram(intBuf, 'int', reduceCount, {bins: 4, min: -1000, max: 1000});
+  const phrase = 'needle in a haystack';
+  const phraseBytes = new Uint8Array(Array.from(phrase, c => c.charCodeAt(0)));
+  const found = mem.indexOf(bytes, 15, bytes.length);
+  const foundFrom = mem.indexOf(bytes, 15, bytes.length, 16);
+  const missing = mem.indexOf(bytes, 200, bytes.length);
+  const patternAt = mem.indexOf(bytes, new Uint8Array([14, 15, 0]), bytes.length);
+  const wordAt = mem.indexOf(phraseBytes, 'hay', phraseBytes.length);
+  logInfo(`histogram[0..3] ${Array.from(byteHist.slice(0, 4)).join(',')}, bins ${Array.from(rangeHist).join(',')}, ` +
+          `indexOf ${found}/${foundFrom}/${missing}/${patternAt}/${wordAt}`);
+
+  let reduceBoundsChecked = false;
+  try {
+    mem.sum(bytes, 'int', 65);
+  } catch (e) {
+    reduceBoundsChecked = e instanceof RangeError;
+  }
+  intBuf.dispose();
+  floatBuf.dispose();
+
+  const expectedReduce = [expectedSum, expectedSum / 8, expectedDot, -5000, 17, 7000, 40, 17, 40,
+    new Uint8Array(new Int32Array(reduceInts).buffer).filter(b => b === 0xff).length].join(',');
+  const inRange = reduceInts.filter(v => v >= -1000 && v <= 1000).length;
+  if (reduceResults.scalar !== expectedReduce || reduceResults.auto !== expectedReduce ||
+      byteHist.length !== 256 || byteHist[0] !== 16 || byteHist[15] !== 16 || byteHist[16] !== 0 ||
+      Array.from(rangeHist).reduce((a, b) => a + b, 0) !== inRange ||
+      found !== 15 || foundFrom !== 31 || missing !== -1 || patternAt !== 14 || wordAt !== 12 ||
+      !reduceBoundsChecked) {
+    logTest("SIMD Reductions", 'FAIL');
+    throw new Error("mem reduction/search results mismatch");
+  }
+  logTest("SIMD Reductions", 'PASS');
+
   close(libHandle);
   logSuccess("Library closed successfully");
 